@@ -0,0 +1,137 @@
+// Copyright 2021 Ian Ruh
+#include <symengine/basic.h>
+#include <symengine/expression.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Dense>
+#include "OrderedSet.h"
+#include "RuntimeCompiler.h"
+#include "SymEngineUtilities.h"
+#include "SymbolicObjective.h"
+
+namespace {
+
+// The number of variables in the benchmark problem
+const size_t numVariables = 40;
+// The number of times each function is evaluated
+const size_t numEvaluations = 2000;
+
+/**
+ * @brief Seconds taken by the function.
+ */
+double secondsTaken(const std::function<void()>& function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+/**
+ * @brief A chain of coupled variables, with a smooth nonlinear cost and a
+ * nonlinear constraint on each variable.
+ */
+void setUpObjective(cppmpc::FastMPC::SymbolicObjective* objective,
+                    const std::vector<RCP<const SymEngine::Symbol>>& x,
+                    const SymEngine::Expression& a) {
+    SymEngine::Expression cost(0);
+    for (size_t i = 0; i < x.size(); i++) {
+        SymEngine::Expression xi(x[i]);
+        cost = cost + SymEngine::exp(0.1 * xi) + SymEngine::sin(xi) * xi;
+        if (i + 1 < x.size()) {
+            SymEngine::Expression next(x[i + 1]);
+            cost = cost + (xi - next) * (xi - next) * (xi + next);
+        }
+        objective->inequalityConstraints.appendLessThan(xi * xi, a * a);
+    }
+    objective->setObjective(cost);
+}
+
+}  // namespace
+
+/**
+ * Compares the time to compile and evaluate the generated code of the same
+ * objective built with each compile preset, and with profile guided
+ * optimization on top of the native preset.
+ */
+int main() {
+    std::vector<RCP<const SymEngine::Symbol>> x =
+            cppmpc::variableVector("x", numVariables);
+    SymEngine::Expression a(cppmpc::parameter("a"));
+    cppmpc::OrderedSet variableOrdering(x.begin(), x.end());
+    cppmpc::OrderedSet parameterOrdering;
+    parameterOrdering.append(a);
+
+    Eigen::VectorXd param = Eigen::VectorXd::Constant(1, 2.0);
+    Eigen::VectorXd state = Eigen::VectorXd::LinSpaced(numVariables, -1, 1);
+
+    // The cache would hide the compile time
+    std::string previousCacheDirectory =
+            cppmpc::RuntimeCompiler::cacheDirectory();
+    cppmpc::RuntimeCompiler::setCacheDirectory("");
+
+    std::vector<std::pair<std::string, cppmpc::CompilePreset>> presets = {
+            {"Debug", cppmpc::CompilePreset::Debug},
+            {"Release", cppmpc::CompilePreset::Release},
+            {"Native", cppmpc::CompilePreset::Native},
+            {"FastMath", cppmpc::CompilePreset::FastMath}};
+    bool profileGuided =
+            std::system("llvm-profdata --version > /dev/null 2>&1") == 0;
+
+    std::printf("%-12s %12s %16s %10s\n", "Profile", "Compile (s)",
+                "Evaluate (us)", "Speedup");
+    double baseline = 0;
+    for (size_t i = 0; i < presets.size() + (profileGuided ? 1 : 0); i++) {
+        bool profiled = i == presets.size();
+        std::string name = profiled ? "Native+PGO" : presets[i].first;
+
+        cppmpc::FastMPC::SymbolicObjective objective;
+        objective.compileOptions = cppmpc::RuntimeCompiler::presetOptions(
+                profiled ? cppmpc::CompilePreset::Native : presets[i].second);
+        setUpObjective(&objective, x, a);
+        double compileTime = secondsTaken([&]() {
+            objective.finalize(variableOrdering, parameterOrdering);
+        });
+        objective.setParameters(param);
+
+        if (profiled) {
+            std::vector<Eigen::VectorXd> states;
+            std::vector<Eigen::VectorXd> parameters;
+            for (size_t j = 0; j < 20; j++) {
+                states.push_back(Eigen::VectorXd::Random(numVariables));
+                parameters.push_back(param);
+            }
+            compileTime += secondsTaken([&]() {
+                objective.optimizeWithProfile(states, parameters);
+            });
+        }
+
+        double sum = 0;
+        double evaluateTime = secondsTaken([&]() {
+            for (size_t j = 0; j < numEvaluations; j++) {
+                sum += objective.value(state);
+                sum += objective.gradient(state).sum();
+                sum += objective.hessian(state).sum();
+                sum += objective.inequalityConstraintsHessian(state).sum();
+            }
+        });
+        double perEvaluation = 1e6 * evaluateTime / numEvaluations;
+        if (i == 0) {
+            baseline = perEvaluation;
+        }
+
+        // Print the sum so the evaluations can't be optimized away
+        std::printf("%-12s %12.3f %16.2f %9.2fx  (%g)\n", name.c_str(),
+                    compileTime, perEvaluation, baseline / perEvaluation, sum);
+    }
+
+    cppmpc::RuntimeCompiler::setCacheDirectory(previousCacheDirectory);
+    return 0;
+}
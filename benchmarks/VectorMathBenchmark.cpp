@@ -0,0 +1,117 @@
+// Copyright 2021 Ian Ruh
+#include <symengine/basic.h>
+#include <symengine/expression.h>
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Dense>
+#include "OrderedSet.h"
+#include "RuntimeCompiler.h"
+#include "SymEngineUtilities.h"
+#include "SymbolicObjective.h"
+#include "VectorMath.h"
+
+namespace {
+
+// The number of variables in the benchmark problem
+const size_t numVariables = 20;
+// The number of constraints on each variable
+const size_t constraintsPerVariable = 8;
+// The number of times each function is evaluated
+const size_t numEvaluations = 20000;
+
+/**
+ * @brief Seconds taken by the function.
+ */
+double secondsTaken(const std::function<void()>& function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+/**
+ * @brief A quadratic cost with many nonlinear constraints on each variable,
+ * so evaluating the barrier is mostly calls to log, sin, and cos.
+ */
+void setUpObjective(cppmpc::FastMPC::SymbolicObjective* objective,
+                    const std::vector<RCP<const SymEngine::Symbol>>& x,
+                    const SymEngine::Expression& a) {
+    SymEngine::Expression cost(0);
+    for (size_t i = 0; i < x.size(); i++) {
+        SymEngine::Expression xi(x[i]);
+        cost = cost + xi * xi;
+        for (size_t j = 0; j < constraintsPerVariable; j++) {
+            SymEngine::Expression k(static_cast<int>(j + 1));
+            objective->inequalityConstraints.appendLessThan(
+                    xi * xi + SymEngine::sin(k * xi) +
+                            SymEngine::cos(xi + k),
+                    a * k);
+        }
+    }
+    objective->setObjective(cost);
+}
+
+}  // namespace
+
+/**
+ * Compares the time to evaluate the barrier of a constraint heavy objective
+ * with the math.h calls, and with each accuracy of the vector math kernels.
+ */
+int main() {
+    std::vector<RCP<const SymEngine::Symbol>> x =
+            cppmpc::variableVector("x", numVariables);
+    SymEngine::Expression a(cppmpc::parameter("a"));
+    cppmpc::OrderedSet variableOrdering(x.begin(), x.end());
+    cppmpc::OrderedSet parameterOrdering;
+    parameterOrdering.append(a);
+
+    Eigen::VectorXd param = Eigen::VectorXd::Constant(1, 4.0);
+    Eigen::VectorXd state = Eigen::VectorXd::LinSpaced(numVariables, -1, 1);
+
+    std::vector<std::pair<std::string, cppmpc::VectorMath>> accuracies = {
+            {"math.h", cppmpc::VectorMath::Off},
+            {"Fast", cppmpc::VectorMath::Fast},
+            {"Accurate", cppmpc::VectorMath::Accurate}};
+
+    std::printf("%-12s %16s %10s %12s\n", "Vector math", "Evaluate (us)",
+                "Speedup", "Error");
+    double baseline = 0;
+    double reference = 0;
+    for (size_t i = 0; i < accuracies.size(); i++) {
+        cppmpc::FastMPC::SymbolicObjective objective;
+        objective.compileOptions = cppmpc::RuntimeCompiler::presetOptions(
+                cppmpc::CompilePreset::Native);
+        objective.compileOptions.vectorMath = accuracies[i].second;
+        setUpObjective(&objective, x, a);
+        objective.finalize(variableOrdering, parameterOrdering);
+        objective.setParameters(param);
+
+        double value = objective.inequalityConstraintsValue(state);
+        double sum = 0;
+        double evaluateTime = secondsTaken([&]() {
+            for (size_t j = 0; j < numEvaluations; j++) {
+                sum += objective.inequalityConstraintsValue(state);
+                sum += objective.inequalityConstraintsGradient(state).sum();
+            }
+        });
+        double perEvaluation = 1e6 * evaluateTime / numEvaluations;
+        if (i == 0) {
+            baseline = perEvaluation;
+            reference = value;
+        }
+
+        // Print the sum so the evaluations can't be optimized away
+        std::printf("%-12s %16.2f %9.2fx %12.3g  (%g)\n",
+                    accuracies[i].first.c_str(), perEvaluation,
+                    baseline / perEvaluation, value - reference, sum);
+    }
+
+    return 0;
+}
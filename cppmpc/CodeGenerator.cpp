@@ -1,19 +1,35 @@
 // Copyright 2021 Ian Ruh
 #include "CodeGenerator.h"
 
+#include <symengine/constants.h>
+#include <symengine/functions.h>
+#include <symengine/pow.h>
 #include <symengine/subs.h>
+#include <algorithm>
+#include <cstdint>
 #include <exception>
-#include <fstream>
+#include <map>
+#include <set>
 #include <sstream>
 #include <string>
 #include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 #include "symengine/basic.h"
 #include "symengine/matrix.h"
 #include "symengine/symbol.h"
 
+#include "CodeSink.h"
+#include "CompiledModule.h"
+#include "ExpressionEmitter.h"
+#include "FinalizeProfiler.h"
 #include "OrderedSet.h"
+#include "SparsityPattern.h"
 #include "SymEngineUtilities.h"
 #include "SymbolicEquality.h"
+#include "VectorMath.h"
 
 namespace cppmpc {
 
@@ -21,32 +37,132 @@ using SymEngine::Basic;
 using SymEngine::RCP;
 using SymEngine::Symbol;
 
-std::string CodeGenerator::generateDenseMatrixCode(
-        const SymEngine::DenseMatrix& mat, const MapBasicString& variableRepr,
-        const MapBasicString& parameterRepr, const std::string& matrixName) {
-    // Verify that each variable  in the matrix has a representation
-    // Verify that each parameter in the matrix has a representation
-    for (size_t i = 0; i < mat.nrows(); i++) {
-        for (size_t j = 0; j < mat.ncols(); j++) {
-            UnorderedSetSymbol variables = getVariables(mat.get(i, j));
-            UnorderedSetSymbol parameters = getParameters(mat.get(i, j));
+namespace {
+
+/**
+ * @brief An entry with its symbols replaced by their representations, and
+ * optimized for evaluation, recording both to the active finalize profiler.
+ */
+RCP<const Basic> optimizedEntry(
+        const RCP<const Basic>& value,
+        const SymEngine::map_basic_basic& symbolsRepMap) {
+    FinalizeProfiler::Phase phase("optimize");
+    RCP<const Basic> replaced = SymEngine::xreplace(value, symbolsRepMap);
+    RCP<const Basic> optimized = ExpressionEmitter::optimize(replaced);
+    if (FinalizeProfiler::active() != nullptr) {
+        FinalizeProfiler::recordTransform("optimize", {value}, {optimized});
+    }
+    return optimized;
+}
 
-            for (auto variable : variables) {
-                if (variableRepr.count(variable) != 1) {
-                    throw std::runtime_error(
-                            "A representation for a variable was not found");
-                }
-            }
-            for (auto parameter : parameters) {
-                if (parameterRepr.count(parameter) != 1) {
-                    throw std::runtime_error(
-                            "A representation for a parameter was not found");
-                }
-            }
+// Keeps a function that only the library calls out of its exports
+const char* const hiddenVisibility = "__attribute__((visibility(\"hidden\"))) ";
+
+/**
+ * @brief Counts the bytes of generated code without keeping them.
+ */
+class CountingSink : public CodeSink {
+ public:
+    size_t count = 0;
+
+    void write(const char*, size_t size) override { this->count += size; }
+};
+
+typedef std::unordered_set<RCP<const Basic>, SymEngine::RCPBasicHash,
+                           SymEngine::RCPBasicKeyEq>
+        BasicSet;
+typedef std::unordered_map<RCP<const Basic>, size_t, SymEngine::RCPBasicHash,
+                           SymEngine::RCPBasicKeyEq>
+        BasicIndices;
+typedef std::unordered_map<RCP<const Basic>, bool, SymEngine::RCPBasicHash,
+                           SymEngine::RCPBasicKeyEq>
+        BasicFlags;
+
+/**
+ * @brief Whether an expression calls a function that has a vector math
+ * kernel with arguments that read a symbol, and the function and the
+ * arguments if it does. pow takes the base and the exponent, the others one
+ * argument. Calls of constants are left to the compiler.
+ */
+bool kernelCall(const RCP<const Basic>& basic, std::string* function,
+                SymEngine::vec_basic* arguments) {
+    SymEngine::vec_basic args = basic->get_args();
+    if (SymEngine::is_a<SymEngine::Log>(*basic) && args.size() == 1) {
+        *function = "log";
+        *arguments = args;
+    } else if (SymEngine::is_a<SymEngine::Sin>(*basic)) {
+        *function = "sin";
+        *arguments = args;
+    } else if (SymEngine::is_a<SymEngine::Cos>(*basic)) {
+        *function = "cos";
+        *arguments = args;
+    } else if (SymEngine::is_a<SymEngine::Pow>(*basic) &&
+               SymEngine::eq(*args[0], *SymEngine::E)) {
+        *function = "exp";
+        *arguments = {args[1]};
+    } else if (SymEngine::is_a<SymEngine::Pow>(*basic) &&
+               ExpressionEmitter::callsPow(args[0], args[1])) {
+        // Only the powers printed as calls to pow, not as multiplications
+        *function = "pow";
+        *arguments = args;
+    } else {
+        return false;
+    }
+    for (const RCP<const Basic>& argument : *arguments) {
+        if (!getSymbols(*argument).empty()) {
+            return true;
         }
     }
+    return false;
+}
 
-    // Now that we have checked, we can throw them all together
+/**
+ * @brief Whether an expression calls any of the functions with a kernel,
+ * remembering the answer for every subexpression it checks.
+ */
+bool callsKernel(const RCP<const Basic>& basic,
+                 const std::set<std::string>& functions, BasicFlags* memo) {
+    auto found = memo->find(basic);
+    if (found != memo->end()) {
+        return found->second;
+    }
+    std::string name;
+    SymEngine::vec_basic arguments;
+    bool calls = kernelCall(basic, &name, &arguments) &&
+                 functions.count(name) > 0;
+    for (const RCP<const Basic>& arg : basic->get_args()) {
+        calls = callsKernel(arg, functions, memo) || calls;
+    }
+    memo->emplace(basic, calls);
+    return calls;
+}
+
+}  // namespace
+
+void CodeGenerator::checkRepresentations(const RCP<const Basic>& basic,
+                                         const MapBasicString& variableRepr,
+                                         const MapBasicString& parameterRepr) {
+    UnorderedSetSymbol variables = getVariables(basic);
+    UnorderedSetSymbol parameters = getParameters(basic);
+
+    for (auto variable : variables) {
+        if (variableRepr.count(variable) != 1) {
+            throw std::runtime_error(
+                    "A representation for a variable was not found");
+        }
+    }
+    for (auto parameter : parameters) {
+        if (parameterRepr.count(parameter) != 1) {
+            throw std::runtime_error(
+                    "A representation for a parameter was not found");
+        }
+    }
+}
+
+SymEngine::map_basic_basic CodeGenerator::representationMap(
+        const MapBasicString& variableRepr,
+        const MapBasicString& parameterRepr) {
+    // Throw them all together
     MapBasicString symbolsMap;
     symbolsMap.insert(variableRepr.begin(), variableRepr.end());
     symbolsMap.insert(parameterRepr.begin(), parameterRepr.end());
@@ -57,166 +173,771 @@ std::string CodeGenerator::generateDenseMatrixCode(
     for (it = symbolsMap.begin(); it != symbolsMap.end(); it++) {
         symbolsRepMap[it->first] = SymEngine::symbol(it->second);
     }
+    return symbolsRepMap;
+}
+
+MapBasicString CodeGenerator::arrayRepresentation(
+        const UnorderedSetSymbol& symbols, const OrderedSet& ordering,
+        const std::string& arrayName) {
+    MapBasicString repr;
+    for (RCP<const Symbol> symbol : symbols) {
+        if (!ordering.contains(symbol)) {
+            throw std::runtime_error("Not all symbols have a representation");
+        }
+        repr[symbol] = arrayName + "[" +
+                       std::to_string(ordering.indexOf(symbol)) + "]";
+    }
+    return repr;
+}
 
-    std::stringstream ss;
+std::vector<std::pair<size_t, RCP<const Basic>>>
+CodeGenerator::denseAssignments(const SymEngine::DenseMatrix& mat,
+                                const MapBasicString& variableRepr,
+                                const MapBasicString& parameterRepr,
+                                const SparsityPattern* pattern) {
+    if (pattern != nullptr &&
+        (pattern->rows() != mat.nrows() || pattern->cols() != mat.ncols())) {
+        throw std::runtime_error(
+                "Sparsity pattern does not match the matrix dimensions");
+    }
 
-    int count = 0;
+    // Verify that each variable  in the matrix has a representation
+    // Verify that each parameter in the matrix has a representation
+    for (size_t i = 0; i < mat.nrows(); i++) {
+        for (size_t j = 0; j < mat.ncols(); j++) {
+            if (pattern != nullptr && !pattern->contains(i, j)) {
+                continue;
+            }
+            CodeGenerator::checkRepresentations(mat.get(i, j), variableRepr,
+                                                parameterRepr);
+        }
+    }
+
+    // Now that we have checked, we can throw them all together
+    SymEngine::map_basic_basic symbolsRepMap =
+            CodeGenerator::representationMap(variableRepr, parameterRepr);
+
+    std::vector<std::pair<size_t, RCP<const Basic>>> assignments;
+
+    size_t count = 0;
     for (size_t col = 0; col < mat.ncols(); col++) {
         for (size_t row = 0; row < mat.nrows(); row++) {
-            RCP<const Basic> replaced = SymEngine::expand(
-                    SymEngine::xreplace(mat.get(row, col), symbolsRepMap));
-            ss << matrixName << "[" << std::to_string(count)
-               << "] = " << SymEngine::ccode(*replaced) << ";" << std::endl;
+            // Structural zeros don't need to be replaced
+            if (pattern != nullptr && !pattern->contains(row, col)) {
+                assignments.emplace_back(count, SymEngine::zero);
+                count += 1;
+                continue;
+            }
+            assignments.emplace_back(
+                    count, optimizedEntry(mat.get(row, col), symbolsRepMap));
             count += 1;
         }
     }
+    return assignments;
+}
+
+std::vector<std::pair<size_t, RCP<const Basic>>>
+CodeGenerator::sparseAssignments(size_t leadingDimension, size_t cols,
+                                 const std::vector<SymbolicTriplet>& entries,
+                                 const MapBasicString& variableRepr,
+                                 const MapBasicString& parameterRepr) {
+    // Sum duplicate entries so each element is only assigned once. The
+    // elements are kept by index, so they are set in column major order.
+    std::map<size_t, RCP<const Basic>> summed;
+    for (const SymbolicTriplet& entry : entries) {
+        if (cols > 0 && (entry.row >= leadingDimension || entry.col >= cols)) {
+            throw std::runtime_error("Sparse matrix entry is out of range");
+        }
+        CodeGenerator::checkRepresentations(entry.value, variableRepr,
+                                            parameterRepr);
+        size_t index = entry.col * leadingDimension + entry.row;
+        auto it = summed.find(index);
+        if (it == summed.end()) {
+            summed.emplace(index, entry.value);
+        } else {
+            it->second = SymEngine::add(it->second, entry.value);
+        }
+    }
+
+    SymEngine::map_basic_basic symbolsRepMap =
+            CodeGenerator::representationMap(variableRepr, parameterRepr);
 
-    return ss.str();
+    std::vector<std::pair<size_t, RCP<const Basic>>> assignments;
+    for (const auto& element : summed) {
+        assignments.emplace_back(
+                element.first, optimizedEntry(element.second, symbolsRepMap));
+    }
+    return assignments;
 }
 
-std::tuple<std::string, std::string, std::string>
-CodeGenerator::generateObjectiveFunctions(
-        const RCP<const Basic> symbolicObjective,
-        const SymEngine::DenseMatrix& gradientMat,
-        const SymEngine::DenseMatrix& hessianMat,
-        const OrderedSet& variableOrdering, const OrderedSet& parameterOrdering,
-        const std::string& valueFunctionName,
-        const std::string& gradientFunctionName,
-        const std::string& hessianFunctionName) {
-    // Get all parameters and variables
-    UnorderedSetSymbol parameters = cppmpc::getParameters(symbolicObjective);
-    UnorderedSetSymbol variables = cppmpc::getVariables(symbolicObjective);
+std::string CodeGenerator::generateDenseMatrixCode(
+        const SymEngine::DenseMatrix& mat, const MapBasicString& variableRepr,
+        const MapBasicString& parameterRepr, const std::string& matrixName,
+        const SparsityPattern* pattern) {
+    StringSink sink;
+    CodeGenerator::writeDenseMatrixCode(sink, mat, variableRepr, parameterRepr,
+                                        matrixName, pattern);
+    return sink.take();
+}
 
-    // Create the representations for the parameters
-    MapBasicString parameterRepr;
-    for (RCP<const Symbol> parameter : parameters) {
-        parameterRepr[parameter] =
-                "param[" +
-                std::to_string(parameterOrdering.indexOf(parameter)) + "]";
+void CodeGenerator::writeDenseMatrixCode(CodeSink& sink,
+                                         const SymEngine::DenseMatrix& mat,
+                                         const MapBasicString& variableRepr,
+                                         const MapBasicString& parameterRepr,
+                                         const std::string& matrixName,
+                                         const SparsityPattern* pattern) {
+    CodeGenerator::writeAssignmentCode(
+            sink,
+            CodeGenerator::denseAssignments(mat, variableRepr, parameterRepr,
+                                            pattern),
+            matrixName);
+}
+
+std::string CodeGenerator::generateSparseMatrixCode(
+        size_t rows, size_t cols, const std::vector<SymbolicTriplet>& entries,
+        const MapBasicString& variableRepr, const MapBasicString& parameterRepr,
+        const std::string& matrixName) {
+    StringSink sink;
+    CodeGenerator::writeSparseMatrixCode(sink, rows, cols, entries,
+                                         variableRepr, parameterRepr,
+                                         matrixName);
+    return sink.take();
+}
+
+void CodeGenerator::writeSparseMatrixCode(
+        CodeSink& sink, size_t rows, size_t cols,
+        const std::vector<SymbolicTriplet>& entries,
+        const MapBasicString& variableRepr, const MapBasicString& parameterRepr,
+        const std::string& matrixName) {
+    std::vector<std::pair<size_t, RCP<const Basic>>> assignments =
+            CodeGenerator::sparseAssignments(rows, cols, entries, variableRepr,
+                                             parameterRepr);
+
+    // Zero everything, then set only the non-zero elements
+    sink << "for (int i = 0; i < " << rows * cols << "; i++) {\n";
+    sink << matrixName << "[i] = 0;\n";
+    sink << "}\n";
+    CodeGenerator::writeAssignmentCode(sink, assignments, matrixName);
+}
+
+std::string CodeGenerator::generateExpressionCode(
+        const RCP<const Basic>& basic, const MapBasicString& variableRepr,
+        const MapBasicString& parameterRepr) {
+    CodeGenerator::checkRepresentations(basic, variableRepr, parameterRepr);
+    SymEngine::map_basic_basic symbolsRepMap =
+            CodeGenerator::representationMap(variableRepr, parameterRepr);
+    return ExpressionEmitter::code(optimizedEntry(basic, symbolsRepMap));
+}
+
+std::string CodeGenerator::generateOffsetMatrixCode(
+        const std::vector<SymbolicTriplet>& entries,
+        const MapBasicString& variableRepr, const MapBasicString& parameterRepr,
+        const std::string& matrixName, const std::string& offset,
+        size_t leadingDimension) {
+    StringSink sink;
+    CodeGenerator::writeOffsetMatrixCode(sink, entries, variableRepr,
+                                         parameterRepr, matrixName, offset,
+                                         leadingDimension);
+    return sink.take();
+}
+
+void CodeGenerator::writeOffsetMatrixCode(
+        CodeSink& sink, const std::vector<SymbolicTriplet>& entries,
+        const MapBasicString& variableRepr, const MapBasicString& parameterRepr,
+        const std::string& matrixName, const std::string& offset,
+        size_t leadingDimension) {
+    // The block's entries aren't checked against its size, since only the
+    // caller knows the rows of the whole matrix that it may reach.
+    CodeGenerator::writeAssignmentCode(
+            sink,
+            CodeGenerator::sparseAssignments(leadingDimension, 0, entries,
+                                             variableRepr, parameterRepr),
+            matrixName, offset);
+}
+
+bool CodeGenerator::parseArrayReference(const std::string& name,
+                                        ArrayReference* reference) {
+    size_t open = name.find('[');
+    if (open == std::string::npos || open == 0 || name.back() != ']') {
+        return false;
     }
+    std::string digits = name.substr(open + 1, name.size() - open - 2);
+    if (digits.empty() ||
+        digits.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    reference->array = name.substr(0, open);
+    reference->index = std::stoll(digits);
+    return true;
+}
 
-    // Create the representations for the variables.
-    MapBasicString variableRepr;
-    for (RCP<const Symbol> variable : variables) {
-        variableRepr[variable] =
-                "state[" + std::to_string(variableOrdering.indexOf(variable)) +
-                "]";
+std::string CodeGenerator::affineIndex(int64_t start, int64_t stride) {
+    std::string index = std::to_string(start);
+    if (stride > 0) {
+        index += " + " + std::to_string(stride) + " * i";
+    } else if (stride < 0) {
+        index += " - " + std::to_string(-stride) + " * i";
     }
+    return index;
+}
 
-    //============= Value ===========
-    std::stringstream ssValue;
+std::string CodeGenerator::generateAssignmentCode(
+        const std::vector<std::pair<size_t, RCP<const Basic>>>& assignments,
+        const std::string& matrixName, const std::string& offset) {
+    StringSink sink;
+    CodeGenerator::writeAssignmentCode(sink, assignments, matrixName, offset);
+    return sink.take();
+}
 
-    // Function signature
-    ssValue << "void " << valueFunctionName
-            << "(const double* state, const double* param, double* out) {"
-            << std::endl;
+void CodeGenerator::writeAssignmentCode(
+        CodeSink& sink,
+        const std::vector<std::pair<size_t, RCP<const Basic>>>& assignments,
+        const std::string& matrixName, const std::string& offset,
+        bool batched) {
+    FinalizeProfiler::Phase phase("print");
+    std::string prefix = offset.empty() ? "" : offset + " + ";
+
+    // The element of an array at an index, which is the element of the
+    // current point in the batched layout.
+    auto element = [batched](const std::string& array,
+                             const std::string& index) {
+        return batched ? array + "[(" + index + ") * count + batch]"
+                       : array + "[" + index + "]";
+    };
+    const std::string batchLoop =
+            "#pragma omp simd\n"
+            "for (int batch = 0; batch < count; batch++) {\n";
+
+    // The canonical form of an entry, and the indices of the array elements
+    // its placeholders stand for.
+    typedef struct CanonicalEntry {
+        size_t index;
+        RCP<const Basic> value;
+        RCP<const Basic> form;
+        std::vector<ArrayReference> references;
+    } CanonicalEntry;
+
+    // Entries are grouped by the canonical form and the arrays the
+    // placeholders read from. The forms are compared structurally rather than
+    // printed, so the text of every entry isn't held at once. Groups are kept
+    // in order of first appearance so the output is deterministic.
+    typedef std::unordered_map<RCP<const Basic>, size_t,
+                               SymEngine::RCPBasicHash,
+                               SymEngine::RCPBasicKeyEq>
+            FormIndices;
+    std::map<std::string, FormIndices> groupIndices;
+    std::vector<std::vector<CanonicalEntry>> groups;
+    std::vector<RCP<const Symbol>> placeholders;
+    for (const auto& assignment : assignments) {
+        CanonicalEntry entry{assignment.first, assignment.second,
+                             assignment.second, {}};
+
+        std::vector<std::pair<ArrayReference, RCP<const Symbol>>> found;
+        for (const RCP<const Symbol>& symbol : getSymbols(entry.value)) {
+            ArrayReference reference;
+            if (CodeGenerator::parseArrayReference(symbol->get_name(),
+                                                   &reference)) {
+                found.emplace_back(reference, symbol);
+            } else if (batched) {
+                throw std::runtime_error(
+                        "A batched entry reads a symbol that isn't an array "
+                        "element");
+            }
+        }
+        std::sort(found.begin(), found.end(),
+                  [](const auto& left, const auto& right) {
+                      return std::tie(left.first.array, left.first.index) <
+                             std::tie(right.first.array, right.first.index);
+                  });
+
+        SymEngine::map_basic_basic placeholderMap;
+        std::string key;
+        for (size_t i = 0; i < found.size(); i++) {
+            if (placeholders.size() <= i) {
+                placeholders.push_back(
+                        SymEngine::symbol("$ref" + std::to_string(i)));
+            }
+            placeholderMap[found[i].second] = placeholders[i];
+            entry.references.push_back(found[i].first);
+            key += found[i].first.array + ",";
+        }
+        entry.form = SymEngine::xreplace(entry.value, placeholderMap);
+
+        FormIndices& forms = groupIndices[key];
+        auto it = forms.find(entry.form);
+        if (it == forms.end()) {
+            forms.emplace(entry.form, groups.size());
+            groups.push_back({entry});
+        } else {
+            groups[it->second].push_back(entry);
+        }
+    }
 
-    // The actual matrix construction code
-    SymEngine::DenseMatrix valueMat(1, 1);
-    valueMat.set(0, 0, symbolicObjective);
-    ssValue << CodeGenerator::generateDenseMatrixCode(valueMat, variableRepr,
-                                                      parameterRepr, "out");
+    // Each entry is written to the sink as soon as it is printed
+    for (std::vector<CanonicalEntry>& group : groups) {
+        std::sort(group.begin(), group.end(),
+                  [](const CanonicalEntry& left, const CanonicalEntry& right) {
+                      return left.index < right.index;
+                  });
+
+        size_t start = 0;
+        while (start < group.size()) {
+            // Extend the run while the output and every reference keep the
+            // same stride as the first two entries.
+            size_t length = 1;
+            if (start + 1 < group.size()) {
+                const CanonicalEntry& first = group[start];
+                const CanonicalEntry& second = group[start + 1];
+                length = 2;
+                while (start + length < group.size()) {
+                    const CanonicalEntry& next = group[start + length];
+                    bool affine = next.index - first.index ==
+                                  length * (second.index - first.index);
+                    for (size_t r = 0; affine && r < first.references.size();
+                         r++) {
+                        int64_t stride = second.references[r].index -
+                                         first.references[r].index;
+                        affine = next.references[r].index -
+                                         first.references[r].index ==
+                                 static_cast<int64_t>(length) * stride;
+                    }
+                    if (!affine) {
+                        break;
+                    }
+                    length += 1;
+                }
+            }
 
-    ssValue << "}" << std::endl;
+            if (length < CodeGenerator::minimumLoopLength) {
+                const CanonicalEntry& entry = group[start];
+                if (!batched) {
+                    sink << matrixName << "[" << prefix << entry.index
+                         << "] = " << ExpressionEmitter::code(entry.value)
+                         << ";\n";
+                    start += 1;
+                    continue;
+                }
 
-    //============= Gradient ===========
-    std::stringstream ssGrad;
+                // Every reference is to the element of the current point
+                SymEngine::map_basic_basic batchMap;
+                for (size_t r = 0; r < entry.references.size(); r++) {
+                    batchMap[placeholders[r]] = SymEngine::symbol(element(
+                            entry.references[r].array,
+                            std::to_string(entry.references[r].index)));
+                }
+                sink << batchLoop;
+                sink << element(matrixName,
+                                prefix + std::to_string(entry.index))
+                     << " = "
+                     << ExpressionEmitter::code(
+                                SymEngine::xreplace(entry.form, batchMap))
+                     << ";\n";
+                sink << "}\n";
+                start += 1;
+                continue;
+            }
+
+            // Replace each placeholder with its element at iteration i
+            const CanonicalEntry& first = group[start];
+            const CanonicalEntry& second = group[start + 1];
+            SymEngine::map_basic_basic loopMap;
+            for (size_t r = 0; r < first.references.size(); r++) {
+                int64_t stride =
+                        second.references[r].index - first.references[r].index;
+                loopMap[placeholders[r]] = SymEngine::symbol(element(
+                        first.references[r].array,
+                        CodeGenerator::affineIndex(first.references[r].index,
+                                                   stride)));
+            }
+            int64_t outputStride = static_cast<int64_t>(second.index) -
+                                   static_cast<int64_t>(first.index);
+
+            // The batch loop is innermost, so its points are contiguous
+            sink << "for (int i = 0; i < " << length << "; i++) {\n";
+            if (batched) {
+                sink << batchLoop;
+            }
+            sink << element(matrixName,
+                            prefix + CodeGenerator::affineIndex(
+                                             first.index, outputStride))
+                 << " = "
+                 << ExpressionEmitter::code(
+                            SymEngine::xreplace(first.form, loopMap))
+                 << ";\n";
+            if (batched) {
+                sink << "}\n";
+            }
+            sink << "}\n";
+            start += length;
+        }
+    }
+}
 
-    // Function signature
-    ssGrad << "void " << gradientFunctionName
-           << "(const double* state, const double* param, double* out) {"
-           << std::endl;
+GeneratedFunction CodeGenerator::verbatimFunction(
+        const std::string& functionString) {
+    GeneratedFunction function;
+    function.code = functionString;
+    return function;
+}
 
-    // The actual matrix construction code
-    ssGrad << CodeGenerator::generateDenseMatrixCode(gradientMat, variableRepr,
-                                                     parameterRepr, "out");
+void CodeGenerator::writeFunctionSignature(
+        CodeSink& sink, const GeneratedFunction& function) {
+    // The arrays of a batch don't overlap
+    std::string pointer = function.batched ? "* __restrict " : "* ";
+    if (function.hidden) {
+        sink << hiddenVisibility;
+    }
+    sink << "void " << function.name;
+    if (function.batched) {
+        sink << CompiledModule::batchSuffix << "(int count, ";
+    } else {
+        sink << "(";
+    }
+    for (const std::string& input : function.inputs) {
+        sink << "const double" << pointer << input << ", ";
+    }
+    sink << "double" << pointer << "out)";
+}
 
-    ssGrad << "}" << std::endl;
+void CodeGenerator::writeFunctionCode(CodeSink& sink,
+                                      const GeneratedFunction& function) {
+    if (!function.code.empty()) {
+        sink << function.code;
+        return;
+    }
 
-    //============= Hessian ===========
-    std::stringstream ssHess;
+    // The chunks are declared first, since they are in other files
+    std::vector<GeneratedFunction> chunks(function.chunks);
+    for (size_t k = 0; k < chunks.size(); k++) {
+        chunks[k].name = function.name + "_chunk" + std::to_string(k);
+        chunks[k].inputs = function.inputs;
+        chunks[k].hidden = true;
+        CodeGenerator::writeFunctionSignature(sink, chunks[k]);
+        sink << ";\n";
+    }
 
-    // Function signature
-    ssHess << "void " << hessianFunctionName
-           << "(const double* state, const double* param, double* out) {"
-           << std::endl;
+    CodeGenerator::writeFunctionSignature(sink, function);
+    sink << " {\n";
 
-    // The actual matrix construction code
-    ssHess << CodeGenerator::generateDenseMatrixCode(hessianMat, variableRepr,
-                                                     parameterRepr, "out");
+    // The gathered calls only read the inputs, so they are evaluated first
+    for (const GatheredCalls& calls : function.gathered) {
+        std::vector<std::pair<size_t, RCP<const Basic>>> arguments;
+        std::vector<std::pair<size_t, RCP<const Basic>>> exponents;
+        for (size_t i = 0; i < calls.arguments.size(); i++) {
+            arguments.emplace_back(i, calls.arguments[i]);
+        }
+        for (size_t i = 0; i < calls.exponents.size(); i++) {
+            exponents.emplace_back(i, calls.exponents[i]);
+        }
+        sink << "double " << calls.array << "_in[" << arguments.size()
+             << "];\n";
+        sink << "double " << calls.array << "[" << arguments.size() << "];\n";
+        CodeGenerator::writeAssignmentCode(sink, arguments,
+                                           calls.array + "_in");
+        if (!exponents.empty()) {
+            sink << "double " << calls.array << "_exponent["
+                 << exponents.size() << "];\n";
+            CodeGenerator::writeAssignmentCode(sink, exponents,
+                                               calls.array + "_exponent");
+        }
+        sink << VectorMathKernels::kernelName(calls.function, calls.accuracy)
+             << "(" << arguments.size() << ", " << calls.array << "_in, ";
+        if (!exponents.empty()) {
+            sink << calls.array << "_exponent, ";
+        }
+        sink << calls.array << ");\n";
+    }
 
-    ssHess << "}" << std::endl;
+    if (function.zeroed > 0) {
+        sink << "for (int i = 0; i < " << function.zeroed << "; i++) {\n";
+        if (function.batched) {
+            sink << "#pragma omp simd\n";
+            sink << "for (int batch = 0; batch < count; batch++) {\n";
+            sink << "out[(i) * count + batch] = 0;\n";
+            sink << "}\n";
+        } else {
+            sink << "out[i] = 0;\n";
+        }
+        sink << "}\n";
+    }
+    for (const GeneratedFunction& chunk : chunks) {
+        sink << chunk.name << "(";
+        for (const std::string& input : chunk.inputs) {
+            sink << input << ", ";
+        }
+        sink << "out);\n";
+    }
+    CodeGenerator::writeAssignmentCode(sink, function.assignments, "out", "",
+                                       function.batched);
 
-    return std::make_tuple(ssValue.str(), ssGrad.str(), ssHess.str());
+    sink << "}\n";
 }
 
-std::pair<std::string, std::string>
-CodeGenerator::generateSymbolicEqualityFunctions(
-        const SymbolicEqualityConstraints& symbolicConstraints,
-        const OrderedSet& variableOrdering, const OrderedSet& parameterOrdering,
-        const std::string& matrixFunctionName,
-        const std::string& vectorFunctionName) {
-    // Get the linearized matrices.
-    SymEngine::DenseMatrix mat;
-    SymEngine::DenseMatrix vec;
-    std::tie(mat, vec) =
-            symbolicConstraints.convertToLinearSystem(variableOrdering);
-
-    // Get all parameters and variables
-    UnorderedSetSymbol parameters = symbolicConstraints.getParameters();
-    UnorderedSetSymbol variables = symbolicConstraints.getVariables();
+std::string CodeGenerator::generateFunctionCode(
+        const GeneratedFunction& function) {
+    StringSink sink;
+    CodeGenerator::writeFunctionCode(sink, function);
+    return sink.take();
+}
 
-    // Verify that all parameteionrs have a representation
-    for (RCP<const Symbol> parameter : parameters) {
-        if (!parameterOrdering.contains(parameter)) {
-            throw std::runtime_error(
-                    "Not all paramaters have a representations");
+GeneratedFunction CodeGenerator::batchFunction(
+        const GeneratedFunction& function) {
+    if (!function.code.empty() || function.batched ||
+        !function.gathered.empty()) {
+        throw std::runtime_error(
+                "Only functions generated from assignments can be batched");
+    }
+    // Checked now, so a batch that can't be printed fails where it is asked
+    // for rather than when it is compiled.
+    for (const auto& assignment : function.assignments) {
+        for (const RCP<const Symbol>& symbol : getSymbols(assignment.second)) {
+            ArrayReference reference;
+            if (!CodeGenerator::parseArrayReference(symbol->get_name(),
+                                                    &reference)) {
+                throw std::runtime_error(
+                        "A batched entry reads a symbol that isn't an array "
+                        "element");
+            }
         }
     }
 
+    GeneratedFunction batch = function;
+    batch.batched = true;
+    return batch;
+}
+
+void CodeGenerator::objectiveRepresentations(
+        const RCP<const Basic>& symbolicObjective,
+        const OrderedSet& variableOrdering, const OrderedSet& parameterOrdering,
+        MapBasicString* variableRepr, MapBasicString* parameterRepr) {
+    // Get all parameters and variables
+    UnorderedSetSymbol parameters = cppmpc::getParameters(symbolicObjective);
+    UnorderedSetSymbol variables = cppmpc::getVariables(symbolicObjective);
+
     // Create the representations for the parameters
-    MapBasicString parameterRepr;
     for (RCP<const Symbol> parameter : parameters) {
-        parameterRepr[parameter] =
+        (*parameterRepr)[parameter] =
                 "param[" +
                 std::to_string(parameterOrdering.indexOf(parameter)) + "]";
     }
 
     // Create the representations for the variables.
-    MapBasicString variableRepr;
     for (RCP<const Symbol> variable : variables) {
-        variableRepr[variable] =
+        (*variableRepr)[variable] =
                 "state[" + std::to_string(variableOrdering.indexOf(variable)) +
                 "]";
     }
+}
 
-    //============= Equality Matrix ===========
-    std::stringstream ssMat;
+GeneratedFunction CodeGenerator::buildMatrixFunction(
+        const std::string& functionName, const SymEngine::DenseMatrix& mat,
+        const MapBasicString& variableRepr, const MapBasicString& parameterRepr,
+        const SparsityPattern* pattern) {
+    GeneratedFunction function;
+    function.name = functionName;
+    function.inputs = {"state", "param"};
+    function.assignments = CodeGenerator::denseAssignments(
+            mat, variableRepr, parameterRepr, pattern);
+    return function;
+}
+
+std::tuple<std::string, std::string, std::string>
+CodeGenerator::generateObjectiveFunctions(
+        const RCP<const Basic> symbolicObjective,
+        const SymEngine::DenseMatrix& gradientMat,
+        const SymEngine::DenseMatrix& hessianMat,
+        const OrderedSet& variableOrdering, const OrderedSet& parameterOrdering,
+        const std::string& valueFunctionName,
+        const std::string& gradientFunctionName,
+        const std::string& hessianFunctionName,
+        const SparsityPattern* gradientPattern,
+        const SparsityPattern* hessianPattern) {
+    std::vector<GeneratedFunction> functions =
+            CodeGenerator::buildObjectiveFunctions(
+                    symbolicObjective, gradientMat, hessianMat,
+                    variableOrdering, parameterOrdering, valueFunctionName,
+                    gradientFunctionName, hessianFunctionName, gradientPattern,
+                    hessianPattern);
+    return std::make_tuple(CodeGenerator::generateFunctionCode(functions[0]),
+                           CodeGenerator::generateFunctionCode(functions[1]),
+                           CodeGenerator::generateFunctionCode(functions[2]));
+}
 
-    // Function signature
-    ssMat << "void " << matrixFunctionName
-          << "(const double* param, double* out) {" << std::endl;
+std::vector<GeneratedFunction> CodeGenerator::buildObjectiveFunctions(
+        const RCP<const Basic> symbolicObjective,
+        const SymEngine::DenseMatrix& gradientMat,
+        const SymEngine::DenseMatrix& hessianMat,
+        const OrderedSet& variableOrdering, const OrderedSet& parameterOrdering,
+        const std::string& valueFunctionName,
+        const std::string& gradientFunctionName,
+        const std::string& hessianFunctionName,
+        const SparsityPattern* gradientPattern,
+        const SparsityPattern* hessianPattern) {
+    MapBasicString variableRepr;
+    MapBasicString parameterRepr;
+    CodeGenerator::objectiveRepresentations(symbolicObjective,
+                                            variableOrdering, parameterOrdering,
+                                            &variableRepr, &parameterRepr);
 
-    // The actual matrix construction code
-    ssMat << CodeGenerator::generateDenseMatrixCode(mat, variableRepr,
-                                                    parameterRepr, "out");
+    SymEngine::DenseMatrix valueMat(1, 1);
+    valueMat.set(0, 0, symbolicObjective);
+    return {CodeGenerator::buildMatrixFunction(valueFunctionName, valueMat,
+                                               variableRepr, parameterRepr),
+            CodeGenerator::buildMatrixFunction(gradientFunctionName,
+                                               gradientMat, variableRepr,
+                                               parameterRepr, gradientPattern),
+            CodeGenerator::buildMatrixFunction(hessianFunctionName, hessianMat,
+                                               variableRepr, parameterRepr,
+                                               hessianPattern)};
+}
 
-    ssMat << "}" << std::endl;
+void CodeGenerator::writeObjectiveSource(
+        const std::string& filePath, const RCP<const Basic> symbolicObjective,
+        const SymEngine::DenseMatrix& gradientMat,
+        const SymEngine::DenseMatrix& hessianMat,
+        const OrderedSet& variableOrdering, const OrderedSet& parameterOrdering,
+        const std::string& valueFunctionName,
+        const std::string& gradientFunctionName,
+        const std::string& hessianFunctionName,
+        const SparsityPattern* gradientPattern,
+        const SparsityPattern* hessianPattern) {
+    std::vector<GeneratedFunction> functions =
+            CodeGenerator::buildObjectiveFunctions(
+                    symbolicObjective, gradientMat, hessianMat,
+                    variableOrdering, parameterOrdering, valueFunctionName,
+                    gradientFunctionName, hessianFunctionName, gradientPattern,
+                    hessianPattern);
+
+    FinalizeProfiler::Phase phase("write");
+    FileSink sink(filePath);
+    CodeGenerator::writeSource(sink, functions);
+    sink.close();
+}
+
+std::pair<std::string, std::string>
+CodeGenerator::generateSymbolicEqualityFunctions(
+        const SymbolicEqualityConstraints& symbolicConstraints,
+        const OrderedSet& variableOrdering, const OrderedSet& parameterOrdering,
+        const std::string& matrixFunctionName,
+        const std::string& vectorFunctionName,
+        std::vector<UpdateFunction>* matrixUpdates,
+        std::vector<UpdateFunction>* vectorUpdates) {
+    std::vector<GeneratedFunction> functions =
+            CodeGenerator::buildSymbolicEqualityFunctions(
+                    symbolicConstraints, variableOrdering, parameterOrdering,
+                    matrixFunctionName, vectorFunctionName, matrixUpdates,
+                    vectorUpdates);
+    return std::make_pair(CodeGenerator::generateFunctionCode(functions[0]),
+                          CodeGenerator::generateFunctionCode(functions[1]));
+}
+
+std::vector<GeneratedFunction> CodeGenerator::buildSymbolicEqualityFunctions(
+        const SymbolicEqualityConstraints& symbolicConstraints,
+        const OrderedSet& variableOrdering, const OrderedSet& parameterOrdering,
+        const std::string& matrixFunctionName,
+        const std::string& vectorFunctionName,
+        std::vector<UpdateFunction>* matrixUpdates,
+        std::vector<UpdateFunction>* vectorUpdates) {
+    // Get the sparse linear system.
+    std::vector<SymbolicTriplet> entries;
+    std::vector<RCP<const Basic>> constants;
+    std::tie(entries, constants) =
+            symbolicConstraints.convertToSparseLinearSystem(variableOrdering);
+
+    // The matrix and vector only depend on the parameters
+    MapBasicString parameterRepr = CodeGenerator::arrayRepresentation(
+            symbolicConstraints.getParameters(), parameterOrdering, "param");
+
+    //============= Equality Matrix ===========
+    size_t rows = symbolicConstraints.numConstraints();
+    GeneratedFunction matrix;
+    matrix.name = matrixFunctionName;
+    matrix.inputs = {"param"};
+    matrix.zeroed = rows * variableOrdering.size();
+    matrix.assignments = CodeGenerator::sparseAssignments(
+            rows, variableOrdering.size(), entries, MapBasicString(),
+            parameterRepr);
 
     //============= Equality Vector ===========
-    std::stringstream ssVec;
+    GeneratedFunction vector = CodeGenerator::buildParameterVectorFunction(
+            constants, parameterRepr, vectorFunctionName);
+
+    //============= Update Functions ===========
+    if (matrixUpdates != nullptr) {
+        *matrixUpdates = CodeGenerator::generateUpdateFunctions(
+                rows, entries, parameterOrdering, matrixFunctionName);
+    }
+    if (vectorUpdates != nullptr) {
+        std::vector<SymbolicTriplet> vectorEntries;
+        for (size_t i = 0; i < constants.size(); i++) {
+            vectorEntries.push_back({i, 0, constants[i]});
+        }
+        *vectorUpdates = CodeGenerator::generateUpdateFunctions(
+                constants.size(), vectorEntries, parameterOrdering,
+                vectorFunctionName);
+    }
 
-    // Function signature
-    ssVec << "void " << vectorFunctionName
-          << "(const double* param, double* out) {" << std::endl;
+    return {matrix, vector};
+}
 
-    // The actual matrix construction code
-    ssVec << CodeGenerator::generateDenseMatrixCode(vec, variableRepr,
-                                                    parameterRepr, "out");
+std::vector<CodeGenerator::UpdateFunction>
+CodeGenerator::generateUpdateFunctions(
+        size_t rows, const std::vector<SymbolicTriplet>& entries,
+        const OrderedSet& parameterOrdering,
+        const std::string& functionName) {
+    // Sum duplicate entries first, so an element is only in one group even if
+    // its terms depend on different parameters.
+    std::map<std::pair<size_t, size_t>, RCP<const Basic>> summed;
+    for (const SymbolicTriplet& entry : entries) {
+        auto key = std::make_pair(entry.row, entry.col);
+        auto it = summed.find(key);
+        if (it == summed.end()) {
+            summed.emplace(key, entry.value);
+        } else {
+            it->second = SymEngine::add(it->second, entry.value);
+        }
+    }
 
-    ssVec << "}" << std::endl;
+    // Group the entries by the sorted indices of their parameters
+    std::map<std::vector<int>, std::vector<SymbolicTriplet>> groups;
+    for (const auto& element : summed) {
+        std::vector<int> parameters;
+        for (const RCP<const Symbol>& parameter :
+             cppmpc::getParameters(element.second)) {
+            if (!parameterOrdering.contains(parameter)) {
+                throw std::runtime_error(
+                        "Not all parameters have a representation");
+            }
+            parameters.push_back(
+                    static_cast<int>(parameterOrdering.indexOf(parameter)));
+        }
+        if (parameters.empty()) {
+            continue;
+        }
+        std::sort(parameters.begin(), parameters.end());
+        groups[parameters].push_back(
+                {element.first.first, element.first.second, element.second});
+    }
 
-    return std::make_pair(ssMat.str(), ssVec.str());
+    std::vector<UpdateFunction> updates;
+    for (const auto& group : groups) {
+        UnorderedSetSymbol groupParameters;
+        for (int index : group.first) {
+            groupParameters.insert(parameterOrdering.at(index));
+        }
+        MapBasicString parameterRepr = CodeGenerator::arrayRepresentation(
+                groupParameters, parameterOrdering, "param");
+
+        // Only the entries of the group are assigned
+        GeneratedFunction function;
+        function.name = functionName + CompiledModule::updateSuffix +
+                        std::to_string(updates.size());
+        function.inputs = {"param"};
+        function.assignments = CodeGenerator::sparseAssignments(
+                rows, 0, group.second, MapBasicString(), parameterRepr);
+        updates.push_back({group.first, function});
+    }
+    return updates;
 }
 
 std::tuple<std::string, std::string, std::string>
@@ -226,6 +947,54 @@ CodeGenerator::generateSymbolicInequalityFunctions(
         const std::string& valueFunctionName,
         const std::string& gradientFunctionName,
         const std::string& hessianFunctionName) {
+    SparsityPattern gradientPattern;
+    SparsityPattern hessianPattern;
+    SymEngine::DenseMatrix barrierGradientMat =
+            symbolicConstraints.symbolicBarrierGradient(variableOrdering,
+                                                        gradientPattern);
+    SymEngine::DenseMatrix barrierHessianMat =
+            symbolicConstraints.symbolicBarrierHessian(variableOrdering,
+                                                       hessianPattern);
+
+    return CodeGenerator::generateSymbolicInequalityFunctions(
+            symbolicConstraints, barrierGradientMat, barrierHessianMat,
+            variableOrdering, parameterOrdering, valueFunctionName,
+            gradientFunctionName, hessianFunctionName, &gradientPattern,
+            &hessianPattern);
+}
+
+std::tuple<std::string, std::string, std::string>
+CodeGenerator::generateSymbolicInequalityFunctions(
+        const SymbolicInequalityConstraints& symbolicConstraints,
+        const SymEngine::DenseMatrix& barrierGradientMat,
+        const SymEngine::DenseMatrix& barrierHessianMat,
+        const OrderedSet& variableOrdering, const OrderedSet& parameterOrdering,
+        const std::string& valueFunctionName,
+        const std::string& gradientFunctionName,
+        const std::string& hessianFunctionName,
+        const SparsityPattern* gradientPattern,
+        const SparsityPattern* hessianPattern) {
+    std::vector<GeneratedFunction> functions =
+            CodeGenerator::buildSymbolicInequalityFunctions(
+                    symbolicConstraints, barrierGradientMat, barrierHessianMat,
+                    variableOrdering, parameterOrdering, valueFunctionName,
+                    gradientFunctionName, hessianFunctionName, gradientPattern,
+                    hessianPattern);
+    return std::make_tuple(CodeGenerator::generateFunctionCode(functions[0]),
+                           CodeGenerator::generateFunctionCode(functions[1]),
+                           CodeGenerator::generateFunctionCode(functions[2]));
+}
+
+std::vector<GeneratedFunction> CodeGenerator::buildSymbolicInequalityFunctions(
+        const SymbolicInequalityConstraints& symbolicConstraints,
+        const SymEngine::DenseMatrix& barrierGradientMat,
+        const SymEngine::DenseMatrix& barrierHessianMat,
+        const OrderedSet& variableOrdering, const OrderedSet& parameterOrdering,
+        const std::string& valueFunctionName,
+        const std::string& gradientFunctionName,
+        const std::string& hessianFunctionName,
+        const SparsityPattern* gradientPattern,
+        const SparsityPattern* hessianPattern) {
     // Get all parameters and variables
     UnorderedSetSymbol parameters = symbolicConstraints.getParameters();
     UnorderedSetSymbol variables = symbolicConstraints.getVariables();
@@ -259,88 +1028,437 @@ CodeGenerator::generateSymbolicInequalityFunctions(
     SymEngine::DenseMatrix barrierValueMat(1, 1);
     barrierValueMat.set(0, 0, barrierValue);
 
-    SymEngine::DenseMatrix barrierGradientMat =
-            symbolicConstraints.symbolicBarrierGradient(variableOrdering);
+    return {CodeGenerator::buildMatrixFunction(valueFunctionName,
+                                               barrierValueMat, variableRepr,
+                                               parameterRepr),
+            CodeGenerator::buildMatrixFunction(
+                    gradientFunctionName, barrierGradientMat, variableRepr,
+                    parameterRepr, gradientPattern),
+            CodeGenerator::buildMatrixFunction(
+                    hessianFunctionName, barrierHessianMat, variableRepr,
+                    parameterRepr, hessianPattern)};
+}
 
-    SymEngine::DenseMatrix barrierHessianMat =
-            symbolicConstraints.symbolicBarrierHessian(variableOrdering);
+std::tuple<std::string, std::string, std::string>
+CodeGenerator::generateStructuredInequalityFunctions(
+        const SymbolicInequalityConstraints& symbolicConstraints,
+        const OrderedSet& variableOrdering, const OrderedSet& parameterOrdering,
+        const std::string& vectorFunctionName,
+        const std::string& jacobianFunctionName,
+        const std::string& hessianFunctionName) {
+    std::vector<GeneratedFunction> functions =
+            CodeGenerator::buildStructuredInequalityFunctions(
+                    symbolicConstraints, variableOrdering, parameterOrdering,
+                    vectorFunctionName, jacobianFunctionName,
+                    hessianFunctionName);
+    return std::make_tuple(CodeGenerator::generateFunctionCode(functions[0]),
+                           CodeGenerator::generateFunctionCode(functions[1]),
+                           CodeGenerator::generateFunctionCode(functions[2]));
+}
 
-    //============= Value Function ===========
-    std::stringstream ssValue;
+std::vector<GeneratedFunction>
+CodeGenerator::buildStructuredInequalityFunctions(
+        const SymbolicInequalityConstraints& symbolicConstraints,
+        const OrderedSet& variableOrdering, const OrderedSet& parameterOrdering,
+        const std::string& vectorFunctionName,
+        const std::string& jacobianFunctionName,
+        const std::string& hessianFunctionName) {
+    // Create the representations for the parameters and variables
+    MapBasicString parameterRepr = CodeGenerator::arrayRepresentation(
+            symbolicConstraints.getParameters(), parameterOrdering, "param");
+    MapBasicString variableRepr = CodeGenerator::arrayRepresentation(
+            symbolicConstraints.getVariables(), variableOrdering, "state");
+
+    size_t numConstraints = symbolicConstraints.numConstraints();
+    size_t numVariables = variableOrdering.size();
+
+    //============= Constraint Vector Function ===========
+    GeneratedFunction vector = CodeGenerator::buildMatrixFunction(
+            vectorFunctionName, symbolicConstraints.symbolicConstraintVector(),
+            variableRepr, parameterRepr);
+
+    //============= Constraint Jacobian Function ===========
+    GeneratedFunction jacobian;
+    jacobian.name = jacobianFunctionName;
+    jacobian.inputs = {"state", "param"};
+    jacobian.zeroed = numConstraints * numVariables;
+    jacobian.assignments = CodeGenerator::sparseAssignments(
+            numConstraints, numVariables,
+            symbolicConstraints.symbolicConstraintJacobian(variableOrdering),
+            variableRepr, parameterRepr);
+
+    //============= Weighted Constraint Hessian Function ===========
+    // Each constraint hessian is scaled by its weight, and the duplicate
+    // entries are summed by the sparse matrix generation.
+    std::vector<std::vector<SymbolicTriplet>> hessians =
+            symbolicConstraints.symbolicConstraintHessians(variableOrdering);
+    std::vector<SymbolicTriplet> weightedEntries;
+    for (size_t i = 0; i < hessians.size(); i++) {
+        RCP<const Symbol> weight =
+                SymEngine::symbol("weight[" + std::to_string(i) + "]");
+        for (const SymbolicTriplet& entry : hessians[i]) {
+            RCP<const Basic> weighted = SymEngine::mul(weight, entry.value);
+            weightedEntries.push_back({entry.row, entry.col, weighted});
+        }
+    }
 
-    // Function signature
-    ssValue << "void " << valueFunctionName
-            << "(const double* state, const double* param, double* out) {"
-            << std::endl;
+    GeneratedFunction hessian;
+    hessian.name = hessianFunctionName;
+    hessian.inputs = {"state", "param", "weight"};
+    hessian.zeroed = numVariables * numVariables;
+    hessian.assignments = CodeGenerator::sparseAssignments(
+            numVariables, numVariables, weightedEntries, variableRepr,
+            parameterRepr);
 
-    // The actual matrix construction code
-    ssValue << CodeGenerator::generateDenseMatrixCode(
-            barrierValueMat, variableRepr, parameterRepr, "out");
+    return {vector, jacobian, hessian};
+}
 
-    ssValue << "}" << std::endl;
+GeneratedFunction CodeGenerator::buildParameterVectorFunction(
+        const std::vector<RCP<const Basic>>& values,
+        const MapBasicString& parameterRepr, const std::string& functionName) {
+    std::vector<SymbolicTriplet> entries;
+    for (size_t i = 0; i < values.size(); i++) {
+        entries.push_back({i, 0, values[i]});
+    }
 
-    //============= Gradient Function ===========
-    std::stringstream ssGrad;
+    GeneratedFunction function;
+    function.name = functionName;
+    function.inputs = {"param"};
+    function.zeroed = values.size();
+    function.assignments = CodeGenerator::sparseAssignments(
+            values.size(), 1, entries, MapBasicString(), parameterRepr);
+    return function;
+}
 
-    // Function signature
-    ssGrad << "void " << gradientFunctionName
-           << "(const double* state, const double* param, double* out) {"
-           << std::endl;
+std::tuple<std::string, std::string, std::string, std::string>
+CodeGenerator::generateLinearInequalityFunctions(
+        const ClassifiedInequalityConstraints& classified,
+        const OrderedSet& variableOrdering, const OrderedSet& parameterOrdering,
+        const std::string& matrixFunctionName,
+        const std::string& vectorFunctionName,
+        const std::string& lowerFunctionName,
+        const std::string& upperFunctionName) {
+    std::vector<GeneratedFunction> functions =
+            CodeGenerator::buildLinearInequalityFunctions(
+                    classified, variableOrdering, parameterOrdering,
+                    matrixFunctionName, vectorFunctionName, lowerFunctionName,
+                    upperFunctionName);
+    return std::make_tuple(CodeGenerator::generateFunctionCode(functions[0]),
+                           CodeGenerator::generateFunctionCode(functions[1]),
+                           CodeGenerator::generateFunctionCode(functions[2]),
+                           CodeGenerator::generateFunctionCode(functions[3]));
+}
 
-    // The actual matrix construction code
-    ssGrad << CodeGenerator::generateDenseMatrixCode(
-            barrierGradientMat, variableRepr, parameterRepr, "out");
+std::vector<GeneratedFunction> CodeGenerator::buildLinearInequalityFunctions(
+        const ClassifiedInequalityConstraints& classified,
+        const OrderedSet& variableOrdering, const OrderedSet& parameterOrdering,
+        const std::string& matrixFunctionName,
+        const std::string& vectorFunctionName,
+        const std::string& lowerFunctionName,
+        const std::string& upperFunctionName) {
+    // Everything in G, h, and the bounds only depends on the parameters
+    UnorderedSetSymbol parameters;
+    for (const SymbolicTriplet& entry : classified.linearMatrix) {
+        util_union(parameters, getParameters(entry.value));
+    }
+    for (const std::vector<RCP<const Basic>>* values :
+         {&classified.linearVector, &classified.lowerBounds,
+          &classified.upperBounds}) {
+        for (const RCP<const Basic>& value : *values) {
+            util_union(parameters, getParameters(value));
+        }
+    }
+    MapBasicString parameterRepr = CodeGenerator::arrayRepresentation(
+            parameters, parameterOrdering, "param");
+
+    //============= Linear Inequality Matrix ===========
+    size_t rows = classified.numLinearConstraints();
+    GeneratedFunction matrix;
+    matrix.name = matrixFunctionName;
+    matrix.inputs = {"param"};
+    matrix.zeroed = rows * variableOrdering.size();
+    matrix.assignments = CodeGenerator::sparseAssignments(
+            rows, variableOrdering.size(), classified.linearMatrix,
+            MapBasicString(), parameterRepr);
+
+    return {matrix,
+            CodeGenerator::buildParameterVectorFunction(
+                    classified.linearVector, parameterRepr, vectorFunctionName),
+            CodeGenerator::buildParameterVectorFunction(
+                    classified.lowerBounds, parameterRepr, lowerFunctionName),
+            CodeGenerator::buildParameterVectorFunction(
+                    classified.upperBounds, parameterRepr, upperFunctionName)};
+}
 
-    ssGrad << "}" << std::endl;
+void CodeGenerator::writeLinkageOpen(CodeSink& sink) {
+    sink << "#ifdef __cplusplus\n";
+    sink << "extern \"C\" {\n";
+    sink << "#endif\n\n";
+}
 
-    //============= Hessian Function ===========
-    std::stringstream ssHess;
+void CodeGenerator::writeLinkageClose(CodeSink& sink) {
+    sink << "#ifdef __cplusplus\n";
+    sink << "}\n";
+    sink << "#endif\n";
+}
 
-    // Function signature
-    ssHess << "void " << hessianFunctionName
-           << "(const double* state, const double* param, double* out) {"
-           << std::endl;
+std::string CodeGenerator::generateSource(
+        const std::vector<std::string>& functionStrings) {
+    StringSink sink;
+    CodeGenerator::writeSource(sink, functionStrings);
+    return sink.take();
+}
 
-    // The actual matrix construction code
-    ssHess << CodeGenerator::generateDenseMatrixCode(
-            barrierHessianMat, variableRepr, parameterRepr, "out");
+void CodeGenerator::writeSource(
+        CodeSink& sink, const std::vector<std::string>& functionStrings) {
+    sink << "#include \"math.h\"\n";
 
-    ssHess << "}" << std::endl;
+    // The helpers are found in each function, without joining them
+    sink << ExpressionEmitter::prelude(functionStrings);
+    sink << VectorMathKernels::prelude(functionStrings);
 
-    return std::make_tuple(ssValue.str(), ssGrad.str(), ssHess.str());
+    CodeGenerator::writeLinkageOpen(sink);
+    for (const std::string& str : functionStrings) {
+        sink << str << "\n\n";
+    }
+    CodeGenerator::writeLinkageClose(sink);
 }
 
-void CodeGenerator::writeFunctionsToFile(
-        const std::string& filePath,
-        const std::vector<std::string>& functionStrings) {
-    std::stringstream ss;
+std::string CodeGenerator::generateSource(
+        const std::vector<GeneratedFunction>& functions) {
+    StringSink sink;
+    CodeGenerator::writeSource(sink, functions);
+    return sink.take();
+}
+
+void CodeGenerator::writeSource(
+        CodeSink& sink, const std::vector<GeneratedFunction>& functions) {
+    sink << "#include \"math.h\"\n";
+
+    // The code isn't known before it is written, so every helper is defined.
+    // Only the functions printed verbatim are searched for vector kernels.
+    std::vector<std::string> verbatim;
+    std::set<std::string> kernels;
+    for (const GeneratedFunction& function : functions) {
+        if (!function.code.empty()) {
+            verbatim.push_back(function.code);
+        }
+        for (const GatheredCalls& calls : function.gathered) {
+            kernels.insert(VectorMathKernels::kernelName(calls.function,
+                                                         calls.accuracy));
+        }
+    }
+    sink << ExpressionEmitter::helpers();
+    sink << VectorMathKernels::prelude(verbatim, kernels);
+
+    CodeGenerator::writeLinkageOpen(sink);
+    for (const GeneratedFunction& function : functions) {
+        CodeGenerator::writeFunctionCode(sink, function);
+        sink << "\n\n";
+    }
+    CodeGenerator::writeLinkageClose(sink);
+}
 
-    ss << "#include \"math.h\"" << std::endl;
+GeneratedFunction CodeGenerator::vectorizeMathCalls(
+        const GeneratedFunction& function, VectorMath accuracy) {
+    if (accuracy == VectorMath::Off || !function.code.empty() ||
+        function.batched || !function.gathered.empty()) {
+        return function;
+    }
+
+    // The distinct calls of each function
+    std::map<std::string, BasicSet> distinct;
+    BasicSet visited;
+    // Pushed in reverse, so the calls are found in the order of the entries
+    std::vector<RCP<const Basic>> stack;
+    for (auto it = function.assignments.rbegin();
+         it != function.assignments.rend(); ++it) {
+        stack.push_back(it->second);
+    }
+    while (!stack.empty()) {
+        RCP<const Basic> basic = stack.back();
+        stack.pop_back();
+        if (!visited.insert(basic).second) {
+            continue;
+        }
+        std::string name;
+        SymEngine::vec_basic callArguments;
+        if (kernelCall(basic, &name, &callArguments)) {
+            distinct[name].insert(basic);
+        }
+        SymEngine::vec_basic args = basic->get_args();
+        stack.insert(stack.end(), args.rbegin(), args.rend());
+    }
+    std::set<std::string> vectorFunctions;
+    for (const auto& entry : distinct) {
+        if (entry.second.size() >= CodeGenerator::minimumVectorCalls) {
+            vectorFunctions.insert(entry.first);
+        }
+    }
+    if (vectorFunctions.empty()) {
+        return function;
+    }
 
-    ss << "#ifdef __cplusplus" << std::endl;
-    ss << "extern \"C\" {" << std::endl;
-    ss << "#endif" << std::endl << std::endl;
+    // Each level evaluates the calls whose arguments have no calls left, and
+    // replaces them with the elements of the results.
+    GeneratedFunction vectorized = function;
+    BasicFlags calls;
+    for (size_t level = 0;; level++) {
+        std::map<std::string, GatheredCalls> gathered;
+        std::map<std::string, BasicIndices> indices;
+        SymEngine::map_basic_basic replacements;
+        visited.clear();
+        for (auto it = vectorized.assignments.rbegin();
+             it != vectorized.assignments.rend(); ++it) {
+            stack.push_back(it->second);
+        }
+        while (!stack.empty()) {
+            RCP<const Basic> basic = stack.back();
+            stack.pop_back();
+            if (!visited.insert(basic).second) {
+                continue;
+            }
+            std::string name;
+            SymEngine::vec_basic callArguments;
+            bool ready = kernelCall(basic, &name, &callArguments) &&
+                         vectorFunctions.count(name) > 0;
+            for (const RCP<const Basic>& argument : callArguments) {
+                ready = ready &&
+                        !callsKernel(argument, vectorFunctions, &calls);
+            }
+            if (ready) {
+                GatheredCalls& entry = gathered[name];
+                if (entry.array.empty()) {
+                    entry.function = name;
+                    entry.accuracy = accuracy;
+                    entry.array = "cppmpc_" + name + std::to_string(level);
+                }
+                auto found = indices[name].find(basic);
+                size_t index = entry.arguments.size();
+                if (found == indices[name].end()) {
+                    indices[name].emplace(basic, index);
+                    entry.arguments.push_back(callArguments[0]);
+                    if (callArguments.size() > 1) {
+                        entry.exponents.push_back(callArguments[1]);
+                    }
+                } else {
+                    index = found->second;
+                }
+                replacements[basic] = SymEngine::symbol(
+                        entry.array + "[" + std::to_string(index) + "]");
+                continue;
+            }
+            SymEngine::vec_basic args = basic->get_args();
+            stack.insert(stack.end(), args.rbegin(), args.rend());
+        }
+        if (replacements.empty()) {
+            break;
+        }
 
-    for (std::string str : functionStrings) {
-        ss << str << std::endl << std::endl;
+        for (auto& assignment : vectorized.assignments) {
+            assignment.second =
+                    SymEngine::xreplace(assignment.second, replacements);
+        }
+        for (const std::string& name : VectorMathKernels::functions()) {
+            if (gathered.count(name) > 0) {
+                vectorized.gathered.push_back(gathered[name]);
+            }
+        }
     }
+    return vectorized;
+}
 
-    ss << "#ifdef __cplusplus" << std::endl;
-    ss << "}" << std::endl;
-    ss << "#endif" << std::endl;
+std::vector<std::vector<GeneratedFunction>>
+CodeGenerator::generateTranslationUnits(
+        const std::vector<GeneratedFunction>& functions,
+        size_t maxChunkAssignments, VectorMath vectorMath,
+        bool separateFunctions) {
+    // The calls of a split function are gathered by each of its chunks
+    auto vectorized = [vectorMath](const GeneratedFunction& function) {
+        return CodeGenerator::vectorizeMathCalls(function, vectorMath);
+    };
+
+    std::vector<std::vector<GeneratedFunction>> units(1);
+    for (const GeneratedFunction& function : functions) {
+        if (maxChunkAssignments == 0 || !function.code.empty() ||
+            function.batched ||
+            function.assignments.size() <= maxChunkAssignments) {
+            if (separateFunctions) {
+                units.push_back({vectorized(function)});
+            } else {
+                units[0].push_back(vectorized(function));
+            }
+            continue;
+        }
 
-#ifdef DEBUG
-    DEBUG_PRINT("Writing temp file: " << filePath);
+        // The chunks take the same inputs, and are called with them. Only
+        // the library itself calls them, so they aren't exported.
+        GeneratedFunction caller = function;
+        caller.assignments.clear();
+        for (size_t start = 0; start < function.assignments.size();
+             start += maxChunkAssignments) {
+            size_t end = std::min(start + maxChunkAssignments,
+                                  function.assignments.size());
+            GeneratedFunction chunk;
+            chunk.name = function.name + "_chunk" +
+                         std::to_string(caller.chunks);
+            chunk.inputs = function.inputs;
+            chunk.hidden = true;
+            chunk.assignments.assign(function.assignments.begin() + start,
+                                     function.assignments.begin() + end);
+            units.push_back({vectorized(chunk)});
+            caller.chunks += 1;
+        }
+        units[0].push_back(caller);
+    }
+    return units;
+}
 
-    for (std::string line; std::getline(ss, line);) {
-        DEBUG_PRINT(line);
+std::map<std::string, OperationCount> CodeGenerator::operationReport(
+        const std::vector<GeneratedFunction>& functions) {
+    std::map<std::string, OperationCount> report;
+    for (const GeneratedFunction& function : functions) {
+        if (!function.code.empty()) {
+            continue;
+        }
+        OperationCount& count = report[function.name];
+        for (const GatheredCalls& calls : function.gathered) {
+            for (const RCP<const Basic>& argument : calls.arguments) {
+                count += ExpressionEmitter::operations(argument);
+            }
+            for (const RCP<const Basic>& exponent : calls.exponents) {
+                count += ExpressionEmitter::operations(exponent);
+            }
+        }
+        for (const auto& assignment : function.assignments) {
+            count += ExpressionEmitter::operations(assignment.second);
+        }
     }
-#endif
+    return report;
+}
 
-    std::ofstream file;
-    file.open(filePath);
-    file << ss.str();
-    file.close();
+std::map<std::string, size_t> CodeGenerator::sourceSizes(
+        const std::vector<GeneratedFunction>& functions) {
+    std::map<std::string, size_t> sizes;
+    for (const GeneratedFunction& function : functions) {
+        if (!function.code.empty()) {
+            continue;
+        }
+        CountingSink sink;
+        CodeGenerator::writeFunctionCode(sink, function);
+        sizes[function.name] += sink.count;
+    }
+    return sizes;
+}
+
+void CodeGenerator::writeFunctionsToFile(
+        const std::string& filePath,
+        const std::vector<std::string>& functionStrings) {
+    FinalizeProfiler::Phase phase("write");
+    // Streamed, so the functions aren't copied into one source first
+    FileSink sink(filePath);
+    CodeGenerator::writeSource(sink, functionStrings);
+    sink.close();
 }
 
 }  // namespace cppmpc
@@ -5,22 +5,270 @@
 #include <symengine/basic.h>
 #include "symengine/matrix.h"
 
+#include <cstdint>
 #include <exception>
+#include <map>
 #include <string>
 #include <tuple>
+#include <utility>
 #include <vector>
+#include "CodeSink.h"
+#include "ExpressionEmitter.h"
 #include "OrderedSet.h"
+#include "SparsityPattern.h"
+#include "SymEngineUtilities.h"
 #include "SymbolicEquality.h"
 #include "SymbolicInequality.h"
 #include "Util.h"
+#include "VectorMath.h"
 
 namespace cppmpc {
 
 using SymEngine::Basic;
 using SymEngine::RCP;
 
+/**
+ * struct GatheredCalls - The calls of one math function that a generated
+ * function evaluates at once with a vector math kernel.
+ *
+ * The arguments are assigned to `<array>_in`, the kernel writes the results
+ * to `<array>`, and the calls are replaced by the symbols `<array>[i]`. The
+ * exponents of pow are assigned to `<array>_exponent`.
+ */
+typedef struct GatheredCalls {
+    // The math.h function, e.g. log.
+    std::string function;
+    VectorMath accuracy = VectorMath::Off;
+    std::string array;
+    std::vector<RCP<const Basic>> arguments;
+    // The exponent of each call, for pow only.
+    std::vector<RCP<const Basic>> exponents;
+} GatheredCalls;
+
+/**
+ * struct GeneratedFunction - A generated function before it is printed.
+ *
+ * The function is `void name(const double* input..., double* out)`, which sets
+ * the first zeroed elements of out to zero and then assigns each entry. The
+ * functions of an objective are kept in this form, so they are printed
+ * straight to a sink, and never parsed back from their text.
+ */
+typedef struct GeneratedFunction {
+    std::string name;
+    // The arrays the function reads, in the order of its parameters, e.g.
+    // state and param.
+    std::vector<std::string> inputs;
+    // The number of elements of out set to zero before the assignments.
+    size_t zeroed = 0;
+    // The index in out and the value of each entry, with the symbols
+    // replaced by their representations.
+    std::vector<std::pair<size_t, RCP<const Basic>>> assignments;
+    // The text of a function that wasn't generated from assignments, which
+    // is printed as it is instead.
+    std::string code;
+    // Whether this is the batched variant of the function, see
+    // CodeGenerator::batchFunction.
+    bool batched = false;
+    // Whether only the library itself calls the function, so it isn't
+    // exported.
+    bool hidden = false;
+    // The number of `<name>_chunk<i>` functions with the same inputs that
+    // assign the entries, which are called in order after zeroing, or 0 if
+    // the function assigns them itself.
+    size_t chunks = 0;
+    // The calls evaluated with vector math kernels before anything else,
+    // in order, see CodeGenerator::vectorizeMathCalls.
+    std::vector<GatheredCalls> gathered;
+} GeneratedFunction;
+
 class CodeGenerator {
+ private:
+    /**
+     * @brief Throw if a variable or parameter in the basic does not have a
+     * representation.
+     */
+    static void checkRepresentations(const RCP<const Basic>& basic,
+                                     const MapBasicString& variableRepr,
+                                     const MapBasicString& parameterRepr);
+
+    /**
+     * @brief The map from each variable and parameter to the symbol printed in
+     * its place.
+     */
+    static SymEngine::map_basic_basic representationMap(
+            const MapBasicString& variableRepr,
+            const MapBasicString& parameterRepr);
+
+    /**
+     * @brief Represent each symbol as an element of the given array, indexed
+     * by its position in the ordering.
+     */
+    static MapBasicString arrayRepresentation(const UnorderedSetSymbol& symbols,
+                                              const OrderedSet& ordering,
+                                              const std::string& arrayName);
+
+    /**
+     * @brief The assignments of a column major matrix, where entries outside
+     * of the pattern are known to be zero.
+     */
+    static std::vector<std::pair<size_t, RCP<const Basic>>> denseAssignments(
+            const SymEngine::DenseMatrix& mat,
+            const MapBasicString& variableRepr,
+            const MapBasicString& parameterRepr,
+            const SparsityPattern* pattern);
+
+    /**
+     * @brief The assignments of the non-zero entries of a column major matrix
+     * with the leading dimension, with duplicate entries summed.
+     *
+     * @param cols The number of columns, which the entries are checked
+     * against, or 0 to not check them.
+     */
+    static std::vector<std::pair<size_t, RCP<const Basic>>> sparseAssignments(
+            size_t leadingDimension, size_t cols,
+            const std::vector<SymbolicTriplet>& entries,
+            const MapBasicString& variableRepr,
+            const MapBasicString& parameterRepr);
+
+    /**
+     * @brief Build a function setting a vector that only depends on the
+     * parameters.
+     */
+    static GeneratedFunction buildParameterVectorFunction(
+            const std::vector<RCP<const Basic>>& values,
+            const MapBasicString& parameterRepr,
+            const std::string& functionName);
+
+    /**
+     * struct ArrayReference - A printed symbol of the form `array[index]`.
+     */
+    typedef struct ArrayReference {
+        std::string array;
+        int64_t index;
+    } ArrayReference;
+
+    /**
+     * @brief Parse a symbol name of the form `array[index]`, returning false
+     * if the name has any other form.
+     */
+    static bool parseArrayReference(const std::string& name,
+                                    ArrayReference* reference);
+
+    /**
+     * @brief Print `start + stride * i`, the index of an element in a rolled
+     * loop.
+     */
+    static std::string affineIndex(int64_t start, int64_t stride);
+
+    /**
+     * @brief The fewest calls of a function that are worth evaluating with a
+     * vector math kernel.
+     */
+    static const size_t minimumVectorCalls = 4;
+
+    /**
+     * @brief The representations of the variables and parameters of an
+     * objective, as elements of the state and param arrays.
+     */
+    static void objectiveRepresentations(
+            const RCP<const Basic>& symbolicObjective,
+            const OrderedSet& variableOrdering,
+            const OrderedSet& parameterOrdering, MapBasicString* variableRepr,
+            MapBasicString* parameterRepr);
+
+    /**
+     * @brief Build a `void name(const double* state, const double* param,
+     * double* out)` function that sets out to the matrix.
+     */
+    static GeneratedFunction buildMatrixFunction(
+            const std::string& functionName, const SymEngine::DenseMatrix& mat,
+            const MapBasicString& variableRepr,
+            const MapBasicString& parameterRepr,
+            const SparsityPattern* pattern = nullptr);
+
+    /**
+     * @brief Write the declaration of a generated function, without the
+     * body or the semicolon.
+     */
+    static void writeFunctionSignature(CodeSink& sink,
+                                       const GeneratedFunction& function);
+
+    /**
+     * @brief Write the start and end of the C linkage block of a source.
+     */
+    static void writeLinkageOpen(CodeSink& sink);
+    static void writeLinkageClose(CodeSink& sink);
+
  public:
+    /**
+     * struct UpdateFunction - A generated function that reassigns only the
+     * entries of a parameter-only output that depend on exactly a set of
+     * parameters, leaving every other element as it was.
+     */
+    typedef struct UpdateFunction {
+        // The indices of the parameters in the parameter ordering.
+        std::vector<int> parameters;
+        GeneratedFunction function;
+    } UpdateFunction;
+
+    /**
+     * @brief A function that is printed as the given text, such as one that
+     * isn't generated from assignments.
+     */
+    static GeneratedFunction verbatimFunction(
+            const std::string& functionString);
+
+    /**
+     * @brief Write the code of a generated function to a sink, one entry or
+     * loop at a time.
+     */
+    static void writeFunctionCode(CodeSink& sink,
+                                  const GeneratedFunction& function);
+
+    /**
+     * @brief The code of a generated function.
+     */
+    static std::string generateFunctionCode(const GeneratedFunction& function);
+
+    /**
+     * @brief The shortest run of entries with the same structure that is
+     * rolled into a loop instead of being assigned one at a time.
+     */
+    static const size_t minimumLoopLength = 4;
+
+    /**
+     * @brief Generate the assignments `matrixName[offset + index] = value;`,
+     * rolling entries with a repeated structure into loops.
+     *
+     * Each value is canonicalized by replacing the array elements it reads,
+     * e.g. `state[7]`, with placeholders. Entries with the same canonical
+     * form are grouped, and a run of at least minimumLoopLength entries in a
+     * group whose output index and array indices all change by a constant
+     * stride are emitted as a single `for` loop.
+     *
+     * @param assignments The index and value of each entry. The values must
+     * already have their symbols replaced by their representations.
+     * @param matrixName The name of the matrix variable in the generated code.
+     * @param offset A C expression added to every index, or empty.
+     */
+    static std::string generateAssignmentCode(
+            const std::vector<std::pair<size_t, RCP<const Basic>>>& assignments,
+            const std::string& matrixName, const std::string& offset = "");
+
+    /**
+     * @brief Write the assignments of generateAssignmentCode to a sink, one
+     * entry or loop at a time.
+     *
+     * @param batched Whether every element is indexed in the structure of
+     * arrays layout of batchFunction, with each entry in a loop over the
+     * points.
+     */
+    static void writeAssignmentCode(
+            CodeSink& sink,
+            const std::vector<std::pair<size_t, RCP<const Basic>>>& assignments,
+            const std::string& matrixName, const std::string& offset = "",
+            bool batched = false);
+
     /**
      * @brief Generate C code that constructs an eigen matrix equivalent to the
      * passed symbolic matrix, using the given strings as representations for
@@ -32,12 +280,98 @@ class CodeGenerator {
      * @param variableRepr A map of variables to symbols.
      * @param parameterRepr A map of parameters to symbols.
      * @param matrixName The name of the matrix variable in the generated code.
+     * @param pattern If given, entries outside of the pattern are known to be
+     * zero and are set without being inspected.
      */
     static std::string generateDenseMatrixCode(
             const SymEngine::DenseMatrix& mat,
             const MapBasicString& variableRepr,
+            const MapBasicString& parameterRepr, const std::string& matrixName,
+            const SparsityPattern* pattern = nullptr);
+
+    /**
+     * @brief Write the code of generateDenseMatrixCode to a sink, one entry
+     * at a time.
+     */
+    static void writeDenseMatrixCode(CodeSink& sink,
+                                     const SymEngine::DenseMatrix& mat,
+                                     const MapBasicString& variableRepr,
+                                     const MapBasicString& parameterRepr,
+                                     const std::string& matrixName,
+                                     const SparsityPattern* pattern = nullptr);
+
+    /**
+     * @brief Generate C code that sets a dense, column major matrix from only
+     * its non-zero entries. Every other element is set to zero, and duplicate
+     * entries are summed.
+     *
+     * @param rows The number of rows in the matrix.
+     * @param cols The number of columns in the matrix.
+     * @param entries The non-zero entries.
+     * @param variableRepr A map of variables to symbols.
+     * @param parameterRepr A map of parameters to symbols.
+     * @param matrixName The name of the matrix variable in the generated code.
+     */
+    static std::string generateSparseMatrixCode(
+            size_t rows, size_t cols,
+            const std::vector<SymbolicTriplet>& entries,
+            const MapBasicString& variableRepr,
             const MapBasicString& parameterRepr, const std::string& matrixName);
 
+    /**
+     * @brief Write the code of generateSparseMatrixCode to a sink, one entry
+     * at a time.
+     */
+    static void writeSparseMatrixCode(
+            CodeSink& sink, size_t rows, size_t cols,
+            const std::vector<SymbolicTriplet>& entries,
+            const MapBasicString& variableRepr,
+            const MapBasicString& parameterRepr, const std::string& matrixName);
+
+    /**
+     * @brief Generate the C expression for a basic, using the given strings
+     * as representations for the variables and parameters.
+     *
+     * @param basic The basic to generate code for.
+     * @param variableRepr A map of variables to symbols.
+     * @param parameterRepr A map of parameters to symbols.
+     */
+    static std::string generateExpressionCode(
+            const RCP<const Basic>& basic, const MapBasicString& variableRepr,
+            const MapBasicString& parameterRepr);
+
+    /**
+     * @brief Generate C code that assigns the entries of a block of a column
+     * major matrix, where the position of the block is only known at runtime.
+     *
+     * Each entry is assigned to `matrixName[offset + col * leadingDimension +
+     * row]`, where offset is a C expression (e.g. `k * 40`). Duplicate
+     * entries are summed, and nothing else in the matrix is assigned.
+     *
+     * @param entries The non-zero entries of the block.
+     * @param variableRepr A map of variables to symbols.
+     * @param parameterRepr A map of parameters to symbols.
+     * @param matrixName The name of the matrix variable in the generated code.
+     * @param offset The C expression for the index of the block's first
+     * element.
+     * @param leadingDimension The number of rows in the whole matrix.
+     */
+    static std::string generateOffsetMatrixCode(
+            const std::vector<SymbolicTriplet>& entries,
+            const MapBasicString& variableRepr,
+            const MapBasicString& parameterRepr, const std::string& matrixName,
+            const std::string& offset, size_t leadingDimension);
+
+    /**
+     * @brief Write the code of generateOffsetMatrixCode to a sink, one entry
+     * at a time.
+     */
+    static void writeOffsetMatrixCode(
+            CodeSink& sink, const std::vector<SymbolicTriplet>& entries,
+            const MapBasicString& variableRepr,
+            const MapBasicString& parameterRepr, const std::string& matrixName,
+            const std::string& offset, size_t leadingDimension);
+
     /**
      * @brief Generate code that can be compiled and used to calculate the
      * objective value, gradient, and hessian.
@@ -48,6 +382,8 @@ class CodeGenerator {
      * @param valueFunctionName Value function name.
      * @param gradientFunctionName Gradient function name.
      * @param hessianFunctionName Hessian function name.
+     * @param gradientPattern Optional sparsity pattern of the gradient.
+     * @param hessianPattern Optional sparsity pattern of the hessian.
      */
     static std::tuple<std::string, std::string, std::string>
     generateObjectiveFunctions(const RCP<const Basic> symbolicObjective,
@@ -57,7 +393,48 @@ class CodeGenerator {
                                const OrderedSet& parameterOrdering,
                                const std::string& valueFunctionName,
                                const std::string& gradientFunctionName,
-                               const std::string& hessianFunctionName);
+                               const std::string& hessianFunctionName,
+                               const SparsityPattern* gradientPattern = nullptr,
+                               const SparsityPattern* hessianPattern = nullptr);
+
+    /**
+     * @brief Build the value, gradient, and hessian functions of
+     * generateObjectiveFunctions, in that order.
+     */
+    static std::vector<GeneratedFunction> buildObjectiveFunctions(
+            const RCP<const Basic> symbolicObjective,
+            const SymEngine::DenseMatrix& gradientMat,
+            const SymEngine::DenseMatrix& hessianMat,
+            const OrderedSet& variableOrdering,
+            const OrderedSet& parameterOrdering,
+            const std::string& valueFunctionName,
+            const std::string& gradientFunctionName,
+            const std::string& hessianFunctionName,
+            const SparsityPattern* gradientPattern = nullptr,
+            const SparsityPattern* hessianPattern = nullptr);
+
+    /**
+     * @brief Write a complete source file with the objective value, gradient,
+     * and hessian functions of generateObjectiveFunctions.
+     *
+     * Each entry is written through a buffered file sink as soon as it is
+     * printed, so the memory used is bounded by the largest entry instead of
+     * the size of the hessian's code.
+     *
+     * @param filePath The source file to write.
+     */
+    static void writeObjectiveSource(
+            const std::string& filePath,
+            const RCP<const Basic> symbolicObjective,
+            const SymEngine::DenseMatrix& gradientMat,
+            const SymEngine::DenseMatrix& hessianMat,
+            const OrderedSet& variableOrdering,
+            const OrderedSet& parameterOrdering,
+            const std::string& valueFunctionName,
+            const std::string& gradientFunctionName,
+            const std::string& hessianFunctionName,
+            const SparsityPattern* gradientPattern = nullptr,
+            const SparsityPattern* hessianPattern = nullptr);
 
     /**
      * @brief Generate code that can be compiled and used to calculate the
@@ -68,6 +445,10 @@ class CodeGenerator {
      * @param variableOrdering Variable ordering to use.
      * @param parameterOrdering Parameter ordering to use.
      * @param functionName The name of the function to generate.
+     * @param matrixUpdates Optionally set to the update functions of the
+     * matrix, from generateUpdateFunctions.
+     * @param vectorUpdates Optionally set to the update functions of the
+     * vector.
      */
     static std::pair<std::string, std::string>
     generateSymbolicEqualityFunctions(
@@ -75,7 +456,43 @@ class CodeGenerator {
             const OrderedSet& variableOrdering,
             const OrderedSet& parameterOrdering,
             const std::string& matrixFunctionName,
-            const std::string& vectorFunctionName);
+            const std::string& vectorFunctionName,
+            std::vector<UpdateFunction>* matrixUpdates = nullptr,
+            std::vector<UpdateFunction>* vectorUpdates = nullptr);
+
+    /**
+     * @brief Build the matrix and vector functions of
+     * generateSymbolicEqualityFunctions, in that order.
+     */
+    static std::vector<GeneratedFunction> buildSymbolicEqualityFunctions(
+            const SymbolicEqualityConstraints& symbolicConstraints,
+            const OrderedSet& variableOrdering,
+            const OrderedSet& parameterOrdering,
+            const std::string& matrixFunctionName,
+            const std::string& vectorFunctionName,
+            std::vector<UpdateFunction>* matrixUpdates = nullptr,
+            std::vector<UpdateFunction>* vectorUpdates = nullptr);
+
+    /**
+     * @brief Generate the update functions of a column major matrix that only
+     * depends on the parameters.
+     *
+     * The entries are grouped by the parameters they depend on, and each
+     * group gets a function `<name><CompiledModule::updateSuffix><i>` with
+     * the same signature as the function setting the whole matrix. After
+     * some parameters change, only the groups depending on one of them need
+     * to be called. Entries without parameters never change, so they aren't
+     * in any group.
+     *
+     * @param rows The number of rows in the matrix.
+     * @param entries The non-zero entries, where duplicates are summed.
+     * @param parameterOrdering The parameter ordering.
+     * @param functionName The name of the function setting the whole matrix.
+     */
+    static std::vector<UpdateFunction> generateUpdateFunctions(
+            size_t rows, const std::vector<SymbolicTriplet>& entries,
+            const OrderedSet& parameterOrdering,
+            const std::string& functionName);
 
     /**
      * @brief Generate code that can be compiled and used to calculate the
@@ -97,6 +514,230 @@ class CodeGenerator {
             const std::string& gradientFunctionName,
             const std::string& hessianFunctionName);
 
+    /**
+     * @brief Generate the inequality constraint functions from an already
+     * differentiated barrier.
+     *
+     * @param symbolicConstraints The symbolic inequality constraints.
+     * @param barrierGradientMat The gradient of the barrier.
+     * @param barrierHessianMat The hessian of the barrier.
+     * @param variableOrdering Variable orderinng
+     * @param parameterOrdering Parameter ordering
+     * @param valueFunctionName The function name for the value function
+     * @param gradientFunctionName The function name for the gradient function
+     * @param hessianFunctionName The functionn name for the hessian function
+     * @param gradientPattern Optional sparsity pattern of the gradient.
+     * @param hessianPattern Optional sparsity pattern of the hessian.
+     */
+    static std::tuple<std::string, std::string, std::string>
+    generateSymbolicInequalityFunctions(
+            const SymbolicInequalityConstraints& symbolicConstraints,
+            const SymEngine::DenseMatrix& barrierGradientMat,
+            const SymEngine::DenseMatrix& barrierHessianMat,
+            const OrderedSet& variableOrdering,
+            const OrderedSet& parameterOrdering,
+            const std::string& valueFunctionName,
+            const std::string& gradientFunctionName,
+            const std::string& hessianFunctionName,
+            const SparsityPattern* gradientPattern = nullptr,
+            const SparsityPattern* hessianPattern = nullptr);
+
+    /**
+     * @brief Build the value, gradient, and hessian functions of
+     * generateSymbolicInequalityFunctions, in that order.
+     */
+    static std::vector<GeneratedFunction> buildSymbolicInequalityFunctions(
+            const SymbolicInequalityConstraints& symbolicConstraints,
+            const SymEngine::DenseMatrix& barrierGradientMat,
+            const SymEngine::DenseMatrix& barrierHessianMat,
+            const OrderedSet& variableOrdering,
+            const OrderedSet& parameterOrdering,
+            const std::string& valueFunctionName,
+            const std::string& gradientFunctionName,
+            const std::string& hessianFunctionName,
+            const SparsityPattern* gradientPattern = nullptr,
+            const SparsityPattern* hessianPattern = nullptr);
+
+    /**
+     * @brief Generate the functions used to assemble the barrier derivatives
+     * numerically rather than differentiating the whole barrier symbolically.
+     *
+     * The vector function sets the m constraint values g(x). The jacobian
+     * function sets the column major mxn jacobian of g. The hessian function
+     * takes an additional vector of m weights and sets the column major nxn
+     * matrix Σ weight_i ∇²g_i.
+     *
+     * @param symbolicConstraints The symbolic inequality constraints.
+     * @param variableOrdering Variable ordering
+     * @param parameterOrdering Parameter ordering
+     * @param vectorFunctionName The function name for the constraint vector
+     * @param jacobianFunctionName The function name for the jacobian
+     * @param hessianFunctionName The function name for the weighted hessian
+     */
+    static std::tuple<std::string, std::string, std::string>
+    generateStructuredInequalityFunctions(
+            const SymbolicInequalityConstraints& symbolicConstraints,
+            const OrderedSet& variableOrdering,
+            const OrderedSet& parameterOrdering,
+            const std::string& vectorFunctionName,
+            const std::string& jacobianFunctionName,
+            const std::string& hessianFunctionName);
+
+    /**
+     * @brief Build the vector, jacobian, and weighted hessian functions of
+     * generateStructuredInequalityFunctions, in that order.
+     */
+    static std::vector<GeneratedFunction> buildStructuredInequalityFunctions(
+            const SymbolicInequalityConstraints& symbolicConstraints,
+            const OrderedSet& variableOrdering,
+            const OrderedSet& parameterOrdering,
+            const std::string& vectorFunctionName,
+            const std::string& jacobianFunctionName,
+            const std::string& hessianFunctionName);
+
+    /**
+     * @brief Generate the functions for the linear inequality constraints and
+     * bounds. Each function only takes the parameters.
+     *
+     * The matrix function sets the column major matrix G, the vector function
+     * sets h, and the bound functions set one value per bounded variable.
+     *
+     * @param classified The classified inequality constraints.
+     * @param variableOrdering Variable ordering
+     * @param parameterOrdering Parameter ordering
+     * @param matrixFunctionName The function name for G
+     * @param vectorFunctionName The function name for h
+     * @param lowerFunctionName The function name for the lower bounds
+     * @param upperFunctionName The function name for the upper bounds
+     */
+    static std::tuple<std::string, std::string, std::string, std::string>
+    generateLinearInequalityFunctions(
+            const ClassifiedInequalityConstraints& classified,
+            const OrderedSet& variableOrdering,
+            const OrderedSet& parameterOrdering,
+            const std::string& matrixFunctionName,
+            const std::string& vectorFunctionName,
+            const std::string& lowerFunctionName,
+            const std::string& upperFunctionName);
+
+    /**
+     * @brief Build the matrix, vector, lower bound, and upper bound functions
+     * of generateLinearInequalityFunctions, in that order.
+     */
+    static std::vector<GeneratedFunction> buildLinearInequalityFunctions(
+            const ClassifiedInequalityConstraints& classified,
+            const OrderedSet& variableOrdering,
+            const OrderedSet& parameterOrdering,
+            const std::string& matrixFunctionName,
+            const std::string& vectorFunctionName,
+            const std::string& lowerFunctionName,
+            const std::string& upperFunctionName);
+
+    /**
+     * @brief The complete source file for the given functions.
+     */
+    static std::string generateSource(
+            const std::vector<std::string>& functionStrings);
+
+    /**
+     * @brief The complete source file for the given generated functions.
+     */
+    static std::string generateSource(
+            const std::vector<GeneratedFunction>& functions);
+
+    /**
+     * @brief Write the source file of generateSource to a sink, without
+     * joining the functions first.
+     */
+    static void writeSource(CodeSink& sink,
+                            const std::vector<std::string>& functionStrings);
+
+    /**
+     * @brief Write the source file of the generated functions to a sink, one
+     * entry or loop at a time. Every helper the functions could call is
+     * defined, since their code isn't known before it is written.
+     */
+    static void writeSource(CodeSink& sink,
+                            const std::vector<GeneratedFunction>& functions);
+
+    /**
+     * @brief The functions of each source file, with large functions split
+     * into chunks that are each in their own file, so they can be compiled
+     * in parallel.
+     *
+     * A function generated from more than maxChunkAssignments assignments is
+     * replaced by hidden `<name>_chunk<i>` functions with the same inputs,
+     * each with at most maxChunkAssignments of the assignments, and a
+     * function that zeroes the output and calls the chunks in order. The
+     * assignments are split before they are printed, so loops are only
+     * rolled within a chunk. Batched functions and functions printed
+     * verbatim aren't split. The first file has the unsplit functions and
+     * the functions calling the chunks.
+     *
+     * @param maxChunkAssignments The largest function that isn't split, or 0
+     * to never split functions.
+     * @param vectorMath The accuracy the math calls of each function, or of
+     * each chunk, are vectorized with.
+     * @param separateFunctions Put each unsplit function in its own file
+     * too, so a file only changes when its function does.
+     */
+    static std::vector<std::vector<GeneratedFunction>> generateTranslationUnits(
+            const std::vector<GeneratedFunction>& functions,
+            size_t maxChunkAssignments, VectorMath vectorMath = VectorMath::Off,
+            bool separateFunctions = false);
+
+    /**
+     * @brief The batched variant of a generated function, which evaluates it
+     * at count points.
+     *
+     * The variant is named `<name><CompiledModule::batchSuffix>` and takes
+     * `int count` before the parameters of the function. Every array is in
+     * structure of arrays layout, so element i of point k is at
+     * `array[i * count + k]`. Each entry is evaluated for the whole batch
+     * in an innermost `#pragma omp simd` loop over the points, and the arrays
+     * are restrict qualified, so the compiler can use a SIMD lane per point.
+     *
+     * The variant is printed from the same assignments as the function, so
+     * it throws if the function is printed verbatim or has gathered calls,
+     * or if an entry reads a symbol that isn't an array element.
+     */
+    static GeneratedFunction batchFunction(const GeneratedFunction& function);
+
+    /**
+     * @brief Evaluate the calls to log, exp, sin, cos, and pow of a
+     * generated function with the vector math kernels.
+     *
+     * The calls are found in the expressions of the assignments, before they
+     * are printed. The arguments of the distinct calls of a function are
+     * gathered into an array, the kernel evaluates all of them at once
+     * before the assignments, and the calls are replaced by the elements of
+     * the result. Calls nested in the arguments of other calls are evaluated
+     * first, in an earlier array. Functions with fewer than
+     * minimumVectorCalls distinct calls are left to math.h, and so are the
+     * powers printed as multiplications, sqrt, or exp.
+     *
+     * @return The vectorized function, or the function unchanged if there is
+     * nothing to vectorize, the accuracy is Off, or the function is batched
+     * or printed verbatim.
+     */
+    static GeneratedFunction vectorizeMathCalls(
+            const GeneratedFunction& function, VectorMath accuracy);
+
+    /**
+     * @brief The operations each generated function evaluates, by the
+     * function's name. Functions printed verbatim aren't counted.
+     */
+    static std::map<std::string, OperationCount> operationReport(
+            const std::vector<GeneratedFunction>& functions);
+
+    /**
+     * @brief The bytes of code of each generated function, by the function's
+     * name, counted without keeping the code. Functions printed verbatim
+     * aren't counted.
+     */
+    static std::map<std::string, size_t> sourceSizes(
+            const std::vector<GeneratedFunction>& functions);
+
     static void writeFunctionsToFile(
             const std::string& filePath,
             const std::vector<std::string>& functionStrings);
@@ -0,0 +1,87 @@
+// Copyright 2021 Ian Ruh
+#include "CodeSink.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace cppmpc {
+
+CodeSink& CodeSink::operator<<(const char* text) {
+    this->write(text, std::strlen(text));
+    return *this;
+}
+
+CodeSink& CodeSink::operator<<(size_t value) {
+    this->write(std::to_string(value));
+    return *this;
+}
+
+std::string StringSink::take() {
+    std::string result = std::move(this->contents);
+    this->contents.clear();
+    return result;
+}
+
+FileSink::FileSink(const std::string& path, size_t bufferSize)
+        : path(path), buffer(bufferSize > 0 ? bufferSize : 1) {
+    this->file = std::fopen(path.c_str(), "w");
+    if (this->file == nullptr) {
+        throw std::runtime_error("Failed to open " + path);
+    }
+}
+
+FileSink::~FileSink() {
+    if (this->file != nullptr) {
+        std::fwrite(this->buffer.data(), 1, this->used, this->file);
+        std::fclose(this->file);
+    }
+}
+
+void FileSink::write(const char* data, size_t size) {
+    if (this->file == nullptr) {
+        throw std::runtime_error("Failed to write " + this->path +
+                                 ", it is closed");
+    }
+    this->written += size;
+
+    // Fill the buffer, and write out anything that doesn't fit directly
+    if (this->used + size > this->buffer.size()) {
+        this->flush();
+        if (size >= this->buffer.size()) {
+            if (std::fwrite(data, 1, size, this->file) != size) {
+                throw std::runtime_error("Failed to write " + this->path);
+            }
+            return;
+        }
+    }
+    std::memcpy(this->buffer.data() + this->used, data, size);
+    this->used += size;
+}
+
+void FileSink::flush() {
+    if (this->file == nullptr || this->used == 0) {
+        return;
+    }
+    size_t size = this->used;
+    this->used = 0;
+    if (std::fwrite(this->buffer.data(), 1, size, this->file) != size) {
+        throw std::runtime_error("Failed to write " + this->path);
+    }
+}
+
+void FileSink::close() {
+    if (this->file == nullptr) {
+        return;
+    }
+    this->flush();
+    int result = std::fclose(this->file);
+    this->file = nullptr;
+    if (result != 0) {
+        throw std::runtime_error("Failed to write " + this->path);
+    }
+}
+
+}  // namespace cppmpc
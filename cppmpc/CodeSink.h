@@ -0,0 +1,101 @@
+// Copyright 2021 Ian Ruh
+#ifndef INCLUDE_CODESINK_H_
+#define INCLUDE_CODESINK_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace cppmpc {
+
+/**
+ * @brief Where generated code is written as it is emitted.
+ *
+ * The code generator writes each entry to the sink as soon as it is printed,
+ * so writing to a FileSink only ever holds one entry of text in memory,
+ * instead of the whole function.
+ */
+class CodeSink {
+ public:
+    virtual ~CodeSink() {}
+
+    virtual void write(const char* data, size_t size) = 0;
+
+    void write(const std::string& text) {
+        this->write(text.data(), text.size());
+    }
+
+    CodeSink& operator<<(const std::string& text) {
+        this->write(text);
+        return *this;
+    }
+
+    CodeSink& operator<<(const char* text);
+    CodeSink& operator<<(size_t value);
+};
+
+/**
+ * @brief Collects the generated code in a string.
+ */
+class StringSink : public CodeSink {
+ private:
+    std::string contents;
+
+ public:
+    void write(const char* data, size_t size) override {
+        this->contents.append(data, size);
+    }
+
+    const std::string& str() const { return this->contents; }
+
+    /**
+     * @brief The collected code, leaving the sink empty.
+     */
+    std::string take();
+};
+
+/**
+ * @brief Writes the generated code to a file through a fixed size buffer.
+ *
+ * Throws if the file can't be opened or written. The file is flushed and
+ * closed by close(), or by the destructor, which can't report errors.
+ */
+class FileSink : public CodeSink {
+ private:
+    std::string path;
+    std::FILE* file = nullptr;
+    std::vector<char> buffer;
+    size_t used = 0;
+    size_t written = 0;
+
+ public:
+    static const size_t defaultBufferSize = 1 << 16;
+
+    explicit FileSink(const std::string& path,
+                      size_t bufferSize = defaultBufferSize);
+    ~FileSink();
+
+    FileSink(const FileSink&) = delete;
+    FileSink& operator=(const FileSink&) = delete;
+
+    void write(const char* data, size_t size) override;
+
+    /**
+     * @brief Write the buffered code to the file.
+     */
+    void flush();
+
+    /**
+     * @brief Flush and close the file. Nothing can be written afterwards.
+     */
+    void close();
+
+    /**
+     * @brief The number of bytes written to the sink so far.
+     */
+    size_t bytesWritten() const { return this->written; }
+};
+
+}  // namespace cppmpc
+
+#endif  // INCLUDE_CODESINK_H_
@@ -0,0 +1,100 @@
+// Copyright 2021 Ian Ruh
+#include "CompiledModule.h"
+
+#include <dlfcn.h>
+
+#ifdef CPPMPC_WITH_LIBTCC
+#include <libtcc.h>
+#endif
+
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+namespace cppmpc {
+
+SharedLibraryModule::SharedLibraryModule(const std::string& path,
+                                         const std::string& directory)
+        : _path(path), directory(directory) {
+    // Every library exports the same function names, so they are kept out
+    // of the global namespace and only looked up through the handle. Binding
+    // everything up front keeps a missing symbol from failing later, on
+    // whichever thread first calls it.
+    this->handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!this->handle) {
+        if (!directory.empty()) {
+            std::error_code error;
+            std::filesystem::remove_all(directory, error);
+        }
+        std::stringstream msg;
+        msg << "Cannot open library: " << dlerror() << std::endl;
+        throw std::runtime_error(msg.str());
+    }
+}
+
+SharedLibraryModule::~SharedLibraryModule() {
+    if (this->handle != nullptr) {
+        dlclose(this->handle);
+    }
+    if (!this->directory.empty()) {
+        std::error_code error;
+        std::filesystem::remove_all(this->directory, error);
+    }
+}
+
+void* SharedLibraryModule::symbol(const std::string& name) const {
+    return dlsym(this->handle, name.c_str());
+}
+
+#ifdef CPPMPC_WITH_LIBTCC
+namespace {
+
+void tinyCCError(void* opaque, const char* msg) {
+    static_cast<std::string*>(opaque)->append(msg).append("\n");
+}
+
+}  // namespace
+
+TinyCCModule::TinyCCModule(const std::string& source) {
+    this->state = tcc_new();
+    if (this->state == nullptr) {
+        throw std::runtime_error("Failed to create a TinyCC state");
+    }
+
+    std::string errors;
+    tcc_set_error_func(this->state, &errors, &tinyCCError);
+    tcc_set_output_type(this->state, TCC_OUTPUT_MEMORY);
+
+    bool compiled = tcc_compile_string(this->state, source.c_str()) == 0;
+    // The generated code calls into libm
+    compiled = compiled && tcc_add_library(this->state, "m") == 0;
+#ifdef TCC_RELOCATE_AUTO
+    compiled = compiled && tcc_relocate(this->state, TCC_RELOCATE_AUTO) >= 0;
+#else
+    compiled = compiled && tcc_relocate(this->state) >= 0;
+#endif
+
+    // The error buffer only lives for the constructor
+    tcc_set_error_func(this->state, nullptr, nullptr);
+
+    if (!compiled) {
+        tcc_delete(this->state);
+        this->state = nullptr;
+        throw std::runtime_error("TinyCC compilation failed:\n" + errors);
+    }
+}
+
+TinyCCModule::~TinyCCModule() {
+    if (this->state != nullptr) {
+        tcc_delete(this->state);
+    }
+}
+
+void* TinyCCModule::symbol(const std::string& name) const {
+    return tcc_get_symbol(this->state, name.c_str());
+}
+#endif  // CPPMPC_WITH_LIBTCC
+
+}  // namespace cppmpc
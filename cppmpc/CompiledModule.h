@@ -0,0 +1,186 @@
+// Copyright 2021 Ian Ruh
+#ifndef INCLUDE_COMPILEDMODULE_H_
+#define INCLUDE_COMPILEDMODULE_H_
+
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+#ifdef CPPMPC_WITH_LIBTCC
+struct TCCState;
+#endif
+
+namespace cppmpc {
+
+/**
+ * @brief How optimized the code an objective is evaluated with is.
+ */
+enum class CompilationTier {
+    // Evaluated by the expression tape interpreter, without a compiler.
+    Interpreted,
+    // Compiled quickly without optimizations, by TinyCC or at -O0.
+    Unoptimized,
+    // Compiled with optimizations.
+    Optimized
+};
+
+// The forms of the generated functions. Compiled functions are plain
+// function pointers, but interpreted functions need to carry their tape.
+typedef std::function<void(const double* state, const double* param,
+                           double* out)>
+        StateFunction;
+typedef std::function<void(const double* param, double* out)>
+        ParameterFunction;
+typedef std::function<void(const double* state, const double* param,
+                           const double* weight, double* out)>
+        WeightedStateFunction;
+// A function of the state and parameters at count points, in structure of
+// arrays layout, so element i of point k is at `array[i * count + k]`.
+typedef std::function<void(int count, const double* state, const double* param,
+                           double* out)>
+        BatchStateFunction;
+
+/**
+ * @brief Compiled generated functions, which are released when the module is
+ * destroyed.
+ *
+ * Objectives hold a shared pointer to the module their function pointers
+ * come from, so the code lives exactly as long as any objective using it.
+ */
+class CompiledModule {
+ public:
+    // The suffix of the batched variant of a generated function.
+    static constexpr const char* batchSuffix = "_batch";
+    // The suffix, before the group index, of the functions updating the
+    // entries of a parameter-only function that depend on some parameters.
+    static constexpr const char* updateSuffix = "_update";
+
+    virtual ~CompiledModule() {}
+
+    /**
+     * @brief Get a function of the state and parameters, throwing if it
+     * doesn't exist.
+     */
+    virtual StateFunction stateFunction(const std::string& name) const {
+        return this->function<void (*)(const double*, const double*,
+                                       double*)>(name);
+    }
+
+    /**
+     * @brief Get a function of only the parameters, throwing if it doesn't
+     * exist.
+     */
+    virtual ParameterFunction parameterFunction(
+            const std::string& name) const {
+        return this->function<void (*)(const double*, double*)>(name);
+    }
+
+    /**
+     * @brief Get a function of the state, parameters, and weights, throwing
+     * if it doesn't exist.
+     */
+    virtual WeightedStateFunction weightedStateFunction(
+            const std::string& name) const {
+        return this->function<void (*)(const double*, const double*,
+                                       const double*, double*)>(name);
+    }
+
+    /**
+     * @brief Get the batched variant of a function of the state and
+     * parameters, or null if the module doesn't have one.
+     */
+    virtual BatchStateFunction batchStateFunction(
+            const std::string& name) const {
+        void* address = this->symbol(name + CompiledModule::batchSuffix);
+        if (address == nullptr) {
+            return nullptr;
+        }
+        return reinterpret_cast<void (*)(int, const double*, const double*,
+                                         double*)>(address);
+    }
+
+    /**
+     * @brief The address of a symbol, or null if it doesn't exist or the
+     * module isn't machine code.
+     */
+    virtual void* symbol(const std::string& name) const = 0;
+
+    /**
+     * @brief The path of the shared library the module was loaded from, or an
+     * empty string if the module was compiled in memory or is interpreted.
+     */
+    virtual std::string path() const { return ""; }
+
+    /**
+     * @brief Get a function from the module, throwing if it doesn't exist.
+     *
+     * @param name The name of the function.
+     */
+    template <class FunctionPointer>
+    FunctionPointer function(const std::string& name) const {
+        void* address = this->symbol(name);
+        if (address == nullptr) {
+            throw std::runtime_error("Function " + name +
+                                     " is missing from the compiled module");
+        }
+        return reinterpret_cast<FunctionPointer>(address);
+    }
+};
+
+/**
+ * @brief A shared library opened with dlopen, and closed with dlclose.
+ */
+class SharedLibraryModule : public CompiledModule {
+ private:
+    std::string _path;
+    std::string directory;
+    void* handle = nullptr;
+
+ public:
+    /**
+     * @param path The path of the shared library, throwing if it can't be
+     * opened.
+     * @param directory The temporary directory the library was built in,
+     * which the module owns and removes after closing the library, or empty
+     * if the library outlives the module.
+     */
+    explicit SharedLibraryModule(const std::string& path,
+                                 const std::string& directory = "");
+    ~SharedLibraryModule();
+
+    SharedLibraryModule(const SharedLibraryModule&) = delete;
+    SharedLibraryModule& operator=(const SharedLibraryModule&) = delete;
+
+    void* symbol(const std::string& name) const override;
+    std::string path() const override { return this->_path; }
+};
+
+#ifdef CPPMPC_WITH_LIBTCC
+/**
+ * @brief Source compiled straight from memory into executable memory by
+ * libtcc, without a compiler process or temporary files.
+ *
+ * TinyCC doesn't optimize, so it trades evaluation speed for compile times
+ * in the milliseconds.
+ */
+class TinyCCModule : public CompiledModule {
+ private:
+    TCCState* state = nullptr;
+
+ public:
+    /**
+     * @param source The C source to compile, throwing if it doesn't compile.
+     */
+    explicit TinyCCModule(const std::string& source);
+    ~TinyCCModule();
+
+    TinyCCModule(const TinyCCModule&) = delete;
+    TinyCCModule& operator=(const TinyCCModule&) = delete;
+
+    void* symbol(const std::string& name) const override;
+};
+#endif  // CPPMPC_WITH_LIBTCC
+
+}  // namespace cppmpc
+
+#endif  // INCLUDE_COMPILEDMODULE_H_
@@ -0,0 +1,114 @@
+// Copyright 2021 Ian Ruh
+#include "DerivativeCache.h"
+
+#include <symengine/add.h>
+#include <symengine/basic.h>
+#include <symengine/derivative.h>
+#include <symengine/symbol.h>
+
+#include <mutex>
+#include <utility>
+
+namespace cppmpc {
+
+using SymEngine::Basic;
+using SymEngine::RCP;
+using SymEngine::Symbol;
+
+// The cache used by the derivative utility functions on each thread
+static thread_local DerivativeCache* activeCache = nullptr;
+
+bool DerivativeCache::find(const RCP<const Basic>& basic,
+                           const RCP<const Basic>& symbol,
+                           RCP<const Basic>* derivative) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto it = this->current.find(basic);
+    if (it != this->current.end()) {
+        auto found = it->second.find(symbol);
+        if (found != it->second.end()) {
+            *derivative = found->second;
+            return true;
+        }
+    }
+
+    auto old = this->previous.find(basic);
+    if (old != this->previous.end()) {
+        auto found = old->second.find(symbol);
+        if (found != old->second.end()) {
+            *derivative = found->second;
+            this->current[basic][symbol] = found->second;
+            return true;
+        }
+    }
+    return false;
+}
+
+void DerivativeCache::insert(const RCP<const Basic>& basic,
+                             const RCP<const Basic>& symbol,
+                             const RCP<const Basic>& derivative) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->current[basic][symbol] = derivative;
+}
+
+RCP<const Basic> DerivativeCache::diff(const RCP<const Basic>& basic,
+                                       const RCP<const Symbol>& symbol) {
+    RCP<const Basic> result;
+    if (this->find(basic, symbol, &result)) {
+        return result;
+    }
+
+    // Differentiate each term on its own, so the terms are shared between
+    // sums, e.g. between the barriers of two sets of constraints.
+    if (SymEngine::is_a<SymEngine::Add>(*basic)) {
+        SymEngine::vec_basic terms;
+        for (const RCP<const Basic>& term : basic->get_args()) {
+            terms.push_back(this->diff(term, symbol));
+        }
+        result = SymEngine::add(terms);
+    } else {
+        result = SymEngine::diff(basic, symbol);
+    }
+
+    this->insert(basic, symbol, result);
+    return result;
+}
+
+void DerivativeCache::nextGeneration() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->previous = std::move(this->current);
+    this->current.clear();
+}
+
+size_t DerivativeCache::size() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    size_t size = this->current.size();
+    for (const auto& node : this->previous) {
+        size += this->current.count(node.first) == 0 ? 1 : 0;
+    }
+    return size;
+}
+
+void DerivativeCache::clear() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->current.clear();
+    this->previous.clear();
+}
+
+DerivativeCache* DerivativeCache::active() { return activeCache; }
+
+DerivativeCache::Scope::Scope(DerivativeCache& cache)
+        : previous(activeCache) {
+    activeCache = &cache;
+}
+
+DerivativeCache::Scope::~Scope() { activeCache = this->previous; }
+
+RCP<const Basic> derivative(const RCP<const Basic>& basic,
+                            const RCP<const Symbol>& symbol) {
+    if (DerivativeCache* cache = DerivativeCache::active()) {
+        return cache->diff(basic, symbol);
+    }
+    return SymEngine::diff(basic, symbol);
+}
+
+}  // namespace cppmpc
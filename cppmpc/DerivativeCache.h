@@ -0,0 +1,107 @@
+// Copyright 2021 Ian Ruh
+#ifndef INCLUDE_DERIVATIVECACHE_H_
+#define INCLUDE_DERIVATIVECACHE_H_
+
+#include <symengine/basic.h>
+#include <symengine/symbol.h>
+
+#include <mutex>
+#include <unordered_map>
+
+namespace cppmpc {
+
+using SymEngine::Basic;
+using SymEngine::RCP;
+using SymEngine::Symbol;
+
+/**
+ * @brief Remembers the derivatives of expressions, term by term, so they can
+ * be reused by a later finalize.
+ *
+ * Sums are differentiated one term at a time, so when a constraint is added
+ * to the barrier, only the new term is differentiated and the derivatives of
+ * the others come from the cache. Entries are kept for two generations: a
+ * new generation is started on each finalize, and the entries that weren't
+ * used during the previous one are dropped, so the cache doesn't grow as
+ * constraints are removed.
+ *
+ * While a DerivativeCache::Scope is alive, the gradient, jacobian, and
+ * hessian utilities on that thread use its cache.
+ */
+class DerivativeCache {
+ private:
+    // The derivatives of a node with respect to each symbol.
+    typedef std::unordered_map<RCP<const Basic>, SymEngine::umap_basic_basic,
+                               SymEngine::RCPBasicHash,
+                               SymEngine::RCPBasicKeyEq>
+            NodeMap;
+
+    NodeMap current;
+    NodeMap previous;
+    std::mutex mutex;
+
+    /**
+     * @brief Find the memoized derivative, moving it to the current
+     * generation if it is from the previous one.
+     */
+    bool find(const RCP<const Basic>& basic, const RCP<const Basic>& symbol,
+              RCP<const Basic>* derivative);
+
+    void insert(const RCP<const Basic>& basic, const RCP<const Basic>& symbol,
+                const RCP<const Basic>& derivative);
+
+ public:
+    /**
+     * @brief The derivative of the basic with respect to the symbol.
+     */
+    RCP<const Basic> diff(const RCP<const Basic>& basic,
+                          const RCP<const Symbol>& symbol);
+
+    /**
+     * @brief Start a new generation, dropping the entries that weren't used
+     * since the last one started.
+     */
+    void nextGeneration();
+
+    /**
+     * @brief The number of nodes with memoized derivatives.
+     */
+    size_t size();
+
+    /**
+     * @brief Forget every memoized derivative.
+     */
+    void clear();
+
+    /**
+     * @brief The cache of the innermost scope on this thread, or null.
+     */
+    static DerivativeCache* active();
+
+    /**
+     * @brief Make a cache the active cache on this thread until the scope is
+     * destroyed.
+     */
+    class Scope {
+     private:
+        DerivativeCache* previous;
+
+     public:
+        explicit Scope(DerivativeCache& cache);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+};
+
+/**
+ * @brief The derivative of the basic with respect to the symbol, from the
+ * active derivative cache if there is one.
+ */
+RCP<const Basic> derivative(const RCP<const Basic>& basic,
+                            const RCP<const Symbol>& symbol);
+
+}  // namespace cppmpc
+
+#endif  // INCLUDE_DERIVATIVECACHE_H_
@@ -0,0 +1,471 @@
+// Copyright 2021 Ian Ruh
+#include "ExpressionEmitter.h"
+
+#include <symengine/add.h>
+#include <symengine/constants.h>
+#include <symengine/eval_double.h>
+#include <symengine/functions.h>
+#include <symengine/integer.h>
+#include <symengine/mul.h>
+#include <symengine/pow.h>
+#include <symengine/printers.h>
+#include <symengine/subs.h>
+#include <symengine/symbol.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cppmpc {
+
+using SymEngine::Symbol;
+
+namespace {
+
+/**
+ * @brief The factors of a term, e.g. `x`, `y**2`, and `sin(z)` of
+ * `2*x*y**2*sin(z)`, without its coefficient.
+ */
+SymEngine::vec_basic factorsOf(const RCP<const Basic>& term) {
+    SymEngine::vec_basic factors;
+    if (SymEngine::is_a<SymEngine::Mul>(*term)) {
+        for (const RCP<const Basic>& arg : term->get_args()) {
+            if (!SymEngine::is_a_Number(*arg)) {
+                factors.push_back(arg);
+            }
+        }
+    } else if (!SymEngine::is_a_Number(*term)) {
+        factors.push_back(term);
+    }
+    return factors;
+}
+
+/**
+ * @brief What a factor contributes to the terms that can share it, so `x` is
+ * shared by `x` and `x**2`.
+ */
+RCP<const Basic> sharedFactor(const RCP<const Basic>& factor) {
+    if (SymEngine::is_a<SymEngine::Pow>(*factor)) {
+        SymEngine::vec_basic args = factor->get_args();
+        if (SymEngine::is_a<SymEngine::Integer>(*args[1]) &&
+            SymEngine::eval_double(*args[1]) > 0) {
+            return args[0];
+        }
+    }
+    return factor;
+}
+
+}  // namespace
+
+std::string ExpressionEmitter::literal(double value) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+    std::string result = buffer;
+    // Keep integers doubles, so they are never divided as integers
+    if (result.find_first_of(".eni") == std::string::npos) {
+        result += ".0";
+    }
+    return result;
+}
+
+std::string ExpressionEmitter::wrap(const Emitted& emitted,
+                                    Precedence precedence) {
+    return emitted.precedence < precedence ? "(" + emitted.code + ")"
+                                           : emitted.code;
+}
+
+bool ExpressionEmitter::isNegative(const RCP<const Basic>& term) {
+    if (SymEngine::is_a_Number(*term)) {
+        return SymEngine::eval_double(*term) < 0;
+    }
+    if (SymEngine::is_a<SymEngine::Mul>(*term)) {
+        for (const RCP<const Basic>& arg : term->get_args()) {
+            if (SymEngine::is_a_Number(*arg)) {
+                return SymEngine::eval_double(*arg) < 0;
+            }
+        }
+    }
+    return false;
+}
+
+ExpressionEmitter::Emitted ExpressionEmitter::emit(
+        const RCP<const Basic>& basic) {
+    Emitted emitted;
+    if (SymEngine::is_a_Number(*basic) ||
+        SymEngine::is_a<SymEngine::Constant>(*basic)) {
+        emitted = {"", Atom, {}, true};
+    } else if (SymEngine::is_a<Symbol>(*basic)) {
+        return {SymEngine::rcp_static_cast<const Symbol>(basic)->get_name(),
+                Atom,
+                {},
+                false};
+    } else if (SymEngine::is_a<SymEngine::Add>(*basic)) {
+        emitted = ExpressionEmitter::emitSum(basic);
+    } else if (SymEngine::is_a<SymEngine::Mul>(*basic)) {
+        emitted = ExpressionEmitter::emitProduct(basic);
+    } else if (SymEngine::is_a<SymEngine::Pow>(*basic)) {
+        SymEngine::vec_basic args = basic->get_args();
+        emitted = ExpressionEmitter::emitPower(args[0], args[1]);
+    } else {
+        emitted = ExpressionEmitter::emitFunction(basic);
+    }
+
+    // Fold constant subexpressions into one literal
+    if (emitted.constant) {
+        try {
+            double value = SymEngine::eval_double(*basic);
+            if (std::isfinite(value)) {
+                return {ExpressionEmitter::literal(value),
+                        value < 0 ? Negation : Atom,
+                        {},
+                        true};
+            }
+        } catch (const std::exception&) {
+        }
+        emitted.constant = false;
+        if (emitted.code.empty()) {
+            emitted.code = SymEngine::ccode(*basic);
+        }
+    }
+    return emitted;
+}
+
+ExpressionEmitter::Emitted ExpressionEmitter::emitSum(
+        const RCP<const Basic>& basic) {
+    Emitted result{"", Sum, {}, true};
+    bool first = true;
+    for (const RCP<const Basic>& arg : basic->get_args()) {
+        // Subtract negative terms after the first one
+        bool negative = !first && ExpressionEmitter::isNegative(arg);
+        Emitted term = ExpressionEmitter::emit(negative ? SymEngine::neg(arg)
+                                                        : arg);
+        result.constant = result.constant && term.constant;
+        result.count += term.count;
+        if (first) {
+            result.code = term.code;
+        } else {
+            result.code += (negative ? " - " : " + ") +
+                           ExpressionEmitter::wrap(term, Product);
+            result.count.additions += 1;
+        }
+        first = false;
+    }
+    return result;
+}
+
+ExpressionEmitter::Emitted ExpressionEmitter::emitProduct(
+        const RCP<const Basic>& basic) {
+    // Constant factors are collected into the coefficient, and factors with
+    // a negative exponent are divided by together.
+    double coefficient = 1;
+    std::vector<Emitted> numerator;
+    std::vector<Emitted> denominator;
+    for (const RCP<const Basic>& arg : basic->get_args()) {
+        bool divides = false;
+        RCP<const Basic> factor = arg;
+        if (SymEngine::is_a<SymEngine::Pow>(*arg)) {
+            SymEngine::vec_basic args = arg->get_args();
+            if (SymEngine::is_a_Number(*args[1]) &&
+                SymEngine::eval_double(*args[1]) < 0) {
+                divides = true;
+                factor = SymEngine::pow(args[0], SymEngine::neg(args[1]));
+            }
+        }
+        Emitted emitted = ExpressionEmitter::emit(factor);
+        if (emitted.constant) {
+            double value = SymEngine::eval_double(*factor);
+            coefficient = divides ? coefficient / value : coefficient * value;
+        } else {
+            (divides ? denominator : numerator).push_back(emitted);
+        }
+    }
+
+    Emitted result{"", Product, {}, numerator.empty() && denominator.empty()};
+    for (const Emitted& factor : numerator) {
+        if (!result.code.empty()) {
+            result.code += "*";
+            result.count.multiplications += 1;
+        }
+        result.code += ExpressionEmitter::wrap(factor, Product);
+        result.count += factor.count;
+    }
+    if (std::fabs(coefficient) != 1 || result.code.empty()) {
+        std::string magnitude =
+                ExpressionEmitter::literal(std::fabs(coefficient));
+        if (!result.code.empty()) {
+            magnitude += "*";
+            result.count.multiplications += 1;
+        }
+        result.code = magnitude + result.code;
+    }
+
+    if (!denominator.empty()) {
+        std::string divisor;
+        for (const Emitted& factor : denominator) {
+            if (!divisor.empty()) {
+                divisor += "*";
+                result.count.multiplications += 1;
+            }
+            divisor += ExpressionEmitter::wrap(factor, Product);
+            result.count += factor.count;
+        }
+        result.code += "/" + (denominator.size() > 1
+                                      ? "(" + divisor + ")"
+                                      : ExpressionEmitter::wrap(denominator[0],
+                                                                Atom));
+        result.count.divisions += 1;
+    }
+
+    if (coefficient < 0) {
+        result.code = "-" + result.code;
+        result.precedence = Negation;
+        result.count.additions += 1;
+    }
+    return result;
+}
+
+bool ExpressionEmitter::callsPow(const RCP<const Basic>& base,
+                                 const RCP<const Basic>& exponent) {
+    if (SymEngine::eq(*base, *SymEngine::E)) {
+        return false;
+    }
+    double value = SymEngine::is_a_Number(*exponent)
+                           ? SymEngine::eval_double(*exponent)
+                           : 0;
+    if (SymEngine::is_a<SymEngine::Integer>(*exponent)) {
+        return std::fabs(value) > 64;
+    }
+    return std::fabs(value) != 0.5;
+}
+
+ExpressionEmitter::Emitted ExpressionEmitter::emitPower(
+        const RCP<const Basic>& base, const RCP<const Basic>& exponent) {
+    if (SymEngine::eq(*base, *SymEngine::E)) {
+        Emitted argument = ExpressionEmitter::emit(exponent);
+        argument.code = "exp(" + argument.code + ")";
+        argument.precedence = Atom;
+        argument.count.calls += 1;
+        return argument;
+    }
+
+    Emitted emittedBase = ExpressionEmitter::emit(base);
+    double value = SymEngine::is_a_Number(*exponent)
+                           ? SymEngine::eval_double(*exponent)
+                           : 0;
+    int64_t power = static_cast<int64_t>(std::fabs(value));
+
+    Emitted result = emittedBase;
+    result.precedence = Atom;
+    if (ExpressionEmitter::callsPow(base, exponent)) {
+        Emitted emittedExponent = ExpressionEmitter::emit(exponent);
+        result.code = "pow(" + emittedBase.code + ", " +
+                      emittedExponent.code + ")";
+        result.count += emittedExponent.count;
+        result.count.calls += 1;
+        result.constant = result.constant && emittedExponent.constant;
+        return result;
+    } else if (SymEngine::is_a<SymEngine::Integer>(*exponent)) {
+        // Multiply small powers of symbols out, and square repeatedly for
+        // the rest
+        if (SymEngine::is_a<Symbol>(*base) &&
+            power <= ExpressionEmitter::maxInlinePower) {
+            for (int64_t i = 1; i < power; i++) {
+                result.code += "*" + emittedBase.code;
+                result.count.multiplications += 1;
+                result.precedence = Product;
+            }
+        } else {
+            result.code = "cppmpc_powi(" + emittedBase.code + ", " +
+                          std::to_string(power) + ")";
+            result.count.calls += 1;
+        }
+    } else {
+        result.code = "sqrt(" + emittedBase.code + ")";
+        result.count.calls += 1;
+    }
+
+    if (value < 0) {
+        result.code = "1.0/" + ExpressionEmitter::wrap(result, Atom);
+        result.precedence = Product;
+        result.count.divisions += 1;
+    }
+    return result;
+}
+
+ExpressionEmitter::Emitted ExpressionEmitter::emitFunction(
+        const RCP<const Basic>& basic) {
+    static const std::vector<std::pair<bool (*)(const Basic&), std::string>>
+            functions = {{&SymEngine::is_a<SymEngine::Sin>, "sin"},
+                         {&SymEngine::is_a<SymEngine::Cos>, "cos"},
+                         {&SymEngine::is_a<SymEngine::Tan>, "tan"},
+                         {&SymEngine::is_a<SymEngine::ASin>, "asin"},
+                         {&SymEngine::is_a<SymEngine::ACos>, "acos"},
+                         {&SymEngine::is_a<SymEngine::ATan>, "atan"},
+                         {&SymEngine::is_a<SymEngine::Sinh>, "sinh"},
+                         {&SymEngine::is_a<SymEngine::Cosh>, "cosh"},
+                         {&SymEngine::is_a<SymEngine::Tanh>, "tanh"},
+                         {&SymEngine::is_a<SymEngine::Abs>, "fabs"},
+                         {&SymEngine::is_a<SymEngine::Log>, "log"}};
+
+    SymEngine::vec_basic args = basic->get_args();
+    for (const auto& function : functions) {
+        if (!function.first(*basic) || args.empty() || args.size() > 2) {
+            continue;
+        }
+        Emitted result{"", Atom, {}, true};
+        std::vector<std::string> calls;
+        for (const RCP<const Basic>& arg : args) {
+            Emitted argument = ExpressionEmitter::emit(arg);
+            calls.push_back(function.second + "(" + argument.code + ")");
+            result.count += argument.count;
+            result.count.calls += 1;
+            result.constant = result.constant && argument.constant;
+        }
+        result.code = calls[0];
+        if (calls.size() == 2) {
+            // log(x, b) = log(x) / log(b)
+            if (function.second != "log") {
+                break;
+            }
+            result.code += "/" + calls[1];
+            result.precedence = Product;
+            result.count.divisions += 1;
+        }
+        return result;
+    }
+
+    // Anything else is left to SymEngine
+    OperationCount count;
+    count.calls = 1;
+    return {SymEngine::ccode(*basic), Atom, count, false};
+}
+
+RCP<const Basic> ExpressionEmitter::hornerSum(
+        const SymEngine::vec_basic& terms) {
+    if (terms.size() < 2) {
+        return SymEngine::add(terms);
+    }
+
+    // Count the terms each factor can be taken out of
+    std::map<RCP<const Basic>, size_t, SymEngine::RCPBasicKeyLess> counts;
+    for (const RCP<const Basic>& term : terms) {
+        for (const RCP<const Basic>& factor : factorsOf(term)) {
+            counts[sharedFactor(factor)] += 1;
+        }
+    }
+    RCP<const Basic> best;
+    size_t bestCount = 1;
+    for (const auto& count : counts) {
+        if (count.second > bestCount) {
+            best = count.first;
+            bestCount = count.second;
+        }
+    }
+    if (bestCount < 2) {
+        return SymEngine::add(terms);
+    }
+
+    // best * (Σ factored / best) + Σ rest
+    SymEngine::vec_basic factored;
+    SymEngine::vec_basic rest;
+    for (const RCP<const Basic>& term : terms) {
+        bool shares = false;
+        for (const RCP<const Basic>& factor : factorsOf(term)) {
+            shares = shares || SymEngine::eq(*sharedFactor(factor), *best);
+        }
+        if (shares) {
+            factored.push_back(SymEngine::div(term, best));
+        } else {
+            rest.push_back(term);
+        }
+    }
+    return SymEngine::add(
+            SymEngine::mul(best, ExpressionEmitter::hornerSum(factored)),
+            ExpressionEmitter::hornerSum(rest));
+}
+
+RCP<const Basic> ExpressionEmitter::hornerForm(const RCP<const Basic>& basic) {
+    if (SymEngine::is_a<Symbol>(*basic) || SymEngine::is_a_Number(*basic) ||
+        SymEngine::is_a<SymEngine::Constant>(*basic)) {
+        return basic;
+    }
+
+    SymEngine::vec_basic args = basic->get_args();
+    if (SymEngine::is_a<SymEngine::Add>(*basic)) {
+        SymEngine::vec_basic terms;
+        for (const RCP<const Basic>& arg : args) {
+            terms.push_back(ExpressionEmitter::hornerForm(arg));
+        }
+        return ExpressionEmitter::hornerSum(terms);
+    }
+
+    SymEngine::map_basic_basic replacements;
+    for (const RCP<const Basic>& arg : args) {
+        RCP<const Basic> factored = ExpressionEmitter::hornerForm(arg);
+        if (SymEngine::neq(*factored, *arg)) {
+            replacements[arg] = factored;
+        }
+    }
+    if (replacements.empty()) {
+        return basic;
+    }
+    return SymEngine::xreplace(basic, replacements);
+}
+
+RCP<const Basic> ExpressionEmitter::optimize(const RCP<const Basic>& basic) {
+    RCP<const Basic> unexpanded = ExpressionEmitter::hornerForm(basic);
+    RCP<const Basic> expanded =
+            ExpressionEmitter::hornerForm(SymEngine::expand(basic));
+    // Prefer the expansion on a tie, since it cancels terms
+    if (ExpressionEmitter::operations(expanded).cost() <=
+        ExpressionEmitter::operations(unexpanded).cost()) {
+        return expanded;
+    }
+    return unexpanded;
+}
+
+std::string ExpressionEmitter::code(const RCP<const Basic>& basic) {
+    return ExpressionEmitter::emit(basic).code;
+}
+
+OperationCount ExpressionEmitter::operations(const RCP<const Basic>& basic) {
+    return ExpressionEmitter::emit(basic).count;
+}
+
+std::string ExpressionEmitter::prelude(const std::string& source) {
+    if (source.find("cppmpc_powi(") == std::string::npos) {
+        return "";
+    }
+    return ExpressionEmitter::helpers();
+}
+
+std::string ExpressionEmitter::prelude(
+        const std::vector<std::string>& sources) {
+    for (const std::string& source : sources) {
+        if (source.find("cppmpc_powi(") != std::string::npos) {
+            return ExpressionEmitter::helpers();
+        }
+    }
+    return "";
+}
+
+std::string ExpressionEmitter::helpers() {
+    return "static inline double cppmpc_powi(double x, int n) {\n"
+           "double result = 1.0;\n"
+           "for (; n > 0; n >>= 1) {\n"
+           "if (n & 1) {\n"
+           "result *= x;\n"
+           "}\n"
+           "x *= x;\n"
+           "}\n"
+           "return result;\n"
+           "}\n\n";
+}
+
+}  // namespace cppmpc
@@ -0,0 +1,165 @@
+// Copyright 2021 Ian Ruh
+#ifndef INCLUDE_EXPRESSIONEMITTER_H_
+#define INCLUDE_EXPRESSIONEMITTER_H_
+
+#include <symengine/basic.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cppmpc {
+
+using SymEngine::Basic;
+using SymEngine::RCP;
+
+/**
+ * @brief The arithmetic in a piece of generated code.
+ */
+typedef struct OperationCount {
+    // Additions, subtractions, and negations.
+    size_t additions = 0;
+    size_t multiplications = 0;
+    size_t divisions = 0;
+    // Calls to math.h and to the helpers of the generated code.
+    size_t calls = 0;
+
+    size_t total() const {
+        return additions + multiplications + divisions + calls;
+    }
+
+    /**
+     * @brief A rough cost, where a division is worth 4 additions and a call
+     * is worth 16.
+     */
+    size_t cost() const {
+        return additions + multiplications + 4 * divisions + 16 * calls;
+    }
+
+    OperationCount& operator+=(const OperationCount& other) {
+        additions += other.additions;
+        multiplications += other.multiplications;
+        divisions += other.divisions;
+        calls += other.calls;
+        return *this;
+    }
+} OperationCount;
+
+/**
+ * @brief Prints symbolic expressions as C, choosing the form that needs the
+ * fewest operations.
+ *
+ * Expressions are given with their symbols already replaced by their
+ * representations, e.g. `state[3]`. Integer powers are multiplied out, sums
+ * are factored into Horner forms, and constant subexpressions are folded into
+ * a single literal.
+ */
+class ExpressionEmitter {
+ private:
+    /**
+     * @brief How tightly an emitted expression binds, to know when it needs
+     * parentheses.
+     */
+    enum Precedence { Sum = 0, Negation = 1, Product = 2, Atom = 3 };
+
+    typedef struct Emitted {
+        std::string code;
+        Precedence precedence;
+        OperationCount count;
+        // Whether the expression has no symbols, so it can be folded.
+        bool constant;
+    } Emitted;
+
+    /**
+     * @brief The emitted expression and its operations.
+     */
+    static Emitted emit(const RCP<const Basic>& basic);
+
+    static Emitted emitSum(const RCP<const Basic>& basic);
+    static Emitted emitProduct(const RCP<const Basic>& basic);
+    static Emitted emitPower(const RCP<const Basic>& base,
+                             const RCP<const Basic>& exponent);
+    static Emitted emitFunction(const RCP<const Basic>& basic);
+
+    /**
+     * @brief The code of the expression, in parentheses if it binds less
+     * tightly than the precedence.
+     */
+    static std::string wrap(const Emitted& emitted, Precedence precedence);
+
+    /**
+     * @brief A double literal.
+     */
+    static std::string literal(double value);
+
+    /**
+     * @brief Whether the number, or the coefficient of the product, is
+     * negative.
+     */
+    static bool isNegative(const RCP<const Basic>& term);
+
+    /**
+     * @brief Sum the terms, repeatedly factoring out the factor that the
+     * most terms have in common.
+     */
+    static RCP<const Basic> hornerSum(const SymEngine::vec_basic& terms);
+
+ public:
+    /**
+     * @brief The largest power of a symbol that is multiplied out inline.
+     * Larger integer powers, and powers of other expressions, call
+     * `cppmpc_powi`, which squares repeatedly.
+     */
+    static const int64_t maxInlinePower = 4;
+
+    /**
+     * @brief Whether the power is printed as a call to pow, rather than as
+     * exp, sqrt, or multiplications.
+     */
+    static bool callsPow(const RCP<const Basic>& base,
+                         const RCP<const Basic>& exponent);
+
+    /**
+     * @brief Factor every sum in the expression into a Horner form, e.g.
+     * `x*y + x*z + x` into `x*(1 + y + z)`.
+     */
+    static RCP<const Basic> hornerForm(const RCP<const Basic>& basic);
+
+    /**
+     * @brief The Horner form of either the expression or its expansion,
+     * whichever costs less to evaluate. Expanding cancels terms and removes
+     * parentheses, but can multiply out products of sums into many more
+     * terms.
+     */
+    static RCP<const Basic> optimize(const RCP<const Basic>& basic);
+
+    /**
+     * @brief The C code evaluating the expression.
+     */
+    static std::string code(const RCP<const Basic>& basic);
+
+    /**
+     * @brief The operations in the code of the expression.
+     */
+    static OperationCount operations(const RCP<const Basic>& basic);
+
+    /**
+     * @brief The definitions of the helpers called by the given source. Empty
+     * if it calls none.
+     */
+    static std::string prelude(const std::string& source);
+
+    /**
+     * @brief The definitions of the helpers called by any of the sources.
+     */
+    static std::string prelude(const std::vector<std::string>& sources);
+
+    /**
+     * @brief The definitions of every helper the emitted code can call.
+     */
+    static std::string helpers();
+};
+
+}  // namespace cppmpc
+
+#endif  // INCLUDE_EXPRESSIONEMITTER_H_
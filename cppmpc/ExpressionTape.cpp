@@ -0,0 +1,287 @@
+// Copyright 2021 Ian Ruh
+#include "ExpressionTape.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "CompiledModule.h"
+
+namespace cppmpc {
+
+uint32_t ExpressionTape::handle(uint32_t kind, size_t index) {
+    if (index >= (size_t(1) << ExpressionTape::kindShift)) {
+        throw std::runtime_error("Expression tape is too large");
+    }
+    return (kind << ExpressionTape::kindShift) | static_cast<uint32_t>(index);
+}
+
+uint32_t ExpressionTape::resolve(uint32_t handle) const {
+    uint32_t kind = handle >> ExpressionTape::kindShift;
+    uint32_t index = handle & ((uint32_t(1) << ExpressionTape::kindShift) - 1);
+    size_t numConstants = this->constants.size();
+    size_t numLoads = this->loadIndices.size();
+
+    if (kind == ExpressionTape::constantKind && index < numConstants) {
+        return index;
+    } else if (kind == ExpressionTape::loadKind && index < numLoads) {
+        return numConstants + index;
+    } else if (kind == ExpressionTape::instructionKind &&
+               index < this->ops.size()) {
+        return numConstants + numLoads + index;
+    }
+    throw std::runtime_error("Invalid expression tape handle");
+}
+
+uint32_t ExpressionTape::constant(double value) {
+    if (this->finished) {
+        throw std::runtime_error("Expression tape is already finished");
+    }
+    this->constants.push_back(value);
+    return ExpressionTape::handle(ExpressionTape::constantKind,
+                                  this->constants.size() - 1);
+}
+
+uint32_t ExpressionTape::load(Input input, uint32_t index) {
+    if (this->finished) {
+        throw std::runtime_error("Expression tape is already finished");
+    }
+    this->loadInputs.push_back(input);
+    this->loadIndices.push_back(index);
+    return ExpressionTape::handle(ExpressionTape::loadKind,
+                                  this->loadIndices.size() - 1);
+}
+
+uint32_t ExpressionTape::apply(Op op, uint32_t left, uint32_t right) {
+    if (this->finished) {
+        throw std::runtime_error("Expression tape is already finished");
+    }
+    // Check the operands now, so the tape is always in SSA form
+    this->resolve(left);
+    bool unary = op != Op::Add && op != Op::Sub && op != Op::Mul &&
+                 op != Op::Div && op != Op::Pow;
+    if (!unary) {
+        this->resolve(right);
+    }
+
+    this->ops.push_back(op);
+    this->lefts.push_back(left);
+    this->rights.push_back(unary ? left : right);
+    return ExpressionTape::handle(ExpressionTape::instructionKind,
+                                  this->ops.size() - 1);
+}
+
+void ExpressionTape::setOutputSize(size_t size) { this->_outputSize = size; }
+
+void ExpressionTape::assign(size_t index, uint32_t value) {
+    if (this->finished) {
+        throw std::runtime_error("Expression tape is already finished");
+    }
+    if (index >= this->_outputSize) {
+        throw std::out_of_range("Expression tape output is out of range");
+    }
+    this->resolve(value);
+    this->outputIndices.push_back(static_cast<uint32_t>(index));
+    this->outputRegisters.push_back(value);
+}
+
+void ExpressionTape::finish() {
+    if (this->finished) {
+        return;
+    }
+    for (size_t i = 0; i < this->ops.size(); i++) {
+        this->lefts[i] = this->resolve(this->lefts[i]);
+        this->rights[i] = this->resolve(this->rights[i]);
+    }
+    for (uint32_t& reg : this->outputRegisters) {
+        reg = this->resolve(reg);
+    }
+    this->finished = true;
+}
+
+void ExpressionTape::evaluate(const double* state, const double* param,
+                              const double* weight, double* out) const {
+    if (!this->finished) {
+        throw std::runtime_error(
+                "Expression tape must be finished before it is evaluated");
+    }
+    this->evaluatePoint(state, param, weight, 1, 0, out);
+}
+
+void ExpressionTape::evaluateBatch(size_t count, const double* state,
+                                   const double* param, const double* weight,
+                                   double* out) const {
+    if (!this->finished) {
+        throw std::runtime_error(
+                "Expression tape must be finished before it is evaluated");
+    }
+    for (size_t point = 0; point < count; point++) {
+        this->evaluatePoint(state, param, weight, count, point, out);
+    }
+}
+
+void ExpressionTape::evaluatePoint(const double* state, const double* param,
+                                   const double* weight, size_t count,
+                                   size_t point, double* out) const {
+    // Each thread has its own registers, so a tape can be shared by solves
+    // running in parallel.
+    thread_local std::vector<double> registers;
+    size_t numConstants = this->constants.size();
+    size_t numLoads = this->loadIndices.size();
+    registers.resize(numConstants + numLoads + this->ops.size());
+    double* reg = registers.data();
+
+    std::copy(this->constants.begin(), this->constants.end(), reg);
+
+    const double* inputs[] = {state, param, weight};
+    double* loaded = reg + numConstants;
+    for (size_t i = 0; i < numLoads; i++) {
+        loaded[i] = inputs[static_cast<size_t>(this->loadInputs[i])]
+                          [this->loadIndices[i] * count + point];
+    }
+
+    const Op* ops = this->ops.data();
+    const uint32_t* lefts = this->lefts.data();
+    const uint32_t* rights = this->rights.data();
+    double* results = loaded + numLoads;
+    for (size_t i = 0; i < this->ops.size(); i++) {
+        double a = reg[lefts[i]];
+        double b = reg[rights[i]];
+        double value;
+        switch (ops[i]) {
+            case Op::Add:
+                value = a + b;
+                break;
+            case Op::Sub:
+                value = a - b;
+                break;
+            case Op::Mul:
+                value = a * b;
+                break;
+            case Op::Div:
+                value = a / b;
+                break;
+            case Op::Pow:
+                value = std::pow(a, b);
+                break;
+            case Op::Neg:
+                value = -a;
+                break;
+            case Op::Exp:
+                value = std::exp(a);
+                break;
+            case Op::Log:
+                value = std::log(a);
+                break;
+            case Op::Sqrt:
+                value = std::sqrt(a);
+                break;
+            case Op::Sin:
+                value = std::sin(a);
+                break;
+            case Op::Cos:
+                value = std::cos(a);
+                break;
+            case Op::Tan:
+                value = std::tan(a);
+                break;
+            case Op::Asin:
+                value = std::asin(a);
+                break;
+            case Op::Acos:
+                value = std::acos(a);
+                break;
+            case Op::Atan:
+                value = std::atan(a);
+                break;
+            case Op::Sinh:
+                value = std::sinh(a);
+                break;
+            case Op::Cosh:
+                value = std::cosh(a);
+                break;
+            case Op::Tanh:
+                value = std::tanh(a);
+                break;
+            case Op::Abs:
+                value = std::fabs(a);
+                break;
+            default:
+                value = NAN;
+                break;
+        }
+        results[i] = value;
+    }
+
+    for (size_t i = 0; i < this->_outputSize; i++) {
+        out[i * count + point] = 0.0;
+    }
+    for (size_t i = 0; i < this->outputIndices.size(); i++) {
+        out[this->outputIndices[i] * count + point] =
+                reg[this->outputRegisters[i]];
+    }
+}
+
+std::shared_ptr<const ExpressionTape> TapeModule::tape(
+        const std::string& name) const {
+    auto it = this->tapes.find(name);
+    if (it == this->tapes.end()) {
+        throw std::runtime_error("Function " + name +
+                                 " is missing from the tape module");
+    }
+    return it->second;
+}
+
+void TapeModule::addTape(const std::string& name, ExpressionTape tape) {
+    tape.finish();
+    this->tapes[name] = std::make_shared<const ExpressionTape>(std::move(tape));
+}
+
+void* TapeModule::symbol([[maybe_unused]] const std::string& name) const {
+    return nullptr;
+}
+
+StateFunction TapeModule::stateFunction(const std::string& name) const {
+    std::shared_ptr<const ExpressionTape> tape = this->tape(name);
+    return [tape](const double* state, const double* param, double* out) {
+        tape->evaluate(state, param, nullptr, out);
+    };
+}
+
+ParameterFunction TapeModule::parameterFunction(
+        const std::string& name) const {
+    std::shared_ptr<const ExpressionTape> tape = this->tape(name);
+    return [tape](const double* param, double* out) {
+        tape->evaluate(nullptr, param, nullptr, out);
+    };
+}
+
+WeightedStateFunction TapeModule::weightedStateFunction(
+        const std::string& name) const {
+    std::shared_ptr<const ExpressionTape> tape = this->tape(name);
+    return [tape](const double* state, const double* param,
+                  const double* weight, double* out) {
+        tape->evaluate(state, param, weight, out);
+    };
+}
+
+BatchStateFunction TapeModule::batchStateFunction(
+        const std::string& name) const {
+    auto it = this->tapes.find(name);
+    if (it == this->tapes.end()) {
+        return nullptr;
+    }
+    std::shared_ptr<const ExpressionTape> tape = it->second;
+    return [tape](int count, const double* state, const double* param,
+                  double* out) {
+        tape->evaluateBatch(static_cast<size_t>(count), state, param, nullptr,
+                            out);
+    };
+}
+
+}  // namespace cppmpc
@@ -0,0 +1,194 @@
+// Copyright 2021 Ian Ruh
+#ifndef INCLUDE_EXPRESSIONTAPE_H_
+#define INCLUDE_EXPRESSIONTAPE_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CompiledModule.h"
+
+namespace cppmpc {
+
+/**
+ * @brief A compact, interpretable form of a generated function, which sets
+ * `out[index] = value` for a list of values computed from the state,
+ * parameters, and weights.
+ *
+ * The tape is in SSA form, and is stored as parallel arrays. Every value has
+ * a register, numbered with the constants first, then the loaded inputs, then
+ * the result of each instruction. Evaluating copies the constants, gathers
+ * the inputs, runs one switch per instruction over the arrays, and scatters
+ * the outputs.
+ *
+ * Values are referred to by handles while the tape is built, and finish
+ * resolves the handles to registers.
+ */
+class ExpressionTape {
+ public:
+    /**
+     * @brief The arithmetic instructions. Unary instructions ignore their
+     * right operand.
+     */
+    enum class Op : uint8_t {
+        Add,
+        Sub,
+        Mul,
+        Div,
+        Pow,
+        Neg,
+        Exp,
+        Log,
+        Sqrt,
+        Sin,
+        Cos,
+        Tan,
+        Asin,
+        Acos,
+        Atan,
+        Sinh,
+        Cosh,
+        Tanh,
+        Abs
+    };
+
+    /**
+     * @brief The arrays an input can be loaded from.
+     */
+    enum class Input : uint8_t { State, Parameter, Weight };
+
+ private:
+    // The top bits of a handle say what it refers to, and the rest index into
+    // the constants, loads, or instructions.
+    static const uint32_t kindShift = 30;
+    static const uint32_t constantKind = 0;
+    static const uint32_t loadKind = 1;
+    static const uint32_t instructionKind = 2;
+
+    bool finished = false;
+
+    std::vector<double> constants;
+
+    std::vector<Input> loadInputs;
+    std::vector<uint32_t> loadIndices;
+
+    std::vector<Op> ops;
+    std::vector<uint32_t> lefts;
+    std::vector<uint32_t> rights;
+
+    size_t _outputSize = 0;
+    std::vector<uint32_t> outputIndices;
+    std::vector<uint32_t> outputRegisters;
+
+    static uint32_t handle(uint32_t kind, size_t index);
+
+    /**
+     * @brief The register of a handle, throwing if it refers to something
+     * that doesn't exist.
+     */
+    uint32_t resolve(uint32_t handle) const;
+
+    /**
+     * @brief Evaluate the tape at one point of inputs and outputs in
+     * structure of arrays layout, where element i of the point is at
+     * `array[i * count + point]`.
+     */
+    void evaluatePoint(const double* state, const double* param,
+                       const double* weight, size_t count, size_t point,
+                       double* out) const;
+
+ public:
+    /**
+     * @brief Add a constant, returning its handle.
+     */
+    uint32_t constant(double value);
+
+    /**
+     * @brief Load an element of an input, returning its handle.
+     */
+    uint32_t load(Input input, uint32_t index);
+
+    /**
+     * @brief Add an instruction on already added values, returning the handle
+     * of its result.
+     */
+    uint32_t apply(Op op, uint32_t left, uint32_t right = 0);
+
+    /**
+     * @brief Set the length of the output. Every element not assigned a value
+     * is set to zero.
+     */
+    void setOutputSize(size_t size);
+
+    /**
+     * @brief Set `out[index]` to the given value.
+     */
+    void assign(size_t index, uint32_t value);
+
+    /**
+     * @brief Resolve the handles to registers. The tape can't be changed
+     * afterwards, and has to be finished before it's evaluated.
+     */
+    void finish();
+
+    size_t numInstructions() const { return this->ops.size(); }
+    size_t outputSize() const { return this->_outputSize; }
+
+    /**
+     * @brief Evaluate the tape.
+     *
+     * @param state The state, or null if the tape doesn't read it.
+     * @param param The parameters, or null if the tape doesn't read them.
+     * @param weight The weights, or null if the tape doesn't read them.
+     * @param out The output, with outputSize() elements.
+     */
+    void evaluate(const double* state, const double* param,
+                  const double* weight, double* out) const;
+
+    /**
+     * @brief Evaluate the tape at count points, with the inputs and output in
+     * structure of arrays layout, so element i of point k is at
+     * `array[i * count + k]`.
+     */
+    void evaluateBatch(size_t count, const double* state, const double* param,
+                       const double* weight, double* out) const;
+};
+
+/**
+ * @brief A module of expression tapes, which provides interpreted functions
+ * in place of compiled ones.
+ *
+ * Interpreted modules have no symbols or shared library, so they can't be
+ * exported.
+ */
+class TapeModule : public CompiledModule {
+ private:
+    std::map<std::string, std::shared_ptr<const ExpressionTape>> tapes;
+
+    /**
+     * @brief The tape with the given name, throwing if it doesn't exist.
+     */
+    std::shared_ptr<const ExpressionTape> tape(const std::string& name) const;
+
+ public:
+    /**
+     * @brief Add a finished tape as the function with the given name.
+     */
+    void addTape(const std::string& name, ExpressionTape tape);
+
+    void* symbol(const std::string& name) const override;
+
+    StateFunction stateFunction(const std::string& name) const override;
+    ParameterFunction parameterFunction(
+            const std::string& name) const override;
+    WeightedStateFunction weightedStateFunction(
+            const std::string& name) const override;
+    BatchStateFunction batchStateFunction(
+            const std::string& name) const override;
+};
+
+}  // namespace cppmpc
+
+#endif  // INCLUDE_EXPRESSIONTAPE_H_
@@ -2,9 +2,16 @@
 #include "FastMPCFunctionPointerObjective.h"
 
 #include <Eigen/Dense>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <future>
+#include <memory>
 #include <optional>
 #include <string>
 #include <stdexcept>
+#include <utility>
+#include <vector>
 
 namespace cppmpc {
 
@@ -62,6 +69,31 @@ std::optional<std::string> FunctionPointerObjective::validate() const {
         return "Inequality hessian function pointer is null";
     }
 
+    if (this->hasStructuredInequalityConstraints() &&
+        (this->inequalityConstraintJacobianFunction == nullptr ||
+         this->inequalityConstraintHessianFunction == nullptr)) {
+        return "Inequality constraint jacobian or hessian function pointer is "
+               "null";
+    }
+
+    if (this->_numLinearInequalityConstraints > 0 &&
+        (this->linearInequalityMatrixFunction == nullptr ||
+         this->linearInequalityVectorFunction == nullptr)) {
+        return "Linear inequality matrix or vector function pointer is null";
+    }
+
+    if ((!this->lowerBoundIndices.empty() &&
+         this->lowerBoundFunction == nullptr) ||
+        (!this->upperBoundIndices.empty() &&
+         this->upperBoundFunction == nullptr)) {
+        return "Bound function pointer is null";
+    }
+
+    if (this->numNonlinearInequalityConstraints() < 0) {
+        return "More linear constraints and bounds than inequality "
+               "constraints";
+    }
+
     // Check that if we have parameters, then the parameters vector exists and
     // is the right size.
     if (this->numParameters() > 0) {
@@ -85,6 +117,43 @@ FunctionPointerObjective::FunctionPointerObjective(int numVariables,
           _numEqualityConstraints(numEqualityConstraints),
           _numParameters(numParameters) {}
 
+void FunctionPointerObjective::loadModule(
+        [[maybe_unused]] std::shared_ptr<const CompiledModule> module) {
+    throw std::runtime_error("This objective can't load compiled modules");
+}
+
+void FunctionPointerObjective::loadOptimizedModule() {
+    // Only try once, even if the build failed
+    std::shared_future<std::shared_ptr<const CompiledModule>> optimized =
+            this->optimizedModule;
+    this->optimizedModule = {};
+
+    this->loadModule(optimized.get());
+    this->_compilationTier = CompilationTier::Optimized;
+}
+
+bool FunctionPointerObjective::swapOptimizedModule() {
+    if (!this->optimizedModule.valid() ||
+        this->optimizedModule.wait_for(std::chrono::seconds(0)) !=
+                std::future_status::ready) {
+        return false;
+    }
+
+    try {
+        this->loadOptimizedModule();
+    } catch (const std::exception& e) {
+        DEBUG_PRINT("Keeping unoptimized code: " << e.what());
+        return false;
+    }
+    return true;
+}
+
+void FunctionPointerObjective::waitForOptimizedModule() {
+    if (this->optimizedModule.valid()) {
+        this->loadOptimizedModule();
+    }
+}
+
 void FunctionPointerObjective::setParameters(Eigen::VectorXd parameters) {
 #ifndef NO_VALIDATE_OBJECTIVE
     if(parameters.rows() != this->numParameters()) {
@@ -96,123 +165,489 @@ void FunctionPointerObjective::setParameters(Eigen::VectorXd parameters) {
 
 double FunctionPointerObjective::value(const Eigen::VectorXd& state) const {
     double value;
-    (*this->valueFunction)(state.data(), this->_parameters->data(), &value);
+    this->valueFunction(state.data(), this->_parameters->data(), &value);
     return value;
 }
 
-void FunctionPointerObjective::setValueFunction(ValueFunction functionPtr) {
+void FunctionPointerObjective::setValueFunction(StateFunction functionPtr) {
     this->valueFunction = functionPtr;
 }
 
 const Eigen::VectorXd FunctionPointerObjective::gradient(
         const Eigen::VectorXd& state) const {
     Eigen::VectorXd vec(this->numVariables());
-    (*this->gradientFunction)(state.data(), this->_parameters->data(),
-                              vec.data());
+    this->gradientFunction(state.data(), this->_parameters->data(),
+                           vec.data());
     return vec;
 }
 
 void FunctionPointerObjective::setGradientFunction(
-        GradientFunction functionPtr) {
+        StateFunction functionPtr) {
     this->gradientFunction = functionPtr;
 }
 
 const Eigen::MatrixXd FunctionPointerObjective::hessian(
         const Eigen::VectorXd& state) const {
     Eigen::MatrixXd mat(this->numVariables(), this->numVariables());
-    (*this->hessianFunction)(state.data(), this->_parameters->data(),
-                             mat.data());
+    this->hessianFunction(state.data(), this->_parameters->data(),
+                          mat.data());
     return mat;
 }
 
-void FunctionPointerObjective::setHessianFunction(HessianFunction functionPtr) {
+void FunctionPointerObjective::setHessianFunction(StateFunction functionPtr) {
     this->hessianFunction = functionPtr;
 }
 
+void FunctionPointerObjective::checkBatchDimensions(
+        const Eigen::MatrixXd& states,
+        const Eigen::MatrixXd& parameters) const {
+    if (states.cols() != this->numVariables()) {
+        throw std::runtime_error(
+                "Batch states must have one column per variable.");
+    }
+    if (parameters.cols() != this->numParameters()) {
+        throw std::runtime_error(
+                "Batch parameters must have one column per parameter.");
+    }
+    if (parameters.rows() != states.rows()) {
+        throw std::runtime_error(
+                "Batch states and parameters must have the same number of "
+                "rows.");
+    }
+}
+
+Eigen::VectorXd FunctionPointerObjective::batchValue(
+        const Eigen::MatrixXd& states,
+        const Eigen::MatrixXd& parameters) const {
+    this->checkBatchDimensions(states, parameters);
+    Eigen::VectorXd values(states.rows());
+    if (this->batchValueFunction) {
+        this->batchValueFunction(static_cast<int>(states.rows()),
+                                 states.data(), parameters.data(),
+                                 values.data());
+        return values;
+    }
+
+    for (Eigen::Index k = 0; k < states.rows(); k++) {
+        Eigen::VectorXd state = states.row(k).transpose();
+        Eigen::VectorXd param = parameters.row(k).transpose();
+        this->valueFunction(state.data(), param.data(), &values(k));
+    }
+    return values;
+}
+
+Eigen::MatrixXd FunctionPointerObjective::batchGradient(
+        const Eigen::MatrixXd& states,
+        const Eigen::MatrixXd& parameters) const {
+    this->checkBatchDimensions(states, parameters);
+    Eigen::MatrixXd gradients(states.rows(), this->numVariables());
+    if (this->batchGradientFunction) {
+        this->batchGradientFunction(static_cast<int>(states.rows()),
+                                    states.data(), parameters.data(),
+                                    gradients.data());
+        return gradients;
+    }
+
+    Eigen::VectorXd gradient(this->numVariables());
+    for (Eigen::Index k = 0; k < states.rows(); k++) {
+        Eigen::VectorXd state = states.row(k).transpose();
+        Eigen::VectorXd param = parameters.row(k).transpose();
+        this->gradientFunction(state.data(), param.data(), gradient.data());
+        gradients.row(k) = gradient.transpose();
+    }
+    return gradients;
+}
+
+std::vector<Eigen::MatrixXd> FunctionPointerObjective::batchHessian(
+        const Eigen::MatrixXd& states,
+        const Eigen::MatrixXd& parameters) const {
+    this->checkBatchDimensions(states, parameters);
+    int n = this->numVariables();
+    std::vector<Eigen::MatrixXd> hessians(states.rows(),
+                                          Eigen::MatrixXd(n, n));
+    if (this->batchHessianFunction) {
+        // Row k holds the column-major hessian of point k
+        Eigen::MatrixXd flattened(states.rows(), n * n);
+        this->batchHessianFunction(static_cast<int>(states.rows()),
+                                   states.data(), parameters.data(),
+                                   flattened.data());
+        for (Eigen::Index k = 0; k < states.rows(); k++) {
+            Eigen::VectorXd entries = flattened.row(k).transpose();
+            hessians[k] = Eigen::Map<Eigen::MatrixXd>(entries.data(), n, n);
+        }
+        return hessians;
+    }
+
+    for (Eigen::Index k = 0; k < states.rows(); k++) {
+        Eigen::VectorXd state = states.row(k).transpose();
+        Eigen::VectorXd param = parameters.row(k).transpose();
+        this->hessianFunction(state.data(), param.data(), hessians[k].data());
+    }
+    return hessians;
+}
+
+void FunctionPointerObjective::setBatchObjectiveFunctions(
+        BatchStateFunction valuePtr, BatchStateFunction gradientPtr,
+        BatchStateFunction hessianPtr) {
+    this->batchValueFunction = valuePtr;
+    this->batchGradientFunction = gradientPtr;
+    this->batchHessianFunction = hessianPtr;
+}
+
 std::optional<const Eigen::MatrixXd>
 FunctionPointerObjective::equalityConstraintMatrix() const {
     if (this->numEqualityConstraints() > 0) {
-        Eigen::MatrixXd mat(this->numEqualityConstraints(),
-                            this->numVariables());
-        (*this->equalityMatrixFunction)(this->_parameters->data(), mat.data());
-        return mat;
+        this->updateEqualityConstraints();
+        return this->equalityMatrix;
     } else {
         return std::optional<const Eigen::MatrixXd>();
     }
 }
 
 void FunctionPointerObjective::setEqualityMatrixFunction(
-        EqualityMatrixFunction functionPtr) {
+        ParameterFunction functionPtr) {
     this->equalityMatrixFunction = functionPtr;
+    this->equalityParameters.reset();
 }
 
 std::optional<const Eigen::VectorXd>
 FunctionPointerObjective::equalityConstraintVector() const {
     if (this->numEqualityConstraints() > 0) {
-        Eigen::VectorXd vec(this->numEqualityConstraints());
-        (*this->equalityVectorFunction)(this->_parameters->data(), vec.data());
-        return vec;
+        this->updateEqualityConstraints();
+        return this->equalityVector;
     } else {
         return std::optional<const Eigen::VectorXd>();
     }
 }
 
 void FunctionPointerObjective::setEqualityVectorFunction(
-        EqualityVectorFunction functionPtr) {
+        ParameterFunction functionPtr) {
     this->equalityVectorFunction = functionPtr;
+    this->equalityParameters.reset();
+}
+
+void FunctionPointerObjective::setEqualityUpdateFunctions(
+        std::optional<std::vector<DependentUpdate>> matrixUpdates,
+        std::optional<std::vector<DependentUpdate>> vectorUpdates) {
+    this->equalityMatrixUpdates = std::move(matrixUpdates);
+    this->equalityVectorUpdates = std::move(vectorUpdates);
+    this->equalityParameters.reset();
+}
+
+std::optional<std::vector<DependentUpdate>>
+FunctionPointerObjective::updateFunctions(
+        const CompiledModule& module, const std::string& functionName,
+        const std::optional<std::vector<std::vector<int>>>& dependencies) {
+    if (!dependencies) {
+        return std::nullopt;
+    }
+    std::vector<DependentUpdate> updates;
+    for (size_t i = 0; i < dependencies->size(); i++) {
+        // Interpreted modules have no update functions
+        std::string name = functionName + CompiledModule::updateSuffix +
+                           std::to_string(i);
+        if (module.symbol(name) == nullptr) {
+            return std::nullopt;
+        }
+        updates.push_back(
+                {(*dependencies)[i], module.parameterFunction(name)});
+    }
+    return updates;
+}
+
+void FunctionPointerObjective::updateEqualityConstraints() const {
+    Eigen::VectorXd parameters = this->_parameters.value_or(Eigen::VectorXd());
+    int rows = this->numEqualityConstraints();
+    int cols = this->numVariables();
+    bool cached = this->equalityParameters &&
+                  this->equalityParameters->rows() == parameters.rows() &&
+                  this->equalityMatrix.rows() == rows &&
+                  this->equalityMatrix.cols() == cols;
+    if (cached && *this->equalityParameters == parameters) {
+        return;
+    }
+
+    // Parameters compare unequal to themselves if they are NaN, which only
+    // updates more entries than needed.
+    std::vector<bool> changed(parameters.rows(), true);
+    if (cached) {
+        for (Eigen::Index i = 0; i < parameters.rows(); i++) {
+            changed[i] = parameters(i) != (*this->equalityParameters)(i);
+        }
+    }
+    typedef std::optional<std::vector<DependentUpdate>> Updates;
+    auto update = [&](const Updates& updates, const ParameterFunction& function,
+                      double* out) {
+        if (!cached || !updates) {
+            function(parameters.data(), out);
+            return;
+        }
+        for (const DependentUpdate& dependent : *updates) {
+            for (int parameter : dependent.parameters) {
+                if (changed[parameter]) {
+                    dependent.function(parameters.data(), out);
+                    break;
+                }
+            }
+        }
+    };
+
+    this->equalityMatrix.resize(rows, cols);
+    this->equalityVector.resize(rows);
+    update(this->equalityMatrixUpdates, this->equalityMatrixFunction,
+           this->equalityMatrix.data());
+    update(this->equalityVectorUpdates, this->equalityVectorFunction,
+           this->equalityVector.data());
+    this->equalityParameters = parameters;
+}
+
+int FunctionPointerObjective::numNonlinearInequalityConstraints() const {
+    return this->numInequalityConstraints() -
+           this->_numLinearInequalityConstraints -
+           static_cast<int>(this->lowerBoundIndices.size()) -
+           static_cast<int>(this->upperBoundIndices.size());
+}
+
+bool FunctionPointerObjective::hasLinearInequalityConstraints() const {
+    return this->_numLinearInequalityConstraints > 0 ||
+           !this->lowerBoundIndices.empty() || !this->upperBoundIndices.empty();
+}
+
+void FunctionPointerObjective::updateLinearInequalityConstraints() const {
+    Eigen::VectorXd parameters = this->_parameters.value_or(Eigen::VectorXd());
+    if (this->linearInequalityParameters &&
+        this->linearInequalityParameters->rows() == parameters.rows() &&
+        *this->linearInequalityParameters == parameters) {
+        return;
+    }
+
+    this->linearInequalityMatrix.resize(this->_numLinearInequalityConstraints,
+                                        this->numVariables());
+    this->linearInequalityVector.resize(this->_numLinearInequalityConstraints);
+    if (this->_numLinearInequalityConstraints > 0) {
+        this->linearInequalityMatrixFunction(
+                parameters.data(), this->linearInequalityMatrix.data());
+        this->linearInequalityVectorFunction(
+                parameters.data(), this->linearInequalityVector.data());
+    }
+
+    this->lowerBounds.resize(this->lowerBoundIndices.size());
+    if (!this->lowerBoundIndices.empty()) {
+        this->lowerBoundFunction(parameters.data(), this->lowerBounds.data());
+    }
+
+    this->upperBounds.resize(this->upperBoundIndices.size());
+    if (!this->upperBoundIndices.empty()) {
+        this->upperBoundFunction(parameters.data(), this->upperBounds.data());
+    }
+
+    this->linearInequalityParameters = parameters;
+}
+
+double FunctionPointerObjective::linearInequalityValue(
+        const Eigen::VectorXd& state) const {
+    if (!this->hasLinearInequalityConstraints()) {
+        return 0.0;
+    }
+    this->updateLinearInequalityConstraints();
+
+    // -Σ log(h - Gx)
+    double value = -1 * (this->linearInequalityVector -
+                         this->linearInequalityMatrix * state)
+                                .array()
+                                .log()
+                                .sum();
+
+    // -Σ log(x - lower) - Σ log(upper - x)
+    for (size_t i = 0; i < this->lowerBoundIndices.size(); i++) {
+        value -= std::log(state(this->lowerBoundIndices[i]) -
+                          this->lowerBounds(i));
+    }
+    for (size_t i = 0; i < this->upperBoundIndices.size(); i++) {
+        value -= std::log(this->upperBounds(i) -
+                          state(this->upperBoundIndices[i]));
+    }
+    return value;
+}
+
+void FunctionPointerObjective::addLinearInequalityGradient(
+        const Eigen::VectorXd& state, Eigen::VectorXd* gradient) const {
+    if (!this->hasLinearInequalityConstraints()) {
+        return;
+    }
+    this->updateLinearInequalityConstraints();
+
+    // Gᵀ(1/(h - Gx))
+    if (this->_numLinearInequalityConstraints > 0) {
+        Eigen::VectorXd weights = (this->linearInequalityVector -
+                                   this->linearInequalityMatrix * state)
+                                          .cwiseInverse();
+        *gradient += this->linearInequalityMatrix.transpose() * weights;
+    }
+
+    for (size_t i = 0; i < this->lowerBoundIndices.size(); i++) {
+        int index = this->lowerBoundIndices[i];
+        (*gradient)(index) -= 1 / (state(index) - this->lowerBounds(i));
+    }
+    for (size_t i = 0; i < this->upperBoundIndices.size(); i++) {
+        int index = this->upperBoundIndices[i];
+        (*gradient)(index) += 1 / (this->upperBounds(i) - state(index));
+    }
+}
+
+void FunctionPointerObjective::addLinearInequalityHessian(
+        const Eigen::VectorXd& state, Eigen::MatrixXd* hessian) const {
+    if (!this->hasLinearInequalityConstraints()) {
+        return;
+    }
+    this->updateLinearInequalityConstraints();
+
+    // Gᵀ diag(1/(h - Gx)²) G
+    if (this->_numLinearInequalityConstraints > 0) {
+        Eigen::VectorXd weights = (this->linearInequalityVector -
+                                   this->linearInequalityMatrix * state)
+                                          .cwiseInverse()
+                                          .cwiseAbs2();
+        *hessian += this->linearInequalityMatrix.transpose() *
+                    weights.asDiagonal() * this->linearInequalityMatrix;
+    }
+
+    // The bounds only add to the diagonal.
+    for (size_t i = 0; i < this->lowerBoundIndices.size(); i++) {
+        int index = this->lowerBoundIndices[i];
+        double slack = state(index) - this->lowerBounds(i);
+        (*hessian)(index, index) += 1 / (slack * slack);
+    }
+    for (size_t i = 0; i < this->upperBoundIndices.size(); i++) {
+        int index = this->upperBoundIndices[i];
+        double slack = this->upperBounds(i) - state(index);
+        (*hessian)(index, index) += 1 / (slack * slack);
+    }
+}
+
+Eigen::VectorXd FunctionPointerObjective::inequalityConstraintVector(
+        const Eigen::VectorXd& state) const {
+    Eigen::VectorXd vec(this->numNonlinearInequalityConstraints());
+    this->inequalityConstraintVectorFunction(
+            state.data(), this->_parameters->data(), vec.data());
+    return vec;
+}
+
+Eigen::MatrixXd FunctionPointerObjective::inequalityConstraintJacobian(
+        const Eigen::VectorXd& state) const {
+    Eigen::MatrixXd mat(this->numNonlinearInequalityConstraints(),
+                        this->numVariables());
+    this->inequalityConstraintJacobianFunction(
+            state.data(), this->_parameters->data(), mat.data());
+    return mat;
 }
 
 double FunctionPointerObjective::inequalityConstraintsValue(
         const Eigen::VectorXd& state) const {
-    if (this->numInequalityConstraints() > 0) {
-        double value;
-        (*this->inequalityValueFunction)(state.data(),
-                                         this->_parameters->data(), &value);
-        return value;
-    } else {
-        return Objective::inequalityConstraintsValue(state);
+    double value = Objective::inequalityConstraintsValue(state) +
+                   this->linearInequalityValue(state);
+    if (this->numNonlinearInequalityConstraints() > 0 &&
+        this->hasStructuredInequalityConstraints()) {
+        // -Σ log(-g_i)
+        Eigen::VectorXd g = this->inequalityConstraintVector(state);
+        value -= (-1 * g.array()).log().sum();
+    } else if (this->numNonlinearInequalityConstraints() > 0) {
+        double nonlinearValue;
+        this->inequalityValueFunction(
+                state.data(), this->_parameters->data(), &nonlinearValue);
+        value += nonlinearValue;
     }
+    return value;
 }
 
 void FunctionPointerObjective::setInequalityValueFunction(
-        InequalityValueFunction functionPtr) {
+        StateFunction functionPtr) {
     this->inequalityValueFunction = functionPtr;
 }
 
 const Eigen::VectorXd FunctionPointerObjective::inequalityConstraintsGradient(
         const Eigen::VectorXd& state) const {
-    if (this->numInequalityConstraints() > 0) {
-        Eigen::VectorXd vec(this->numVariables());
-        (*this->inequalityGradientFunction)(
-                state.data(), this->_parameters->data(), vec.data());
-        return vec;
-    } else {
-        return Objective::inequalityConstraintsGradient(state);
+    Eigen::VectorXd vec = Objective::inequalityConstraintsGradient(state);
+    this->addLinearInequalityGradient(state, &vec);
+    if (this->numNonlinearInequalityConstraints() > 0 &&
+        this->hasStructuredInequalityConstraints()) {
+        // Jᵀ(1/-g)
+        Eigen::VectorXd weights =
+                (-1 * this->inequalityConstraintVector(state)).cwiseInverse();
+        vec += this->inequalityConstraintJacobian(state).transpose() * weights;
+    } else if (this->numNonlinearInequalityConstraints() > 0) {
+        Eigen::VectorXd nonlinearVec(this->numVariables());
+        this->inequalityGradientFunction(
+                state.data(), this->_parameters->data(), nonlinearVec.data());
+        vec += nonlinearVec;
     }
+    return vec;
 }
 
 void FunctionPointerObjective::setInequalityGradientFunction(
-        InequalityGradientFunction functionPtr) {
+        StateFunction functionPtr) {
     this->inequalityGradientFunction = functionPtr;
 }
 
 const Eigen::MatrixXd FunctionPointerObjective::inequalityConstraintsHessian(
         const Eigen::VectorXd& state) const {
-    if (this->numInequalityConstraints() > 0) {
-        Eigen::MatrixXd mat(this->numVariables(), this->numVariables());
-        (*this->inequalityHessianFunction)(
-                state.data(), this->_parameters->data(), mat.data());
-        return mat;
-    } else {
-        return Objective::inequalityConstraintsHessian(state);
+    Eigen::MatrixXd mat = Objective::inequalityConstraintsHessian(state);
+    this->addLinearInequalityHessian(state, &mat);
+    if (this->numNonlinearInequalityConstraints() > 0 &&
+        this->hasStructuredInequalityConstraints()) {
+        // Jᵀ diag(1/g²) J + Σ (1/-g_i)∇²g_i
+        Eigen::VectorXd weights =
+                (-1 * this->inequalityConstraintVector(state)).cwiseInverse();
+        Eigen::MatrixXd jacobian = this->inequalityConstraintJacobian(state);
+
+        Eigen::MatrixXd weighted(this->numVariables(), this->numVariables());
+        this->inequalityConstraintHessianFunction(
+                state.data(), this->_parameters->data(), weights.data(),
+                weighted.data());
+        mat += weighted + jacobian.transpose() *
+                                  weights.cwiseAbs2().asDiagonal() * jacobian;
+    } else if (this->numNonlinearInequalityConstraints() > 0) {
+        Eigen::MatrixXd nonlinearMat(this->numVariables(),
+                                     this->numVariables());
+        this->inequalityHessianFunction(
+                state.data(), this->_parameters->data(), nonlinearMat.data());
+        mat += nonlinearMat;
     }
+    return mat;
 }
 
 void FunctionPointerObjective::setInequalityHessianFunction(
-        InequalityHessianFunction functionPtr) {
+        StateFunction functionPtr) {
     this->inequalityHessianFunction = functionPtr;
 }
 
+void FunctionPointerObjective::setInequalityConstraintFunctions(
+        StateFunction vectorPtr, StateFunction jacobianPtr,
+        WeightedStateFunction hessianPtr) {
+    this->inequalityConstraintVectorFunction = vectorPtr;
+    this->inequalityConstraintJacobianFunction = jacobianPtr;
+    this->inequalityConstraintHessianFunction = hessianPtr;
+}
+
+void FunctionPointerObjective::setLinearInequalityFunctions(
+        int numConstraints, ParameterFunction matrixPtr,
+        ParameterFunction vectorPtr) {
+    this->_numLinearInequalityConstraints = numConstraints;
+    this->linearInequalityMatrixFunction = matrixPtr;
+    this->linearInequalityVectorFunction = vectorPtr;
+    this->linearInequalityParameters.reset();
+}
+
+void FunctionPointerObjective::setBoundFunctions(
+        const std::vector<int>& lowerIndices, ParameterFunction lowerPtr,
+        const std::vector<int>& upperIndices, ParameterFunction upperPtr) {
+    this->lowerBoundIndices = lowerIndices;
+    this->lowerBoundFunction = lowerPtr;
+    this->upperBoundIndices = upperIndices;
+    this->upperBoundFunction = upperPtr;
+    this->linearInequalityParameters.reset();
+}
+
 }  // namespace FastMPC
 
 }  // namespace cppmpc
@@ -3,8 +3,13 @@
 #define INCLUDE_FASTMPCFUNCTIONPOINTEROBJECTIVE_H_
 
 #include <Eigen/Dense>
+#include <functional>
+#include <future>
+#include <memory>
 #include <optional>
 #include <string>
+#include <vector>
+#include "CompiledModule.h"
 #include "FastMPC.h"
 #include "Util.h"
 
@@ -12,6 +17,16 @@ namespace cppmpc {
 
 namespace FastMPC {
 
+/**
+ * struct DependentUpdate - A function reassigning the entries of a
+ * parameter-only output that depend on a set of parameters.
+ */
+typedef struct DependentUpdate {
+    // The indices of the parameters the entries depend on.
+    std::vector<int> parameters;
+    ParameterFunction function;
+} DependentUpdate;
+
 // TODO(ianruh): Reuse the same vector/matrix for each of the functions each
 // time they are called rather than allocating a new one.
 /**
@@ -21,6 +36,11 @@ namespace FastMPC {
  * functions in FastMPC::Objective. Refer to those functions for what each
  * function should calculate, and refer to the set* functions in this class
  * for the semantics of accessing and returning the values/vectors/matrices.
+ *
+ * The equality and linear inequality constraints are cached by the const
+ * evaluation functions, so an objective can't be evaluated from several
+ * threads at once. Concurrent solvers should each use their own copy, which
+ * shares the compiled code.
  */
 class FunctionPointerObjective : public Objective {
  protected:
@@ -35,6 +55,39 @@ class FunctionPointerObjective : public Objective {
     int _numParameters;
     std::optional<Eigen::VectorXd> _parameters;
 
+    // The module the function pointers point into, which is kept alive for as
+    // long as the objective (or any copy of it) is.
+    std::shared_ptr<const CompiledModule> module;
+    CompilationTier _compilationTier = CompilationTier::Optimized;
+
+    // An optimized build of the module that is being compiled in the
+    // background, which replaces the module once it's ready and
+    // swapOptimizedModule or waitForOptimizedModule is called. Releasing the
+    // last reference to a pending build, by destroying the objective or
+    // finalizing it again, waits for the build to finish.
+    std::shared_future<std::shared_ptr<const CompiledModule>> optimizedModule;
+
+    /**
+     * @brief Set the function pointers from the functions in the module, and
+     * keep the module alive.
+     *
+     * Objectives with generated code override this to look up their
+     * functions. The default implementation throws.
+     */
+    virtual void loadModule(std::shared_ptr<const CompiledModule> module);
+
+    /**
+     * @brief The update functions `<name><CompiledModule::updateSuffix><i>`
+     * of a parameter-only function, paired with the parameters each depends
+     * on, or nothing if any of them is missing from the module.
+     *
+     * @param dependencies The parameters of each update function, in order,
+     * or nothing if the function has no update functions.
+     */
+    static std::optional<std::vector<DependentUpdate>> updateFunctions(
+            const CompiledModule& module, const std::string& functionName,
+            const std::optional<std::vector<std::vector<int>>>& dependencies);
+
  public:
     // Types of the function pointers being used
     typedef void (*ValueFunction)(const double* state, const double* param,
@@ -55,6 +108,23 @@ class FunctionPointerObjective : public Objective {
     typedef void (*InequalityHessianFunction)(const double* state,
                                               const double* param, double* out);
 
+    typedef void (*InequalityConstraintVectorFunction)(const double* state,
+                                                       const double* param,
+                                                       double* out);
+    typedef void (*InequalityConstraintJacobianFunction)(const double* state,
+                                                         const double* param,
+                                                         double* out);
+    typedef void (*InequalityConstraintHessianFunction)(const double* state,
+                                                        const double* param,
+                                                        const double* weight,
+                                                        double* out);
+
+    typedef void (*LinearInequalityMatrixFunction)(const double* param,
+                                                   double* out);
+    typedef void (*LinearInequalityVectorFunction)(const double* param,
+                                                   double* out);
+    typedef void (*BoundFunction)(const double* param, double* out);
+
  private:
     /**
      * struct DefaultFunctions - Default implementations of the functions to
@@ -74,23 +144,118 @@ class FunctionPointerObjective : public Objective {
     } DefaultFunctions;
 
     //============= Function pointer storage =============
-    ValueFunction valueFunction = nullptr;
-    GradientFunction gradientFunction = nullptr;
-    HessianFunction hessianFunction = nullptr;
+    // The functions are stored as callables, so they can be either compiled
+    // function pointers or interpreted expression tapes.
+    StateFunction valueFunction;
+    StateFunction gradientFunction;
+    StateFunction hessianFunction;
+
+    // Batched variants of the value, gradient, and hessian functions, which
+    // are optional. Without them, the batch evaluations loop over the points.
+    BatchStateFunction batchValueFunction;
+    BatchStateFunction batchGradientFunction;
+    BatchStateFunction batchHessianFunction;
 
-    EqualityMatrixFunction equalityMatrixFunction =
+    ParameterFunction equalityMatrixFunction =
             &DefaultFunctions::equalityMatrixFunction;
-    EqualityVectorFunction equalityVectorFunction =
+    ParameterFunction equalityVectorFunction =
             &DefaultFunctions::equalityVectorFunction;
 
-    InequalityValueFunction inequalityValueFunction =
+    StateFunction inequalityValueFunction =
             &DefaultFunctions::inequalityValueFunction;
-    InequalityGradientFunction inequalityGradientFunction =
+    StateFunction inequalityGradientFunction =
             &DefaultFunctions::inequalityGradientFunction;
-    InequalityHessianFunction inequalityHessianFunction =
+    StateFunction inequalityHessianFunction =
             &DefaultFunctions::inequalityHessianFunction;
+
+    // When set, the barrier is assembled from the constraint values, jacobian,
+    // and hessians instead of using the inequality value/gradient/hessian
+    // functions.
+    StateFunction inequalityConstraintVectorFunction;
+    StateFunction inequalityConstraintJacobianFunction;
+    WeightedStateFunction inequalityConstraintHessianFunction;
+
+    // Linear constraints G x < h, and the bounds on single variables. These
+    // are included in the number of inequality constraints.
+    int _numLinearInequalityConstraints = 0;
+    ParameterFunction linearInequalityMatrixFunction;
+    ParameterFunction linearInequalityVectorFunction;
+    std::vector<int> lowerBoundIndices;
+    std::vector<int> upperBoundIndices;
+    ParameterFunction lowerBoundFunction;
+    ParameterFunction upperBoundFunction;
+    // Functions updating only the entries of the equality matrix and vector
+    // that depend on some parameters. Without them, every entry is
+    // re-evaluated when any parameter changes.
+    std::optional<std::vector<DependentUpdate>> equalityMatrixUpdates;
+    std::optional<std::vector<DependentUpdate>> equalityVectorUpdates;
     //====================================================
 
+    // The equality matrix and vector only depend on the parameters, so they
+    // are cached along with the parameters they were evaluated with.
+    mutable std::optional<Eigen::VectorXd> equalityParameters;
+    mutable Eigen::MatrixXd equalityMatrix;
+    mutable Eigen::VectorXd equalityVector;
+
+    /**
+     * @brief Re-evaluate the entries of the equality matrix and vector that
+     * depend on the parameters that changed since they were last evaluated.
+     */
+    void updateEqualityConstraints() const;
+
+    // G, h, and the bounds only depend on the parameters, so they are cached
+    // along with the parameters they were evaluated with.
+    mutable std::optional<Eigen::VectorXd> linearInequalityParameters;
+    mutable Eigen::MatrixXd linearInequalityMatrix;
+    mutable Eigen::VectorXd linearInequalityVector;
+    mutable Eigen::VectorXd lowerBounds;
+    mutable Eigen::VectorXd upperBounds;
+
+    /**
+     * @brief The number of inequality constraints that are not linear
+     * constraints or bounds.
+     */
+    int numNonlinearInequalityConstraints() const;
+
+    /**
+     * @brief Whether there are any linear constraints or bounds.
+     */
+    bool hasLinearInequalityConstraints() const;
+
+    /**
+     * @brief Re-evaluate G, h, and the bounds if the parameters have changed
+     * since they were last evaluated.
+     */
+    void updateLinearInequalityConstraints() const;
+
+    /**
+     * @brief The barrier of the linear constraints and bounds.
+     */
+    double linearInequalityValue(const Eigen::VectorXd& state) const;
+    void addLinearInequalityGradient(const Eigen::VectorXd& state,
+                                     Eigen::VectorXd* gradient) const;
+    void addLinearInequalityHessian(const Eigen::VectorXd& state,
+                                    Eigen::MatrixXd* hessian) const;
+
+    /**
+     * @brief Evaluate the inequality constraint vector g(x).
+     */
+    Eigen::VectorXd inequalityConstraintVector(
+            const Eigen::VectorXd& state) const;
+
+    /**
+     * @brief Evaluate the mxn jacobian of the inequality constraint vector.
+     */
+    Eigen::MatrixXd inequalityConstraintJacobian(
+            const Eigen::VectorXd& state) const;
+
+    /**
+     * @brief Throw if the states and parameters of a batch evaluation don't
+     * have one row per point and one column per variable or parameter.
+     */
+    void checkBatchDimensions(const Eigen::MatrixXd& states,
+                              const Eigen::MatrixXd& parameters) const;
+
  protected:
     /**
      * @brief Calls the parent validate function, but also checks that none of
@@ -98,6 +263,13 @@ class FunctionPointerObjective : public Objective {
      */
     std::optional<std::string> validate() const override;
 
+ private:
+    /**
+     * @brief Replace the module with the optimized build, rethrowing if it
+     * failed to compile.
+     */
+    void loadOptimizedModule();
+
  public:
     FunctionPointerObjective(int numVariables, int numInequalityConstraints,
                              int numEqualityConstraints, int numParameters);
@@ -114,6 +286,39 @@ class FunctionPointerObjective : public Objective {
         return this->_numEqualityConstraints;
     }
 
+    /**
+     * @brief The tier of the code the objective is currently evaluated with.
+     * Objectives built from user provided function pointers are assumed to be
+     * optimized.
+     */
+    CompilationTier compilationTier() const { return this->_compilationTier; }
+
+    /**
+     * @brief Whether an optimized build is still waiting to be swapped in.
+     */
+    bool hasPendingOptimizedModule() const {
+        return this->optimizedModule.valid();
+    }
+
+    /**
+     * @brief Swap in the optimized build if it has finished compiling,
+     * without waiting for it.
+     *
+     * The function pointers and the module they point into are replaced, so
+     * this must be called between solves, while no solver or other thread is
+     * evaluating the objective. If the optimized build failed, the objective
+     * keeps using the code it has.
+     *
+     * @return Whether the optimized build was swapped in.
+     */
+    bool swapOptimizedModule();
+
+    /**
+     * @brief Block until the optimized build has finished, and swap it in.
+     * Throws if it failed to compile.
+     */
+    void waitForOptimizedModule();
+
     double value(const Eigen::VectorXd& state) const override;
     /**
      * @brief Set the function pointer for the value function.
@@ -129,7 +334,7 @@ class FunctionPointerObjective : public Objective {
      * objective value given the state and parameters when the function
      * ValueFunction exits.
      */
-    void setValueFunction(ValueFunction functionPtr);
+    void setValueFunction(StateFunction functionPtr);
 
     const Eigen::VectorXd gradient(const Eigen::VectorXd& state) const override;
     /**
@@ -145,7 +350,7 @@ class FunctionPointerObjective : public Objective {
      * The out pointer will point to an array of doubles with the same length
      * as the number of variables as reported by numVariables().
      */
-    void setGradientFunction(GradientFunction functionPtr);
+    void setGradientFunction(StateFunction functionPtr);
 
     const Eigen::MatrixXd hessian(const Eigen::VectorXd& state) const override;
     /**
@@ -162,7 +367,51 @@ class FunctionPointerObjective : public Objective {
      * as the number of variables as reported by numVariables() squared. The
      * matrix is in a column-major format.
      */
-    void setHessianFunction(HessianFunction functionPtr);
+    void setHessianFunction(StateFunction functionPtr);
+
+    /**
+     * @brief Evaluate the objective at many points at once.
+     *
+     * @param states One state per row, so K x numVariables().
+     * @param parameters One set of parameters per row, so K x
+     * numParameters().
+     * @return The K values.
+     */
+    Eigen::VectorXd batchValue(const Eigen::MatrixXd& states,
+                               const Eigen::MatrixXd& parameters) const;
+
+    /**
+     * @brief Evaluate the gradient at many points at once, like batchValue.
+     *
+     * @return One gradient per row, so K x numVariables().
+     */
+    Eigen::MatrixXd batchGradient(const Eigen::MatrixXd& states,
+                                  const Eigen::MatrixXd& parameters) const;
+
+    /**
+     * @brief Evaluate the hessian at many points at once, like batchValue.
+     *
+     * @return The hessian at each of the K points.
+     */
+    std::vector<Eigen::MatrixXd> batchHessian(
+            const Eigen::MatrixXd& states,
+            const Eigen::MatrixXd& parameters) const;
+
+    /**
+     * @brief Set the batched variants of the value, gradient, and hessian
+     * functions. Any of them can be null, in which case that batch evaluation
+     * calls the scalar function once per point.
+     *
+     * The batched functions are called with the number of points K, and the
+     * states, parameters, and output in structure of arrays layout, so
+     * element i of point k is at `array[i * K + k]`. That is the layout of a
+     * column-major matrix with one point per row, so the states and
+     * parameters are passed straight through. The hessians are column-major
+     * with numVariables() squared elements per point.
+     */
+    void setBatchObjectiveFunctions(BatchStateFunction valuePtr,
+                                    BatchStateFunction gradientPtr,
+                                    BatchStateFunction hessianPtr);
 
     std::optional<const Eigen::MatrixXd> equalityConstraintMatrix()
             const override;
@@ -179,7 +428,7 @@ class FunctionPointerObjective : public Objective {
      * This EqualityMatrixFunction will not be called if the number of
      * equality constraints is 0.
      */
-    void setEqualityMatrixFunction(EqualityMatrixFunction functionPtr);
+    void setEqualityMatrixFunction(ParameterFunction functionPtr);
 
     std::optional<const Eigen::VectorXd> equalityConstraintVector()
             const override;
@@ -195,7 +444,22 @@ class FunctionPointerObjective : public Objective {
      * This EqualityVectorFunction will not be called if the number of
      * equality constraints is 0.
      */
-    void setEqualityVectorFunction(EqualityVectorFunction functionPtr);
+    void setEqualityVectorFunction(ParameterFunction functionPtr);
+
+    /**
+     * @brief Set the functions updating the entries of the equality matrix
+     * and vector that depend on some of the parameters.
+     *
+     * Each update function takes the same arguments as the function setting
+     * the whole matrix or vector, but only assigns the entries depending on
+     * its parameters. Entries that don't depend on any parameter must not be
+     * in any update function. When only some parameters change, only the
+     * update functions depending on one of them are called. Without update
+     * functions, the whole matrix or vector is re-evaluated.
+     */
+    void setEqualityUpdateFunctions(
+            std::optional<std::vector<DependentUpdate>> matrixUpdates,
+            std::optional<std::vector<DependentUpdate>> vectorUpdates);
 
     double inequalityConstraintsValue(
             const Eigen::VectorXd& state) const override;
@@ -216,15 +480,84 @@ class FunctionPointerObjective : public Objective {
      * InequalityValueFunction will not be called if the number of inequality
      * constraints is 0.
      */
-    void setInequalityValueFunction(InequalityValueFunction functionPtr);
+    void setInequalityValueFunction(StateFunction functionPtr);
 
     const Eigen::VectorXd inequalityConstraintsGradient(
             const Eigen::VectorXd& state) const override;
-    void setInequalityGradientFunction(InequalityGradientFunction functionPtr);
+    void setInequalityGradientFunction(StateFunction functionPtr);
 
     const Eigen::MatrixXd inequalityConstraintsHessian(
             const Eigen::VectorXd& state) const override;
-    void setInequalityHessianFunction(InequalityHessianFunction funcionPtr);
+    void setInequalityHessianFunction(StateFunction funcionPtr);
+
+    /**
+     * @brief Set the function pointers used to assemble the barrier
+     * numerically. Once set, the inequality value, gradient, and hessian
+     * functions are no longer used.
+     *
+     * @param vectorPtr The constraint vector function. The out pointer will
+     * point to an array with the same length as the number of inequality
+     * constraints that are not linear constraints or bounds, which should be
+     * set to the constraint values in normal form (e.g. g(x) < 0).
+     * @param jacobianPtr The constraint jacobian function. The out pointer will
+     * point to an array for the column-major mxn jacobian of the constraint
+     * vector.
+     * @param hessianPtr The weighted constraint hessian function. The weight
+     * pointer points to m weights, and the out pointer to an array for the
+     * column-major nxn matrix Σ weight_i ∇²g_i.
+     *
+     * The barrier is then evaluated as:
+     *  - value: -Σ log(-g_i)
+     *  - gradient: Jᵀ(1/-g)
+     *  - hessian: Jᵀ diag(1/g²) J + Σ (1/-g_i)∇²g_i
+     */
+    void setInequalityConstraintFunctions(StateFunction vectorPtr,
+                                          StateFunction jacobianPtr,
+                                          WeightedStateFunction hessianPtr);
+
+    /**
+     * @brief Whether the barrier is assembled from the constraint functions.
+     */
+    bool hasStructuredInequalityConstraints() const {
+        return this->inequalityConstraintVectorFunction != nullptr;
+    }
+
+    /**
+     * @brief Set the functions for the linear inequality constraints G x < h.
+     *
+     * @param numConstraints The number of linear constraints, which are
+     * included in the number of inequality constraints.
+     * @param matrixPtr Sets the column-major matrix G, with one row per linear
+     * constraint and one column per variable, from the parameters.
+     * @param vectorPtr Sets the vector h from the parameters.
+     *
+     * G and h are only re-evaluated when the parameters change, and the
+     * barrier is evaluated numerically:
+     *  - value: -Σ log(h - Gx)
+     *  - gradient: Gᵀ(1/(h - Gx))
+     *  - hessian: Gᵀ diag(1/(h - Gx)²) G
+     */
+    void setLinearInequalityFunctions(int numConstraints,
+                                      ParameterFunction matrixPtr,
+                                      ParameterFunction vectorPtr);
+
+    /**
+     * @brief Set the bounds lower < x[i] and x[i] < upper.
+     *
+     * Each bound is included in the number of inequality constraints. The
+     * bound functions set one value per index from the parameters, and are
+     * only re-evaluated when the parameters change. The hessian of the bound
+     * barriers is diagonal.
+     *
+     * @param lowerIndices The indices of the variables with a lower bound.
+     * @param lowerPtr Sets the lower bounds.
+     * @param upperIndices The indices of the variables with an upper bound.
+     * @param upperPtr Sets the upper bounds.
+     */
+    void setBoundFunctions(const std::vector<int>& lowerIndices,
+                           ParameterFunction lowerPtr,
+                           const std::vector<int>& upperIndices,
+                           ParameterFunction upperPtr);
 };
 
 }  // namespace FastMPC
@@ -0,0 +1,207 @@
+// Copyright 2021 Ian Ruh
+#include "FinalizeProfiler.h"
+
+#include <symengine/basic.h>
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <unordered_set>
+#include <vector>
+
+namespace cppmpc {
+
+namespace {
+
+// The profiler and the innermost phase on each thread
+thread_local FinalizeProfiler* activeProfiler = nullptr;
+thread_local FinalizeProfiler::Phase* activePhase = nullptr;
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+            .count();
+}
+
+std::string jsonString(const std::string& text) {
+    std::stringstream ss;
+    ss << "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            ss << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            ss << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+               << static_cast<int>(c) << std::dec;
+        } else {
+            ss << c;
+        }
+    }
+    ss << "\"";
+    return ss.str();
+}
+
+}  // namespace
+
+std::string FinalizeReport::toJson() const {
+    std::stringstream ss;
+    ss << std::setprecision(9);
+    ss << "{\n";
+    ss << "  \"totalSeconds\": " << this->totalSeconds << ",\n";
+
+    ss << "  \"phases\": [";
+    for (size_t i = 0; i < this->phases.size(); i++) {
+        const PhaseTiming& phase = this->phases[i];
+        ss << (i == 0 ? "\n" : ",\n") << "    {\"name\": "
+           << jsonString(phase.name) << ", \"seconds\": " << phase.seconds
+           << ", \"calls\": " << phase.calls << "}";
+    }
+    ss << (this->phases.empty() ? "],\n" : "\n  ],\n");
+
+    ss << "  \"transforms\": [";
+    for (size_t i = 0; i < this->transforms.size(); i++) {
+        const TransformSize& transform = this->transforms[i];
+        ss << (i == 0 ? "\n" : ",\n") << "    {\"name\": "
+           << jsonString(transform.name)
+           << ", \"nodesBefore\": " << transform.nodesBefore
+           << ", \"nodesAfter\": " << transform.nodesAfter
+           << ", \"applications\": " << transform.applications << "}";
+    }
+    ss << (this->transforms.empty() ? "],\n" : "\n  ],\n");
+
+    ss << "  \"sourceBytes\": {";
+    bool first = true;
+    for (const auto& source : this->sourceBytes) {
+        ss << (first ? "\n" : ",\n") << "    " << jsonString(source.first)
+           << ": " << source.second;
+        first = false;
+    }
+    ss << (this->sourceBytes.empty() ? "},\n" : "\n  },\n");
+
+    ss << "  \"objectBytes\": " << this->objectBytes << "\n";
+    ss << "}\n";
+    return ss.str();
+}
+
+FinalizeProfiler::FinalizeProfiler()
+        : start(std::chrono::steady_clock::now()) {}
+
+void FinalizeProfiler::addPhase(const std::string& name, double seconds) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto it = this->phaseIndices.find(name);
+    if (it == this->phaseIndices.end()) {
+        it = this->phaseIndices.emplace(name, this->report.phases.size())
+                     .first;
+        this->report.phases.push_back(PhaseTiming{name, 0, 0});
+    }
+    PhaseTiming& phase = this->report.phases[it->second];
+    phase.seconds += seconds;
+    phase.calls += 1;
+}
+
+void FinalizeProfiler::addTransform(const std::string& name,
+                                    size_t nodesBefore, size_t nodesAfter) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto it = this->transformIndices.find(name);
+    if (it == this->transformIndices.end()) {
+        it = this->transformIndices
+                     .emplace(name, this->report.transforms.size())
+                     .first;
+        this->report.transforms.push_back(TransformSize{name, 0, 0, 0});
+    }
+    TransformSize& transform = this->report.transforms[it->second];
+    transform.nodesBefore += nodesBefore;
+    transform.nodesAfter += nodesAfter;
+    transform.applications += 1;
+}
+
+void FinalizeProfiler::addSourceBytes(const std::string& name, size_t bytes) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->report.sourceBytes[name] += bytes;
+}
+
+void FinalizeProfiler::addObjectBytes(size_t bytes) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->report.objectBytes += bytes;
+}
+
+FinalizeReport FinalizeProfiler::finish() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->report.totalSeconds = secondsSince(this->start);
+    return this->report;
+}
+
+FinalizeProfiler* FinalizeProfiler::active() { return activeProfiler; }
+
+size_t FinalizeProfiler::countNodes(const SymEngine::vec_basic& expressions) {
+    std::unordered_set<RCP<const Basic>, SymEngine::RCPBasicHash,
+                       SymEngine::RCPBasicKeyEq>
+            seen;
+    std::vector<RCP<const Basic>> stack(expressions.begin(),
+                                        expressions.end());
+    while (!stack.empty()) {
+        RCP<const Basic> node = stack.back();
+        stack.pop_back();
+        if (!seen.insert(node).second) {
+            continue;
+        }
+        for (const RCP<const Basic>& arg : node->get_args()) {
+            stack.push_back(arg);
+        }
+    }
+    return seen.size();
+}
+
+void FinalizeProfiler::recordTransform(const std::string& name,
+                                       const SymEngine::vec_basic& before,
+                                       const SymEngine::vec_basic& after) {
+    if (FinalizeProfiler* profiler = FinalizeProfiler::active()) {
+        profiler->addTransform(name, FinalizeProfiler::countNodes(before),
+                               FinalizeProfiler::countNodes(after));
+    }
+}
+
+void FinalizeProfiler::recordObject(const std::string& path) {
+    if (FinalizeProfiler* profiler = FinalizeProfiler::active()) {
+        std::error_code error;
+        uintmax_t size = std::filesystem::file_size(path, error);
+        if (!error) {
+            profiler->addObjectBytes(static_cast<size_t>(size));
+        }
+    }
+}
+
+FinalizeProfiler::Scope::Scope(FinalizeProfiler& profiler)
+        : previous(activeProfiler) {
+    activeProfiler = &profiler;
+}
+
+FinalizeProfiler::Scope::~Scope() { activeProfiler = this->previous; }
+
+FinalizeProfiler::Phase::Phase(const char* name)
+        : profiler(activeProfiler), name(name), parent(nullptr) {
+    if (this->profiler == nullptr) {
+        return;
+    }
+    this->parent = activePhase;
+    activePhase = this;
+    this->start = std::chrono::steady_clock::now();
+}
+
+FinalizeProfiler::Phase::~Phase() {
+    if (this->profiler == nullptr) {
+        return;
+    }
+    double seconds = secondsSince(this->start);
+    this->profiler->addPhase(this->name, seconds - this->nestedSeconds);
+    if (this->parent != nullptr && this->parent->profiler == this->profiler) {
+        this->parent->nestedSeconds += seconds;
+    }
+    activePhase = this->parent;
+}
+
+}  // namespace cppmpc
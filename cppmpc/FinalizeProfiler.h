@@ -0,0 +1,162 @@
+// Copyright 2021 Ian Ruh
+#ifndef INCLUDE_FINALIZEPROFILER_H_
+#define INCLUDE_FINALIZEPROFILER_H_
+
+#include <symengine/basic.h>
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace cppmpc {
+
+using SymEngine::Basic;
+using SymEngine::RCP;
+
+/**
+ * struct PhaseTiming - The wall time spent in one phase of finalize.
+ */
+typedef struct PhaseTiming {
+    std::string name;
+    // Not counting the time of the phases nested in it, so the phases add up
+    // to the time spent in any phase.
+    double seconds = 0;
+    size_t calls = 0;
+} PhaseTiming;
+
+/**
+ * struct TransformSize - The size of the expressions before and after a
+ * symbolic transform.
+ *
+ * Nodes are the distinct subexpressions of the expressions a transform was
+ * applied to at once, summed over every time it was applied.
+ */
+typedef struct TransformSize {
+    std::string name;
+    size_t nodesBefore = 0;
+    size_t nodesAfter = 0;
+    // The number of times the transform was applied.
+    size_t applications = 0;
+} TransformSize;
+
+/**
+ * struct FinalizeReport - Where the time of a finalize went, and how large
+ * its expressions and code were.
+ */
+typedef struct FinalizeReport {
+    double totalSeconds = 0;
+    // In the order the phases first started.
+    std::vector<PhaseTiming> phases;
+    // In the order the transforms were first applied.
+    std::vector<TransformSize> transforms;
+    // The bytes of generated code of each function, by its name.
+    std::map<std::string, size_t> sourceBytes;
+    // The size of the compiled library, or 0 if nothing was compiled to a
+    // file, e.g. with TinyCC or the interpreter.
+    size_t objectBytes = 0;
+
+    /**
+     * @brief The report as a JSON object.
+     */
+    std::string toJson() const;
+} FinalizeReport;
+
+/**
+ * @brief Collects a FinalizeReport.
+ *
+ * While a FinalizeProfiler::Scope is alive, the phases, transforms, and
+ * compiled libraries of that thread are recorded to its profiler. Without an
+ * active profiler, recording does nothing, and the expressions aren't
+ * counted.
+ */
+class FinalizeProfiler {
+ private:
+    FinalizeReport report;
+    std::map<std::string, size_t> phaseIndices;
+    std::map<std::string, size_t> transformIndices;
+    std::chrono::steady_clock::time_point start;
+    std::mutex mutex;
+
+ public:
+    FinalizeProfiler();
+
+    FinalizeProfiler(const FinalizeProfiler&) = delete;
+    FinalizeProfiler& operator=(const FinalizeProfiler&) = delete;
+
+    void addPhase(const std::string& name, double seconds);
+    void addTransform(const std::string& name, size_t nodesBefore,
+                      size_t nodesAfter);
+    void addSourceBytes(const std::string& name, size_t bytes);
+    void addObjectBytes(size_t bytes);
+
+    /**
+     * @brief The report, with the time since the profiler was created.
+     */
+    FinalizeReport finish();
+
+    /**
+     * @brief The profiler of the innermost scope on this thread, or null.
+     */
+    static FinalizeProfiler* active();
+
+    /**
+     * @brief The number of distinct subexpressions of the expressions.
+     */
+    static size_t countNodes(const SymEngine::vec_basic& expressions);
+
+    /**
+     * @brief Record a transform to the active profiler, if there is one.
+     */
+    static void recordTransform(const std::string& name,
+                                const SymEngine::vec_basic& before,
+                                const SymEngine::vec_basic& after);
+
+    /**
+     * @brief Record the size of a compiled library to the active profiler, if
+     * there is one.
+     */
+    static void recordObject(const std::string& path);
+
+    /**
+     * @brief Make a profiler the active profiler on this thread until the
+     * scope is destroyed.
+     */
+    class Scope {
+     private:
+        FinalizeProfiler* previous;
+
+     public:
+        explicit Scope(FinalizeProfiler& profiler);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    /**
+     * @brief Time a phase until it is destroyed, if there is an active
+     * profiler. The time of phases started on the same thread while it is
+     * alive is left out of its own.
+     */
+    class Phase {
+     private:
+        FinalizeProfiler* profiler;
+        const char* name;
+        Phase* parent;
+        std::chrono::steady_clock::time_point start;
+        double nestedSeconds = 0;
+
+     public:
+        explicit Phase(const char* name);
+        ~Phase();
+
+        Phase(const Phase&) = delete;
+        Phase& operator=(const Phase&) = delete;
+    };
+};
+
+}  // namespace cppmpc
+
+#endif  // INCLUDE_FINALIZEPROFILER_H_
@@ -16,7 +16,8 @@ using SymEngine::RCP;
 using SymEngine::Symbol;
 
 void GetSymbolsVisitor::bvisit(const SymEngine::Symbol &x) {
-    this->symbols.insert(SymEngine::symbol(x.get_name()));
+    this->symbols.insert(
+            SymEngine::rcp_static_cast<const Symbol>(x.rcp_from_this()));
 }
 
 void GetSymbolsVisitor::bvisit(const SymEngine::Basic &b) {
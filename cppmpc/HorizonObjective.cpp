@@ -0,0 +1,513 @@
+// Copyright 2021 Ian Ruh
+#include "HorizonObjective.h"
+
+#include <symengine/basic.h>
+#include <symengine/matrix.h>
+#include <symengine/mul.h>
+#include <symengine/symbol.h>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "CodeGenerator.h"
+#include "CompiledModule.h"
+#include "RuntimeCompiler.h"
+#include "SymEngineUtilities.h"
+#include "SymbolCollector.h"
+
+namespace cppmpc {
+
+namespace FastMPC {
+
+/**
+ * @brief Like the symbolic objective, the sizes are set to negative 1 until
+ * the horizon is finalized.
+ */
+HorizonObjective::HorizonObjective(size_t numStages)
+        : FunctionPointerObjective(-1, -1, -1, -1), numStages(numStages) {
+    if (numStages == 0) {
+        throw std::runtime_error("A horizon must have at least one stage.");
+    }
+}
+
+std::optional<std::string> HorizonObjective::validate() const {
+    if (!this->finalized) {
+        return "HorizonObjective must be finalized before being given to a "
+               "solver.";
+    }
+    return FunctionPointerObjective::validate();
+}
+
+void HorizonObjective::setState(
+        const std::vector<RCP<const Symbol>>& state,
+        const std::vector<RCP<const Symbol>>& nextState) {
+    if (state.size() != nextState.size()) {
+        throw std::runtime_error(
+                "The state and next state must be the same size.");
+    }
+    this->state = state;
+    this->nextState = nextState;
+}
+
+void HorizonObjective::setControl(
+        const std::vector<RCP<const Symbol>>& control) {
+    this->control = control;
+}
+
+void HorizonObjective::setStageParameters(
+        const std::vector<RCP<const Symbol>>& parameters) {
+    this->stageParameters = parameters;
+}
+
+void HorizonObjective::setGlobalParameters(
+        const std::vector<RCP<const Symbol>>& parameters) {
+    this->globalParameters = parameters;
+}
+
+void HorizonObjective::setStageCost(const Expression& cost) {
+    this->stageCost = cost.get_basic();
+}
+
+void HorizonObjective::appendDynamicsConstraint(const Expression& left,
+                                                const Expression& right) {
+    this->dynamicsConstraints.appendConstraint(left, right);
+}
+
+void HorizonObjective::setInitialState(
+        const std::vector<Expression>& initialState) {
+    this->initialState.clear();
+    for (const Expression& exp : initialState) {
+        this->initialState.push_back(exp.get_basic());
+    }
+}
+
+void HorizonObjective::checkStageSymbols(const RCP<const Basic>& basic,
+                                         const OrderedSet& variables,
+                                         const OrderedSet& parameters,
+                                         const std::string& description) const {
+    for (const RCP<const Symbol>& variable : cppmpc::getVariables(basic)) {
+        if (!variables.contains(variable)) {
+            throw std::runtime_error(description +
+                                     " depends on a variable that is not "
+                                     "part of the stage.");
+        }
+    }
+    for (const RCP<const Symbol>& parameter : cppmpc::getParameters(basic)) {
+        if (!parameters.contains(parameter)) {
+            throw std::runtime_error(description +
+                                     " depends on a parameter that is not "
+                                     "part of the stage.");
+        }
+    }
+}
+
+MapBasicString HorizonObjective::parameterRepresentation() const {
+    MapBasicString parameterRepr;
+    for (size_t i = 0; i < this->globalParameters.size(); i++) {
+        parameterRepr[this->globalParameters[i]] =
+                "param[" + std::to_string(i) + "]";
+    }
+    for (size_t i = 0; i < this->stageParameters.size(); i++) {
+        parameterRepr[this->stageParameters[i]] =
+                "sp[" + std::to_string(i) + "]";
+    }
+    return parameterRepr;
+}
+
+std::string HorizonObjective::zeroArrayCode(const std::string& arrayName,
+                                            size_t size) {
+    std::stringstream ss;
+    ss << "for (int i = 0; i < " << std::to_string(size) << "; i++) {"
+       << std::endl;
+    ss << arrayName << "[i] = 0;" << std::endl;
+    ss << "}" << std::endl;
+    return ss.str();
+}
+
+std::string HorizonObjective::stageLoopCode(size_t numStages,
+                                            bool withState) const {
+    std::stringstream ss;
+    ss << "for (int k = 0; k < " << std::to_string(numStages) << "; k++) {"
+       << std::endl;
+    if (withState) {
+        ss << "const double* z = state + k * "
+           << std::to_string(this->stageWidth()) << ";" << std::endl;
+    }
+    ss << "const double* sp = param + "
+       << std::to_string(this->globalParameters.size()) << " + k * "
+       << std::to_string(this->stageParameters.size()) << ";" << std::endl;
+    return ss.str();
+}
+
+std::vector<std::string> HorizonObjective::generateObjectiveFunctions(
+        const OrderedSet& stageOrdering, const MapBasicString& variableRepr,
+        const MapBasicString& parameterRepr) const {
+    size_t width = this->stageWidth();
+    size_t n = this->numStages * width;
+
+    // The stage is only differentiated once
+    SymEngine::DenseMatrix costMat(1, 1);
+    costMat.set(0, 0, *this->stageCost);
+    std::vector<SymbolicTriplet> gradientEntries;
+    for (const SymbolicTriplet& entry :
+         cppmpc::sparseJacobian(costMat, stageOrdering)) {
+        gradientEntries.push_back({entry.col, 0, entry.value});
+    }
+    std::vector<SymbolicTriplet> hessianEntries =
+            cppmpc::sparseHessian(*this->stageCost, stageOrdering);
+
+    //============= Value ===========
+    std::stringstream ssValue;
+
+    // Function signature
+    ssValue << "void " << this->valueFunctionName
+            << "(const double* state, const double* param, double* out) {"
+            << std::endl;
+    ssValue << "out[0] = 0;" << std::endl;
+    ssValue << this->stageLoopCode(this->numStages, true);
+    ssValue << "out[0] += "
+            << CodeGenerator::generateExpressionCode(
+                       *this->stageCost, variableRepr, parameterRepr)
+            << ";" << std::endl;
+    ssValue << "}" << std::endl;
+    ssValue << "}" << std::endl;
+
+    //============= Gradient ===========
+    std::stringstream ssGrad;
+
+    // Function signature
+    ssGrad << "void " << this->gradientFunctionName
+           << "(const double* state, const double* param, double* out) {"
+           << std::endl;
+    ssGrad << zeroArrayCode("out", n);
+    ssGrad << this->stageLoopCode(this->numStages, true);
+    ssGrad << CodeGenerator::generateOffsetMatrixCode(
+            gradientEntries, variableRepr, parameterRepr, "out",
+            "k * " + std::to_string(width), n);
+    ssGrad << "}" << std::endl;
+    ssGrad << "}" << std::endl;
+
+    //============= Hessian ===========
+    // Each stage's block is on the diagonal
+    std::stringstream ssHess;
+
+    // Function signature
+    ssHess << "void " << this->hessianFunctionName
+           << "(const double* state, const double* param, double* out) {"
+           << std::endl;
+    ssHess << zeroArrayCode("out", n * n);
+    ssHess << this->stageLoopCode(this->numStages, true);
+    ssHess << CodeGenerator::generateOffsetMatrixCode(
+            hessianEntries, variableRepr, parameterRepr, "out",
+            "k * " + std::to_string(width * n + width), n);
+    ssHess << "}" << std::endl;
+    ssHess << "}" << std::endl;
+
+    return {ssValue.str(), ssGrad.str(), ssHess.str()};
+}
+
+std::vector<std::string> HorizonObjective::generateEqualityFunctions(
+        const OrderedSet& localOrdering,
+        const MapBasicString& parameterRepr) const {
+    size_t width = this->stageWidth();
+    size_t n = this->numStages * width;
+    size_t numInitial = this->initialState.size();
+    size_t numDynamics = this->dynamicsConstraints.numConstraints();
+    size_t numRows = this->numEqualityConstraints();
+
+    // The columns of the local system are [x_k, u_k, x_{k+1}], which are
+    // contiguous in the stage major variables.
+    std::vector<SymbolicTriplet> entries;
+    std::vector<RCP<const Basic>> constants;
+    std::tie(entries, constants) =
+            this->dynamicsConstraints.convertToSparseLinearSystem(
+                    localOrdering);
+    for (SymbolicTriplet& entry : entries) {
+        entry.row += numInitial;
+    }
+    std::vector<SymbolicTriplet> constantEntries;
+    for (size_t i = 0; i < constants.size(); i++) {
+        constantEntries.push_back({i, 0, constants[i]});
+    }
+
+    //============= Equality Matrix ===========
+    std::stringstream ssMat;
+
+    // Function signature
+    ssMat << "void " << this->equalityMatrixFunctionName
+          << "(const double* param, double* out) {" << std::endl;
+    ssMat << zeroArrayCode("out", numRows * n);
+
+    // The initial state rows select x_0
+    for (size_t i = 0; i < numInitial; i++) {
+        ssMat << "out[" << std::to_string(i * numRows + i) << "] = 1;"
+              << std::endl;
+    }
+
+    // The dynamics of the last stage aren't constrained
+    ssMat << this->stageLoopCode(this->numStages - 1, false);
+    ssMat << CodeGenerator::generateOffsetMatrixCode(
+            entries, MapBasicString(), parameterRepr, "out",
+            "k * " + std::to_string(width * numRows + numDynamics), numRows);
+    ssMat << "}" << std::endl;
+    ssMat << "}" << std::endl;
+
+    //============= Equality Vector ===========
+    std::stringstream ssVec;
+
+    // Function signature
+    ssVec << "void " << this->equalityVectorFunctionName
+          << "(const double* param, double* out) {" << std::endl;
+    for (size_t i = 0; i < numInitial; i++) {
+        ssVec << "out[" << std::to_string(i) << "] = "
+              << CodeGenerator::generateExpressionCode(
+                         this->initialState[i], MapBasicString(),
+                         parameterRepr)
+              << ";" << std::endl;
+    }
+    ssVec << this->stageLoopCode(this->numStages - 1, false);
+    ssVec << CodeGenerator::generateOffsetMatrixCode(
+            constantEntries, MapBasicString(), parameterRepr, "out",
+            std::to_string(numInitial) + " + k * " +
+                    std::to_string(numDynamics),
+            1);
+    ssVec << "}" << std::endl;
+    ssVec << "}" << std::endl;
+
+    return {ssMat.str(), ssVec.str()};
+}
+
+std::vector<std::string> HorizonObjective::generateInequalityFunctions(
+        const OrderedSet& stageOrdering, const MapBasicString& variableRepr,
+        const MapBasicString& parameterRepr) const {
+    const SymbolicInequalityConstraints& constraints =
+            this->stageInequalityConstraints;
+    size_t width = this->stageWidth();
+    size_t n = this->numStages * width;
+    size_t m = constraints.numConstraints();
+    size_t numRows = this->numStages * m;
+
+    SymEngine::DenseMatrix vectorMat = constraints.symbolicConstraintVector();
+    std::vector<SymbolicTriplet> vectorEntries;
+    for (size_t i = 0; i < m; i++) {
+        vectorEntries.push_back({i, 0, vectorMat.get(i, 0)});
+    }
+    std::vector<SymbolicTriplet> jacobianEntries =
+            constraints.symbolicConstraintJacobian(stageOrdering);
+
+    // Each stage's weights start at sw, and the duplicate entries are summed
+    // by the matrix generation.
+    std::vector<std::vector<SymbolicTriplet>> hessians =
+            constraints.symbolicConstraintHessians(stageOrdering);
+    std::vector<SymbolicTriplet> weightedEntries;
+    for (size_t i = 0; i < hessians.size(); i++) {
+        RCP<const Symbol> weight =
+                SymEngine::symbol("sw[" + std::to_string(i) + "]");
+        for (const SymbolicTriplet& entry : hessians[i]) {
+            RCP<const Basic> weighted = SymEngine::mul(weight, entry.value);
+            weightedEntries.push_back({entry.row, entry.col, weighted});
+        }
+    }
+
+    //============= Constraint Vector Function ===========
+    std::stringstream ssVec;
+
+    // Function signature
+    ssVec << "void " << this->inequalityConstraintVectorFunctionName
+          << "(const double* state, const double* param, double* out) {"
+          << std::endl;
+    ssVec << this->stageLoopCode(this->numStages, true);
+    ssVec << CodeGenerator::generateOffsetMatrixCode(
+            vectorEntries, variableRepr, parameterRepr, "out",
+            "k * " + std::to_string(m), 1);
+    ssVec << "}" << std::endl;
+    ssVec << "}" << std::endl;
+
+    //============= Constraint Jacobian Function ===========
+    std::stringstream ssJac;
+
+    // Function signature
+    ssJac << "void " << this->inequalityConstraintJacobianFunctionName
+          << "(const double* state, const double* param, double* out) {"
+          << std::endl;
+    ssJac << zeroArrayCode("out", numRows * n);
+    ssJac << this->stageLoopCode(this->numStages, true);
+    ssJac << CodeGenerator::generateOffsetMatrixCode(
+            jacobianEntries, variableRepr, parameterRepr, "out",
+            "k * " + std::to_string(width * numRows + m), numRows);
+    ssJac << "}" << std::endl;
+    ssJac << "}" << std::endl;
+
+    //============= Weighted Constraint Hessian Function ===========
+    std::stringstream ssHess;
+
+    // Function signature
+    ssHess << "void " << this->inequalityConstraintHessianFunctionName
+           << "(const double* state, const double* param, "
+           << "const double* weight, double* out) {" << std::endl;
+    ssHess << zeroArrayCode("out", n * n);
+    ssHess << this->stageLoopCode(this->numStages, true);
+    ssHess << "const double* sw = weight + k * " << std::to_string(m) << ";"
+           << std::endl;
+    ssHess << CodeGenerator::generateOffsetMatrixCode(
+            weightedEntries, variableRepr, parameterRepr, "out",
+            "k * " + std::to_string(width * n + width), n);
+    ssHess << "}" << std::endl;
+    ssHess << "}" << std::endl;
+
+    return {ssVec.str(), ssJac.str(), ssHess.str()};
+}
+
+void HorizonObjective::finalize() {
+    if (!this->stageCost) {
+        throw std::runtime_error(
+                "Stage cost must be set before the horizon can be finalized.");
+    }
+    if (this->state.empty()) {
+        throw std::runtime_error(
+                "State must be set before the horizon can be finalized.");
+    }
+    if (!this->initialState.empty() &&
+        this->initialState.size() != this->state.size()) {
+        throw std::runtime_error(
+                "The initial state must be the same size as the state.");
+    }
+
+    SymbolCollector collector;
+    SymbolCollector::Scope collectorScope(collector);
+
+    // The stage variables [x_k, u_k], and the local variables of the dynamics
+    // [x_k, u_k, x_{k+1}].
+    OrderedSet stageOrdering(this->state);
+    stageOrdering.append(this->control.begin(), this->control.end());
+    OrderedSet localOrdering = stageOrdering;
+    localOrdering.append(this->nextState.begin(), this->nextState.end());
+
+    OrderedSet globalOrdering(this->globalParameters);
+    OrderedSet parameterOrdering = globalOrdering;
+    parameterOrdering.append(this->stageParameters.begin(),
+                             this->stageParameters.end());
+
+    this->checkStageSymbols(*this->stageCost, stageOrdering,
+                            parameterOrdering, "The stage cost");
+    for (size_t i = 0; i < this->stageInequalityConstraints.numConstraints();
+         i++) {
+        this->checkStageSymbols(
+                this->stageInequalityConstraints.getConstraint(i),
+                stageOrdering, parameterOrdering,
+                "A stage inequality constraint");
+    }
+    for (size_t i = 0; i < this->dynamicsConstraints.numConstraints(); i++) {
+        this->checkStageSymbols(this->dynamicsConstraints.getConstraint(i),
+                                localOrdering, parameterOrdering,
+                                "A dynamics constraint");
+    }
+    for (const RCP<const Basic>& exp : this->initialState) {
+        this->checkStageSymbols(exp, OrderedSet(), globalOrdering,
+                                "The initial state");
+    }
+
+    // The stage variables are indexed from the start of the stage
+    MapBasicString variableRepr;
+    for (size_t i = 0; i < stageOrdering.size(); i++) {
+        variableRepr[stageOrdering.at(i)] = "z[" + std::to_string(i) + "]";
+    }
+    MapBasicString parameterRepr = this->parameterRepresentation();
+
+    // Set the sizes first, as the generated functions depend on them
+    this->_numVariables = this->numStages * this->stageWidth();
+    this->_numParameters = this->globalParameters.size() +
+                           this->numStages * this->stageParameters.size();
+    this->_numEqualityConstraints =
+            this->initialState.size() +
+            (this->numStages - 1) * this->dynamicsConstraints.numConstraints();
+    this->_numInequalityConstraints =
+            this->numStages * this->stageInequalityConstraints.numConstraints();
+
+    std::vector<std::string> functionStrings;
+    for (const std::vector<std::string>& functions :
+         {this->generateObjectiveFunctions(stageOrdering, variableRepr,
+                                           parameterRepr),
+          this->generateEqualityFunctions(localOrdering, parameterRepr),
+          this->generateInequalityFunctions(stageOrdering, variableRepr,
+                                            parameterRepr)}) {
+        functionStrings.insert(functionStrings.end(), functions.begin(),
+                               functions.end());
+    }
+
+    std::stringstream metadata;
+    metadata << "stages: " << this->numStages << std::endl;
+    metadata << "variables: " << this->_numVariables << std::endl;
+    metadata << "parameters: " << this->_numParameters << std::endl;
+    metadata << "equalityConstraints: " << this->_numEqualityConstraints
+             << std::endl;
+    metadata << "inequalityConstraints: " << this->_numInequalityConstraints
+             << std::endl;
+
+    TieredModule tiered = RuntimeCompiler::compileTiered(
+            functionStrings, metadata.str(), this->compileOptions);
+    this->loadModule(tiered.module);
+    this->_compilationTier = tiered.tier;
+    this->optimizedModule = tiered.optimized;
+    this->finalized = true;
+}
+
+void HorizonObjective::loadModule(
+        std::shared_ptr<const CompiledModule> module) {
+    this->setValueFunction(module->stateFunction(this->valueFunctionName));
+    this->setGradientFunction(
+            module->stateFunction(this->gradientFunctionName));
+    this->setHessianFunction(module->stateFunction(this->hessianFunctionName));
+
+    this->setEqualityMatrixFunction(
+            module->parameterFunction(this->equalityMatrixFunctionName));
+    this->setEqualityVectorFunction(
+            module->parameterFunction(this->equalityVectorFunctionName));
+
+    // The barrier is always assembled from the constraint functions, so only
+    // a single stage's constraint hessians are generated.
+    this->setInequalityConstraintFunctions(
+            module->stateFunction(this->inequalityConstraintVectorFunctionName),
+            module->stateFunction(
+                    this->inequalityConstraintJacobianFunctionName),
+            module->weightedStateFunction(
+                    this->inequalityConstraintHessianFunctionName));
+
+    this->module = module;
+}
+
+size_t HorizonObjective::stateIndex(size_t stage, size_t i) const {
+    if (stage >= this->numStages || i >= this->state.size()) {
+        throw std::out_of_range("State index is out of range.");
+    }
+    return stage * this->stageWidth() + i;
+}
+
+size_t HorizonObjective::controlIndex(size_t stage, size_t i) const {
+    if (stage >= this->numStages || i >= this->control.size()) {
+        throw std::out_of_range("Control index is out of range.");
+    }
+    return stage * this->stageWidth() + this->state.size() + i;
+}
+
+size_t HorizonObjective::globalParameterIndex(size_t i) const {
+    if (i >= this->globalParameters.size()) {
+        throw std::out_of_range("Global parameter index is out of range.");
+    }
+    return i;
+}
+
+size_t HorizonObjective::stageParameterIndex(size_t stage, size_t i) const {
+    if (stage >= this->numStages || i >= this->stageParameters.size()) {
+        throw std::out_of_range("Stage parameter index is out of range.");
+    }
+    return this->globalParameters.size() +
+           stage * this->stageParameters.size() + i;
+}
+
+}  // namespace FastMPC
+
+}  // namespace cppmpc
@@ -0,0 +1,217 @@
+// Copyright 2021 Ian Ruh
+#ifndef INCLUDE_HORIZONOBJECTIVE_H_
+#define INCLUDE_HORIZONOBJECTIVE_H_
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <symengine/basic.h>
+#include <symengine/expression.h>
+
+#include "FastMPCFunctionPointerObjective.h"
+#include "OrderedSet.h"
+#include "RuntimeCompiler.h"
+#include "SymEngineUtilities.h"
+#include "SymbolicEquality.h"
+#include "SymbolicInequality.h"
+
+namespace cppmpc {
+
+namespace FastMPC {
+
+using SymEngine::Basic;
+using SymEngine::Expression;
+using SymEngine::RCP;
+using SymEngine::Symbol;
+
+/**
+ * @brief An objective over a horizon of identical stages.
+ *
+ * One stage is described with stage-local symbols: the state x_k, the control
+ * u_k, the next state x_{k+1}, the stage parameters p_k, and the global
+ * parameters g. The stage is differentiated once, and the generated functions
+ * loop over the stages, so the finalize time and the size of the generated
+ * code don't depend on the number of stages.
+ *
+ * The variables are stage major, [x_0, u_0, x_1, u_1, ...], and the parameters
+ * are [g, p_0, p_1, ...]. The objective is Σ cost(x_k, u_k, p_k, g), subject
+ * to:
+ *  - x_0 = the initial state, which can only depend on g.
+ *  - The dynamics constraints between x_k, u_k, and x_{k+1}, for every stage
+ *    but the last, which must be linear in the variables.
+ *  - The stage inequality constraints on x_k and u_k, for every stage.
+ */
+class HorizonObjective : public FunctionPointerObjective {
+ private:
+    size_t numStages;
+    bool finalized = false;
+
+    std::vector<RCP<const Symbol>> state;
+    std::vector<RCP<const Symbol>> nextState;
+    std::vector<RCP<const Symbol>> control;
+    std::vector<RCP<const Symbol>> stageParameters;
+    std::vector<RCP<const Symbol>> globalParameters;
+
+    std::optional<RCP<const Basic>> stageCost;
+    SymbolicEqualityConstraints dynamicsConstraints;
+    std::vector<RCP<const Basic>> initialState;
+
+    // Function names
+    const std::string valueFunctionName = "value";
+    const std::string gradientFunctionName = "gradient";
+    const std::string hessianFunctionName = "hessian";
+    const std::string equalityMatrixFunctionName = "equalityMatrix";
+    const std::string equalityVectorFunctionName = "equalityVector";
+    const std::string inequalityConstraintVectorFunctionName =
+            "inequalityConstraintVector";
+    const std::string inequalityConstraintJacobianFunctionName =
+            "inequalityConstraintJacobian";
+    const std::string inequalityConstraintHessianFunctionName =
+            "inequalityConstraintHessian";
+
+    /**
+     * @brief Check that the basic only depends on the given variables and the
+     * stage and global parameters.
+     */
+    void checkStageSymbols(const RCP<const Basic>& basic,
+                           const OrderedSet& variables,
+                           const OrderedSet& parameters,
+                           const std::string& description) const;
+
+    /**
+     * @brief The representations of the stage and global parameters.
+     */
+    MapBasicString parameterRepresentation() const;
+
+    /**
+     * @brief The start of a loop over the given number of stages, which sets
+     * `sp` to the stage parameters and, if withState, `z` to the stage
+     * variables. The loop still needs to be closed.
+     */
+    std::string stageLoopCode(size_t numStages, bool withState) const;
+
+    /**
+     * @brief Code that sets the first size elements of an array to zero.
+     */
+    static std::string zeroArrayCode(const std::string& arrayName,
+                                     size_t size);
+
+    std::vector<std::string> generateObjectiveFunctions(
+            const OrderedSet& stageOrdering,
+            const MapBasicString& variableRepr,
+            const MapBasicString& parameterRepr) const;
+    std::vector<std::string> generateEqualityFunctions(
+            const OrderedSet& localOrdering,
+            const MapBasicString& parameterRepr) const;
+    std::vector<std::string> generateInequalityFunctions(
+            const OrderedSet& stageOrdering,
+            const MapBasicString& variableRepr,
+            const MapBasicString& parameterRepr) const;
+
+ protected:
+    /**
+     * @brief Set the function pointers from a module compiled on finalize.
+     */
+    void loadModule(std::shared_ptr<const CompiledModule> module) override;
+
+    /**
+     * @brief Check that the horizon has been finalized and call the function
+     * pointer objective validate function.
+     */
+    std::optional<std::string> validate() const override;
+
+ public:
+    /**
+     * @param numStages The number of stages in the horizon.
+     */
+    explicit HorizonObjective(size_t numStages);
+
+    // Inequality constraints on the state and control of a single stage,
+    // which are applied to every stage.
+    SymbolicInequalityConstraints stageInequalityConstraints;
+
+    // How the generated functions are compiled on finalize.
+    CompileOptions compileOptions;
+
+    /**
+     * @brief Set the state of a stage, and the state of the following stage
+     * used by the dynamics.
+     */
+    void setState(const std::vector<RCP<const Symbol>>& state,
+                  const std::vector<RCP<const Symbol>>& nextState);
+
+    /**
+     * @brief Set the control of a stage.
+     */
+    void setControl(const std::vector<RCP<const Symbol>>& control);
+
+    /**
+     * @brief Set the parameters that have a different value for each stage.
+     */
+    void setStageParameters(const std::vector<RCP<const Symbol>>& parameters);
+
+    /**
+     * @brief Set the parameters that are shared by all of the stages.
+     */
+    void setGlobalParameters(const std::vector<RCP<const Symbol>>& parameters);
+
+    /**
+     * @brief Set the cost of a single stage, which can only depend on the
+     * state, control, and parameters.
+     */
+    void setStageCost(const Expression& cost);
+
+    /**
+     * @brief Add the dynamics constraint left = right between the state,
+     * control, and next state, which must be linear in those variables.
+     */
+    void appendDynamicsConstraint(const Expression& left,
+                                  const Expression& right);
+
+    /**
+     * @brief Set the initial state, which can only depend on the global
+     * parameters.
+     */
+    void setInitialState(const std::vector<Expression>& initialState);
+
+    /**
+     * @brief Differentiate the stage, then compile the looped functions and
+     * set the function pointers.
+     */
+    void finalize();
+
+    /**
+     * @brief The number of variables in a single stage.
+     */
+    size_t stageWidth() const {
+        return this->state.size() + this->control.size();
+    }
+
+    /**
+     * @brief The index of the ith state variable of a stage.
+     */
+    size_t stateIndex(size_t stage, size_t i) const;
+
+    /**
+     * @brief The index of the ith control variable of a stage.
+     */
+    size_t controlIndex(size_t stage, size_t i) const;
+
+    /**
+     * @brief The index of the ith global parameter.
+     */
+    size_t globalParameterIndex(size_t i) const;
+
+    /**
+     * @brief The index of the ith parameter of a stage.
+     */
+    size_t stageParameterIndex(size_t stage, size_t i) const;
+};
+
+}  // namespace FastMPC
+
+}  // namespace cppmpc
+
+#endif  // INCLUDE_HORIZONOBJECTIVE_H_
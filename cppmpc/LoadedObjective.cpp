@@ -0,0 +1,106 @@
+// Copyright 2021 Ian Ruh
+#include "LoadedObjective.h"
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "CompiledModule.h"
+#include "FastMPCFunctionPointerObjective.h"
+#include "ObjectiveManifest.h"
+
+namespace cppmpc {
+
+namespace FastMPC {
+
+const char* LoadedObjective::libraryFileName = "objective.so";
+const char* LoadedObjective::manifestFileName = "manifest.txt";
+
+LoadedObjective::LoadedObjective(const std::string& directory)
+        : FunctionPointerObjective(0, 0, 0, 0),
+          _manifest(ObjectiveManifest::read(directory + "/" +
+                                            manifestFileName)) {
+    this->_numVariables = this->_manifest.numVariables;
+    this->_numParameters = this->_manifest.numParameters;
+    this->_numEqualityConstraints = this->_manifest.numEqualityConstraints;
+    this->_numInequalityConstraints = this->_manifest.numInequalityConstraints;
+
+    this->loadModule(std::make_shared<SharedLibraryModule>(
+            directory + "/" + libraryFileName));
+}
+
+void LoadedObjective::loadModule(
+        std::shared_ptr<const CompiledModule> module) {
+    // The function names are the same as the symbolic objective's
+    this->setValueFunction(module->stateFunction("value"));
+    this->setGradientFunction(module->stateFunction("gradient"));
+    this->setHessianFunction(module->stateFunction("hessian"));
+    // Objectives exported before batched functions were generated don't have
+    // them, and loop over the scalar functions instead.
+    this->setBatchObjectiveFunctions(module->batchStateFunction("value"),
+                                     module->batchStateFunction("gradient"),
+                                     module->batchStateFunction("hessian"));
+
+    this->setEqualityMatrixFunction(
+            module->parameterFunction("equalityMatrix"));
+    this->setEqualityVectorFunction(
+            module->parameterFunction("equalityVector"));
+    this->setEqualityUpdateFunctions(
+            FunctionPointerObjective::updateFunctions(
+                    *module, "equalityMatrix",
+                    this->_manifest.equalityMatrixUpdates),
+            FunctionPointerObjective::updateFunctions(
+                    *module, "equalityVector",
+                    this->_manifest.equalityVectorUpdates));
+
+    if (this->_manifest.structuredBarrier) {
+        this->setInequalityConstraintFunctions(
+                module->stateFunction("inequalityConstraintVector"),
+                module->stateFunction("inequalityConstraintJacobian"),
+                module->weightedStateFunction("inequalityConstraintHessian"));
+    } else {
+        this->setInequalityValueFunction(
+                module->stateFunction("inequalityValue"));
+        this->setInequalityGradientFunction(
+                module->stateFunction("inequalityGradient"));
+        this->setInequalityHessianFunction(
+                module->stateFunction("inequalityHessian"));
+    }
+
+    this->setLinearInequalityFunctions(
+            this->_manifest.numLinearInequalityConstraints,
+            module->parameterFunction("linearInequalityMatrix"),
+            module->parameterFunction("linearInequalityVector"));
+    this->setBoundFunctions(
+            this->_manifest.lowerBoundIndices,
+            module->parameterFunction("lowerBounds"),
+            this->_manifest.upperBoundIndices,
+            module->parameterFunction("upperBounds"));
+
+    this->module = module;
+}
+
+size_t LoadedObjective::indexOf(const std::vector<std::string>& names,
+                                const std::string& name,
+                                const std::string& prefix) {
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == name || names[i] == prefix + name) {
+            return i;
+        }
+    }
+    throw std::out_of_range("No symbol named " + name);
+}
+
+size_t LoadedObjective::variableIndex(const std::string& name) const {
+    return LoadedObjective::indexOf(this->_manifest.variableNames, name, "$v_");
+}
+
+size_t LoadedObjective::parameterIndex(const std::string& name) const {
+    return LoadedObjective::indexOf(this->_manifest.parameterNames, name,
+                                    "$p_");
+}
+
+}  // namespace FastMPC
+
+}  // namespace cppmpc
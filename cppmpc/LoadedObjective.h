@@ -0,0 +1,76 @@
+// Copyright 2021 Ian Ruh
+#ifndef INCLUDE_LOADEDOBJECTIVE_H_
+#define INCLUDE_LOADEDOBJECTIVE_H_
+
+#include <memory>
+#include <string>
+
+#include "FastMPCFunctionPointerObjective.h"
+#include "ObjectiveManifest.h"
+
+namespace cppmpc {
+
+namespace FastMPC {
+
+/**
+ * @brief An objective loaded from a directory written by
+ * SymbolicObjective::exportObjective.
+ *
+ * The directory holds the compiled library and its manifest. Loading only
+ * opens the library and sets the function pointers, so it doesn't need
+ * SymEngine, a compiler, or the symbolic problem.
+ */
+class LoadedObjective : public FunctionPointerObjective {
+ private:
+    ObjectiveManifest _manifest;
+
+    /**
+     * @brief The index of a name in a list of names, matching either the
+     * full name or the name without its `$v_` or `$p_` prefix.
+     */
+    static size_t indexOf(const std::vector<std::string>& names,
+                          const std::string& name, const std::string& prefix);
+
+ protected:
+    /**
+     * @brief Set the function pointers from the exported library, using the
+     * manifest for the barrier mode and the linear constraints.
+     */
+    void loadModule(std::shared_ptr<const CompiledModule> module) override;
+
+ public:
+    /**
+     * @brief The name of the library in an exported objective directory.
+     */
+    static const char* libraryFileName;
+    /**
+     * @brief The name of the manifest in an exported objective directory.
+     */
+    static const char* manifestFileName;
+
+    /**
+     * @param directory The directory the objective was exported to.
+     */
+    explicit LoadedObjective(const std::string& directory);
+
+    /**
+     * @brief The manifest the objective was loaded with.
+     */
+    const ObjectiveManifest& manifest() const { return this->_manifest; }
+
+    /**
+     * @brief The index of a variable in the state vector.
+     */
+    size_t variableIndex(const std::string& name) const;
+
+    /**
+     * @brief The index of a parameter in the parameter vector.
+     */
+    size_t parameterIndex(const std::string& name) const;
+};
+
+}  // namespace FastMPC
+
+}  // namespace cppmpc
+
+#endif  // INCLUDE_LOADEDOBJECTIVE_H_
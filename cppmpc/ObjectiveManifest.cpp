@@ -0,0 +1,315 @@
+// Copyright 2021 Ian Ruh
+#include "ObjectiveManifest.h"
+
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "SparsityPattern.h"
+
+namespace cppmpc {
+
+namespace FastMPC {
+
+namespace {
+
+const char* manifestVersion = "cppmpc-objective-1";
+
+/**
+ * @brief Names are written separated by spaces, so they can't be empty or
+ * contain whitespace.
+ */
+void checkNames(const std::string& key, const std::vector<std::string>& names) {
+    for (const std::string& name : names) {
+        bool whitespace = name.empty();
+        for (char c : name) {
+            whitespace =
+                    whitespace || std::isspace(static_cast<unsigned char>(c));
+        }
+        if (whitespace) {
+            throw std::runtime_error("The " + key +
+                                     " of a manifest can't be empty or "
+                                     "contain whitespace: '" +
+                                     name + "'");
+        }
+    }
+}
+
+template <class T>
+void writeList(std::ostream& out, const std::string& key,
+               const std::vector<T>& values) {
+    out << key << ":";
+    for (const T& value : values) {
+        out << " " << value;
+    }
+    out << std::endl;
+}
+
+/**
+ * @brief Patterns are written as the dimensions followed by the row and
+ * column of each non-zero.
+ */
+void writePattern(std::ostream& out, const std::string& key,
+                  const SparsityPattern& pattern) {
+    out << key << ": " << pattern.rows() << " " << pattern.cols();
+    for (size_t row = 0; row < pattern.rows(); row++) {
+        for (size_t col : pattern.row(row)) {
+            out << " " << row << " " << col;
+        }
+    }
+    out << std::endl;
+}
+
+/**
+ * @brief Groups are written as the size of each group followed by its
+ * elements. Nothing is written for missing groups.
+ */
+void writeGroups(std::ostream& out, const std::string& key,
+                 const std::optional<std::vector<std::vector<int>>>& groups) {
+    if (!groups) {
+        return;
+    }
+    out << key << ":";
+    for (const std::vector<int>& group : *groups) {
+        out << " " << group.size();
+        for (int element : group) {
+            out << " " << element;
+        }
+    }
+    out << std::endl;
+}
+
+std::runtime_error malformed(const std::string& key) {
+    return std::runtime_error("Malformed manifest field: " + key);
+}
+
+/**
+ * @brief Read the only value of a field. Reading stops at the first value
+ * that doesn't parse, so the whole field has to be read.
+ */
+template <class T>
+T readValue(std::istream& in, const std::string& key) {
+    T value;
+    if (!(in >> value) || !(in >> std::ws).eof()) {
+        throw malformed(key);
+    }
+    return value;
+}
+
+std::vector<std::vector<int>> readGroups(std::istream& in,
+                                         const std::string& key) {
+    std::vector<std::vector<int>> groups;
+    int64_t size;
+    while (in >> size) {
+        std::vector<int> group;
+        int element;
+        for (int64_t i = 0; i < size && in >> element; i++) {
+            group.push_back(element);
+        }
+        if (size < 0 || static_cast<int64_t>(group.size()) != size) {
+            throw malformed(key);
+        }
+        groups.push_back(group);
+    }
+    if (!in.eof()) {
+        throw malformed(key);
+    }
+    return groups;
+}
+
+SparsityPattern readPattern(std::istream& in, const std::string& key) {
+    int64_t rows = 0;
+    int64_t cols = 0;
+    if (!(in >> rows >> cols) || rows < 0 || cols < 0) {
+        throw malformed(key);
+    }
+    SparsityPattern pattern(rows, cols);
+    int64_t row;
+    int64_t col;
+    while (in >> row) {
+        if (!(in >> col)) {
+            throw malformed(key);
+        }
+        if (row < 0 || row >= rows || col < 0 || col >= cols) {
+            throw std::runtime_error("The manifest field " + key +
+                                     " has an entry outside of its " +
+                                     std::to_string(rows) + "x" +
+                                     std::to_string(cols) + " pattern");
+        }
+        pattern.insert(row, col);
+    }
+    if (!in.eof()) {
+        throw malformed(key);
+    }
+    return pattern;
+}
+
+template <class T>
+std::vector<T> readList(std::istream& in, const std::string& key) {
+    std::vector<T> values;
+    T value;
+    while (in >> value) {
+        values.push_back(value);
+    }
+    if (!in.eof()) {
+        throw malformed(key);
+    }
+    return values;
+}
+
+}  // namespace
+
+void ObjectiveManifest::write(const std::string& path) const {
+    checkNames("variableNames", this->variableNames);
+    checkNames("parameterNames", this->parameterNames);
+    checkNames("fixedParameterNames", this->fixedParameterNames);
+
+    std::ofstream out(path);
+    out << "version: " << manifestVersion << std::endl;
+    out << "numVariables: " << this->numVariables << std::endl;
+    out << "numParameters: " << this->numParameters << std::endl;
+    out << "numEqualityConstraints: " << this->numEqualityConstraints
+        << std::endl;
+    out << "numInequalityConstraints: " << this->numInequalityConstraints
+        << std::endl;
+    out << "structuredBarrier: " << this->structuredBarrier << std::endl;
+    out << "numLinearInequalityConstraints: "
+        << this->numLinearInequalityConstraints << std::endl;
+    writeList(out, "lowerBoundIndices", this->lowerBoundIndices);
+    writeList(out, "upperBoundIndices", this->upperBoundIndices);
+    writeList(out, "variableNames", this->variableNames);
+    writeList(out, "parameterNames", this->parameterNames);
+    writeList(out, "fixedParameterNames", this->fixedParameterNames);
+    out << std::setprecision(17);
+    writeList(out, "fixedParameterValues", this->fixedParameterValues);
+    writePattern(out, "objectiveGradient", this->sparsity.objectiveGradient);
+    writePattern(out, "objectiveHessian", this->sparsity.objectiveHessian);
+    writePattern(out, "inequalityGradient", this->sparsity.inequalityGradient);
+    writePattern(out, "inequalityHessian", this->sparsity.inequalityHessian);
+    writeGroups(out, "equalityMatrixUpdates", this->equalityMatrixUpdates);
+    writeGroups(out, "equalityVectorUpdates", this->equalityVectorUpdates);
+
+    if (!out) {
+        throw std::runtime_error("Failed to write the manifest " + path);
+    }
+}
+
+ObjectiveManifest ObjectiveManifest::read(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Failed to open the manifest " + path);
+    }
+
+    // Split each line into its key and values
+    std::map<std::string, std::string> fields;
+    for (std::string line; std::getline(in, line);) {
+        size_t separator = line.find(':');
+        if (separator == std::string::npos) {
+            throw std::runtime_error("Malformed manifest line: " + line);
+        }
+        fields[line.substr(0, separator)] = line.substr(separator + 1);
+    }
+
+    auto field = [&fields, &path](const std::string& key) {
+        auto it = fields.find(key);
+        if (it == fields.end()) {
+            throw std::runtime_error("The manifest " + path +
+                                     " is missing the field " + key);
+        }
+        return std::istringstream(it->second);
+    };
+
+    std::istringstream versionField = field("version");
+    std::string version = readValue<std::string>(versionField, "version");
+    if (version != manifestVersion) {
+        throw std::runtime_error("Unsupported manifest version: " + version);
+    }
+
+    auto value = [&field](const std::string& key, auto* result) {
+        std::istringstream in = field(key);
+        *result = readValue<std::remove_pointer_t<decltype(result)>>(in, key);
+    };
+    ObjectiveManifest manifest;
+    value("numVariables", &manifest.numVariables);
+    value("numParameters", &manifest.numParameters);
+    value("numEqualityConstraints", &manifest.numEqualityConstraints);
+    value("numInequalityConstraints", &manifest.numInequalityConstraints);
+    value("structuredBarrier", &manifest.structuredBarrier);
+    value("numLinearInequalityConstraints",
+          &manifest.numLinearInequalityConstraints);
+    std::istringstream lower = field("lowerBoundIndices");
+    manifest.lowerBoundIndices = readList<int>(lower, "lowerBoundIndices");
+    std::istringstream upper = field("upperBoundIndices");
+    manifest.upperBoundIndices = readList<int>(upper, "upperBoundIndices");
+    std::istringstream variables = field("variableNames");
+    manifest.variableNames =
+            readList<std::string>(variables, "variableNames");
+    std::istringstream parameters = field("parameterNames");
+    manifest.parameterNames =
+            readList<std::string>(parameters, "parameterNames");
+    // Manifests written before parameters could be fixed don't have them
+    if (fields.count("fixedParameterNames") != 0) {
+        std::istringstream fixedNames = field("fixedParameterNames");
+        manifest.fixedParameterNames =
+                readList<std::string>(fixedNames, "fixedParameterNames");
+        std::istringstream fixedValues = field("fixedParameterValues");
+        manifest.fixedParameterValues =
+                readList<double>(fixedValues, "fixedParameterValues");
+    }
+
+    // The names are looked up by index, so they have to match the counts
+    auto checkCount = [&path](const std::string& key, size_t count,
+                              int expected) {
+        if (expected < 0 || count != static_cast<size_t>(expected)) {
+            throw std::runtime_error(
+                    "The manifest " + path + " has " + std::to_string(count) +
+                    " " + key + ", but declares " + std::to_string(expected));
+        }
+    };
+    checkCount("variableNames", manifest.variableNames.size(),
+               manifest.numVariables);
+    checkCount("parameterNames", manifest.parameterNames.size(),
+               manifest.numParameters);
+    checkCount("fixedParameterValues", manifest.fixedParameterValues.size(),
+               static_cast<int>(manifest.fixedParameterNames.size()));
+
+    std::istringstream objectiveGradient = field("objectiveGradient");
+    manifest.sparsity.objectiveGradient =
+            readPattern(objectiveGradient, "objectiveGradient");
+    std::istringstream objectiveHessian = field("objectiveHessian");
+    manifest.sparsity.objectiveHessian =
+            readPattern(objectiveHessian, "objectiveHessian");
+    std::istringstream inequalityGradient = field("inequalityGradient");
+    manifest.sparsity.inequalityGradient =
+            readPattern(inequalityGradient, "inequalityGradient");
+    std::istringstream inequalityHessian = field("inequalityHessian");
+    manifest.sparsity.inequalityHessian =
+            readPattern(inequalityHessian, "inequalityHessian");
+
+    // Manifests written before the update functions were generated don't
+    // have them, so every entry is re-evaluated
+    if (fields.count("equalityMatrixUpdates") != 0) {
+        std::istringstream matrixUpdates = field("equalityMatrixUpdates");
+        manifest.equalityMatrixUpdates =
+                readGroups(matrixUpdates, "equalityMatrixUpdates");
+    }
+    if (fields.count("equalityVectorUpdates") != 0) {
+        std::istringstream vectorUpdates = field("equalityVectorUpdates");
+        manifest.equalityVectorUpdates =
+                readGroups(vectorUpdates, "equalityVectorUpdates");
+    }
+
+    return manifest;
+}
+
+}  // namespace FastMPC
+
+}  // namespace cppmpc
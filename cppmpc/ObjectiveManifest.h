@@ -0,0 +1,85 @@
+// Copyright 2021 Ian Ruh
+#ifndef INCLUDE_OBJECTIVEMANIFEST_H_
+#define INCLUDE_OBJECTIVEMANIFEST_H_
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "SparsityPattern.h"
+
+namespace cppmpc {
+
+namespace FastMPC {
+
+/**
+ * struct DerivativeSparsity - The structural non-zeros of the derivatives of a
+ * finalized symbolic objective, found while differentiating it.
+ */
+typedef struct DerivativeSparsity {
+    SparsityPattern objectiveGradient;
+    SparsityPattern objectiveHessian;
+    SparsityPattern inequalityGradient;
+    SparsityPattern inequalityHessian;
+} DerivativeSparsity;
+
+/**
+ * struct ObjectiveManifest - Everything needed to use the compiled library of
+ * a finalized objective without the symbolic objective.
+ *
+ * The manifest doesn't depend on SymEngine, so an exported objective can be
+ * loaded by a binary that only links the runtime library. It is stored as a
+ * plain text file with one `key: values` line per field.
+ */
+typedef struct ObjectiveManifest {
+    int numVariables = 0;
+    int numParameters = 0;
+    int numEqualityConstraints = 0;
+    int numInequalityConstraints = 0;
+
+    // Whether the barrier is assembled from the constraint functions instead
+    // of the generated barrier value, gradient, and hessian.
+    bool structuredBarrier = false;
+
+    // The linear inequality constraints and bounds, which are included in the
+    // number of inequality constraints.
+    int numLinearInequalityConstraints = 0;
+    std::vector<int> lowerBoundIndices;
+    std::vector<int> upperBoundIndices;
+
+    // The names of the variables and parameters, in order. Names can't
+    // contain whitespace.
+    std::vector<std::string> variableNames;
+    std::vector<std::string> parameterNames;
+
+    // The parameters whose values were substituted into the generated code,
+    // which aren't in the parameter names. Optional when reading.
+    std::vector<std::string> fixedParameterNames;
+    std::vector<double> fixedParameterValues;
+
+    DerivativeSparsity sparsity;
+
+    // The parameters each update function of the equality matrix and vector
+    // depends on, or nothing if they have no update functions.
+    std::optional<std::vector<std::vector<int>>> equalityMatrixUpdates;
+    std::optional<std::vector<std::vector<int>>> equalityVectorUpdates;
+
+    /**
+     * @brief Write the manifest to a file, throwing on failure or if a name
+     * is empty or contains whitespace.
+     */
+    void write(const std::string& path) const;
+
+    /**
+     * @brief Read a manifest written by write, throwing if it is missing or
+     * malformed, if the names don't match the number of variables and
+     * parameters, or if a sparsity entry is outside of its pattern.
+     */
+    static ObjectiveManifest read(const std::string& path);
+} ObjectiveManifest;
+
+}  // namespace FastMPC
+
+}  // namespace cppmpc
+
+#endif  // INCLUDE_OBJECTIVEMANIFEST_H_
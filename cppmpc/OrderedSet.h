@@ -6,29 +6,123 @@
 #include <symengine/expression.h>
 #include <symengine/symbol.h>
 
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
 #include <unordered_map>
 #include <vector>
 
+#include "SymbolRegistry.h"
+
 using SymEngine::Basic;
 using SymEngine::RCP;
 using SymEngine::Symbol;
 
 namespace cppmpc {
 
+class FrozenOrderedSet;
+
 class OrderedSet {
  private:
     // Contains the actual elmenets
     std::vector<RCP<const Symbol>> elements_vector;
 
-    // A map from symbol to the index in the vector.
+    // The index in the vector of each symbol created by the registry,
+    // indexed by the symbol's id less first_id. It only spans the ids of the
+    // symbols in the set, and the ids between them that are not in the set
+    // are at npos.
+    std::vector<size_t> positions_by_id;
+    SymbolId first_id = 0;
+
+    // A map from every symbol to the index in the vector, which finds the
+    // symbols the registry didn't create.
     std::unordered_map<RCP<const Symbol>, size_t, SymEngine::RCPBasicHash,
                        SymEngine::RCPBasicKeyEq>
             elements_map;
 
+    // The number of symbols in the set that the registry didn't create.
+    // While there are none, a registered symbol is only looked for by id.
+    size_t num_unregistered = 0;
+
+    static constexpr size_t npos = SIZE_MAX;
+
+    /**
+     * @brief The index of the symbol in the vector, or npos.
+     */
+    size_t position(const RCP<const Symbol>& el) const {
+        if (const RegisteredSymbol* registered =
+                    SymbolRegistry::registered(*el)) {
+            SymbolId id = registered->id();
+            if (id >= this->first_id &&
+                id - this->first_id < this->positions_by_id.size() &&
+                this->positions_by_id[id - this->first_id] != npos) {
+                return this->positions_by_id[id - this->first_id];
+            }
+            // An equal symbol created elsewhere may be in the set
+            if (this->num_unregistered == 0) {
+                return npos;
+            }
+        }
+        auto it = this->elements_map.find(el);
+        return it == this->elements_map.end() ? npos : it->second;
+    }
+
+    /**
+     * @brief Set the index of the symbol in the vector, or remove it if npos.
+     */
+    void setPosition(const RCP<const Symbol>& el, size_t index) {
+        const RegisteredSymbol* registered = SymbolRegistry::registered(*el);
+        if (registered) {
+            SymbolId id = registered->id();
+            if (this->positions_by_id.empty()) {
+                this->first_id = id;
+            } else if (id < this->first_id) {
+                this->positions_by_id.insert(this->positions_by_id.begin(),
+                                             this->first_id - id, npos);
+                this->first_id = id;
+            }
+            if (id - this->first_id >= this->positions_by_id.size()) {
+                this->positions_by_id.resize(id - this->first_id + 1, npos);
+            }
+            this->positions_by_id[id - this->first_id] = index;
+        }
+
+        if (index == npos) {
+            if (this->elements_map.erase(el) > 0 && !registered) {
+                this->num_unregistered -= 1;
+            }
+        } else if (this->elements_map.insert_or_assign(el, index).second &&
+                   !registered) {
+            this->num_unregistered += 1;
+        }
+    }
+
+    static RCP<const Symbol> asSymbol(const RCP<const Symbol>& el) {
+        return el;
+    }
+
+    static RCP<const Symbol> asSymbol(const SymEngine::Expression& exp) {
+        RCP<const Basic> basic = exp.get_basic();
+        if (!SymEngine::is_a<SymEngine::Symbol>(*basic)) {
+            throw std::runtime_error("Only symbols can be in ordered set.");
+        }
+        return SymEngine::rcp_static_cast<const SymEngine::Symbol>(basic);
+    }
+
  public:
     OrderedSet() {}
-    // TODO(ianruh): Copy constructor
-    // TODO(ianruh): Move constructor
+
+    /**
+     * @brief Build the ordered set from a range of symbols or symbol
+     * expressions in one pass. Duplicates after the first are skipped.
+     */
+    template <class Iterator>
+    OrderedSet(Iterator begin, Iterator end) {
+        this->insert(0, begin, end);
+    }
+
+    explicit OrderedSet(const std::vector<RCP<const Symbol>>& symbols)
+            : OrderedSet(symbols.begin(), symbols.end()) {}
 
     /**
      * @brief Append a symbol to the ordered set.
@@ -54,7 +148,7 @@ class OrderedSet {
      * @param el The symbol to insert.
      */
     void insert(size_t index, RCP<const Symbol> el) {
-        if (this->elements_map.count(el) > 0) {
+        if (this->contains(el)) {
             return;
         }
 
@@ -65,10 +159,8 @@ class OrderedSet {
                                          el);
         }
 
-        this->elements_map.insert({el, index});
-
         for (size_t i = index; i < this->elements_vector.size(); i++) {
-            this->elements_map.at(this->elements_vector.at(i)) = i;
+            this->setPosition(this->elements_vector[i], i);
         }
     }
 
@@ -80,24 +172,59 @@ class OrderedSet {
      * @param exp The symbol to insert.
      */
     void insert(size_t index, const SymEngine::Expression& exp) {
-        RCP<const Basic> basic = exp.get_basic();
+        this->insert(index, OrderedSet::asSymbol(exp));
+    }
 
-        if (SymEngine::is_a<SymEngine::Symbol>(*basic)) {
-            this->insert(index,
-                         SymEngine::rcp_dynamic_cast<const SymEngine::Symbol>(
-                                 basic));
-        } else {
-            throw std::runtime_error("Only symbols can be in ordered set.");
+    /**
+     * @brief Insert a range of symbols or symbol expressions at the given
+     * index, only re-indexing the later elements once.
+     *
+     * Symbols already in the set, and duplicates within the range, are
+     * skipped.
+     *
+     * @param index The index to insert the first new symbol at.
+     * @param begin The start of the range.
+     * @param end The end of the range.
+     */
+    template <class Iterator>
+    void insert(size_t index, Iterator begin, Iterator end) {
+        if (index > this->elements_vector.size()) {
+            throw std::out_of_range("Ordered set index is out of range.");
         }
+
+        std::vector<RCP<const Symbol>> added;
+        for (Iterator it = begin; it != end; ++it) {
+            RCP<const Symbol> el = OrderedSet::asSymbol(*it);
+            if (!this->contains(el)) {
+                // Mark it as present so later duplicates are skipped. The
+                // real position is set below.
+                this->setPosition(el, index);
+                added.push_back(el);
+            }
+        }
+
+        this->elements_vector.insert(this->elements_vector.begin() + index,
+                                     added.begin(), added.end());
+        for (size_t i = index; i < this->elements_vector.size(); i++) {
+            this->setPosition(this->elements_vector[i], i);
+        }
+    }
+
+    /**
+     * @brief Append a range of symbols or symbol expressions.
+     */
+    template <class Iterator>
+    void append(Iterator begin, Iterator end) {
+        this->insert(this->size(), begin, end);
     }
 
     // We need to remove the element from the vector, and then
     // update the indexes of every element after in the map.
     void remove(size_t index) {
-        this->elements_map.erase(this->elements_vector.at(index));
+        this->setPosition(this->elements_vector.at(index), npos);
         this->elements_vector.erase(this->elements_vector.begin() + index);
         for (size_t i = index; i < this->elements_vector.size(); i++) {
-            this->elements_map.at(this->elements_vector.at(i)) = i;
+            this->setPosition(this->elements_vector[i], i);
         }
     }
 
@@ -114,23 +241,28 @@ class OrderedSet {
     size_t size() const { return this->elements_vector.size(); }
 
     /**
-     * @brief Whether the set contains the given symbol. Is O(1).
+     * @brief Whether the set contains the given symbol. Is O(1), and only
+     * indexes an array for the symbols the registry created.
      *
      * @param el The element to test.
      * @return True if in the set, false if not.
      */
     bool contains(const RCP<const Symbol>& el) const {
-        return this->elements_map.count(el) > 0;
+        return this->position(el) != npos;
     }
 
     size_t indexOf(const RCP<const Symbol>& el) const {
-        return this->elements_map.at(el);
+        size_t index = this->position(el);
+        if (index == npos) {
+            throw std::out_of_range("Symbol is not in the ordered set.");
+        }
+        return index;
     }
 
     // Determine if the set other is a subset of this.
     bool isSubset(const OrderedSet& other) const {
         for (size_t i = 0; i < other.size(); i++) {
-            if (!(this->elements_map.count(other.at(i)) > 0)) {
+            if (!this->contains(other.at(i))) {
                 return false;
             }
         }
@@ -138,28 +270,156 @@ class OrderedSet {
     }
 
     void unionWith(const OrderedSet& other) {
-        for (size_t i = 0; i < other.size(); i++) {
-            this->append(other.at(i));
-        }
+        this->append(other.elements_vector.begin(),
+                     other.elements_vector.end());
+    }
+
+    /**
+     * @brief The symbols in order.
+     */
+    const std::vector<RCP<const Symbol>>& elements() const {
+        return this->elements_vector;
     }
 
+    /**
+     * @brief An immutable copy of the set that is cheap to copy and safe to
+     * read from several threads.
+     */
+    FrozenOrderedSet freeze() const;
+
     // Utility method used in testing to verify that the data
     // structures are self consistent with each other.
     bool isConsistent() const {
         bool goodSoFar = true;
 
+        size_t numRegistered = 0;
+        for (size_t position : this->positions_by_id) {
+            numRegistered += position != npos ? 1 : 0;
+        }
         goodSoFar = goodSoFar &&
-                    (this->elements_vector.size() == this->elements_map.size());
+                    this->elements_vector.size() == this->elements_map.size() &&
+                    this->elements_vector.size() ==
+                            numRegistered + this->num_unregistered;
 
         for (size_t i = 0; i < this->elements_vector.size(); i++) {
             auto el = this->elements_vector.at(i);
-            goodSoFar = goodSoFar && this->elements_map.at(el) == i;
+            goodSoFar = goodSoFar && this->position(el) == i;
         }
 
         return goodSoFar;
     }
 };
 
+/**
+ * @brief An immutable ordered set of symbols.
+ *
+ * Copies share the same storage, and lookups don't take any locks, so a
+ * frozen set can be shared read-only between threads. Symbols are found with
+ * a flat open addressing table keyed by their (cached) structural hash.
+ */
+class FrozenOrderedSet {
+ private:
+    typedef struct Data {
+        std::vector<RCP<const Symbol>> elements;
+        // Indices into elements, or npos for empty slots. The size is a power
+        // of two.
+        std::vector<size_t> slots;
+    } Data;
+
+    static constexpr size_t npos = SIZE_MAX;
+
+    std::shared_ptr<const Data> data;
+
+    /**
+     * @brief The index of the symbol, or npos.
+     */
+    size_t position(const RCP<const Symbol>& el) const {
+        const std::vector<size_t>& slots = this->data->slots;
+        size_t mask = slots.size() - 1;
+        for (size_t slot = el->hash() & mask;; slot = (slot + 1) & mask) {
+            size_t index = slots[slot];
+            if (index == npos) {
+                return npos;
+            }
+            if (SymEngine::eq(*this->data->elements[index], *el)) {
+                return index;
+            }
+        }
+    }
+
+ public:
+    FrozenOrderedSet() : FrozenOrderedSet(OrderedSet()) {}
+
+    explicit FrozenOrderedSet(const OrderedSet& set) {
+        auto built = std::make_shared<Data>();
+        built->elements = set.elements();
+
+        // Keep the table at most half full
+        size_t numSlots = 8;
+        while (numSlots < 2 * built->elements.size()) {
+            numSlots *= 2;
+        }
+        built->slots.assign(numSlots, npos);
+
+        size_t mask = numSlots - 1;
+        for (size_t i = 0; i < built->elements.size(); i++) {
+            size_t slot = built->elements[i]->hash() & mask;
+            while (built->slots[slot] != npos) {
+                slot = (slot + 1) & mask;
+            }
+            built->slots[slot] = i;
+        }
+
+        this->data = built;
+    }
+
+    /**
+     * @brief Get the symbol at the given index.
+     */
+    RCP<const Symbol> at(size_t index) const {
+        return this->data->elements.at(index);
+    }
+
+    /**
+     * @brief The number of symbols in the set.
+     */
+    size_t size() const { return this->data->elements.size(); }
+
+    /**
+     * @brief Whether the set contains the given symbol.
+     */
+    bool contains(const RCP<const Symbol>& el) const {
+        return this->position(el) != npos;
+    }
+
+    size_t indexOf(const RCP<const Symbol>& el) const {
+        size_t index = this->position(el);
+        if (index == npos) {
+            throw std::out_of_range("Symbol is not in the ordered set.");
+        }
+        return index;
+    }
+
+    /**
+     * @brief The symbols in order.
+     */
+    const std::vector<RCP<const Symbol>>& elements() const {
+        return this->data->elements;
+    }
+
+    /**
+     * @brief A mutable copy of the set.
+     */
+    OrderedSet thaw() const {
+        return OrderedSet(this->data->elements.begin(),
+                          this->data->elements.end());
+    }
+};
+
+inline FrozenOrderedSet OrderedSet::freeze() const {
+    return FrozenOrderedSet(*this);
+}
+
 }  // namespace cppmpc
 
 #endif  // INCLUDE_ORDEREDSET_H_
@@ -0,0 +1,106 @@
+// Copyright 2021 Ian Ruh
+#ifndef INCLUDE_PARALLEL_H_
+#define INCLUDE_PARALLEL_H_
+
+#include <symengine/symengine_config.h>
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace cppmpc {
+
+/**
+ * @brief The number of threads running the loops the current thread is
+ * nested in, 1 outside of any parallel loop.
+ *
+ * Loops nested in a parallel loop divide their threads by it, so the loops
+ * of e.g. concurrently finalized objectives share the cores instead of
+ * each using all of them. Threads started outside of parallelFor for the
+ * same work should copy it from the thread that starts them.
+ */
+inline size_t& concurrentThreads() {
+    thread_local size_t threads = 1;
+    return threads;
+}
+
+/**
+ * @brief Call body(i) for each i in [0, count), split across at most
+ * maxThreads threads. Unlike the overload without a limit, this doesn't
+ * check that SymEngine is thread safe.
+ *
+ * The first exception thrown by an iteration is rethrown after every thread
+ * finishes.
+ *
+ * @param count The number of iterations.
+ * @param maxThreads The most threads to use, or 0 for one per core, divided
+ * between the concurrentThreads running the enclosing loops.
+ * @param body The body of the loop, which must be safe to call concurrently.
+ */
+inline void parallelFor(size_t count, size_t maxThreads,
+                        const std::function<void(size_t)>& body) {
+    if (maxThreads == 0) {
+        maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    size_t outerThreads = concurrentThreads();
+    maxThreads = std::max<size_t>(1, maxThreads / outerThreads);
+    size_t numThreads = std::min(maxThreads, count);
+
+    if (numThreads <= 1) {
+        for (size_t i = 0; i < count; i++) {
+            body(i);
+        }
+        return;
+    }
+
+    std::vector<std::exception_ptr> errors(numThreads);
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads);
+    for (size_t t = 0; t < numThreads; t++) {
+        threads.emplace_back([&body, &errors, count, numThreads, outerThreads,
+                              t]() {
+            concurrentThreads() = outerThreads * numThreads;
+            try {
+                for (size_t i = t; i < count; i += numThreads) {
+                    body(i);
+                }
+            } catch (...) {
+                errors[t] = std::current_exception();
+            }
+        });
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    for (const std::exception_ptr& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+/**
+ * @brief Call body(i) for each i in [0, count), split across threads.
+ *
+ * SymEngine's reference counting is only atomic when it is built with
+ * WITH_SYMENGINE_THREAD_SAFE, so otherwise the loop runs serially. The first
+ * exception thrown by an iteration is rethrown after every thread finishes.
+ *
+ * @param count The number of iterations.
+ * @param body The body of the loop, which must be safe to call concurrently.
+ */
+inline void parallelFor(size_t count, const std::function<void(size_t)>& body) {
+#ifdef WITH_SYMENGINE_THREAD_SAFE
+    parallelFor(count, 0, body);
+#else
+    parallelFor(count, 1, body);
+#endif
+}
+
+}  // namespace cppmpc
+
+#endif  // INCLUDE_PARALLEL_H_
@@ -0,0 +1,805 @@
+// Copyright 2021 Ian Ruh
+#include "RuntimeCompiler.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "CodeGenerator.h"
+#include "CodeSink.h"
+#include "CompiledModule.h"
+#include "FinalizeProfiler.h"
+#include "Parallel.h"
+#include "Util.h"
+
+namespace cppmpc {
+
+namespace {
+
+std::mutex cacheDirectoryMutex;
+
+std::string& cacheDirectoryStorage() {
+    static std::string directory = []() -> std::string {
+        const char* env = std::getenv("CPPMPC_CACHE_DIR");
+        if (env != nullptr) {
+            return env;
+        }
+        std::error_code error;
+        std::filesystem::path temp =
+                std::filesystem::temp_directory_path(error);
+        if (error) {
+            return "";
+        }
+        return (temp / "cppmpc-cache").string();
+    }();
+    return directory;
+}
+
+std::string readFile(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        return "";
+    }
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+/**
+ * @brief A 64 bit FNV-1a hash, updated a piece at a time.
+ */
+class Fnv1aHash {
+ private:
+    uint64_t hash = 14695981039346656037ULL;
+
+ public:
+    void update(const char* data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            this->hash ^= static_cast<unsigned char>(data[i]);
+            this->hash *= 1099511628211ULL;
+        }
+    }
+
+    void update(const std::string& text) {
+        this->update(text.data(), text.size());
+    }
+
+    /**
+     * @brief Separate the parts so they can't run into each other.
+     */
+    void separate() {
+        this->hash ^= 0xff;
+        this->hash *= 1099511628211ULL;
+    }
+
+    std::string hex() const {
+        std::stringstream ss;
+        ss << std::hex << std::setw(16) << std::setfill('0') << this->hash;
+        return ss.str();
+    }
+};
+
+/**
+ * @brief Passes the code on to another sink, hashing it on the way, so the
+ * hash of a file is known once it is written without reading it back.
+ */
+class HashingSink : public CodeSink {
+ private:
+    CodeSink* sink;
+    Fnv1aHash hash;
+
+ public:
+    explicit HashingSink(CodeSink* sink) : sink(sink) {}
+
+    void write(const char* data, size_t size) override {
+        this->hash.update(data, size);
+        this->sink->write(data, size);
+    }
+
+    std::string digest() const { return this->hash.hex(); }
+};
+
+// The size of the blocks the source files are compared and copied in
+const size_t sourceBlockSize = 1 << 16;
+
+/**
+ * @brief Copy the source files to the stored source of a cache entry, each
+ * after its size, so the files can't run into each other.
+ */
+void writeStoredSource(std::ostream& stored,
+                       const std::vector<std::string>& paths) {
+    std::vector<char> block(sourceBlockSize);
+    for (const std::string& path : paths) {
+        std::ifstream file(path, std::ios::binary);
+        stored << std::filesystem::file_size(path) << std::endl;
+        while (file.read(block.data(), block.size()) || file.gcount() > 0) {
+            stored.write(block.data(), file.gcount());
+        }
+    }
+}
+
+/**
+ * @brief Whether the stored source of a cache entry is a copy of the source
+ * files, compared a block at a time.
+ */
+bool storedSourceMatches(const std::string& storedPath,
+                         const std::vector<std::string>& paths) {
+    std::ifstream stored(storedPath, std::ios::binary);
+    if (!stored) {
+        return false;
+    }
+    std::vector<char> expected(sourceBlockSize);
+    std::vector<char> actual(sourceBlockSize);
+    for (const std::string& path : paths) {
+        std::ifstream file(path, std::ios::binary);
+        uintmax_t size = std::filesystem::file_size(path);
+        std::string header;
+        if (!file || !std::getline(stored, header) ||
+            header != std::to_string(size)) {
+            return false;
+        }
+        while (size > 0) {
+            std::streamsize count = static_cast<std::streamsize>(
+                    std::min<uintmax_t>(size, sourceBlockSize));
+            file.read(expected.data(), count);
+            stored.read(actual.data(), count);
+            if (!file || !stored ||
+                !std::equal(expected.begin(), expected.begin() + count,
+                            actual.begin())) {
+                return false;
+            }
+            size -= count;
+        }
+    }
+    return stored.peek() == std::ifstream::traits_type::eof();
+}
+
+}  // namespace
+
+void RuntimeCompiler::setCacheDirectory(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(cacheDirectoryMutex);
+    cacheDirectoryStorage() = directory;
+}
+
+std::string RuntimeCompiler::cacheDirectory() {
+    std::lock_guard<std::mutex> lock(cacheDirectoryMutex);
+    return cacheDirectoryStorage();
+}
+
+std::string RuntimeCompiler::cacheKey(const std::string& source,
+                                      const CompileOptions& options) {
+    return RuntimeCompiler::cacheKey(std::vector<const std::string*>{&source},
+                                     options);
+}
+
+std::string RuntimeCompiler::cacheKey(const std::vector<std::string>& sources,
+                                      const CompileOptions& options) {
+    std::vector<const std::string*> pieces;
+    for (const std::string& source : sources) {
+        pieces.push_back(&source);
+    }
+    return RuntimeCompiler::cacheKey(pieces, options);
+}
+
+std::string RuntimeCompiler::cacheKey(
+        const std::vector<const std::string*>& sourcePieces,
+        const CompileOptions& options) {
+    // The pieces of the source are hashed as one part
+    Fnv1aHash hash;
+    hash.update(CPP_COMPILER_PATH);
+    hash.separate();
+    hash.update(RuntimeCompiler::compilerFlags(options));
+    hash.separate();
+    for (const std::string* piece : sourcePieces) {
+        hash.update(*piece);
+    }
+    hash.separate();
+    return hash.hex();
+}
+
+std::string RuntimeCompiler::uniqueSuffix() {
+    static std::atomic<uint64_t> counter(0);
+    return "." + std::to_string(getpid()) + "." + std::to_string(counter++);
+}
+
+std::string RuntimeCompiler::makeTempDirectory(const std::string& prefix) {
+    std::string directoryTemplate =
+            (std::filesystem::temp_directory_path() / (prefix + "-XXXXXX"))
+                    .string();
+    std::vector<char> directoryBuffer(directoryTemplate.begin(),
+                                      directoryTemplate.end());
+    directoryBuffer.push_back('\0');
+    if (mkdtemp(directoryBuffer.data()) == nullptr) {
+        throw std::runtime_error("Failed to create a temporary directory");
+    }
+    return std::string(directoryBuffer.data());
+}
+
+std::string RuntimeCompiler::compilerFlags(const CompileOptions& options) {
+    // OpenMP SIMD only enables the `omp simd` pragmas of the batched
+    // functions, without the OpenMP runtime.
+    std::string flags = std::string(RUNTIME_COMPILER_FLAGS) + " -O" +
+                        std::to_string(options.optimizationLevel) +
+                        " -fopenmp-simd";
+    if (!options.targetArchitecture.empty()) {
+        flags += " -march=" + options.targetArchitecture;
+    }
+
+    switch (options.fastMath) {
+        case FastMathPolicy::Off:
+            break;
+        case FastMathPolicy::NoErrno:
+            flags += " -fno-math-errno";
+            break;
+        case FastMathPolicy::Relaxed:
+            flags += " -fno-math-errno -fno-trapping-math -fno-signed-zeros"
+                     " -fassociative-math -freciprocal-math";
+            break;
+        case FastMathPolicy::Full:
+            flags += " -ffast-math";
+            break;
+    }
+
+    switch (options.fpContraction) {
+        case FPContraction::Default:
+            break;
+        case FPContraction::Off:
+            flags += " -ffp-contract=off";
+            break;
+        case FPContraction::On:
+            flags += " -ffp-contract=on";
+            break;
+        case FPContraction::Fast:
+            flags += " -ffp-contract=fast";
+            break;
+    }
+
+    if (!options.instrumentProfile.empty()) {
+        flags += " -fprofile-instr-generate=\"" + options.instrumentProfile +
+                 "\"";
+    }
+    if (!options.useProfile.empty()) {
+        flags += " -fprofile-instr-use=\"" + options.useProfile + "\"";
+    }
+    return flags;
+}
+
+CompileOptions RuntimeCompiler::presetOptions(CompilePreset preset) {
+    CompileOptions options;
+    switch (preset) {
+        case CompilePreset::Debug:
+            options.optimizationLevel = 0;
+            break;
+        case CompilePreset::Release:
+            options.optimizationLevel = 2;
+            break;
+        case CompilePreset::FastMath:
+            options.fastMath = FastMathPolicy::Relaxed;
+            [[fallthrough]];
+        case CompilePreset::Native:
+            options.optimizationLevel = 3;
+            options.targetArchitecture = "native";
+            options.fpContraction = FPContraction::Fast;
+            break;
+    }
+    return options;
+}
+
+bool RuntimeCompiler::isAvailable(CompilerBackend backend) {
+    switch (backend) {
+        case CompilerBackend::External:
+            return true;
+        case CompilerBackend::TinyCC:
+#ifdef CPPMPC_WITH_LIBTCC
+            return true;
+#else
+            return false;
+#endif
+        case CompilerBackend::Interpreter:
+            return true;
+    }
+    return false;
+}
+
+CompilationTier RuntimeCompiler::compilationTier(
+        const CompileOptions& options) {
+    if (options.backend == CompilerBackend::Interpreter) {
+        return CompilationTier::Interpreted;
+    }
+    if (options.backend == CompilerBackend::TinyCC ||
+        options.optimizationLevel == 0) {
+        return CompilationTier::Unoptimized;
+    }
+    return CompilationTier::Optimized;
+}
+
+void RuntimeCompiler::runCompiler(const std::string& arguments) {
+    std::string cmd = std::string(CPP_COMPILER_PATH) + " " + arguments;
+    int rt = std::system(cmd.c_str());
+
+    if (rt != 0) {
+        throw std::runtime_error("Runtime compilation failed");
+    }
+}
+
+void RuntimeCompiler::compileSources(
+        const std::vector<std::string>& sourcePaths,
+        const std::string& libraryPath, const CompileOptions& options,
+        const std::vector<std::string>& cachedObjectPaths) {
+    FinalizeProfiler::Phase phase("compile");
+    std::string flags = RuntimeCompiler::compilerFlags(options);
+    // Calls between the generated functions bind within the library, so a
+    // function of the same name loaded from another library never replaces
+    // them.
+    const std::string linkFlags = "-Wl,-Bsymbolic ";
+    if (cachedObjectPaths.empty() && sourcePaths.size() == 1) {
+        RuntimeCompiler::runCompiler("-shared " + linkFlags + flags +
+                                     " \"" + sourcePaths[0] + "\" -o \"" +
+                                     libraryPath + "\"");
+        return;
+    }
+
+    bool cached = !cachedObjectPaths.empty();
+    std::vector<std::string> objectPaths = cachedObjectPaths;
+    if (!cached) {
+        for (const std::string& sourcePath : sourcePaths) {
+            objectPaths.push_back(sourcePath + ".o");
+        }
+    }
+    // The flags are also needed to link, e.g. the profile runtime
+    std::stringstream link;
+    link << "-shared " << linkFlags << flags;
+    for (const std::string& objectPath : objectPaths) {
+        link << " \"" << objectPath << "\"";
+    }
+    link << " -o \"" << libraryPath << "\"";
+
+    if (cached) {
+        // Cached objects are compiled to a unique path and renamed into
+        // place, so a concurrent build never links a partial object.
+        parallelFor(sourcePaths.size(), options.compileJobs, [&](size_t i) {
+            if (std::filesystem::exists(objectPaths[i])) {
+                DEBUG_PRINT("Using cached object: " << objectPaths[i]);
+                return;
+            }
+            std::string tempPath =
+                    objectPaths[i] + RuntimeCompiler::uniqueSuffix();
+            try {
+                RuntimeCompiler::runCompiler("-c -fPIC " + flags + " \"" +
+                                             sourcePaths[i] + "\" -o \"" +
+                                             tempPath + "\"");
+            } catch (...) {
+                std::remove(tempPath.c_str());
+                throw;
+            }
+            if (std::rename(tempPath.c_str(), objectPaths[i].c_str()) != 0) {
+                std::remove(tempPath.c_str());
+                throw std::runtime_error("Failed to rename " + tempPath);
+            }
+        });
+        RuntimeCompiler::runCompiler(link.str());
+        return;
+    }
+
+    try {
+        parallelFor(sourcePaths.size(), options.compileJobs, [&](size_t i) {
+            RuntimeCompiler::runCompiler("-c -fPIC " + flags + " \"" +
+                                         sourcePaths[i] + "\" -o \"" +
+                                         objectPaths[i] + "\"");
+        });
+        RuntimeCompiler::runCompiler(link.str());
+    } catch (...) {
+        for (const std::string& objectPath : objectPaths) {
+            std::remove(objectPath.c_str());
+        }
+        throw;
+    }
+    for (const std::string& objectPath : objectPaths) {
+        std::remove(objectPath.c_str());
+    }
+}
+
+std::shared_ptr<CompiledModule> RuntimeCompiler::loadLibrary(
+        const std::string& path, const std::string& directory) {
+    FinalizeProfiler::recordObject(path);
+    FinalizeProfiler::Phase phase("load");
+    return std::make_shared<SharedLibraryModule>(path, directory);
+}
+
+void RuntimeCompiler::writeFileAtomically(
+        const std::string& path,
+        const std::function<void(std::ostream&)>& write) {
+    std::string tempPath = path + RuntimeCompiler::uniqueSuffix();
+    {
+        std::ofstream file(tempPath, std::ios::binary);
+        write(file);
+        if (!file) {
+            std::remove(tempPath.c_str());
+            throw std::runtime_error("Failed to write " + tempPath);
+        }
+    }
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::remove(tempPath.c_str());
+        throw std::runtime_error("Failed to rename " + tempPath);
+    }
+}
+
+void RuntimeCompiler::writeFileAtomically(const std::string& path,
+                                          const std::string& contents) {
+    RuntimeCompiler::writeFileAtomically(
+            path, [&contents](std::ostream& file) { file << contents; });
+}
+
+std::vector<std::vector<GeneratedFunction>> RuntimeCompiler::translationUnits(
+        const std::vector<GeneratedFunction>& functions,
+        const CompileOptions& options) {
+    // TinyCC compiles from memory, so nothing is gained by splitting
+    if (options.backend != CompilerBackend::External) {
+        return CodeGenerator::generateTranslationUnits(functions, 0,
+                                                       options.vectorMath);
+    }
+    return CodeGenerator::generateTranslationUnits(
+            functions, options.maxChunkAssignments, options.vectorMath,
+            options.incremental);
+}
+
+RuntimeCompiler::SourceFiles RuntimeCompiler::writeSourceFiles(
+        const std::vector<std::vector<GeneratedFunction>>& units,
+        const CompileOptions& options) {
+    FinalizeProfiler::Phase phase("write");
+    SourceFiles files;
+
+    // Fall back to a one-off temporary library if there is no usable cache.
+    // Profiled builds depend on more than the source, so they aren't cached.
+    std::string directory = RuntimeCompiler::cacheDirectory();
+    std::error_code error;
+    std::string prefix;
+    if (directory.empty() || !options.instrumentProfile.empty() ||
+        !options.useProfile.empty() ||
+        (!std::filesystem::create_directories(directory, error) && error)) {
+        // A directory of its own, so concurrent builds can't pick the same
+        // names. The module of the library removes it.
+        files.tempDirectory =
+                RuntimeCompiler::makeTempDirectory("cppmpc-build");
+        prefix = files.tempDirectory + "/source";
+    } else {
+        files.cacheDirectory = directory;
+        prefix = (std::filesystem::path(directory) /
+                  ("source" + RuntimeCompiler::uniqueSuffix()))
+                         .string();
+    }
+
+    try {
+        for (size_t i = 0; i < units.size(); i++) {
+            files.paths.push_back(prefix + std::to_string(i) + ".cpp");
+            FileSink file(files.paths.back());
+            HashingSink sink(&file);
+            CodeGenerator::writeSource(sink, units[i]);
+            file.close();
+            files.digests.push_back(sink.digest());
+        }
+    } catch (...) {
+        for (const std::string& path : files.paths) {
+            std::remove(path.c_str());
+        }
+        if (!files.tempDirectory.empty()) {
+            std::filesystem::remove_all(files.tempDirectory, error);
+        }
+        throw;
+    }
+    return files;
+}
+
+std::shared_ptr<CompiledModule> RuntimeCompiler::compile(
+        const std::vector<GeneratedFunction>& functions,
+        const std::string& metadata, const CompileOptions& options) {
+    switch (options.backend) {
+        case CompilerBackend::External:
+            return RuntimeCompiler::compileSourceFiles(
+                    RuntimeCompiler::writeSourceFiles(
+                            RuntimeCompiler::translationUnits(functions,
+                                                              options),
+                            options),
+                    metadata, options);
+        case CompilerBackend::TinyCC:
+#ifdef CPPMPC_WITH_LIBTCC
+        {
+            // Compiled from memory, so the source is kept as text
+            std::string source = CodeGenerator::generateSource(
+                    RuntimeCompiler::translationUnits(functions, options)[0]);
+            FinalizeProfiler::Phase phase("compile");
+            return std::make_shared<TinyCCModule>(source);
+        }
+#else
+            throw std::runtime_error(
+                    "The TinyCC backend requires building with "
+                    "CPPMPC_WITH_LIBTCC");
+#endif
+        case CompilerBackend::Interpreter:
+            throw std::runtime_error(
+                    "The interpreter backend can't compile source, it needs "
+                    "the objective's interpreter");
+    }
+    throw std::runtime_error("Unknown compiler backend");
+}
+
+std::shared_ptr<CompiledModule> RuntimeCompiler::compile(
+        const std::vector<std::string>& functionStrings,
+        const std::string& metadata, const CompileOptions& options) {
+    std::vector<GeneratedFunction> functions;
+    for (const std::string& functionString : functionStrings) {
+        functions.push_back(CodeGenerator::verbatimFunction(functionString));
+    }
+    return RuntimeCompiler::compile(functions, metadata, options);
+}
+
+TieredModule RuntimeCompiler::compileTiered(
+        const std::vector<std::string>& functionStrings,
+        const std::string& metadata, const CompileOptions& options,
+        const InterpreterFactory& interpreter) {
+    std::vector<GeneratedFunction> functions;
+    for (const std::string& functionString : functionStrings) {
+        functions.push_back(CodeGenerator::verbatimFunction(functionString));
+    }
+    return RuntimeCompiler::compileTiered(functions, metadata, options,
+                                          interpreter);
+}
+
+TieredModule RuntimeCompiler::compileTiered(
+        const std::vector<GeneratedFunction>& functions,
+        const std::string& metadata, const CompileOptions& options,
+        const InterpreterFactory& interpreter) {
+    TieredModule tiered;
+    tiered.tier = RuntimeCompiler::compilationTier(options);
+    if (tiered.tier == CompilationTier::Interpreted) {
+        if (!interpreter) {
+            throw std::runtime_error(
+                    "The interpreter backend isn't supported by this "
+                    "objective");
+        }
+        tiered.module = interpreter();
+        return tiered;
+    }
+
+    if (!options.tiered || tiered.tier == CompilationTier::Unoptimized) {
+        try {
+            tiered.module =
+                    RuntimeCompiler::compile(functions, metadata, options);
+        } catch (const std::runtime_error& e) {
+            if (!interpreter || !options.interpreterFallback) {
+                throw;
+            }
+            DEBUG_PRINT("Interpreting after compilation failed: " << e.what());
+            tiered.module = interpreter();
+            tiered.tier = CompilationTier::Interpreted;
+        }
+        return tiered;
+    }
+
+    // TinyCC compiles about as quickly as a tape is built, and its code runs
+    // faster, so the interpreter is only the first tier without it.
+    if (RuntimeCompiler::isAvailable(CompilerBackend::TinyCC) ||
+        !interpreter) {
+        CompileOptions fast;
+        fast.backend = RuntimeCompiler::isAvailable(CompilerBackend::TinyCC)
+                               ? CompilerBackend::TinyCC
+                               : CompilerBackend::External;
+        fast.optimizationLevel = 0;
+        tiered.module = RuntimeCompiler::compile(functions, metadata, fast);
+        tiered.tier = CompilationTier::Unoptimized;
+    } else {
+        tiered.module = interpreter();
+        tiered.tier = CompilationTier::Interpreted;
+    }
+
+    // The source files are written here, so the thread only keeps their
+    // paths and digests, and the functions, which are borrowed from the
+    // caller, don't need to outlive it. Only the external compiler builds
+    // the optimized tier.
+    CompileOptions optimized = options;
+    optimized.tiered = false;
+    SourceFiles files = RuntimeCompiler::writeSourceFiles(
+            RuntimeCompiler::translationUnits(functions, optimized),
+            optimized);
+    // The thread compiles with the caller's share of the threads
+    size_t threads = concurrentThreads();
+    tiered.optimized =
+            std::async(std::launch::async,
+                       [files, metadata, optimized, threads]()
+                               -> std::shared_ptr<const CompiledModule> {
+                           concurrentThreads() = threads;
+                           return RuntimeCompiler::compileSourceFiles(
+                                   files, metadata, optimized);
+                       })
+                    .share();
+    return tiered;
+}
+
+std::shared_ptr<CompiledModule> RuntimeCompiler::compileProfileGuided(
+        const std::vector<GeneratedFunction>& functions,
+        const std::string& metadata, const CompileOptions& options,
+        const ProfileWorkload& workload) {
+    if (options.backend != CompilerBackend::External) {
+        throw std::runtime_error(
+                "Profile guided optimization needs the external compiler");
+    }
+
+    std::string directory =
+            RuntimeCompiler::makeTempDirectory("cppmpc-profile");
+    std::string rawProfile = directory + "/profile.profraw";
+    std::string indexedProfile = directory + "/profile.profdata";
+
+    try {
+        // The profile is normally written when the process exits, so the
+        // instrumented library exports a function to write it early.
+        std::vector<GeneratedFunction> instrumentedFunctions = functions;
+        instrumentedFunctions.push_back(CodeGenerator::verbatimFunction(
+                "int __llvm_profile_write_file(void);\n"
+                "void cppmpc_write_profile(void) {\n"
+                "__llvm_profile_write_file();\n}\n"));
+        CompileOptions instrumented = options;
+        instrumented.tiered = false;
+        instrumented.instrumentProfile = rawProfile;
+        instrumented.useProfile.clear();
+        {
+            std::shared_ptr<const CompiledModule> module =
+                    RuntimeCompiler::compile(instrumentedFunctions, metadata,
+                                             instrumented);
+            workload(module);
+            module->function<void (*)()>("cppmpc_write_profile")();
+        }
+
+        std::string merge = std::string(PROFDATA_TOOL_PATH) +
+                            " merge -output=\"" + indexedProfile + "\" \"" +
+                            rawProfile + "\"";
+        if (std::system(merge.c_str()) != 0) {
+            throw std::runtime_error("Failed to merge the recorded profile");
+        }
+
+        CompileOptions optimized = options;
+        optimized.tiered = false;
+        optimized.instrumentProfile.clear();
+        optimized.useProfile = indexedProfile;
+        // Neither build is cached, so each module removes its own build
+        // directory, and only the profiles are left here
+        std::shared_ptr<CompiledModule> module =
+                RuntimeCompiler::compile(functions, metadata, optimized);
+        std::error_code error;
+        std::filesystem::remove_all(directory, error);
+        return module;
+    } catch (...) {
+        std::error_code error;
+        std::filesystem::remove_all(directory, error);
+        throw;
+    }
+}
+
+std::shared_ptr<CompiledModule> RuntimeCompiler::compileSourceFiles(
+        const SourceFiles& files, const std::string& metadata,
+        const CompileOptions& options) {
+    auto removeSources = [&files]() {
+        for (const std::string& path : files.paths) {
+            std::remove(path.c_str());
+        }
+    };
+
+    // The module owns the temporary directory of an uncached library, and
+    // removes it with the library
+    if (files.cacheDirectory.empty()) {
+        std::string tempSharedObject = files.tempDirectory + "/library.so";
+        try {
+            RuntimeCompiler::compileSources(files.paths, tempSharedObject,
+                                            options);
+        } catch (...) {
+            std::error_code removeError;
+            std::filesystem::remove_all(files.tempDirectory, removeError);
+            throw;
+        }
+        removeSources();
+        return RuntimeCompiler::loadLibrary(tempSharedObject,
+                                            files.tempDirectory);
+    }
+
+    try {
+        // The files are hashed together, so the way functions are split
+        // into chunks is part of the key. So is the metadata, so objectives
+        // with the same code but different metadata are separate entries.
+        std::vector<const std::string*> keyPieces;
+        for (const std::string& digest : files.digests) {
+            keyPieces.push_back(&digest);
+        }
+        keyPieces.push_back(&metadata);
+        std::string key = RuntimeCompiler::cacheKey(keyPieces, options);
+
+        std::stringstream meta;
+        meta << "key: " << key << std::endl;
+        meta << "compiler: " << CPP_COMPILER_PATH << std::endl;
+        meta << "flags: " << RuntimeCompiler::compilerFlags(options)
+             << std::endl;
+        meta << metadata;
+
+        // The whole source is kept with each entry and compared on a hit,
+        // so sources whose keys collide get entries next to each other
+        // instead of replacing each other on every compile. The first free
+        // slot is used, or the last one once they are all taken.
+        std::filesystem::path base;
+        for (size_t slot = 0; slot < RuntimeCompiler::maxCacheSlots;
+             slot++) {
+            base = std::filesystem::path(files.cacheDirectory) /
+                   (slot == 0 ? key : key + "-" + std::to_string(slot));
+            std::string storedMeta = readFile(base.string() + ".meta");
+            if (storedMeta.empty()) {
+                break;
+            }
+            if (storedMeta == meta.str() &&
+                std::filesystem::exists(base.string() + ".so") &&
+                storedSourceMatches(base.string() + ".source", files.paths)) {
+                DEBUG_PRINT("Using cached library: " << base.string()
+                                                     << ".so");
+                removeSources();
+                return RuntimeCompiler::loadLibrary(base.string() + ".so");
+            }
+        }
+        std::string cachedPath = base.string() + ".so";
+        std::string sourcePath = base.string() + ".source";
+        std::string metadataPath = base.string() + ".meta";
+
+        // Compile to a unique path, then rename the finished library into
+        // place. The metadata is written last, so an entry is only used
+        // once it is complete.
+        std::string tempLibraryPath =
+                base.string() + RuntimeCompiler::uniqueSuffix() + ".so";
+
+        // Each file's object is keyed by the file alone, so the files that
+        // are unchanged since an earlier build aren't compiled again.
+        std::vector<std::string> objectPaths;
+        if (options.incremental) {
+            for (const std::string& digest : files.digests) {
+                objectPaths.push_back(
+                        (std::filesystem::path(files.cacheDirectory) /
+                         RuntimeCompiler::cacheKey(digest, options))
+                                .string() +
+                        ".o");
+            }
+        }
+        try {
+            RuntimeCompiler::compileSources(files.paths, tempLibraryPath,
+                                            options, objectPaths);
+        } catch (...) {
+            std::remove(tempLibraryPath.c_str());
+            throw;
+        }
+
+        if (std::rename(tempLibraryPath.c_str(), cachedPath.c_str()) != 0) {
+            std::remove(tempLibraryPath.c_str());
+            throw std::runtime_error("Failed to rename " + tempLibraryPath);
+        }
+        RuntimeCompiler::writeFileAtomically(
+                sourcePath, [&files](std::ostream& stored) {
+                    writeStoredSource(stored, files.paths);
+                });
+        RuntimeCompiler::writeFileAtomically(metadataPath, meta.str());
+        removeSources();
+        return RuntimeCompiler::loadLibrary(cachedPath);
+    } catch (...) {
+        removeSources();
+        throw;
+    }
+}
+
+}  // namespace cppmpc
@@ -0,0 +1,406 @@
+// Copyright 2021 Ian Ruh
+#ifndef INCLUDE_RUNTIMECOMPILER_H_
+#define INCLUDE_RUNTIMECOMPILER_H_
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "CodeGenerator.h"
+#include "CompiledModule.h"
+#include "VectorMath.h"
+
+namespace cppmpc {
+
+/**
+ * @brief How generated source is turned into executable code.
+ */
+enum class CompilerBackend {
+    // Run CPP_COMPILER_PATH in a separate process to build a shared library,
+    // which is cached on disk and loaded with dlopen.
+    External,
+    // Compile in process from memory with libtcc. Only available when built
+    // with CPPMPC_WITH_LIBTCC.
+    TinyCC,
+    // Don't compile, and evaluate expression tapes built from the symbolic
+    // expressions instead. Only objectives that provide an interpreter can
+    // use it.
+    Interpreter
+};
+
+/**
+ * @brief Builds an interpreted module with the same functions as the
+ * generated source.
+ */
+typedef std::function<std::shared_ptr<const CompiledModule>()>
+        InterpreterFactory;
+
+/**
+ * @brief Which floating point rules the external compiler may relax.
+ */
+enum class FastMathPolicy {
+    // Strict IEEE semantics.
+    Off,
+    // Math functions don't set errno, so sqrt and friends can be inlined.
+    NoErrno,
+    // Also allow reassociation, reciprocals, and ignoring the sign of zero,
+    // while still handling infinities and NaNs, which the barrier produces
+    // outside of the feasible region.
+    Relaxed,
+    // -ffast-math, which also assumes there are no infinities or NaNs. The
+    // barrier is undefined outside of the feasible region, so this is only
+    // safe if the solver always stays feasible.
+    Full
+};
+
+/**
+ * @brief Whether the external compiler may fuse multiplies and adds.
+ */
+enum class FPContraction {
+    // The compiler's default.
+    Default,
+    Off,
+    // Only within a single expression.
+    On,
+    // Across expressions.
+    Fast
+};
+
+/**
+ * struct CompileOptions - How the generated functions of an objective are
+ * compiled.
+ *
+ * The optimization level, target, floating point, and profile options only
+ * apply to the external compiler.
+ */
+typedef struct CompileOptions {
+    CompilerBackend backend = CompilerBackend::External;
+    // Passed to the external compiler as -O<level>. TinyCC doesn't optimize,
+    // so it is ignored by that backend.
+    int optimizationLevel = 0;
+    // Passed as -march=<target>, e.g. "native". Empty uses the default.
+    std::string targetArchitecture;
+    FastMathPolicy fastMath = FastMathPolicy::Off;
+    FPContraction fpContraction = FPContraction::Default;
+    // Evaluate log, exp, sin, cos, and pow with the bundled SIMD kernels
+    // instead of math.h. Applies to both compilers, but not the interpreter,
+    // and only to functions generated from assignments, not given as text.
+    VectorMath vectorMath = VectorMath::Off;
+    // Instrument the code to write a raw profile to this path. Instrumented
+    // builds aren't cached.
+    std::string instrumentProfile;
+    // Optimize the code with this indexed profile. Builds using a profile
+    // aren't cached.
+    std::string useProfile;
+    // Compile without optimizations first, so finalize returns quickly, and
+    // compile at the optimization level in the background. The optimized
+    // functions are swapped in between solves by swapOptimizedModule or
+    // waitForOptimizedModule once they are ready.
+    bool tiered = false;
+    // Interpret the functions if they fail to compile, instead of throwing.
+    // Only used by objectives that provide an interpreter.
+    bool interpreterFallback = true;
+    // Functions generated from more assignments are split into chunks in
+    // their own source files, which the external compiler builds in
+    // parallel. 0 never splits functions.
+    size_t maxChunkAssignments = 2000;
+    // The most external compiler processes to run at once, or 0 for one per
+    // core. Objectives finalized at once by finalizeAll divide it between
+    // them.
+    size_t compileJobs = 0;
+    // Compile each function to its own object, and keep the objects in the
+    // compile cache, so a later finalize only compiles the functions that
+    // changed and links them with the cached ones. Only used by the external
+    // compiler with a cache directory.
+    bool incremental = false;
+} CompileOptions;
+
+/**
+ * @brief Common combinations of compile options.
+ */
+enum class CompilePreset {
+    // -O0, which compiles fastest.
+    Debug,
+    // -O2.
+    Release,
+    // -O3 for this machine's instruction set, with fused multiply-adds.
+    Native,
+    // Native, with relaxed floating point rules.
+    FastMath
+};
+
+/**
+ * @brief Runs sample inputs through a module built to record a profile.
+ */
+typedef std::function<void(std::shared_ptr<const CompiledModule>)>
+        ProfileWorkload;
+
+/**
+ * struct TieredModule - A module to use right away, and possibly an optimized
+ * build of the same functions that is still being compiled.
+ */
+typedef struct TieredModule {
+    std::shared_ptr<const CompiledModule> module;
+    CompilationTier tier = CompilationTier::Unoptimized;
+    // Not valid if there is no optimized build coming.
+    std::shared_future<std::shared_ptr<const CompiledModule>> optimized;
+} TieredModule;
+
+/**
+ * @brief Compiles generated C functions into a shared library and loads them.
+ *
+ * Compiled libraries are kept in a content addressed cache directory, keyed
+ * by a hash of the generated source, the compiler, and the compiler flags, so
+ * an identical objective is only compiled once, even across processes. The
+ * cache directory is $CPPMPC_CACHE_DIR if it is set, and cppmpc-cache in the
+ * system temporary directory otherwise.
+ *
+ * Each entry is a `<key>.so` library, a `<key>.source` copy of the source
+ * files it was compiled from, and a `<key>.meta` file describing the
+ * objective it was compiled for. Each is written to a unique temporary file
+ * and renamed into place, so processes sharing the cache never see a partial
+ * entry. The key also covers the metadata, and the source and metadata are
+ * compared on a hit, so entries whose keys collide are kept next to each
+ * other as `<key>-1`, `<key>-2`, and so on.
+ *
+ * Large functions are split into several source files, which are compiled in
+ * parallel and linked into one library, so the time to compile a large
+ * objective is bounded by its largest chunk instead of its largest function.
+ * Each file is printed straight to disk, and the source is only compared
+ * with and copied to the cache a block at a time.
+ *
+ * With the TinyCC backend, the source is compiled straight from memory and
+ * nothing is written to disk.
+ */
+class RuntimeCompiler {
+ private:
+    // The most entries kept for one key
+    static const size_t maxCacheSlots = 8;
+
+    /**
+     * @brief The cache key of the pieces of a source, hashed in order as if
+     * they were one string.
+     */
+    static std::string cacheKey(
+            const std::vector<const std::string*>& sourcePieces,
+            const CompileOptions& options);
+
+    /**
+     * @brief Compile source files into a shared library. Several files are
+     * compiled to objects in parallel and then linked.
+     *
+     * @param cachedObjectPaths Where the object of each file is kept. The
+     * objects that already exist are linked without compiling their files,
+     * and none of them are removed. If empty, temporary objects are used.
+     */
+    static void compileSources(
+            const std::vector<std::string>& sourcePaths,
+            const std::string& libraryPath, const CompileOptions& options,
+            const std::vector<std::string>& cachedObjectPaths = {});
+
+    /**
+     * @brief Load a compiled library. The module removes the temporary
+     * directory it was built in, if given, when it is destroyed.
+     */
+    static std::shared_ptr<CompiledModule> loadLibrary(
+            const std::string& path, const std::string& directory = "");
+
+    /**
+     * @brief Run a compiler command, throwing if it fails.
+     */
+    static void runCompiler(const std::string& arguments);
+
+    /**
+     * @brief The flags passed to the external compiler.
+     */
+    static std::string compilerFlags(const CompileOptions& options);
+
+    /**
+     * struct SourceFiles - The source files of a build by the external
+     * compiler, written before they are compiled.
+     */
+    typedef struct SourceFiles {
+        std::vector<std::string> paths;
+        // The hash of each file's contents, taken as it was written
+        std::vector<std::string> digests;
+        // The cache directory the files are written to, or empty if the
+        // build isn't cached.
+        std::string cacheDirectory;
+        // The directory of an uncached build, which keeps its library
+        std::string tempDirectory;
+    } SourceFiles;
+
+    /**
+     * @brief The translation units of the functions, split and vectorized as
+     * the options ask.
+     */
+    static std::vector<std::vector<GeneratedFunction>> translationUnits(
+            const std::vector<GeneratedFunction>& functions,
+            const CompileOptions& options);
+
+    /**
+     * @brief Print each translation unit straight to its own file, hashing
+     * it on the way, so no unit is ever held in memory as a whole.
+     *
+     * The files are written to the cache directory if it is enabled, and to
+     * a new temporary directory otherwise. Only the paths are used
+     * afterwards, so the files can be compiled on another thread.
+     */
+    static SourceFiles writeSourceFiles(
+            const std::vector<std::vector<GeneratedFunction>>& units,
+            const CompileOptions& options);
+
+    /**
+     * @brief Compile written source files with the external compiler, using
+     * the cache if they were written to it. The source files are removed.
+     */
+    static std::shared_ptr<CompiledModule> compileSourceFiles(
+            const SourceFiles& files, const std::string& metadata,
+            const CompileOptions& options);
+
+    /**
+     * @brief A suffix that is unique to this process and call, used for
+     * temporary files in the cache directory.
+     */
+    static std::string uniqueSuffix();
+
+    /**
+     * @brief Create a new directory with a unique name in the system's
+     * temporary directory, which is safe to use from several threads and
+     * processes at once.
+     *
+     * @param prefix The start of the directory's name.
+     * @return The path of the directory.
+     */
+    static std::string makeTempDirectory(const std::string& prefix);
+
+    /**
+     * @brief Write the file to a temporary path and rename it into place.
+     */
+    static void writeFileAtomically(
+            const std::string& path,
+            const std::function<void(std::ostream&)>& write);
+    static void writeFileAtomically(const std::string& path,
+                                    const std::string& contents);
+
+ public:
+    /**
+     * @brief Set the cache directory. An empty directory disables the cache.
+     */
+    static void setCacheDirectory(const std::string& directory);
+
+    /**
+     * @brief The cache directory, or an empty string if the cache is disabled.
+     */
+    static std::string cacheDirectory();
+
+    /**
+     * @brief The cache key of a source file: a hex FNV-1a hash of the source,
+     * the compiler, and the compiler flags.
+     */
+    static std::string cacheKey(const std::string& source,
+                                const CompileOptions& options = {});
+
+    /**
+     * @brief The cache key of the sources joined together, without joining
+     * them.
+     */
+    static std::string cacheKey(const std::vector<std::string>& sources,
+                                const CompileOptions& options = {});
+
+    /**
+     * @brief The options for a preset, with the default external backend.
+     */
+    static CompileOptions presetOptions(CompilePreset preset);
+
+    /**
+     * @brief Whether the given backend is available in this build.
+     */
+    static bool isAvailable(CompilerBackend backend);
+
+    /**
+     * @brief The tier of code compiled with the given options.
+     */
+    static CompilationTier compilationTier(const CompileOptions& options);
+
+    /**
+     * @brief Compile the functions and load them, reusing the cached library
+     * if the same source has been compiled before by the external compiler.
+     *
+     * @param functions The generated functions.
+     * @param metadata A description of the objective, such as its dimensions
+     * and orderings, stored alongside the library. A cached library is only
+     * reused if its metadata matches.
+     * @param options The backend and optimization level to compile with.
+     * @return The compiled module, which releases the code when destroyed.
+     */
+    static std::shared_ptr<CompiledModule> compile(
+            const std::vector<GeneratedFunction>& functions,
+            const std::string& metadata = "",
+            const CompileOptions& options = {});
+
+    /**
+     * @brief Compile functions given as text, which are printed verbatim.
+     */
+    static std::shared_ptr<CompiledModule> compile(
+            const std::vector<std::string>& functionStrings,
+            const std::string& metadata = "",
+            const CompileOptions& options = {});
+
+    /**
+     * @brief Compile the functions, quickly first if the options are tiered.
+     *
+     * If the options are tiered and optimized, the functions are compiled by
+     * TinyCC if it is available, interpreted if there is an interpreter, and
+     * compiled without optimizations otherwise, and the optimized build is
+     * started on a background thread. Otherwise this is the same as compile,
+     * except that the functions are interpreted if they fail to compile and
+     * the options allow it.
+     *
+     * @param interpreter Builds the interpreted module, if the objective can
+     * be interpreted.
+     * @return The module to use now, and the optimized build, if any.
+     */
+    static TieredModule compileTiered(
+            const std::vector<std::string>& functionStrings,
+            const std::string& metadata = "",
+            const CompileOptions& options = {},
+            const InterpreterFactory& interpreter = nullptr);
+
+    /**
+     * @brief Compile generated functions, quickly first if the options are
+     * tiered.
+     *
+     * The source files of the optimized build are written on the calling
+     * thread, so the build never touches the functions' expressions.
+     */
+    static TieredModule compileTiered(
+            const std::vector<GeneratedFunction>& functions,
+            const std::string& metadata = "",
+            const CompileOptions& options = {},
+            const InterpreterFactory& interpreter = nullptr);
+
+    /**
+     * @brief Compile the functions with profile guided optimization.
+     *
+     * The functions are built with instrumentation and passed to the
+     * workload, which should evaluate them on representative inputs. The
+     * recorded profile is then merged with PROFDATA_TOOL_PATH, and the
+     * functions are rebuilt with the options and the profile.
+     *
+     * @param options The options of the final build. They must use the
+     * external backend.
+     * @return The module optimized with the profile.
+     */
+    static std::shared_ptr<CompiledModule> compileProfileGuided(
+            const std::vector<GeneratedFunction>& functions,
+            const std::string& metadata, const CompileOptions& options,
+            const ProfileWorkload& workload);
+};
+
+}  // namespace cppmpc
+
+#endif  // INCLUDE_RUNTIMECOMPILER_H_
@@ -0,0 +1,77 @@
+// Copyright 2021 Ian Ruh
+#ifndef INCLUDE_SPARSITYPATTERN_H_
+#define INCLUDE_SPARSITYPATTERN_H_
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace cppmpc {
+
+/**
+ * @brief The structural non-zeros of a matrix.
+ *
+ * Entries that are not in the pattern are known to be identically zero, so
+ * they never need to be differentiated, generated, or evaluated. The column
+ * indices of each row are kept sorted.
+ */
+class SparsityPattern {
+ private:
+    size_t _rows = 0;
+    size_t _cols = 0;
+
+    // The sorted column indices of the non-zero entries in each row.
+    std::vector<std::vector<size_t>> rowColumns;
+
+ public:
+    SparsityPattern() {}
+    SparsityPattern(size_t rows, size_t cols)
+            : _rows(rows), _cols(cols), rowColumns(rows) {}
+
+    size_t rows() const { return this->_rows; }
+    size_t cols() const { return this->_cols; }
+
+    /**
+     * @brief Mark the given entry as structurally non-zero.
+     */
+    void insert(size_t row, size_t col) {
+        if (row >= this->_rows || col >= this->_cols) {
+            throw std::out_of_range("Sparsity pattern entry is out of range.");
+        }
+        std::vector<size_t>& columns = this->rowColumns[row];
+        auto it = std::lower_bound(columns.begin(), columns.end(), col);
+        if (it == columns.end() || *it != col) {
+            columns.insert(it, col);
+        }
+    }
+
+    /**
+     * @brief Whether the given entry is structurally non-zero.
+     */
+    bool contains(size_t row, size_t col) const {
+        const std::vector<size_t>& columns = this->rowColumns.at(row);
+        return std::binary_search(columns.begin(), columns.end(), col);
+    }
+
+    /**
+     * @brief The sorted column indices of the non-zeros in a row.
+     */
+    const std::vector<size_t>& row(size_t row) const {
+        return this->rowColumns.at(row);
+    }
+
+    /**
+     * @brief The number of structurally non-zero entries.
+     */
+    size_t nnz() const {
+        size_t count = 0;
+        for (const std::vector<size_t>& columns : this->rowColumns) {
+            count += columns.size();
+        }
+        return count;
+    }
+};
+
+}  // namespace cppmpc
+
+#endif  // INCLUDE_SPARSITYPATTERN_H_
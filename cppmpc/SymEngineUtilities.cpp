@@ -16,6 +16,7 @@
 #include <symengine/integer.h>
 #include <symengine/functions.h>
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
@@ -23,8 +24,12 @@
 #include <unordered_set>
 #include <vector>
 
+#include "DerivativeCache.h"
 #include "GetSymbolsVisitor.h"
 #include "OrderedSet.h"
+#include "SparsityPattern.h"
+#include "SymbolCollector.h"
+#include "SymbolRegistry.h"
 
 namespace cppmpc {
 
@@ -34,31 +39,25 @@ using SymEngine::Symbol;
 using SymEngine::Expression;
 
 RCP<const Symbol> variable(const std::string& name) {
-    return SymEngine::symbol("$v_" + name);
+    return SymbolRegistry::instance().intern("$v_" + name,
+                                             SymbolKind::Variable);
 }
 
 std::vector<RCP<const Symbol>> variableVector(const std::string& baseName,
                                               size_t num) {
-    std::vector<RCP<const Symbol>> vec;
-    vec.reserve(num);
-    for (size_t i = 0; i < num; i++) {
-        vec.push_back(variable(baseName + "[" + std::to_string(i) + "]"));
-    }
-    return vec;
+    return SymbolRegistry::instance().internRange("$v_" + baseName, num,
+                                                  SymbolKind::Variable);
 }
 
 RCP<const Symbol> parameter(const std::string& name) {
-    return SymEngine::symbol("$p_" + name);
+    return SymbolRegistry::instance().intern("$p_" + name,
+                                             SymbolKind::Parameter);
 }
 
 std::vector<RCP<const Symbol>> parameterVector(const std::string& baseName,
                                                size_t num) {
-    std::vector<RCP<const Symbol>> vec;
-    vec.reserve(num);
-    for (size_t i = 0; i < num; i++) {
-        vec.push_back(parameter(baseName + "[" + std::to_string(i) + "]"));
-    }
-    return vec;
+    return SymbolRegistry::instance().internRange("$p_" + baseName, num,
+                                                  SymbolKind::Parameter);
 }
 
 std::vector<SymEngine::Expression> toExpressions(const std::vector<RCP<const Symbol>>& rcpVec) {
@@ -118,62 +117,143 @@ RCP<const Basic> taylorExpand(const Expression& original,
     return Expression(taylorExpand(originalBasic, variableSymbol, locationBasic, order));
 }
 
+std::vector<size_t> variableDependencies(const RCP<const Basic>& basic,
+                                         const OrderedSet& variableOrdering) {
+    std::vector<size_t> indices;
+    for (const RCP<const Symbol>& symbol : getSymbols(basic)) {
+        if (variableOrdering.contains(symbol)) {
+            indices.push_back(variableOrdering.indexOf(symbol));
+        }
+    }
+    std::sort(indices.begin(), indices.end());
+    return indices;
+}
+
 SymEngine::DenseMatrix gradient(const RCP<const Basic>& basic,
-                                const OrderedSet& variableOrdering) {
+                                const OrderedSet& variableOrdering,
+                                SparsityPattern& pattern) {
     SymEngine::DenseMatrix grad(variableOrdering.size(), 1);
-    for (size_t i = 0; i < variableOrdering.size(); i++) {
+    SymEngine::zeros(grad);
+    pattern = SparsityPattern(variableOrdering.size(), 1);
+
+    for (size_t i : variableDependencies(basic, variableOrdering)) {
         RCP<const Symbol> symbol = variableOrdering.at(i);
-        grad.set(i, 0, SymEngine::diff(basic, symbol));
+        RCP<const Basic> derivative = cppmpc::derivative(basic, symbol);
+        if (SymEngine::neq(*derivative, *SymEngine::zero)) {
+            grad.set(i, 0, derivative);
+            pattern.insert(i, 0);
+        }
     }
 
     return grad;
 }
 
-SymEngine::DenseMatrix jacobian(const SymEngine::DenseMatrix& f,
+SymEngine::DenseMatrix gradient(const RCP<const Basic>& basic,
                                 const OrderedSet& variableOrdering) {
-    SymEngine::DenseMatrix jacobian(
-            f.nrows(),
-            variableOrdering.size());
-    // Rows first, then columns
+    SparsityPattern pattern;
+    return gradient(basic, variableOrdering, pattern);
+}
+
+std::vector<SymbolicTriplet> sparseJacobian(
+        const SymEngine::DenseMatrix& f, const OrderedSet& variableOrdering) {
+    std::vector<SymbolicTriplet> entries;
+    // Rows first, then only the columns the row depends on
     for (size_t row = 0; row < f.nrows(); row++) {
-        for(size_t col = 0; col < variableOrdering.size(); col++) {
+        for (size_t col : variableDependencies(f.get(row, 0),
+                                               variableOrdering)) {
             RCP<const Symbol> symbol = variableOrdering.at(col);
-            jacobian.set(row, col, SymEngine::diff(f.get(row, 0), symbol));
+            RCP<const Basic> derivative =
+                    cppmpc::derivative(f.get(row, 0), symbol);
+            if (SymEngine::neq(*derivative, *SymEngine::zero)) {
+                entries.push_back({row, col, derivative});
+            }
         }
     }
+    return entries;
+}
+
+SymEngine::DenseMatrix jacobian(const SymEngine::DenseMatrix& f,
+                                const OrderedSet& variableOrdering,
+                                SparsityPattern& pattern) {
+    SymEngine::DenseMatrix jacobian(
+            f.nrows(),
+            variableOrdering.size());
+    SymEngine::zeros(jacobian);
+    pattern = SparsityPattern(f.nrows(), variableOrdering.size());
+
+    for (const SymbolicTriplet& entry : sparseJacobian(f, variableOrdering)) {
+        jacobian.set(entry.row, entry.col, entry.value);
+        pattern.insert(entry.row, entry.col);
+    }
 
     return jacobian;
 }
 
-SymEngine::DenseMatrix hessian(const RCP<const Basic>& basic,
-                               const OrderedSet& variableOrdering) {
-    SymEngine::DenseMatrix hess(variableOrdering.size(),
-                                variableOrdering.size());
+SymEngine::DenseMatrix jacobian(const SymEngine::DenseMatrix& f,
+                                const OrderedSet& variableOrdering) {
+    SparsityPattern pattern;
+    return jacobian(f, variableOrdering, pattern);
+}
 
-    for (size_t row = 0; row < variableOrdering.size(); row++) {
-        for (size_t col = 0; col < variableOrdering.size(); col++) {
-            RCP<const Symbol> symbol_row = variableOrdering.at(row);
+std::vector<SymbolicTriplet> sparseHessian(const RCP<const Basic>& basic,
+                                           const OrderedSet& variableOrdering) {
+    std::vector<SymbolicTriplet> entries;
+    for (size_t row : variableDependencies(basic, variableOrdering)) {
+        RCP<const Symbol> symbol_row = variableOrdering.at(row);
+        RCP<const Basic> d_row = cppmpc::derivative(basic, symbol_row);
+        for (size_t col : variableDependencies(d_row, variableOrdering)) {
             RCP<const Symbol> symbol_col = variableOrdering.at(col);
-            RCP<const Basic> d_row = SymEngine::diff(basic, symbol_row);
-            RCP<const Basic> d_row_col = SymEngine::diff(d_row, symbol_col);
-            hess.set(row, col, d_row_col);
+            RCP<const Basic> d_row_col =
+                    cppmpc::derivative(d_row, symbol_col);
+            if (SymEngine::neq(*d_row_col, *SymEngine::zero)) {
+                entries.push_back({row, col, d_row_col});
+            }
         }
     }
+    return entries;
+}
+
+SymEngine::DenseMatrix hessian(const RCP<const Basic>& basic,
+                               const OrderedSet& variableOrdering,
+                               SparsityPattern& pattern) {
+    SymEngine::DenseMatrix hess(variableOrdering.size(),
+                                variableOrdering.size());
+    SymEngine::zeros(hess);
+    pattern = SparsityPattern(variableOrdering.size(),
+                              variableOrdering.size());
+
+    for (const SymbolicTriplet& entry :
+         sparseHessian(basic, variableOrdering)) {
+        hess.set(entry.row, entry.col, entry.value);
+        pattern.insert(entry.row, entry.col);
+    }
 
     return hess;
 }
 
+SymEngine::DenseMatrix hessian(const RCP<const Basic>& basic,
+                               const OrderedSet& variableOrdering) {
+    SparsityPattern pattern;
+    return hessian(basic, variableOrdering, pattern);
+}
+
 UnorderedSetSymbol getSymbols(const RCP<const Basic>& basic) {
+    if (SymbolCollector* collector = SymbolCollector::active()) {
+        return collector->collect(basic)->symbols;
+    }
     GetSymbolsVisitor visitor;
     return visitor.apply(*basic.get());
 }
 
 UnorderedSetSymbol getVariables(const RCP<const Basic>& basic) {
+    if (SymbolCollector* collector = SymbolCollector::active()) {
+        return collector->collect(basic)->variables;
+    }
     UnorderedSetSymbol allSymbols = getSymbols(basic);
     UnorderedSetSymbol variables;
+    const SymbolRegistry& registry = SymbolRegistry::instance();
     for (const RCP<const Symbol>& symbol : allSymbols) {
-        std::string name = symbol.get()->get_name();
-        if (name.substr(0, 3) == "$v_") {
+        if (registry.kind(*symbol) == SymbolKind::Variable) {
             variables.insert(symbol);
         }
     }
@@ -193,11 +273,14 @@ UnorderedSetSymbol getVariables(const SymEngine::DenseMatrix& mat) {
 }
 
 UnorderedSetSymbol getParameters(const RCP<const Basic>& basic) {
+    if (SymbolCollector* collector = SymbolCollector::active()) {
+        return collector->collect(basic)->parameters;
+    }
     UnorderedSetSymbol allSymbols = getSymbols(basic);
     UnorderedSetSymbol parameters;
+    const SymbolRegistry& registry = SymbolRegistry::instance();
     for (const RCP<const Symbol>& symbol : allSymbols) {
-        std::string name = symbol.get()->get_name();
-        if (name.substr(0, 3) == "$p_") {
+        if (registry.kind(*symbol) == SymbolKind::Parameter) {
             parameters.insert(symbol);
         }
     }
@@ -10,8 +10,10 @@
 #include <map>
 #include <string>
 #include <unordered_set>
+#include <vector>
 
 #include "OrderedSet.h"
+#include "SparsityPattern.h"
 
 namespace cppmpc {
 
@@ -28,8 +30,20 @@ typedef std::map<RCP<const Basic>, std::string, SymEngine::RCPBasicKeyLess>
         MapBasicString;
 
 /**
- * @brief Create a symbol with the `$v_` prefix indicating it is an active
- * variable.
+ * struct SymbolicTriplet - A single non-zero entry of a sparse symbolic matrix.
+ */
+typedef struct SymbolicTriplet {
+    size_t row;
+    size_t col;
+    RCP<const Basic> value;
+} SymbolicTriplet;
+
+/**
+ * @brief Get the variable with the given name, registering it as a variable
+ * if it does not exist yet. The symbol's name has a `$v_` prefix.
+ *
+ * The symbols of a variable vector are given a contiguous range of ids when
+ * they are created together.
  *
  * @param name The name of the variable.
  */
@@ -38,8 +52,8 @@ std::vector<RCP<const Symbol>> variableVector(const std::string& baseName,
                                               size_t num);
 
 /**
- * @brief Create a symbol with the `$p_` prefix indicating it is not an active
- * variable.
+ * @brief Get the parameter with the given name, registering it as a parameter
+ * if it does not exist yet. The symbol's name has a `$p_` prefix.
  *
  * @param name The name of the parameter.
  */
@@ -69,39 +83,96 @@ RCP<const Basic> taylorExpand(const Expression& original,
                               const Expression& location,
                               size_t order);
 
+/**
+ * @brief Get the indices in the variable ordering of every variable the basic
+ * depends on. Symbols that are not in the ordering are ignored.
+ *
+ * @param basic The basic.
+ * @param variableOrdering The variable ordering.
+ *
+ * @return The sorted indices of the variables present in the basic.
+ */
+std::vector<size_t> variableDependencies(const RCP<const Basic>& basic,
+                                         const OrderedSet& variableOrdering);
+
 /**
  * @brief Get the gradient of the basic using the given variable ordering.
  *
+ * Only the variables the basic depends on are differentiated with respect to,
+ * all other entries are set to zero.
+ *
  * @param basic The basic.
  * @param variableOrdering The variable ordering.
+ * @param pattern Set to the nx1 sparsity pattern of the gradient.
  *
  * @return A 1xn matrix contatining the gradient of the basic.
  */
+SymEngine::DenseMatrix gradient(const RCP<const Basic>& basic,
+                                const OrderedSet& variableOrdering,
+                                SparsityPattern& pattern);
 SymEngine::DenseMatrix gradient(const RCP<const Basic>& basic,
                                 const OrderedSet& variableOrdering);
 
 /**
  * @brief Get the jacobian of the vector valued functionn f.
  *
+ * Each row is only differentiated with respect to the variables it depends
+ * on.
+ *
  * @param f A vector valued function.
  * @param variableOrdering The variable ordering to use.
+ * @param pattern Set to the sparsity pattern of the jacobian.
  *
  * @return The jacobian of the function f.
  */
+SymEngine::DenseMatrix jacobian(const SymEngine::DenseMatrix& f,
+                                const OrderedSet& variableOrdering,
+                                SparsityPattern& pattern);
 SymEngine::DenseMatrix jacobian(const SymEngine::DenseMatrix& f,
                                 const OrderedSet& variableOrdering);
 
+/**
+ * @brief Get only the non-zero entries of the jacobian of the vector valued
+ * function f.
+ *
+ * @param f A vector valued function.
+ * @param variableOrdering The variable ordering to use.
+ *
+ * @return The non-zero entries of the jacobian, in row major order.
+ */
+std::vector<SymbolicTriplet> sparseJacobian(const SymEngine::DenseMatrix& f,
+                                            const OrderedSet& variableOrdering);
+
 /**
  * @brief Get the hessian of the basic using the given variable ordering.
  *
+ * The basic is only differentiated with respect to the variables it depends
+ * on, and each first derivative only with respect to the variables it still
+ * depends on, so the work is proportional to the number of non-zeros.
+ *
  * @param basic The basic.
  * @param variableOrdering The variable ordering.
+ * @param pattern Set to the sparsity pattern of the hessian.
  *
  * @return An nxn matrix containing the hessian of the basic.
  */
+SymEngine::DenseMatrix hessian(const RCP<const Basic>& basic,
+                               const OrderedSet& variableOrdering,
+                               SparsityPattern& pattern);
 SymEngine::DenseMatrix hessian(const RCP<const Basic>& basic,
                                const OrderedSet& variableOrdering);
 
+/**
+ * @brief Get only the non-zero entries of the hessian of the basic.
+ *
+ * @param basic The basic.
+ * @param variableOrdering The variable ordering.
+ *
+ * @return The non-zero entries of the hessian, in row major order.
+ */
+std::vector<SymbolicTriplet> sparseHessian(const RCP<const Basic>& basic,
+                                           const OrderedSet& variableOrdering);
+
 /**
  * @brief Get all the symbols present in a basic.
  *
@@ -110,17 +181,15 @@ SymEngine::DenseMatrix hessian(const RCP<const Basic>& basic,
  */
 UnorderedSetSymbol getSymbols(const RCP<const Basic>& basic);
 
-// Get the variables in a given basic. All variables are just symbols whose
-// names begin with `$v_`.
-//
-// For example, a variable named `x`, is a symbol with name `$v_x`.
+// Get the variables in a given basic. Variables are the symbols the
+// SymbolRegistry created as variables, e.g. by `variable`, and other symbols
+// with the `$v_` prefix.
 UnorderedSetSymbol getVariables(const RCP<const Basic>& basic);
 UnorderedSetSymbol getVariables(const SymEngine::DenseMatrix& mat);
 
-// Get the parameters in a given basic. All parameters are just symbols whose
-// names begin with `$p_`.
-//
-// For example, a parameter named `i`, is a symbol with name `$p_i`.
+// Get the parameters in a given basic. Parameters are the symbols the
+// SymbolRegistry created as parameters, e.g. by `parameter`, and other
+// symbols with the `$p_` prefix.
 UnorderedSetSymbol getParameters(const RCP<const Basic>& basic);
 UnorderedSetSymbol getParameters(const SymEngine::DenseMatrix& mat);
 
@@ -0,0 +1,103 @@
+// Copyright 2021 Ian Ruh
+#include "SymbolCollector.h"
+
+#include <symengine/basic.h>
+#include <symengine/symbol.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "SymEngineUtilities.h"
+#include "SymbolRegistry.h"
+
+namespace cppmpc {
+
+using SymEngine::Basic;
+using SymEngine::RCP;
+using SymEngine::Symbol;
+
+// The collector used by the symbol utility functions on each thread
+static thread_local SymbolCollector* activeCollector = nullptr;
+
+SymbolCollector::SymbolCollector()
+        : empty(std::make_shared<const CollectedSymbols>()) {}
+
+std::shared_ptr<const CollectedSymbols> SymbolCollector::collectNode(
+        const RCP<const Basic>& basic) {
+    auto it = this->memo.find(basic);
+    if (it != this->memo.end()) {
+        return it->second;
+    }
+
+    std::shared_ptr<const CollectedSymbols> result;
+    if (SymEngine::is_a<Symbol>(*basic)) {
+        RCP<const Symbol> symbol =
+                SymEngine::rcp_static_cast<const Symbol>(basic);
+        auto collected = std::make_shared<CollectedSymbols>();
+        collected->symbols.insert(symbol);
+        SymbolKind kind = SymbolRegistry::instance().kind(*symbol);
+        if (kind == SymbolKind::Variable) {
+            collected->variables.insert(symbol);
+        } else if (kind == SymbolKind::Parameter) {
+            collected->parameters.insert(symbol);
+        }
+        result = collected;
+    } else {
+        // Reuse a child's result when it is the only one with symbols, and
+        // only merge when there are several.
+        std::vector<std::shared_ptr<const CollectedSymbols>> children;
+        for (const RCP<const Basic>& arg : basic->get_args()) {
+            std::shared_ptr<const CollectedSymbols> child =
+                    this->collectNode(arg);
+            if (!child->symbols.empty()) {
+                children.push_back(child);
+            }
+        }
+
+        if (children.empty()) {
+            result = this->empty;
+        } else if (children.size() == 1) {
+            result = children[0];
+        } else {
+            auto collected = std::make_shared<CollectedSymbols>();
+            for (const std::shared_ptr<const CollectedSymbols>& child :
+                 children) {
+                util_union(collected->symbols, child->symbols);
+                util_union(collected->variables, child->variables);
+                util_union(collected->parameters, child->parameters);
+            }
+            result = collected;
+        }
+    }
+
+    this->memo.emplace(basic, result);
+    return result;
+}
+
+std::shared_ptr<const CollectedSymbols> SymbolCollector::collect(
+        const RCP<const Basic>& basic) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->collectNode(basic);
+}
+
+size_t SymbolCollector::size() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->memo.size();
+}
+
+void SymbolCollector::clear() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->memo.clear();
+}
+
+SymbolCollector* SymbolCollector::active() { return activeCollector; }
+
+SymbolCollector::Scope::Scope(SymbolCollector& collector)
+        : previous(activeCollector) {
+    activeCollector = &collector;
+}
+
+SymbolCollector::Scope::~Scope() { activeCollector = this->previous; }
+
+}  // namespace cppmpc
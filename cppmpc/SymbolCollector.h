@@ -0,0 +1,99 @@
+// Copyright 2021 Ian Ruh
+#ifndef INCLUDE_SYMBOLCOLLECTOR_H_
+#define INCLUDE_SYMBOLCOLLECTOR_H_
+
+#include <symengine/basic.h>
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "SymEngineUtilities.h"
+
+namespace cppmpc {
+
+using SymEngine::Basic;
+using SymEngine::RCP;
+
+/**
+ * struct CollectedSymbols - The symbols in an expression, along with which of
+ * them are variables and which are parameters.
+ */
+typedef struct CollectedSymbols {
+    UnorderedSetSymbol symbols;
+    UnorderedSetSymbol variables;
+    UnorderedSetSymbol parameters;
+} CollectedSymbols;
+
+/**
+ * @brief Collects the symbols in expressions, remembering the result for
+ * every node it visits.
+ *
+ * Nodes are keyed by their structural hash, so subexpressions shared between
+ * expressions (e.g. between the entries of a hessian) are only visited once,
+ * and the variables and parameters are classified in the same pass.
+ *
+ * While a SymbolCollector::Scope is alive, getSymbols, getVariables, and
+ * getParameters on that thread use its collector.
+ */
+class SymbolCollector {
+ private:
+    typedef std::unordered_map<RCP<const Basic>,
+                               std::shared_ptr<const CollectedSymbols>,
+                               SymEngine::RCPBasicHash,
+                               SymEngine::RCPBasicKeyEq>
+            NodeMap;
+
+    NodeMap memo;
+    std::mutex mutex;
+
+    // Shared by every node without symbols
+    const std::shared_ptr<const CollectedSymbols> empty;
+
+    std::shared_ptr<const CollectedSymbols> collectNode(
+            const RCP<const Basic>& basic);
+
+ public:
+    SymbolCollector();
+
+    /**
+     * @brief Get the symbols in the basic.
+     */
+    std::shared_ptr<const CollectedSymbols> collect(
+            const RCP<const Basic>& basic);
+
+    /**
+     * @brief The number of nodes that have been memoized.
+     */
+    size_t size();
+
+    /**
+     * @brief Forget every memoized node.
+     */
+    void clear();
+
+    /**
+     * @brief The collector of the innermost scope on this thread, or null.
+     */
+    static SymbolCollector* active();
+
+    /**
+     * @brief Make a collector the active collector on this thread until the
+     * scope is destroyed.
+     */
+    class Scope {
+     private:
+        SymbolCollector* previous;
+
+     public:
+        explicit Scope(SymbolCollector& collector);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+};
+
+}  // namespace cppmpc
+
+#endif  // INCLUDE_SYMBOLCOLLECTOR_H_
@@ -0,0 +1,110 @@
+// Copyright 2021 Ian Ruh
+#include "SymbolRegistry.h"
+
+#include <symengine/basic.h>
+#include <symengine/symbol.h>
+
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cppmpc {
+
+using SymEngine::RCP;
+using SymEngine::Symbol;
+
+SymbolRegistry& SymbolRegistry::instance() {
+    static SymbolRegistry registry;
+    return registry;
+}
+
+RCP<const Symbol> SymbolRegistry::registerSymbol(const std::string& name,
+                                                 SymbolKind kind) {
+    SymbolId id = static_cast<SymbolId>(this->symbols.size());
+    RCP<const Symbol> symbol =
+            SymEngine::make_rcp<const RegisteredSymbol>(name, id, kind);
+    this->symbols.push_back(symbol);
+    this->kinds.push_back(kind);
+    this->idsByName.emplace(name, id);
+    return symbol;
+}
+
+RCP<const Symbol> SymbolRegistry::intern(const std::string& name,
+                                         SymbolKind kind) {
+    std::unique_lock<std::shared_mutex> lock(this->mutex);
+    auto it = this->idsByName.find(name);
+    if (it != this->idsByName.end()) {
+        if (this->kinds[it->second] != kind) {
+            throw std::runtime_error("Symbol " + name +
+                                     " already exists with a different kind.");
+        }
+        return this->symbols[it->second];
+    }
+    return this->registerSymbol(name, kind);
+}
+
+std::vector<RCP<const Symbol>> SymbolRegistry::internRange(
+        const std::string& baseName, size_t num, SymbolKind kind) {
+    std::unique_lock<std::shared_mutex> lock(this->mutex);
+    std::vector<RCP<const Symbol>> range;
+    range.reserve(num);
+
+    // The lock is held for the whole range, so new symbols get consecutive
+    // ids.
+    for (size_t i = 0; i < num; i++) {
+        std::string name = baseName + "[" + std::to_string(i) + "]";
+        auto it = this->idsByName.find(name);
+        if (it == this->idsByName.end()) {
+            range.push_back(this->registerSymbol(name, kind));
+        } else if (this->kinds[it->second] != kind) {
+            throw std::runtime_error("Symbol " + name +
+                                     " already exists with a different kind.");
+        } else {
+            range.push_back(this->symbols[it->second]);
+        }
+    }
+    return range;
+}
+
+std::optional<SymbolId> SymbolRegistry::id(const Symbol& symbol) const {
+    if (const RegisteredSymbol* registered =
+                SymbolRegistry::registered(symbol)) {
+        return registered->id();
+    }
+    return std::nullopt;
+}
+
+SymbolKind SymbolRegistry::kind(const Symbol& symbol) const {
+    if (const RegisteredSymbol* registered =
+                SymbolRegistry::registered(symbol)) {
+        return registered->kind();
+    }
+    const std::string& name = symbol.get_name();
+    if (name.compare(0, 3, "$v_") == 0) {
+        return SymbolKind::Variable;
+    }
+    if (name.compare(0, 3, "$p_") == 0) {
+        return SymbolKind::Parameter;
+    }
+    return SymbolKind::Other;
+}
+
+SymbolKind SymbolRegistry::kind(SymbolId id) const {
+    std::shared_lock<std::shared_mutex> lock(this->mutex);
+    return this->kinds.at(id);
+}
+
+RCP<const Symbol> SymbolRegistry::symbol(SymbolId id) const {
+    std::shared_lock<std::shared_mutex> lock(this->mutex);
+    return this->symbols.at(id);
+}
+
+size_t SymbolRegistry::size() const {
+    std::shared_lock<std::shared_mutex> lock(this->mutex);
+    return this->symbols.size();
+}
+
+}  // namespace cppmpc
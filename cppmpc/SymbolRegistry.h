@@ -0,0 +1,147 @@
+// Copyright 2021 Ian Ruh
+#ifndef INCLUDE_SYMBOLREGISTRY_H_
+#define INCLUDE_SYMBOLREGISTRY_H_
+
+#include <symengine/basic.h>
+#include <symengine/symbol.h>
+
+#include <cstdint>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cppmpc {
+
+using SymEngine::RCP;
+using SymEngine::Symbol;
+
+/**
+ * @brief What a symbol represents.
+ */
+enum class SymbolKind : uint8_t {
+    // Neither a variable nor a parameter
+    Other,
+    // An active variable being optimized over
+    Variable,
+    // A parameter that is fixed for each solve
+    Parameter
+};
+
+typedef uint32_t SymbolId;
+
+/**
+ * @brief A symbol created by the registry, which carries its id and kind.
+ *
+ * It is still a plain SymEngine symbol to everything else, and is equal to
+ * any symbol with the same name.
+ */
+class RegisteredSymbol : public Symbol {
+ private:
+    SymbolId _id;
+    SymbolKind _kind;
+
+ public:
+    RegisteredSymbol(const std::string& name, SymbolId id, SymbolKind kind)
+            : Symbol(name), _id(id), _kind(kind) {}
+
+    SymbolId id() const { return this->_id; }
+    SymbolKind kind() const { return this->_kind; }
+};
+
+/**
+ * @brief Interns every variable and parameter, assigning each a stable
+ * integer id and kind when it is created.
+ *
+ * The id and kind are stored on the symbol the registry creates, so they are
+ * read without any lookup or lock. Symbols with the same name that were
+ * created elsewhere have no id, and are classified by the `$v_` and `$p_`
+ * prefixes of their names.
+ */
+class SymbolRegistry {
+ private:
+    // Only guards the registered symbols, the reads from a symbol don't
+    // take it.
+    mutable std::shared_mutex mutex;
+
+    // Indexed by id
+    std::vector<RCP<const Symbol>> symbols;
+    std::vector<SymbolKind> kinds;
+
+    std::unordered_map<std::string, SymbolId> idsByName;
+
+    SymbolRegistry() {}
+
+    /**
+     * @brief Register a new symbol. The lock must be held exclusively.
+     */
+    RCP<const Symbol> registerSymbol(const std::string& name, SymbolKind kind);
+
+ public:
+    SymbolRegistry(const SymbolRegistry&) = delete;
+    SymbolRegistry& operator=(const SymbolRegistry&) = delete;
+
+    /**
+     * @brief The registry shared by the whole process.
+     */
+    static SymbolRegistry& instance();
+
+    /**
+     * @brief Get the symbol with the given name, creating it if it does not
+     * exist yet.
+     *
+     * Throws if the symbol already exists with a different kind.
+     *
+     * @param name The full name of the symbol.
+     * @param kind The kind of the symbol.
+     */
+    RCP<const Symbol> intern(const std::string& name, SymbolKind kind);
+
+    /**
+     * @brief Intern the symbols `baseName[0]` to `baseName[num - 1]`.
+     *
+     * If none of them exist yet, they are given a contiguous range of ids in
+     * order.
+     *
+     * @param baseName The full name of the symbols without the index.
+     * @param num The number of symbols.
+     * @param kind The kind of the symbols.
+     */
+    std::vector<RCP<const Symbol>> internRange(const std::string& baseName,
+                                               size_t num, SymbolKind kind);
+
+    /**
+     * @brief The symbol as created by the registry, or null if it was created
+     * elsewhere.
+     */
+    static const RegisteredSymbol* registered(const Symbol& symbol) {
+        return dynamic_cast<const RegisteredSymbol*>(&symbol);
+    }
+
+    /**
+     * @brief The id of a symbol, if the registry created it.
+     */
+    std::optional<SymbolId> id(const Symbol& symbol) const;
+
+    /**
+     * @brief The kind of a symbol. Symbols the registry didn't create are
+     * classified by the prefix of their name, and are Other without one.
+     */
+    SymbolKind kind(const Symbol& symbol) const;
+    SymbolKind kind(SymbolId id) const;
+
+    /**
+     * @brief The symbol with the given id.
+     */
+    RCP<const Symbol> symbol(SymbolId id) const;
+
+    /**
+     * @brief The number of registered symbols. Every id is less than this.
+     */
+    size_t size() const;
+};
+
+}  // namespace cppmpc
+
+#endif  // INCLUDE_SYMBOLREGISTRY_H_
@@ -8,12 +8,16 @@
 #include <symengine/sets.h>
 #include <symengine/subs.h>
 
+#include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <utility>
+#include <vector>
 
+#include "FinalizeProfiler.h"
 #include "OrderedSet.h"
+#include "Parallel.h"
 #include "SymEngineUtilities.h"
 
 namespace cppmpc {
@@ -52,6 +56,16 @@ void SymbolicEqualityConstraints::insertConstraint(size_t index,
                            SymEngine::sub(left.get_basic(), right.get_basic()));
 }
 
+SymbolicEqualityConstraints SymbolicEqualityConstraints::substitute(
+        const SymEngine::map_basic_basic& replacements) const {
+    SymbolicEqualityConstraints substituted;
+    for (const RCP<const Basic>& constraint : this->constraints) {
+        substituted.constraints.push_back(
+                SymEngine::xreplace(constraint, replacements));
+    }
+    return substituted;
+}
+
 UnorderedSetSymbol SymbolicEqualityConstraints::getSymbols() const {
     UnorderedSetSymbol allSymbols;
     for (const RCP<const Basic>& b : this->constraints) {
@@ -76,111 +90,120 @@ UnorderedSetSymbol SymbolicEqualityConstraints::getParameters() const {
     return parameters;
 }
 
-SymEngine::set_basic getSymEngineSet(const OrderedSet& variables) {
-    SymEngine::set_basic sb;
-    for (size_t i = 0; i < variables.size(); i++) {
-        sb.insert(variables.at(i));
+/**
+ * @brief Turn a top level equality into an expression equal to 0.
+ */
+static RCP<const Basic> normalForm(const RCP<const Basic>& equality) {
+    if (SymEngine::is_a<SymEngine::Equality>(*equality)) {
+        const SymEngine::Equality& eq =
+                SymEngine::down_cast<const SymEngine::Equality&>(*equality);
+        return SymEngine::sub(eq.get_arg2(), eq.get_arg1());
     }
-    return sb;
+    return equality;
 }
 
-std::pair<SymEngine::DenseMatrix, SymEngine::DenseMatrix>
-SymbolicEqualityConstraints::convertToLinearSystem(
+std::pair<std::vector<SymbolicTriplet>, std::vector<RCP<const Basic>>>
+SymbolicEqualityConstraints::convertToSparseLinearSystem(
         const OrderedSet& variableOrdering) const {
-    UnorderedSetSymbol unorderedVariables = this->getVariables();
-
-    // Verify that the variableOrdering is a superset of the variables in the
-    // constraints.
-    for (auto it = unorderedVariables.cbegin(); it != unorderedVariables.end();
-         ++it) {
-        if (!variableOrdering.contains(*it)) {
-            throw std::runtime_error(
-                    "Variable ordering is not a super set of the variables in "
-                    "the equality constraints.");
-        }
-    }
-
-    // Create the constraints matrix and vector
+    FinalizeProfiler::Phase phase("linearize");
     size_t numConstraints = this->numConstraints();
-    size_t numVariables = variableOrdering.size();
-
-    SymEngine::DenseMatrix constraintsMatrix(numConstraints, numVariables);
-    zeros(constraintsMatrix);
-    SymEngine::DenseMatrix constantsVector(numConstraints, 1);
-    zeros(constantsVector);
-
-    SymEngine::set_basic gens = getSymEngineSet(variableOrdering);
-    SymEngine::umap_basic_uint index_of_sym;
-    for (size_t i = 0; i < variableOrdering.size(); i++) {
-        index_of_sym[variableOrdering.at(i)] = i;
-    }
-
-    // Loop through each constraint (e.g. each row of the matrix)
-    size_t row = 0;
-    for (const RCP<const Basic>& equality : this->constraints) {
-        // If the top level is an equality constraint, then turn it into an
-        // ewuation equal to 0.
-        RCP<const Basic> constraint = equality;
-        if (SymEngine::is_a<SymEngine::Equality>(*equality)) {
-            constraint = SymEngine::sub(
-                    SymEngine::down_cast<const SymEngine::Equality&>(*equality)
-                            .get_arg2(),
-                    SymEngine::down_cast<const SymEngine::Equality&>(*equality)
-                            .get_arg1());
+    std::vector<std::vector<SymbolicTriplet>> rowEntries(numConstraints);
+    std::vector<RCP<const Basic>> constantsVector(numConstraints);
+
+    // Each row only reads the shared constraints and the frozen ordering.
+    FrozenOrderedSet ordering = variableOrdering.freeze();
+    parallelFor(numConstraints, [&](size_t row) {
+        RCP<const Basic> constraint = normalForm(this->constraints[row]);
+
+        // Verify that the variableOrdering is a superset of the variables in
+        // the constraint.
+        for (const RCP<const Symbol>& variable :
+             cppmpc::getVariables(constraint)) {
+            if (!ordering.contains(variable)) {
+                throw std::runtime_error(
+                        "Variable ordering is not a super set of the "
+                        "variables in the equality constraints.");
+            }
         }
 
-        // UnivariateSeries 1 + 2*x + x**2 + O(x**5) has dict_ = {{0, 1}, {1,
-        // 2}, {2, 1}} with var_ = "x" and prec_ = 5
-
-        // Construct a polynomial in powers of the variables.
-        auto mpoly =
-                SymEngine::from_basic<SymEngine::MExprPoly>(constraint, gens);
+        // Only the variables present in this constraint are generators, and
+        // columns[i] is the column of the i-th generator in the exponent
+        // vectors.
+        SymEngine::set_basic gens;
+        for (const RCP<const Symbol>& symbol : cppmpc::getSymbols(constraint)) {
+            if (ordering.contains(symbol)) {
+                gens.insert(symbol);
+            }
+        }
+        std::vector<size_t> columns;
+        columns.reserve(gens.size());
+        for (const RCP<const Basic>& gen : gens) {
+            columns.push_back(ordering.indexOf(
+                    SymEngine::rcp_static_cast<const Symbol>(gen)));
+        }
 
-        // The remainder after going through the variables. This is the term
-        // on the constant side of the constraint.
+        // The term on the constant side of the constraint.
         RCP<const Basic> rem = SymEngine::zero;
 
-        // Loop through each term in the polynomial of the current constraint
-        for (const auto& p : mpoly->get_poly().dict_) {
-            // Get the term multiplier as a basic
-            RCP<const Basic> res = (p.second.get_basic());
-
-            // The index of the current variable being looked at
-            size_t whichvar = 0;
-
-            // The count of the number of non-zero terms
-            size_t non_zero = 0;
-
-            // Loop through each variable. If this term is linear, then only
-            // one variable should be non-zero
-            RCP<const Basic> cursim;
-            for (auto& sym : gens) {
-                // If term is not a constant (e.g. x^0)
-                if (0 != p.first[whichvar]) {
-                    non_zero++;
-                    cursim = sym;
-                    // If the power of the current variable is not equal to
-                    // one, or if this would be the second non-zero term, then
-                    // throw an exception because this constraint can't be
-                    // linear.
-                    if (p.first[whichvar] != 1 || non_zero == 2) {
+        if (gens.empty()) {
+            rem = constraint;
+        } else {
+            // Construct a polynomial in powers of the variables.
+            auto mpoly = SymEngine::from_basic<SymEngine::MExprPoly>(
+                    constraint, gens);
+
+            for (const auto& term : mpoly->get_poly().dict_) {
+                // A linear term has at most one non-zero power, and it must
+                // be one.
+                std::optional<size_t> column;
+                for (size_t i = 0; i < term.first.size(); i++) {
+                    if (term.first[i] == 0) {
+                        continue;
+                    }
+                    if (term.first[i] != 1 || column) {
                         throw std::runtime_error("Expected a linear equation.");
                     }
+                    column = columns[i];
+                }
+
+                if (column) {
+                    rowEntries[row].push_back(
+                            {row, *column, term.second.get_basic()});
+                } else {
+                    rem = term.second.get_basic();
                 }
-                whichvar++;
-            }
-            if (non_zero == 0) {
-                // If all variable powers were zero, then the entire term is
-                // constant.
-                rem = res;
-            } else {
-                // Set the given element in the matrix to the current term.
-                constraintsMatrix.set(row, index_of_sym[cursim], res);
             }
         }
-        constantsVector.set(row, 0, neg(rem));
-        row += 1;
+        constantsVector[row] = SymEngine::neg(rem);
+    });
+
+    std::vector<SymbolicTriplet> entries;
+    for (std::vector<SymbolicTriplet>& row : rowEntries) {
+        entries.insert(entries.end(), row.begin(), row.end());
     }
+    return std::make_pair(entries, constantsVector);
+}
+
+std::pair<SymEngine::DenseMatrix, SymEngine::DenseMatrix>
+SymbolicEqualityConstraints::convertToLinearSystem(
+        const OrderedSet& variableOrdering) const {
+    std::vector<SymbolicTriplet> entries;
+    std::vector<RCP<const Basic>> constants;
+    std::tie(entries, constants) =
+            this->convertToSparseLinearSystem(variableOrdering);
+
+    SymEngine::DenseMatrix constraintsMatrix(this->numConstraints(),
+                                             variableOrdering.size());
+    zeros(constraintsMatrix);
+    for (const SymbolicTriplet& entry : entries) {
+        constraintsMatrix.set(entry.row, entry.col, entry.value);
+    }
+
+    SymEngine::DenseMatrix constantsVector(this->numConstraints(), 1);
+    for (size_t row = 0; row < constants.size(); row++) {
+        constantsVector.set(row, 0, constants[row]);
+    }
+
     return std::make_pair(constraintsMatrix, constantsVector);
 }
 
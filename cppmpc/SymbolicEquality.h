@@ -76,6 +76,15 @@ class SymbolicEqualityConstraints {
      */
     size_t numConstraints() const { return this->constraints.size(); }
 
+    /**
+     * @brief The constraints with symbols replaced, e.g. parameters by their
+     * values.
+     *
+     * @param replacements A map from each symbol to its replacement.
+     */
+    SymbolicEqualityConstraints substitute(
+            const SymEngine::map_basic_basic& replacements) const;
+
     UnorderedSetSymbol getSymbols() const;
 
     UnorderedSetSymbol getVariables() const;
@@ -92,6 +101,21 @@ class SymbolicEqualityConstraints {
      */
     std::pair<SymEngine::DenseMatrix, SymEngine::DenseMatrix>
     convertToLinearSystem(const OrderedSet& variableOrdering) const;
+
+    /**
+     * @brief Convert the equality constraints to a sparse linear system.
+     *
+     * Each constraint is only expanded in the variables it contains, and the
+     * constraints are converted in parallel.
+     *
+     * @param variableOrdering The variable ordering to use for the linear
+     * system.
+     *
+     * @return A pair containing the non-zero entries of the equality matrix,
+     * and the constant vector.
+     */
+    std::pair<std::vector<SymbolicTriplet>, std::vector<RCP<const Basic>>>
+    convertToSparseLinearSystem(const OrderedSet& variableOrdering) const;
 };
 
 }  // namespace cppmpc
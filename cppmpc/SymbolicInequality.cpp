@@ -8,6 +8,7 @@
 #include <symengine/functions.h>
 #include <symengine/matrix.h>
 #include <symengine/mul.h>
+#include <symengine/number.h>
 #include <symengine/polys/basic_conversions.h>
 #include <symengine/sets.h>
 #include <symengine/subs.h>
@@ -16,8 +17,11 @@
 #include <stdexcept>
 #include <string>
 #include <utility>
+#include <vector>
 
+#include "DerivativeCache.h"
 #include "OrderedSet.h"
+#include "SparsityPattern.h"
 #include "SymEngineUtilities.h"
 
 namespace cppmpc {
@@ -69,6 +73,16 @@ void SymbolicInequalityConstraints::insertGreaterThan(size_t index,
             index, SymEngine::sub(right.get_basic(), left.get_basic()));
 }
 
+SymbolicInequalityConstraints SymbolicInequalityConstraints::substitute(
+        const SymEngine::map_basic_basic& replacements) const {
+    SymbolicInequalityConstraints substituted;
+    for (const RCP<const Basic>& constraint : this->constraints) {
+        substituted.constraints.push_back(
+                SymEngine::xreplace(constraint, replacements));
+    }
+    return substituted;
+}
+
 UnorderedSetSymbol SymbolicInequalityConstraints::getSymbols() const {
     UnorderedSetSymbol allSymbols;
     for (const RCP<const Basic>& b : this->constraints) {
@@ -108,9 +122,112 @@ SymEngine::DenseMatrix SymbolicInequalityConstraints::symbolicBarrierGradient(
     return gradient(this->symbolicBarrierValue(), variableOrdering);
 }
 
+SymEngine::DenseMatrix SymbolicInequalityConstraints::symbolicBarrierGradient(
+        const OrderedSet& variableOrdering, SparsityPattern& pattern) const {
+    return gradient(this->symbolicBarrierValue(), variableOrdering, pattern);
+}
+
 SymEngine::DenseMatrix SymbolicInequalityConstraints::symbolicBarrierHessian(
         const OrderedSet& variableOrdering) const {
     return hessian(this->symbolicBarrierValue(), variableOrdering);
 }
 
+SymEngine::DenseMatrix SymbolicInequalityConstraints::symbolicBarrierHessian(
+        const OrderedSet& variableOrdering, SparsityPattern& pattern) const {
+    return hessian(this->symbolicBarrierValue(), variableOrdering, pattern);
+}
+
+SymEngine::DenseMatrix SymbolicInequalityConstraints::symbolicConstraintVector()
+        const {
+    SymEngine::DenseMatrix vec(this->numConstraints(), 1);
+    for (size_t i = 0; i < this->numConstraints(); i++) {
+        vec.set(i, 0, this->getConstraint(i));
+    }
+    return vec;
+}
+
+std::vector<SymbolicTriplet>
+SymbolicInequalityConstraints::symbolicConstraintJacobian(
+        const OrderedSet& variableOrdering) const {
+    return sparseJacobian(this->symbolicConstraintVector(), variableOrdering);
+}
+
+std::vector<std::vector<SymbolicTriplet>>
+SymbolicInequalityConstraints::symbolicConstraintHessians(
+        const OrderedSet& variableOrdering) const {
+    std::vector<std::vector<SymbolicTriplet>> hessians;
+    hessians.reserve(this->numConstraints());
+    for (const RCP<const Basic>& constraint : this->constraints) {
+        hessians.push_back(sparseHessian(constraint, variableOrdering));
+    }
+    return hessians;
+}
+
+ClassifiedInequalityConstraints SymbolicInequalityConstraints::classify(
+        const OrderedSet& variableOrdering) const {
+    ClassifiedInequalityConstraints classified;
+    std::vector<bool> hasLowerBound(variableOrdering.size(), false);
+    std::vector<bool> hasUpperBound(variableOrdering.size(), false);
+
+    for (const RCP<const Basic>& constraint : this->constraints) {
+        std::vector<size_t> dependencies =
+                variableDependencies(constraint, variableOrdering);
+
+        // The coefficient of each variable, if they only depend on parameters.
+        std::vector<RCP<const Basic>> coefficients;
+        bool isLinear = !dependencies.empty();
+        SymEngine::map_basic_basic atOrigin;
+        for (size_t i : dependencies) {
+            RCP<const Symbol> symbol = variableOrdering.at(i);
+            RCP<const Basic> coefficient =
+                    cppmpc::derivative(constraint, symbol);
+            if (!cppmpc::getVariables(coefficient).empty()) {
+                isLinear = false;
+                break;
+            }
+            coefficients.push_back(coefficient);
+            atOrigin[symbol] = SymEngine::zero;
+        }
+
+        if (!isLinear) {
+            classified.nonlinear.appendNormalConstraint(constraint);
+            continue;
+        }
+
+        // The constraint is a x + c < 0, so a x < -c
+        RCP<const Basic> constant = SymEngine::neg(SymEngine::expand(
+                SymEngine::xreplace(constraint, atOrigin)));
+
+        // A single variable with a known sign is a bound.
+        if (dependencies.size() == 1 &&
+            SymEngine::is_a_Number(*coefficients[0])) {
+            size_t index = dependencies[0];
+            const SymEngine::Number& coefficient =
+                    SymEngine::down_cast<const SymEngine::Number&>(
+                            *coefficients[0]);
+            RCP<const Basic> bound = SymEngine::div(constant, coefficients[0]);
+            if (coefficient.is_positive() && !hasUpperBound[index]) {
+                hasUpperBound[index] = true;
+                classified.upperBoundIndices.push_back(index);
+                classified.upperBounds.push_back(bound);
+                continue;
+            } else if (coefficient.is_negative() && !hasLowerBound[index]) {
+                hasLowerBound[index] = true;
+                classified.lowerBoundIndices.push_back(index);
+                classified.lowerBounds.push_back(bound);
+                continue;
+            }
+        }
+
+        size_t row = classified.numLinearConstraints();
+        for (size_t i = 0; i < dependencies.size(); i++) {
+            classified.linearMatrix.push_back(
+                    {row, dependencies[i], coefficients[i]});
+        }
+        classified.linearVector.push_back(constant);
+    }
+
+    return classified;
+}
+
 }  // namespace cppmpc
@@ -11,6 +11,7 @@
 #include <vector>
 
 #include "OrderedSet.h"
+#include "SparsityPattern.h"
 #include "SymEngineUtilities.h"
 
 // TODO(ianruh): Identify linear and non-linear terms within a basic.
@@ -21,6 +22,8 @@ using SymEngine::Basic;
 using SymEngine::Expression;
 using SymEngine::RCP;
 
+struct ClassifiedInequalityConstraints;
+
 class SymbolicInequalityConstraints {
  private:
     std::vector<RCP<const Basic>> constraints;
@@ -103,6 +106,15 @@ class SymbolicInequalityConstraints {
      */
     size_t numConstraints() const { return this->constraints.size(); }
 
+    /**
+     * @brief The constraints with symbols replaced, e.g. parameters by their
+     * values.
+     *
+     * @param replacements A map from each symbol to its replacement.
+     */
+    SymbolicInequalityConstraints substitute(
+            const SymEngine::map_basic_basic& replacements) const;
+
     UnorderedSetSymbol getSymbols() const;
 
     UnorderedSetSymbol getVariables() const;
@@ -113,11 +125,81 @@ class SymbolicInequalityConstraints {
 
     SymEngine::DenseMatrix symbolicBarrierGradient(
             const OrderedSet& variableOrdering) const;
+    SymEngine::DenseMatrix symbolicBarrierGradient(
+            const OrderedSet& variableOrdering,
+            SparsityPattern& pattern) const;
 
     SymEngine::DenseMatrix symbolicBarrierHessian(
             const OrderedSet& variableOrdering) const;
+    SymEngine::DenseMatrix symbolicBarrierHessian(
+            const OrderedSet& variableOrdering,
+            SparsityPattern& pattern) const;
+
+    /**
+     * @brief The constraints in normal form as an mx1 vector, e.g. g(x) < 0.
+     */
+    SymEngine::DenseMatrix symbolicConstraintVector() const;
+
+    /**
+     * @brief The non-zero entries of the mxn jacobian of the constraint
+     * vector.
+     *
+     * @param variableOrdering The variable ordering.
+     */
+    std::vector<SymbolicTriplet> symbolicConstraintJacobian(
+            const OrderedSet& variableOrdering) const;
+
+    /**
+     * @brief The non-zero entries of the hessian of each constraint. Linear
+     * constraints have no entries.
+     *
+     * @param variableOrdering The variable ordering.
+     */
+    std::vector<std::vector<SymbolicTriplet>> symbolicConstraintHessians(
+            const OrderedSet& variableOrdering) const;
+
+    /**
+     * @brief Split the constraints into bounds, linear constraints, and
+     * nonlinear constraints.
+     *
+     * A constraint is linear if its gradient only depends on parameters. A
+     * linear constraint on a single variable with a numeric coefficient is a
+     * bound, unless that side of the variable is already bounded.
+     *
+     * @param variableOrdering The variable ordering.
+     */
+    ClassifiedInequalityConstraints classify(
+            const OrderedSet& variableOrdering) const;
 };
 
+/**
+ * struct ClassifiedInequalityConstraints - Inequality constraints split by how
+ * their barrier is evaluated.
+ *
+ * The linear constraints are G x < h, where G and h only depend on the
+ * parameters. The bounds are lower < x[i] and x[i] < upper for the given
+ * variable indices, and only depend on the parameters.
+ */
+typedef struct ClassifiedInequalityConstraints {
+    // Constraints that still need a symbolic barrier.
+    SymbolicInequalityConstraints nonlinear;
+
+    // The non-zero entries of G, with one row per linear constraint.
+    std::vector<SymbolicTriplet> linearMatrix;
+    // The entries of h.
+    std::vector<RCP<const Basic>> linearVector;
+
+    std::vector<size_t> lowerBoundIndices;
+    std::vector<RCP<const Basic>> lowerBounds;
+    std::vector<size_t> upperBoundIndices;
+    std::vector<RCP<const Basic>> upperBounds;
+
+    /**
+     * @brief The number of linear constraints.
+     */
+    size_t numLinearConstraints() const { return this->linearVector.size(); }
+} ClassifiedInequalityConstraints;
+
 }  // namespace cppmpc
 
 #endif  // INCLUDE_SYMBOLICINEQUALITY_H_
@@ -1,17 +1,39 @@
 // Copyright 2021 Ian Ruh
 #include "SymbolicObjective.h"
 
-#include <dlfcn.h>
 #include <symengine/basic.h>
+#include <symengine/eval_double.h>
+#include <symengine/integer.h>
 #include <symengine/matrix.h>
+#include <symengine/real_double.h>
+#include <symengine/subs.h>
 #include <symengine/symbol.h>
+#include <filesystem>
+#include <iomanip>
+#include <map>
+#include <memory>
 #include <optional>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <tuple>
+#include <unordered_set>
 #include <vector>
 
+#include "CompiledModule.h"
+#include "DerivativeCache.h"
+#include "ExpressionEmitter.h"
+#include "ExpressionTape.h"
+#include "FinalizeProfiler.h"
 #include "FastMPCFunctionPointerObjective.h"
+#include "LoadedObjective.h"
+#include "ObjectiveManifest.h"
+#include "Parallel.h"
+#include "RuntimeCompiler.h"
 #include "SymEngineUtilities.h"
+#include "SymbolCollector.h"
+#include "SymbolRegistry.h"
+#include "TapeBuilder.h"
 #include "Util.h"
 
 namespace cppmpc {
@@ -21,6 +43,82 @@ namespace FastMPC {
 using SymEngine::Basic;
 using SymEngine::RCP;
 
+namespace {
+
+/**
+ * @brief What a part of the generated code depends on: the orderings, its
+ * options, and its expressions. The sizes of the lists are included, so they
+ * can't run into each other.
+ */
+SymEngine::vec_basic partKey(const OrderedSet& variableOrdering,
+                             const OrderedSet& parameterOrdering,
+                             const std::vector<int>& options,
+                             const SymEngine::vec_basic& expressions) {
+    SymEngine::vec_basic key;
+    key.push_back(SymEngine::integer(variableOrdering.size()));
+    for (const RCP<const Symbol>& variable : variableOrdering.elements()) {
+        key.push_back(variable);
+    }
+    key.push_back(SymEngine::integer(parameterOrdering.size()));
+    for (const RCP<const Symbol>& parameter : parameterOrdering.elements()) {
+        key.push_back(parameter);
+    }
+    key.push_back(SymEngine::integer(options.size()));
+    for (int option : options) {
+        key.push_back(SymEngine::integer(option));
+    }
+    key.insert(key.end(), expressions.begin(), expressions.end());
+    return key;
+}
+
+bool sameExpressions(const SymEngine::vec_basic& a,
+                     const SymEngine::vec_basic& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (SymEngine::neq(*a[i], *b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief The expressions of an objective and its constraints, to be counted.
+ */
+SymEngine::vec_basic expressions(
+        const RCP<const Basic>& objective,
+        const SymbolicEqualityConstraints& equalityConstraints,
+        const SymbolicInequalityConstraints& inequalityConstraints) {
+    SymEngine::vec_basic result = {objective};
+    for (size_t i = 0; i < equalityConstraints.numConstraints(); i++) {
+        result.push_back(equalityConstraints.getConstraint(i));
+    }
+    for (size_t i = 0; i < inequalityConstraints.numConstraints(); i++) {
+        result.push_back(inequalityConstraints.getConstraint(i));
+    }
+    return result;
+}
+
+/**
+ * @brief The entries of the matrices, to be counted.
+ */
+SymEngine::vec_basic entries(
+        const std::vector<const SymEngine::DenseMatrix*>& matrices) {
+    SymEngine::vec_basic result;
+    for (const SymEngine::DenseMatrix* matrix : matrices) {
+        for (size_t i = 0; i < matrix->nrows(); i++) {
+            for (size_t j = 0; j < matrix->ncols(); j++) {
+                result.push_back(matrix->get(i, j));
+            }
+        }
+    }
+    return result;
+}
+
+}  // namespace
+
 /**
  * @brief We set all of the parameters equal to negative 1. These act as flags
  * to indicate that we should use the symbolic constraints/objectives to get
@@ -47,97 +145,595 @@ void SymbolicObjective::setObjective(SymEngine::Expression obj) {
     this->setObjective(obj.get_basic());
 }
 
+void SymbolicObjective::fixParameter(const SymEngine::Expression& parameter,
+                                     double value) {
+    RCP<const Basic> basic = parameter.get_basic();
+    if (!SymEngine::is_a<SymEngine::Symbol>(*basic) ||
+        SymbolRegistry::instance().kind(
+                *SymEngine::rcp_static_cast<const Symbol>(basic)) !=
+                SymbolKind::Parameter) {
+        throw std::runtime_error("Only parameters can be fixed.");
+    }
+    this->fixedParameters[basic] = SymEngine::real_double(value);
+}
+
+void SymbolicObjective::clearFixedParameters() {
+    this->fixedParameters.clear();
+}
+
 void SymbolicObjective::finalize(const OrderedSet& variableOrdering,
-                                 const OrderedSet& parameterOrdering) {
+                                 const OrderedSet& fullParameterOrdering) {
     // Check that we have the objective
     if (!this->objective) {
         throw std::runtime_error(
                 "Objective must be set before it can be finalized.");
     }
 
-    // Get the gradient and the hessian of the objective
-    SymEngine::DenseMatrix symbolicObjectiveGradient =
-            cppmpc::gradient(*this->objective, variableOrdering);
-    SymEngine::DenseMatrix symbolicObjectiveHessian =
-            cppmpc::hessian(*this->objective, variableOrdering);
+    // Record where the time goes while profiling
+    std::unique_ptr<FinalizeProfiler> profiler;
+    std::optional<FinalizeProfiler::Scope> profilerScope;
+    this->lastFinalizeReport.reset();
+    if (this->profileFinalize) {
+        profiler = std::make_unique<FinalizeProfiler>();
+        profilerScope.emplace(*profiler);
+    }
+
+    // Substitute the fixed parameters before differentiating, so their
+    // values are folded into the generated code.
+    RCP<const Basic> objective = *this->objective;
+    SymbolicEqualityConstraints equalityConstraints =
+            this->equalityConstraints;
+    SymbolicInequalityConstraints inequalityConstraints =
+            this->inequalityConstraints;
+    std::vector<RCP<const Symbol>> freeParameters;
+    for (const RCP<const Symbol>& parameter :
+         fullParameterOrdering.elements()) {
+        if (this->fixedParameters.count(parameter) == 0) {
+            freeParameters.push_back(parameter);
+        }
+    }
+    OrderedSet parameterOrdering(freeParameters);
+    if (!this->fixedParameters.empty()) {
+        FinalizeProfiler::Phase phase("substitute");
+        objective = SymEngine::xreplace(objective, this->fixedParameters);
+        equalityConstraints =
+                equalityConstraints.substitute(this->fixedParameters);
+        inequalityConstraints =
+                inequalityConstraints.substitute(this->fixedParameters);
+        if (profiler) {
+            FinalizeProfiler::recordTransform(
+                    "substitute",
+                    expressions(*this->objective, this->equalityConstraints,
+                                this->inequalityConstraints),
+                    expressions(objective, equalityConstraints,
+                                inequalityConstraints));
+        }
+    }
+
+    // Symbols are collected from the same subexpressions many times while
+    // differentiating and generating code, so remember them for the whole
+    // finalize.
+    SymbolCollector collector;
+    SymbolCollector::Scope collectorScope(collector);
 
-    // Vector to store all of the function strings
-    std::vector<std::string> functionStrings(8, "");
+    // Derivatives are remembered between finalizes, so only the terms that
+    // are new since the last finalize are differentiated.
+    this->derivativeCache->nextGeneration();
+    DerivativeCache::Scope derivativeScope(*this->derivativeCache);
 
+    // Each part is only generated again if its expressions, the orderings,
+    // or its options changed since the last finalize.
     //====== Objective Functions ======
-    std::tie(functionStrings[0], functionStrings[1], functionStrings[2]) =
-            CodeGenerator::generateObjectiveFunctions(
-                    *this->objective, symbolicObjectiveGradient,
-                    symbolicObjectiveHessian, variableOrdering,
-                    parameterOrdering, this->valueFunctionName,
-                    this->gradientFunctionName, this->hessianFunctionName);
+    SymEngine::vec_basic objectiveKey =
+            partKey(variableOrdering, parameterOrdering, {}, {objective});
+    if (!this->objectivePart ||
+        !sameExpressions(this->objectivePart->key, objectiveKey)) {
+        GeneratedPart part;
+        part.key = objectiveKey;
+        {
+            FinalizeProfiler::Phase phase("differentiate");
+            part.gradient = cppmpc::gradient(objective, variableOrdering,
+                                             part.gradientPattern);
+            part.hessian = cppmpc::hessian(objective, variableOrdering,
+                                           part.hessianPattern);
+        }
+        if (profiler) {
+            FinalizeProfiler::recordTransform(
+                    "differentiate", {objective},
+                    entries({&part.gradient, &part.hessian}));
+        }
+        FinalizeProfiler::Phase phase("generate");
+        part.functions = CodeGenerator::buildObjectiveFunctions(
+                objective, part.gradient, part.hessian, variableOrdering,
+                parameterOrdering, this->valueFunctionName,
+                this->gradientFunctionName, this->hessianFunctionName,
+                &part.gradientPattern, &part.hessianPattern);
+        this->objectivePart = part;
+    }
+    const GeneratedPart& objectivePart = *this->objectivePart;
 
     //====== Equality Functions ======
-    std::tie(functionStrings[3], functionStrings[4]) =
-            CodeGenerator::generateSymbolicEqualityFunctions(
-                    this->equalityConstraints, variableOrdering,
-                    parameterOrdering, this->equalityMatrixFunctionName,
-                    this->equalityVectorFunctionName);
+    SymEngine::vec_basic equalityExpressions;
+    for (size_t i = 0; i < equalityConstraints.numConstraints(); i++) {
+        equalityExpressions.push_back(equalityConstraints.getConstraint(i));
+    }
+    SymEngine::vec_basic equalityKey = partKey(
+            variableOrdering, parameterOrdering, {}, equalityExpressions);
+    if (!this->equalityPart ||
+        !sameExpressions(this->equalityPart->key, equalityKey)) {
+        GeneratedPart part;
+        part.key = equalityKey;
+        FinalizeProfiler::Phase phase("generate");
+        std::vector<CodeGenerator::UpdateFunction> matrixUpdates;
+        std::vector<CodeGenerator::UpdateFunction> vectorUpdates;
+        part.functions = CodeGenerator::buildSymbolicEqualityFunctions(
+                equalityConstraints, variableOrdering, parameterOrdering,
+                this->equalityMatrixFunctionName,
+                this->equalityVectorFunctionName, &matrixUpdates,
+                &vectorUpdates);
+
+        // Entries of the equality matrix and vector, grouped by the
+        // parameters they depend on, so only the groups of changed
+        // parameters are updated.
+        for (const CodeGenerator::UpdateFunction& update : matrixUpdates) {
+            part.functions.push_back(update.function);
+            part.matrixDependencies.push_back(update.parameters);
+        }
+        for (const CodeGenerator::UpdateFunction& update : vectorUpdates) {
+            part.functions.push_back(update.function);
+            part.vectorDependencies.push_back(update.parameters);
+        }
+        this->equalityPart = part;
+    }
+    const GeneratedPart& equalityPart = *this->equalityPart;
 
     //====== Inequality Functions ======
-    std::tie(functionStrings[5], functionStrings[6], functionStrings[7]) =
-            CodeGenerator::generateSymbolicInequalityFunctions(
-                    this->inequalityConstraints, variableOrdering,
+    SymEngine::vec_basic inequalityExpressions;
+    for (size_t i = 0; i < inequalityConstraints.numConstraints(); i++) {
+        inequalityExpressions.push_back(
+                inequalityConstraints.getConstraint(i));
+    }
+    SymEngine::vec_basic inequalityKey =
+            partKey(variableOrdering, parameterOrdering,
+                    {static_cast<int>(this->barrierMode),
+                     this->detectLinearInequalities ? 1 : 0},
+                    inequalityExpressions);
+    if (!this->inequalityPart ||
+        !sameExpressions(this->inequalityPart->key, inequalityKey)) {
+        GeneratedPart part;
+        part.key = inequalityKey;
+        // Linear constraints and bounds are evaluated numerically, so only
+        // the nonlinear constraints need a barrier to be generated.
+        if (this->detectLinearInequalities) {
+            FinalizeProfiler::Phase phase("classify");
+            part.classified = inequalityConstraints.classify(variableOrdering);
+        } else {
+            part.classified.nonlinear = inequalityConstraints;
+        }
+        const SymbolicInequalityConstraints& nonlinear =
+                part.classified.nonlinear;
+
+        if (this->barrierMode == BarrierMode::Symbolic) {
+            // Get the gradient and the hessian of the barrier
+            {
+                FinalizeProfiler::Phase phase("differentiate");
+                part.gradient = nonlinear.symbolicBarrierGradient(
+                        variableOrdering, part.gradientPattern);
+                part.hessian = nonlinear.symbolicBarrierHessian(
+                        variableOrdering, part.hessianPattern);
+            }
+            if (profiler) {
+                SymEngine::vec_basic constraints;
+                for (size_t i = 0; i < nonlinear.numConstraints(); i++) {
+                    constraints.push_back(nonlinear.getConstraint(i));
+                }
+                FinalizeProfiler::recordTransform(
+                        "differentiate", constraints,
+                        entries({&part.gradient, &part.hessian}));
+            }
+
+            FinalizeProfiler::Phase phase("generate");
+            part.functions = CodeGenerator::buildSymbolicInequalityFunctions(
+                    nonlinear, part.gradient, part.hessian, variableOrdering,
                     parameterOrdering, this->inequalityValueFunctionName,
                     this->inequalityGradientFunctionName,
-                    this->inequalityHessianFunctionName);
+                    this->inequalityHessianFunctionName, &part.gradientPattern,
+                    &part.hessianPattern);
+        } else {
+            FinalizeProfiler::Phase phase("generate");
+            part.functions =
+                    CodeGenerator::buildStructuredInequalityFunctions(
+                            nonlinear, variableOrdering, parameterOrdering,
+                            this->inequalityConstraintVectorFunctionName,
+                            this->inequalityConstraintJacobianFunctionName,
+                            this->inequalityConstraintHessianFunctionName);
+        }
+
+        //====== Linear Inequality Functions ======
+        FinalizeProfiler::Phase phase("generate");
+        std::vector<GeneratedFunction> linear =
+                CodeGenerator::buildLinearInequalityFunctions(
+                        part.classified, variableOrdering, parameterOrdering,
+                        this->linearInequalityMatrixFunctionName,
+                        this->linearInequalityVectorFunctionName,
+                        this->lowerBoundFunctionName,
+                        this->upperBoundFunctionName);
+        part.functions.insert(part.functions.end(), linear.begin(),
+                              linear.end());
+        this->inequalityPart = part;
+    }
+    const GeneratedPart& inequalityPart = *this->inequalityPart;
+    const ClassifiedInequalityConstraints& classified =
+            inequalityPart.classified;
+
+    DerivativeSparsity sparsity;
+    sparsity.objectiveGradient = objectivePart.gradientPattern;
+    sparsity.objectiveHessian = objectivePart.hessianPattern;
+    sparsity.inequalityGradient = inequalityPart.gradientPattern;
+    sparsity.inequalityHessian = inequalityPart.hessianPattern;
+
+    // The objective, equality, and inequality functions, in that order
+    std::vector<GeneratedFunction> functions(objectivePart.functions);
+    functions.insert(functions.end(), equalityPart.functions.begin(),
+                     equalityPart.functions.begin() + 2);
+    functions.insert(functions.end(), inequalityPart.functions.begin(),
+                     inequalityPart.functions.end());
+
+    //====== Batched Objective Functions ======
+    if (this->generateBatchFunctions) {
+        FinalizeProfiler::Phase phase("batch");
+        for (size_t i = 0; i < 3; i++) {
+            functions.push_back(CodeGenerator::batchFunction(functions[i]));
+        }
+    }
+
+    //====== Equality Update Functions ======
+    functions.insert(functions.end(), equalityPart.functions.begin() + 2,
+                     equalityPart.functions.end());
+
+    // Only called before finalize returns, so it can capture by reference
+    InterpreterFactory interpreter = [&]() {
+        FinalizeProfiler::Phase phase("interpret");
+        return this->interpretedModule(
+                objective, equalityConstraints, objectivePart.gradient,
+                objectivePart.hessian, classified, inequalityPart.gradient,
+                inequalityPart.hessian, sparsity, variableOrdering,
+                parameterOrdering);
+    };
+    std::string metadata =
+            this->compileMetadata(variableOrdering, parameterOrdering);
+    TieredModule tiered = RuntimeCompiler::compileTiered(
+            functions, metadata, this->compileOptions, interpreter);
+    this->generatedFunctions = functions;
+    this->generatedMetadata = metadata;
+
+    // Cleanup
+    // Counted again on every finalize, since constraints may have been added
+    // since the last one. The fixed parameters are already left out of the
+    // ordering.
+    this->_numParameters = static_cast<int>(parameterOrdering.size());
+    this->_numVariables = static_cast<int>(variableOrdering.size());
+    this->_numEqualityConstraints =
+            static_cast<int>(equalityConstraints.numConstraints());
+    this->_numInequalityConstraints =
+            static_cast<int>(inequalityConstraints.numConstraints());
+    this->parameterOrdering = parameterOrdering.freeze();
+    this->sparsity = sparsity;
+
+    ObjectiveManifest manifest;
+    manifest.numVariables = this->_numVariables;
+    manifest.numParameters = this->_numParameters;
+    manifest.numEqualityConstraints = this->_numEqualityConstraints;
+    manifest.numInequalityConstraints = this->_numInequalityConstraints;
+    manifest.structuredBarrier = this->barrierMode == BarrierMode::Structured;
+    manifest.numLinearInequalityConstraints =
+            classified.numLinearConstraints();
+    manifest.lowerBoundIndices.assign(classified.lowerBoundIndices.begin(),
+                                      classified.lowerBoundIndices.end());
+    manifest.upperBoundIndices.assign(classified.upperBoundIndices.begin(),
+                                      classified.upperBoundIndices.end());
+    for (const RCP<const Symbol>& variable : variableOrdering.elements()) {
+        manifest.variableNames.push_back(variable->get_name());
+    }
+    for (const RCP<const Symbol>& parameter : parameterOrdering.elements()) {
+        manifest.parameterNames.push_back(parameter->get_name());
+    }
+    for (const auto& fixed : this->fixedParameters) {
+        manifest.fixedParameterNames.push_back(
+                SymEngine::rcp_static_cast<const Symbol>(fixed.first)
+                        ->get_name());
+        manifest.fixedParameterValues.push_back(
+                SymEngine::eval_double(*fixed.second));
+    }
+    manifest.sparsity = sparsity;
+    manifest.equalityMatrixUpdates = equalityPart.matrixDependencies;
+    manifest.equalityVectorUpdates = equalityPart.vectorDependencies;
+    this->manifest = manifest;
+
+    this->loadModule(tiered.module);
+    this->_compilationTier = tiered.tier;
+    this->optimizedModule = tiered.optimized;
+    this->finalized = true;
+
+    if (profiler) {
+        for (const auto& source : CodeGenerator::sourceSizes(functions)) {
+            profiler->addSourceBytes(source.first, source.second);
+        }
+        this->lastFinalizeReport = profiler->finish();
+    }
+}
+
+void SymbolicObjective::loadModule(
+        std::shared_ptr<const CompiledModule> module) {
+    this->setValueFunction(module->stateFunction(this->valueFunctionName));
+    this->setGradientFunction(
+            module->stateFunction(this->gradientFunctionName));
+    this->setHessianFunction(module->stateFunction(this->hessianFunctionName));
+    this->setBatchObjectiveFunctions(
+            module->batchStateFunction(this->valueFunctionName),
+            module->batchStateFunction(this->gradientFunctionName),
+            module->batchStateFunction(this->hessianFunctionName));
+
+    this->setEqualityMatrixFunction(
+            module->parameterFunction(this->equalityMatrixFunctionName));
+    this->setEqualityVectorFunction(
+            module->parameterFunction(this->equalityVectorFunctionName));
+    this->setEqualityUpdateFunctions(
+            FunctionPointerObjective::updateFunctions(
+                    *module, this->equalityMatrixFunctionName,
+                    this->manifest->equalityMatrixUpdates),
+            FunctionPointerObjective::updateFunctions(
+                    *module, this->equalityVectorFunctionName,
+                    this->manifest->equalityVectorUpdates));
+
+    // The barrier mode may have changed since finalize, so use the manifest
+    if (!this->manifest->structuredBarrier) {
+        this->setInequalityValueFunction(
+                module->stateFunction(this->inequalityValueFunctionName));
+        this->setInequalityGradientFunction(
+                module->stateFunction(this->inequalityGradientFunctionName));
+        this->setInequalityHessianFunction(
+                module->stateFunction(this->inequalityHessianFunctionName));
+    } else {
+        this->setInequalityConstraintFunctions(
+                module->stateFunction(
+                        this->inequalityConstraintVectorFunctionName),
+                module->stateFunction(
+                        this->inequalityConstraintJacobianFunctionName),
+                module->weightedStateFunction(
+                        this->inequalityConstraintHessianFunctionName));
+    }
 
-    std::string tempFileBase = std::tmpnam(nullptr);
-    std::string tempFile = tempFileBase + std::string(".cpp");
+    this->setLinearInequalityFunctions(
+            this->manifest->numLinearInequalityConstraints,
+            module->parameterFunction(this->linearInequalityMatrixFunctionName),
+            module->parameterFunction(
+                    this->linearInequalityVectorFunctionName));
+    this->setBoundFunctions(
+            this->manifest->lowerBoundIndices,
+            module->parameterFunction(this->lowerBoundFunctionName),
+            this->manifest->upperBoundIndices,
+            module->parameterFunction(this->upperBoundFunctionName));
+
+    this->module = module;
+}
 
-    CodeGenerator::writeFunctionsToFile(tempFile, functionStrings);
+void SymbolicObjective::exportObjective(const std::string& directory) const {
+    if (!this->finalized || !this->manifest) {
+        throw std::runtime_error(
+                "Objective must be finalized before it can be exported.");
+    }
+    if (this->module->path().empty()) {
+        throw std::runtime_error(
+                "Only objectives compiled to a shared library can be "
+                "exported.");
+    }
 
-    std::string tempSharedObject = tempFileBase + std::string(".so");
+    std::filesystem::create_directories(directory);
+    std::filesystem::copy_file(
+            this->module->path(),
+            std::filesystem::path(directory) / LoadedObjective::libraryFileName,
+            std::filesystem::copy_options::overwrite_existing);
+    this->manifest->write(
+            (std::filesystem::path(directory) /
+             LoadedObjective::manifestFileName)
+                    .string());
+}
 
-    std::stringstream cmd;
-    cmd << CPP_COMPILER_PATH << " -shared " << RUNTIME_COMPILER_FLAGS << " "
-        << tempFile << " -o " << tempSharedObject;
-    int rt = std::system(cmd.str().c_str());
+void SymbolicObjective::optimizeWithProfile(
+        const std::vector<Eigen::VectorXd>& states,
+        const std::vector<Eigen::VectorXd>& parameters) {
+    if (!this->finalized) {
+        throw std::runtime_error(
+                "Objective must be finalized before it can be profiled.");
+    }
+    if (states.size() != parameters.size()) {
+        throw std::runtime_error(
+                "Each profile sample needs a state and parameters.");
+    }
 
-    if (rt != 0) {
-        throw std::runtime_error("Runtime compilation failed");
+    // The pending build would replace the profiled one
+    this->optimizedModule = {};
+
+    std::shared_ptr<const CompiledModule> previousModule = this->module;
+    std::optional<Eigen::VectorXd> previousParameters = this->_parameters;
+    try {
+        std::shared_ptr<const CompiledModule> optimized =
+                RuntimeCompiler::compileProfileGuided(
+                        this->generatedFunctions, this->generatedMetadata,
+                        this->compileOptions,
+                        [&](std::shared_ptr<const CompiledModule> module) {
+                            this->loadModule(module);
+                            for (size_t i = 0; i < states.size(); i++) {
+                                this->setParameters(parameters[i]);
+                                this->value(states[i]);
+                                this->gradient(states[i]);
+                                this->hessian(states[i]);
+                                this->equalityConstraintMatrix();
+                                this->equalityConstraintVector();
+                                this->inequalityConstraintsValue(states[i]);
+                                this->inequalityConstraintsGradient(states[i]);
+                                this->inequalityConstraintsHessian(states[i]);
+                            }
+                        });
+        this->loadModule(optimized);
+    } catch (...) {
+        this->loadModule(previousModule);
+        this->_parameters = previousParameters;
+        throw;
     }
+    this->_compilationTier =
+            RuntimeCompiler::compilationTier(this->compileOptions);
+    this->_parameters = previousParameters;
+}
 
-    // load library
-    // TODO(ianruh): I should probably call dlclose at some point
-    void* sharedLib = dlopen(tempSharedObject.c_str(), RTLD_LAZY);
-    if (!sharedLib) {
-        std::stringstream msg;
-        msg << "Cannot open library: " << dlerror() << std::endl;
-        throw std::runtime_error(msg.str());
+std::string SymbolicObjective::compileMetadata(
+        const OrderedSet& variableOrdering,
+        const OrderedSet& parameterOrdering) const {
+    std::stringstream ss;
+    // Not the counts of the last finalize, which may be out of date
+    ss << "equalityConstraints: " << this->equalityConstraints.numConstraints()
+       << std::endl;
+    ss << "inequalityConstraints: "
+       << this->inequalityConstraints.numConstraints() << std::endl;
+    ss << "variables:";
+    for (const RCP<const Symbol>& variable : variableOrdering.elements()) {
+        ss << " " << variable->get_name();
+    }
+    ss << std::endl;
+    ss << "parameters:";
+    for (const RCP<const Symbol>& parameter : parameterOrdering.elements()) {
+        ss << " " << parameter->get_name();
     }
+    ss << std::endl;
+    ss << "fixedParameters:" << std::setprecision(17);
+    for (const auto& fixed : this->fixedParameters) {
+        ss << " " << *fixed.first << "="
+           << SymEngine::eval_double(*fixed.second);
+    }
+    ss << std::endl;
+    return ss.str();
+}
 
-    this->setValueFunction(
-            (ValueFunction)dlsym(sharedLib, this->valueFunctionName.c_str()));
-    this->setGradientFunction((GradientFunction)dlsym(
-            sharedLib, this->gradientFunctionName.c_str()));
-    this->setHessianFunction((HessianFunction)dlsym(
-            sharedLib, this->hessianFunctionName.c_str()));
+std::shared_ptr<const CompiledModule> SymbolicObjective::interpretedModule(
+        const RCP<const Basic>& objective,
+        const SymbolicEqualityConstraints& equalityConstraints,
+        const SymEngine::DenseMatrix& objectiveGradient,
+        const SymEngine::DenseMatrix& objectiveHessian,
+        const ClassifiedInequalityConstraints& classified,
+        const SymEngine::DenseMatrix& barrierGradient,
+        const SymEngine::DenseMatrix& barrierHessian,
+        const DerivativeSparsity& sparsity, const OrderedSet& variableOrdering,
+        const OrderedSet& parameterOrdering) const {
+    TapeBuilder builder(variableOrdering, parameterOrdering);
+    std::shared_ptr<TapeModule> module = std::make_shared<TapeModule>();
+    size_t numVariables = variableOrdering.size();
 
-    this->setEqualityMatrixFunction((EqualityMatrixFunction)dlsym(
-            sharedLib, this->equalityMatrixFunctionName.c_str()));
-    this->setEqualityVectorFunction((EqualityVectorFunction)dlsym(
-            sharedLib, this->equalityVectorFunctionName.c_str()));
+    //====== Objective Functions ======
+    SymEngine::DenseMatrix valueMat(1, 1);
+    valueMat.set(0, 0, objective);
+    module->addTape(this->valueFunctionName, builder.denseMatrix(valueMat));
+    module->addTape(this->gradientFunctionName,
+                    builder.denseMatrix(objectiveGradient,
+                                        &sparsity.objectiveGradient));
+    module->addTape(this->hessianFunctionName,
+                    builder.denseMatrix(objectiveHessian,
+                                        &sparsity.objectiveHessian));
 
-    this->setInequalityValueFunction((InequalityValueFunction)dlsym(
-            sharedLib, this->inequalityValueFunctionName.c_str()));
-    this->setInequalityGradientFunction((InequalityGradientFunction)dlsym(
-            sharedLib, this->inequalityGradientFunctionName.c_str()));
-    this->setInequalityHessianFunction((InequalityHessianFunction)dlsym(
-            sharedLib, this->inequalityHessianFunctionName.c_str()));
+    //====== Equality Functions ======
+    std::vector<SymbolicTriplet> entries;
+    std::vector<RCP<const Basic>> constants;
+    std::tie(entries, constants) =
+            equalityConstraints.convertToSparseLinearSystem(variableOrdering);
+    module->addTape(this->equalityMatrixFunctionName,
+                    builder.sparseMatrix(equalityConstraints.numConstraints(),
+                                         numVariables, entries));
+    module->addTape(this->equalityVectorFunctionName,
+                    builder.vector(constants));
 
-    // Cleanup
-    this->_numParameters = this->numParameters();
-    this->_numVariables = this->numVariables();
-    this->_numEqualityConstraints = this->numEqualityConstraints();
-    this->_numInequalityConstraints = this->numInequalityConstraints();
-    this->finalized = true;
-    this->parameterOrdering = parameterOrdering;
+    //====== Inequality Functions ======
+    if (this->barrierMode == BarrierMode::Symbolic) {
+        SymEngine::DenseMatrix barrierValueMat(1, 1);
+        barrierValueMat.set(0, 0,
+                            classified.nonlinear.symbolicBarrierValue());
+        module->addTape(this->inequalityValueFunctionName,
+                        builder.denseMatrix(barrierValueMat));
+        module->addTape(this->inequalityGradientFunctionName,
+                        builder.denseMatrix(barrierGradient,
+                                            &sparsity.inequalityGradient));
+        module->addTape(this->inequalityHessianFunctionName,
+                        builder.denseMatrix(barrierHessian,
+                                            &sparsity.inequalityHessian));
+    } else {
+        size_t numConstraints = classified.nonlinear.numConstraints();
+        module->addTape(
+                this->inequalityConstraintVectorFunctionName,
+                builder.denseMatrix(
+                        classified.nonlinear.symbolicConstraintVector()));
+        module->addTape(
+                this->inequalityConstraintJacobianFunctionName,
+                builder.sparseMatrix(
+                        numConstraints, numVariables,
+                        classified.nonlinear.symbolicConstraintJacobian(
+                                variableOrdering)));
+        module->addTape(
+                this->inequalityConstraintHessianFunctionName,
+                builder.weightedSparseMatrix(
+                        numVariables, numVariables,
+                        classified.nonlinear.symbolicConstraintHessians(
+                                variableOrdering)));
+    }
+
+    //====== Linear Inequality Functions ======
+    module->addTape(this->linearInequalityMatrixFunctionName,
+                    builder.sparseMatrix(classified.numLinearConstraints(),
+                                         numVariables,
+                                         classified.linearMatrix));
+    module->addTape(this->linearInequalityVectorFunctionName,
+                    builder.vector(classified.linearVector));
+    module->addTape(this->lowerBoundFunctionName,
+                    builder.vector(classified.lowerBounds));
+    module->addTape(this->upperBoundFunctionName,
+                    builder.vector(classified.upperBounds));
+
+    return module;
+}
+
+void SymbolicObjective::finalizeAll(const std::vector<FinalizeJob>& jobs,
+                                    size_t maxThreads) {
+    std::unordered_set<const SymbolicObjective*> objectives;
+    for (const FinalizeJob& job : jobs) {
+        if (job.objective == nullptr) {
+            throw std::runtime_error("Cannot finalize a null objective.");
+        }
+        if (!objectives.insert(job.objective).second) {
+            throw std::runtime_error(
+                    "An objective can only be finalized by one job.");
+        }
+    }
+
+    // The objectives share symbols, so their reference counts are changed
+    // from every thread. The loops of each objective get a share of the
+    // threads, see concurrentThreads.
+#ifndef WITH_SYMENGINE_THREAD_SAFE
+    maxThreads = 1;
+#endif
+    parallelFor(jobs.size(), maxThreads, [&jobs](size_t i) {
+        jobs[i].objective->finalize(jobs[i].variableOrdering,
+                                    jobs[i].parameterOrdering);
+    });
+}
+
+void SymbolicObjective::finalizeAll(
+        const std::vector<SymbolicObjective*>& objectives,
+        const OrderedSet& variableOrdering,
+        const OrderedSet& parameterOrdering, size_t maxThreads) {
+    std::vector<FinalizeJob> jobs;
+    for (SymbolicObjective* objective : objectives) {
+        jobs.push_back(
+                FinalizeJob{objective, variableOrdering, parameterOrdering});
+    }
+    SymbolicObjective::finalizeAll(jobs, maxThreads);
 }
 
 double& SymbolicObjective::parameter(const SymEngine::Expression& exp) {
@@ -154,6 +750,33 @@ double& SymbolicObjective::parameter(const SymEngine::Expression& exp) {
     return (*this->_parameters)(index);
 }
 
+const DerivativeSparsity& SymbolicObjective::derivativeSparsity() const {
+    if (!this->finalized || !this->sparsity) {
+        throw std::runtime_error(
+                "Objective must be finalized before its sparsity is known.");
+    }
+    return *this->sparsity;
+}
+
+FinalizeReport SymbolicObjective::finalizeReport() const {
+    if (!this->lastFinalizeReport) {
+        throw std::runtime_error(
+                "Objective must be finalized with profileFinalize set before "
+                "its finalize report is known.");
+    }
+    return *this->lastFinalizeReport;
+}
+
+std::map<std::string, OperationCount> SymbolicObjective::operationReport()
+        const {
+    if (!this->finalized) {
+        throw std::runtime_error(
+                "Objective must be finalized before its operations are "
+                "known.");
+    }
+    return CodeGenerator::operationReport(this->generatedFunctions);
+}
+
 UnorderedSetSymbol SymbolicObjective::getSymbols() const {
     UnorderedSetSymbol allSymbols;
 
@@ -2,15 +2,23 @@
 #ifndef INCLUDE_SYMBOLICOBJECTIVE_H_
 #define INCLUDE_SYMBOLICOBJECTIVE_H_
 
+#include <map>
+#include <memory>
 #include <optional>
 #include <string>
+#include <vector>
 
 #include <symengine/basic.h>
 #include <symengine/expression.h>
 
 #include "CodeGenerator.h"
+#include "DerivativeCache.h"
 #include "FastMPCFunctionPointerObjective.h"
+#include "FinalizeProfiler.h"
+#include "ObjectiveManifest.h"
 #include "OrderedSet.h"
+#include "RuntimeCompiler.h"
+#include "SparsityPattern.h"
 #include "SymEngineUtilities.h"
 #include "SymbolicEquality.h"
 #include "SymbolicInequality.h"
@@ -22,6 +30,17 @@ namespace cppmpc {
 
 namespace FastMPC {
 
+/**
+ * @brief How the derivatives of the inequality barrier are generated.
+ */
+enum class BarrierMode {
+    // Build -Σ log(-g_i) and differentiate the whole sum symbolically.
+    Symbolic,
+    // Only generate the constraint vector, its jacobian, and the constraint
+    // hessians, and assemble the barrier derivatives numerically.
+    Structured
+};
+
 class SymbolicObjective : public FunctionPointerObjective {
  private:
     std::optional<RCP<const Basic>> objective;
@@ -30,7 +49,50 @@ class SymbolicObjective : public FunctionPointerObjective {
 
     // Stores the parameter ordering once the objective has been finalized.
     // This is just to make it easier to set parameters.
-    std::optional<OrderedSet> parameterOrdering;
+    std::optional<FrozenOrderedSet> parameterOrdering;
+
+    // Stores the sparsity of the derivatives once the objective has been
+    // finalized.
+    std::optional<DerivativeSparsity> sparsity;
+
+    // Describes the compiled library once the objective has been finalized,
+    // so it can be exported.
+    std::optional<ObjectiveManifest> manifest;
+
+    // The parameters fixed for the next finalize, and their values.
+    SymEngine::map_basic_basic fixedParameters;
+
+    // The derivatives of the expressions, shared by the next finalize.
+    std::shared_ptr<DerivativeCache> derivativeCache =
+            std::make_shared<DerivativeCache>();
+
+    // The generated code of one part of the objective, kept so the next
+    // finalize only generates the parts that changed.
+    typedef struct GeneratedPart {
+        // The orderings, options, and expressions it was generated from
+        SymEngine::vec_basic key;
+        std::vector<GeneratedFunction> functions;
+        SymEngine::DenseMatrix gradient;
+        SymEngine::DenseMatrix hessian;
+        SparsityPattern gradientPattern;
+        SparsityPattern hessianPattern;
+        // The parameters of each equality update function
+        std::vector<std::vector<int>> matrixDependencies;
+        std::vector<std::vector<int>> vectorDependencies;
+        ClassifiedInequalityConstraints classified;
+    } GeneratedPart;
+
+    std::optional<GeneratedPart> objectivePart;
+    std::optional<GeneratedPart> equalityPart;
+    std::optional<GeneratedPart> inequalityPart;
+
+    // The generated functions and their description, kept after finalize so
+    // the objective can be rebuilt with a profile.
+    std::vector<GeneratedFunction> generatedFunctions;
+    std::string generatedMetadata;
+
+    // The report of the last finalize, if it was profiled.
+    std::optional<FinalizeReport> lastFinalizeReport;
 
     // Function names
     const std::string valueFunctionName = "value";
@@ -41,8 +103,51 @@ class SymbolicObjective : public FunctionPointerObjective {
     const std::string inequalityValueFunctionName = "inequalityValue";
     const std::string inequalityGradientFunctionName = "inequalityGradient";
     const std::string inequalityHessianFunctionName = "inequalityHessian";
+    const std::string inequalityConstraintVectorFunctionName =
+            "inequalityConstraintVector";
+    const std::string inequalityConstraintJacobianFunctionName =
+            "inequalityConstraintJacobian";
+    const std::string inequalityConstraintHessianFunctionName =
+            "inequalityConstraintHessian";
+    const std::string linearInequalityMatrixFunctionName =
+            "linearInequalityMatrix";
+    const std::string linearInequalityVectorFunctionName =
+            "linearInequalityVector";
+    const std::string lowerBoundFunctionName = "lowerBounds";
+    const std::string upperBoundFunctionName = "upperBounds";
+
+    /**
+     * @brief A description of the objective that is stored with the compiled
+     * library in the compile cache.
+     */
+    std::string compileMetadata(const OrderedSet& variableOrdering,
+                                const OrderedSet& parameterOrdering) const;
+
+    /**
+     * @brief A module of expression tapes with the same functions as the
+     * generated source, used as the first tier and when compilation fails.
+     *
+     * The barrier derivatives are only used with the symbolic barrier.
+     */
+    std::shared_ptr<const CompiledModule> interpretedModule(
+            const RCP<const Basic>& objective,
+            const SymbolicEqualityConstraints& equalityConstraints,
+            const SymEngine::DenseMatrix& objectiveGradient,
+            const SymEngine::DenseMatrix& objectiveHessian,
+            const ClassifiedInequalityConstraints& classified,
+            const SymEngine::DenseMatrix& barrierGradient,
+            const SymEngine::DenseMatrix& barrierHessian,
+            const DerivativeSparsity& sparsity,
+            const OrderedSet& variableOrdering,
+            const OrderedSet& parameterOrdering) const;
 
  protected:
+    /**
+     * @brief Set the function pointers from a module compiled on finalize,
+     * using the manifest for the barrier mode and the linear constraints.
+     */
+    void loadModule(std::shared_ptr<const CompiledModule> module) override;
+
     /**
      * @brief Check that the symbolic objective has been finalized and call
      * the function pointer objective validate function.
@@ -55,21 +160,99 @@ class SymbolicObjective : public FunctionPointerObjective {
     SymbolicEqualityConstraints equalityConstraints;
     SymbolicInequalityConstraints inequalityConstraints;
 
+    // How the inequality barrier derivatives are generated on finalize.
+    BarrierMode barrierMode = BarrierMode::Symbolic;
+
+    // Whether linear inequality constraints and bounds are found on finalize
+    // and evaluated numerically instead of through the generated barrier.
+    bool detectLinearInequalities = true;
+
+    // Whether batched variants of the value, gradient, and hessian are
+    // generated on finalize, for batchValue, batchGradient, and batchHessian.
+    bool generateBatchFunctions = true;
+
+    // How the generated functions are compiled on finalize.
+    CompileOptions compileOptions;
+
+    // Whether finalize records a report of where its time went, for
+    // finalizeReport.
+    bool profileFinalize = false;
+
     /**
      * @brief Set the objective function
      */
     void setObjective(RCP<const Basic> obj);
     void setObjective(SymEngine::Expression obj);
 
+    /**
+     * @brief Fix a parameter to a value from the next finalize on.
+     *
+     * The value is substituted into the objective and constraints before
+     * they are differentiated, so the generated code is specialized for it
+     * and the parameter is left out of the parameter ordering. The
+     * parameters passed to setParameters are then only the ones that aren't
+     * fixed, in the same order.
+     *
+     * @param parameter The parameter to fix.
+     * @param value Its value.
+     */
+    void fixParameter(const SymEngine::Expression& parameter, double value);
+
+    /**
+     * @brief Stop fixing parameters from the next finalize on.
+     */
+    void clearFixedParameters();
+
     /**
      * @brief Compile the objectives and set the function pointers.
      *
      * @param variableOrdering The variable ordering.
-     * @param parameterOrdering The parameter ordering.
+     * @param parameterOrdering The parameter ordering, including any fixed
+     * parameters.
      */
     void finalize(const OrderedSet& variableOrdering,
                   const OrderedSet& parameterOrdering);
 
+    /**
+     * struct FinalizeJob - An objective for finalizeAll, and the orderings to
+     * finalize it with.
+     */
+    typedef struct FinalizeJob {
+        SymbolicObjective* objective;
+        OrderedSet variableOrdering;
+        OrderedSet parameterOrdering;
+    } FinalizeJob;
+
+    /**
+     * @brief Finalize several objectives at once, split across threads.
+     *
+     * The objectives may share symbols and expressions, which needs SymEngine
+     * to be built with WITH_SYMENGINE_THREAD_SAFE for its reference counts to
+     * be atomic. Otherwise they are finalized one at a time. Each objective
+     * can only be in one job, and shouldn't be used by another thread until
+     * this returns. The objectives finalized at once share the threads, so
+     * the compiles and the other parallel steps of each objective use their
+     * share of compileOptions.compileJobs or of the cores.
+     *
+     * The first exception thrown by a finalize is rethrown once every job
+     * finishes, and the other objectives are still finalized.
+     *
+     * @param jobs The objectives and their orderings.
+     * @param maxThreads The most objectives to finalize at once, or 0 for one
+     * per core.
+     */
+    static void finalizeAll(const std::vector<FinalizeJob>& jobs,
+                            size_t maxThreads = 0);
+
+    /**
+     * @brief Finalize several objectives with the same orderings at once,
+     * like finalizeAll with a job for each objective.
+     */
+    static void finalizeAll(const std::vector<SymbolicObjective*>& objectives,
+                            const OrderedSet& variableOrdering,
+                            const OrderedSet& parameterOrdering,
+                            size_t maxThreads = 0);
+
     /**
      * @brief Get a reference to the given parameter.
      *
@@ -77,6 +260,61 @@ class SymbolicObjective : public FunctionPointerObjective {
      */
     double& parameter(const SymEngine::Expression& exp);
 
+    /**
+     * @brief The sparsity patterns of the objective and barrier derivatives.
+     * Only available once the objective has been finalized. The barrier
+     * patterns are only found in the symbolic barrier mode, and only cover the
+     * nonlinear inequality constraints.
+     */
+    const DerivativeSparsity& derivativeSparsity() const;
+
+    /**
+     * @brief Export the finalized objective to a directory, which can then be
+     * loaded with LoadedObjective without SymEngine.
+     *
+     * The directory is created if needed, and gets a copy of the compiled
+     * library and a manifest with the dimensions, orderings, and sparsity
+     * patterns. Objectives compiled in memory or interpreted can't be
+     * exported.
+     *
+     * @param directory The directory to export to.
+     */
+    void exportObjective(const std::string& directory) const;
+
+    /**
+     * @brief Rebuild the finalized objective with profile guided
+     * optimization, using compileOptions for the final build.
+     *
+     * Every function of an instrumented build is evaluated at each sample,
+     * which should be representative of the problems that will be solved.
+     * The parameters the objective had are restored afterwards, and a pending
+     * tiered build is discarded.
+     *
+     * @param states The state of each sample.
+     * @param parameters The parameters of each sample.
+     */
+    void optimizeWithProfile(const std::vector<Eigen::VectorXd>& states,
+                             const std::vector<Eigen::VectorXd>& parameters);
+
+    /**
+     * @brief The additions, multiplications, divisions, and calls each
+     * generated function evaluates, by the function's name. Only available
+     * once the objective has been finalized.
+     */
+    std::map<std::string, OperationCount> operationReport() const;
+
+    /**
+     * @brief Where the time of the last finalize went: the wall time of each
+     * phase, the symbolic nodes before and after each transform, the bytes
+     * of each generated function, and the size of the compiled library.
+     * Only available once the objective has been finalized with
+     * profileFinalize set.
+     *
+     * With tiered compilation, only the first tier is included, since the
+     * optimized library is built after finalize returns.
+     */
+    FinalizeReport finalizeReport() const;
+
     UnorderedSetSymbol getSymbols() const;
 
     UnorderedSetSymbol getVariables() const;
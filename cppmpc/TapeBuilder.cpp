@@ -0,0 +1,273 @@
+// Copyright 2021 Ian Ruh
+#include "TapeBuilder.h"
+
+#include <symengine/constants.h>
+#include <symengine/eval_double.h>
+#include <symengine/functions.h>
+#include <symengine/mul.h>
+#include <symengine/pow.h>
+#include <symengine/symbol.h>
+
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ExpressionTape.h"
+#include "OrderedSet.h"
+#include "SparsityPattern.h"
+#include "SymEngineUtilities.h"
+
+namespace cppmpc {
+
+using SymEngine::Symbol;
+using Op = ExpressionTape::Op;
+using Input = ExpressionTape::Input;
+
+TapeBuilder::TapeBuilder(const OrderedSet& variableOrdering,
+                         const OrderedSet& parameterOrdering)
+        : variableOrdering(variableOrdering),
+          parameterOrdering(parameterOrdering) {}
+
+uint32_t TapeBuilder::recordNumericPower(uint32_t base, double exponent,
+                                         ExpressionTape* tape) {
+    if (exponent == 0.5) {
+        return tape->apply(Op::Sqrt, base);
+    } else if (exponent == -0.5) {
+        return tape->apply(Op::Div, tape->constant(1.0),
+                           tape->apply(Op::Sqrt, base));
+    }
+
+    // Small integer powers are a few multiplications, by squaring
+    double magnitude = std::fabs(exponent);
+    if (magnitude >= 1 && magnitude <= 8 &&
+        std::floor(magnitude) == magnitude) {
+        uint64_t remaining = static_cast<uint64_t>(magnitude);
+        uint32_t square = base;
+        bool haveResult = false;
+        uint32_t result = 0;
+        while (remaining > 0) {
+            if (remaining & 1) {
+                result = haveResult ? tape->apply(Op::Mul, result, square)
+                                    : square;
+                haveResult = true;
+            }
+            remaining >>= 1;
+            if (remaining > 0) {
+                square = tape->apply(Op::Mul, square, square);
+            }
+        }
+        if (exponent < 0) {
+            result = tape->apply(Op::Div, tape->constant(1.0), result);
+        }
+        return result;
+    }
+
+    return tape->apply(Op::Pow, base, tape->constant(exponent));
+}
+
+uint32_t TapeBuilder::record(const RCP<const Basic>& basic,
+                             ExpressionTape* tape,
+                             RecordedValues* recorded) const {
+    auto it = recorded->find(basic);
+    if (it != recorded->end()) {
+        return it->second;
+    }
+
+    uint32_t value;
+    SymEngine::vec_basic args = basic->get_args();
+    if (SymEngine::is_a_Number(*basic) ||
+        SymEngine::is_a<SymEngine::Constant>(*basic)) {
+        value = tape->constant(SymEngine::eval_double(*basic));
+    } else if (SymEngine::is_a<Symbol>(*basic)) {
+        RCP<const Symbol> symbol =
+                SymEngine::rcp_static_cast<const Symbol>(basic);
+        if (this->variableOrdering.contains(symbol)) {
+            value = tape->load(Input::State, static_cast<uint32_t>(
+                    this->variableOrdering.indexOf(symbol)));
+        } else if (this->parameterOrdering.contains(symbol)) {
+            value = tape->load(Input::Parameter, static_cast<uint32_t>(
+                    this->parameterOrdering.indexOf(symbol)));
+        } else {
+            throw std::runtime_error("Not all symbols have a representation");
+        }
+    } else if (SymEngine::is_a<SymEngine::Add>(*basic) ||
+               SymEngine::is_a<SymEngine::Mul>(*basic)) {
+        Op op = SymEngine::is_a<SymEngine::Add>(*basic) ? Op::Add : Op::Mul;
+        value = this->record(args[0], tape, recorded);
+        for (size_t i = 1; i < args.size(); i++) {
+            value = tape->apply(op, value,
+                                this->record(args[i], tape, recorded));
+        }
+    } else if (SymEngine::is_a<SymEngine::Pow>(*basic)) {
+        const RCP<const Basic>& base = args[0];
+        const RCP<const Basic>& exponent = args[1];
+        if (SymEngine::eq(*base, *SymEngine::E)) {
+            value = tape->apply(Op::Exp,
+                                this->record(exponent, tape, recorded));
+        } else if (SymEngine::is_a_Number(*exponent)) {
+            value = TapeBuilder::recordNumericPower(
+                    this->record(base, tape, recorded),
+                    SymEngine::eval_double(*exponent), tape);
+        } else {
+            value = tape->apply(Op::Pow, this->record(base, tape, recorded),
+                                this->record(exponent, tape, recorded));
+        }
+    } else if (SymEngine::is_a<SymEngine::Log>(*basic)) {
+        value = tape->apply(Op::Log, this->record(args[0], tape, recorded));
+        if (args.size() == 2) {
+            // log(x, b) = log(x) / log(b)
+            value = tape->apply(
+                    Op::Div, value,
+                    tape->apply(Op::Log,
+                                this->record(args[1], tape, recorded)));
+        }
+    } else {
+        // The remaining supported functions take a single argument
+        static const std::vector<std::pair<bool (*)(const Basic&), Op>>
+                functions = {
+                        {&SymEngine::is_a<SymEngine::Sin>, Op::Sin},
+                        {&SymEngine::is_a<SymEngine::Cos>, Op::Cos},
+                        {&SymEngine::is_a<SymEngine::Tan>, Op::Tan},
+                        {&SymEngine::is_a<SymEngine::ASin>, Op::Asin},
+                        {&SymEngine::is_a<SymEngine::ACos>, Op::Acos},
+                        {&SymEngine::is_a<SymEngine::ATan>, Op::Atan},
+                        {&SymEngine::is_a<SymEngine::Sinh>, Op::Sinh},
+                        {&SymEngine::is_a<SymEngine::Cosh>, Op::Cosh},
+                        {&SymEngine::is_a<SymEngine::Tanh>, Op::Tanh},
+                        {&SymEngine::is_a<SymEngine::Abs>, Op::Abs}};
+        bool found = false;
+        for (const auto& function : functions) {
+            if (function.first(*basic) && args.size() == 1) {
+                value = tape->apply(function.second,
+                                    this->record(args[0], tape, recorded));
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            throw std::runtime_error(
+                    "The expression tape can't evaluate " +
+                    SymEngine::str(*basic));
+        }
+    }
+
+    recorded->emplace(basic, value);
+    return value;
+}
+
+ExpressionTape TapeBuilder::denseMatrix(const SymEngine::DenseMatrix& mat,
+                                        const SparsityPattern* pattern) const {
+    if (pattern != nullptr &&
+        (pattern->rows() != mat.nrows() || pattern->cols() != mat.ncols())) {
+        throw std::runtime_error(
+                "Sparsity pattern does not match the matrix dimensions");
+    }
+
+    ExpressionTape tape;
+    RecordedValues recorded;
+    tape.setOutputSize(mat.nrows() * mat.ncols());
+    for (size_t col = 0; col < mat.ncols(); col++) {
+        for (size_t row = 0; row < mat.nrows(); row++) {
+            if (pattern != nullptr && !pattern->contains(row, col)) {
+                continue;
+            }
+            RCP<const Basic> value = mat.get(row, col);
+            // Unassigned outputs are already zero
+            if (SymEngine::eq(*value, *SymEngine::zero)) {
+                continue;
+            }
+            tape.assign(col * mat.nrows() + row,
+                        this->record(value, &tape, &recorded));
+        }
+    }
+    tape.finish();
+    return tape;
+}
+
+ExpressionTape TapeBuilder::sparseMatrix(
+        size_t rows, size_t cols,
+        const std::vector<SymbolicTriplet>& entries) const {
+    ExpressionTape tape;
+    RecordedValues recorded;
+    tape.setOutputSize(rows * cols);
+
+    // Sum the duplicate entries on the tape
+    std::map<size_t, uint32_t> summed;
+    for (const SymbolicTriplet& entry : entries) {
+        if (entry.row >= rows || entry.col >= cols) {
+            throw std::runtime_error("Sparse matrix entry is out of range");
+        }
+        uint32_t value = this->record(entry.value, &tape, &recorded);
+        size_t index = entry.col * rows + entry.row;
+        auto it = summed.find(index);
+        if (it == summed.end()) {
+            summed.emplace(index, value);
+        } else {
+            it->second = tape.apply(Op::Add, it->second, value);
+        }
+    }
+    for (const auto& element : summed) {
+        tape.assign(element.first, element.second);
+    }
+    tape.finish();
+    return tape;
+}
+
+ExpressionTape TapeBuilder::weightedSparseMatrix(
+        size_t rows, size_t cols,
+        const std::vector<std::vector<SymbolicTriplet>>& matrices) const {
+    ExpressionTape tape;
+    RecordedValues recorded;
+    tape.setOutputSize(rows * cols);
+
+    std::map<size_t, uint32_t> summed;
+    for (size_t i = 0; i < matrices.size(); i++) {
+        if (matrices[i].empty()) {
+            continue;
+        }
+        uint32_t weight =
+                tape.load(Input::Weight, static_cast<uint32_t>(i));
+        for (const SymbolicTriplet& entry : matrices[i]) {
+            if (entry.row >= rows || entry.col >= cols) {
+                throw std::runtime_error(
+                        "Sparse matrix entry is out of range");
+            }
+            uint32_t value = tape.apply(
+                    Op::Mul, weight,
+                    this->record(entry.value, &tape, &recorded));
+            size_t index = entry.col * rows + entry.row;
+            auto it = summed.find(index);
+            if (it == summed.end()) {
+                summed.emplace(index, value);
+            } else {
+                it->second = tape.apply(Op::Add, it->second, value);
+            }
+        }
+    }
+    for (const auto& element : summed) {
+        tape.assign(element.first, element.second);
+    }
+    tape.finish();
+    return tape;
+}
+
+ExpressionTape TapeBuilder::vector(
+        const std::vector<RCP<const Basic>>& values) const {
+    ExpressionTape tape;
+    RecordedValues recorded;
+    tape.setOutputSize(values.size());
+    for (size_t i = 0; i < values.size(); i++) {
+        if (SymEngine::eq(*values[i], *SymEngine::zero)) {
+            continue;
+        }
+        tape.assign(i, this->record(values[i], &tape, &recorded));
+    }
+    tape.finish();
+    return tape;
+}
+
+}  // namespace cppmpc
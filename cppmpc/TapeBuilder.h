@@ -0,0 +1,98 @@
+// Copyright 2021 Ian Ruh
+#ifndef INCLUDE_TAPEBUILDER_H_
+#define INCLUDE_TAPEBUILDER_H_
+
+#include <symengine/basic.h>
+#include "symengine/matrix.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "ExpressionTape.h"
+#include "OrderedSet.h"
+#include "SparsityPattern.h"
+#include "SymEngineUtilities.h"
+
+namespace cppmpc {
+
+using SymEngine::Basic;
+using SymEngine::RCP;
+
+/**
+ * @brief Builds expression tapes from symbolic expressions, as an interpreted
+ * alternative to the code generator.
+ *
+ * Variables are loaded from the state and parameters from the parameters, by
+ * their index in the orderings. Each subexpression is only recorded once per
+ * tape, so common subexpressions between the outputs are shared.
+ *
+ * The builder keeps references to the orderings, so they have to outlive it.
+ */
+class TapeBuilder {
+ private:
+    const OrderedSet& variableOrdering;
+    const OrderedSet& parameterOrdering;
+
+    typedef std::unordered_map<RCP<const Basic>, uint32_t,
+                               SymEngine::RCPBasicHash,
+                               SymEngine::RCPBasicKeyEq>
+            RecordedValues;
+
+    /**
+     * @brief Record the basic on the tape, returning the handle of its value.
+     * Throws if the basic contains a function the tape can't evaluate.
+     */
+    uint32_t record(const RCP<const Basic>& basic, ExpressionTape* tape,
+                    RecordedValues* recorded) const;
+
+    /**
+     * @brief Record x^exponent for a numeric exponent, using multiplications
+     * and square roots where possible.
+     */
+    static uint32_t recordNumericPower(uint32_t base, double exponent,
+                                       ExpressionTape* tape);
+
+ public:
+    TapeBuilder(const OrderedSet& variableOrdering,
+                const OrderedSet& parameterOrdering);
+
+    /**
+     * @brief A tape setting a column major matrix, like
+     * CodeGenerator::generateDenseMatrixCode.
+     *
+     * @param mat The matrix.
+     * @param pattern If given, entries outside of the pattern are known to be
+     * zero and aren't recorded.
+     */
+    ExpressionTape denseMatrix(const SymEngine::DenseMatrix& mat,
+                               const SparsityPattern* pattern = nullptr) const;
+
+    /**
+     * @brief A tape setting a column major matrix from its non-zero entries,
+     * like CodeGenerator::generateSparseMatrixCode. Duplicate entries are
+     * summed.
+     */
+    ExpressionTape sparseMatrix(
+            size_t rows, size_t cols,
+            const std::vector<SymbolicTriplet>& entries) const;
+
+    /**
+     * @brief A tape setting the column major matrix Σ weight[i] * M_i, where
+     * the weights are an input of the tape.
+     *
+     * @param matrices The non-zero entries of each matrix M_i.
+     */
+    ExpressionTape weightedSparseMatrix(
+            size_t rows, size_t cols,
+            const std::vector<std::vector<SymbolicTriplet>>& matrices) const;
+
+    /**
+     * @brief A tape setting a vector.
+     */
+    ExpressionTape vector(const std::vector<RCP<const Basic>>& values) const;
+};
+
+}  // namespace cppmpc
+
+#endif  // INCLUDE_TAPEBUILDER_H_
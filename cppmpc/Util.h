@@ -18,6 +18,11 @@ inline Eigen::IOFormat FlatFmt(4, 0, ", ", ";", "", "", "[", "]");
 #endif  // DEBUG
 
 #define CPP_COMPILER_PATH "clang"
+// Merges the raw profiles written by instrumented generated code
+#define PROFDATA_TOOL_PATH "llvm-profdata"
+// Passed to every external compilation, before the per-objective options
+#ifndef RUNTIME_COMPILER_FLAGS
 #define RUNTIME_COMPILER_FLAGS ""
+#endif
 
 #endif  // INCLUDE_UTIL_H_
@@ -0,0 +1,284 @@
+// Copyright 2021 Ian Ruh
+#include "VectorMath.h"
+
+#include <cstdio>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cppmpc {
+
+namespace {
+
+/**
+ * @brief The signature and loop header shared by the kernels.
+ */
+std::string kernelHeader(const std::string& name) {
+    return "static void " + name +
+           "(int n, const double* __restrict in, double* __restrict out) {\n"
+           "#pragma omp simd\n"
+           "for (int i = 0; i < n; i++) {\n"
+           "double x = in[i];\n";
+}
+
+}  // namespace
+
+std::string VectorMathKernels::horner(
+        const std::string& variable, const std::vector<double>& coefficients) {
+    std::string result;
+    for (size_t i = coefficients.size(); i-- > 0;) {
+        char coefficient[32];
+        std::snprintf(coefficient, sizeof(coefficient), "%.17g",
+                      coefficients[i]);
+        result = result.empty() ? coefficient
+                                : std::string(coefficient) + " + " + variable +
+                                          " * (" + result + ")";
+    }
+    return result;
+}
+
+const std::vector<std::string>& VectorMathKernels::functions() {
+    static const std::vector<std::string> functions = {"log", "exp", "sin",
+                                                       "cos", "pow"};
+    return functions;
+}
+
+std::string VectorMathKernels::kernelName(const std::string& function,
+                                          VectorMath accuracy) {
+    bool known = false;
+    for (const std::string& name : VectorMathKernels::functions()) {
+        known = known || name == function;
+    }
+    if (!known) {
+        throw std::runtime_error("There is no vector math kernel for " +
+                                 function);
+    }
+    switch (accuracy) {
+        case VectorMath::Fast:
+            return "cppmpc_v" + function + "_fast";
+        case VectorMath::Accurate:
+            return "cppmpc_v" + function + "_accurate";
+        case VectorMath::Off:
+            break;
+    }
+    throw std::runtime_error("Vector math kernels are off");
+}
+
+std::string VectorMathKernels::kernelSource(const std::string& function,
+                                            VectorMath accuracy) {
+    std::string name = VectorMathKernels::kernelName(function, accuracy);
+    bool accurate = accuracy == VectorMath::Accurate;
+    if (function == "log") {
+        return VectorMathKernels::logSource(name, accurate);
+    } else if (function == "exp") {
+        return VectorMathKernels::expSource(name, accurate);
+    } else if (function == "pow") {
+        return VectorMathKernels::powSource(
+                name, VectorMathKernels::kernelName("log", accuracy),
+                VectorMathKernels::kernelName("exp", accuracy));
+    }
+    return VectorMathKernels::sinCosSource(name, accurate, function == "cos");
+}
+
+std::string VectorMathKernels::logSource(const std::string& name,
+                                         bool accurate) {
+    // log(m) = 2 atanh(s) = 2s Σ s^2k / (2k + 1), with s = (m - 1) / (m + 1)
+    std::vector<double> series;
+    for (int k = 0; k < (accurate ? 10 : 4); k++) {
+        series.push_back(1.0 / (2 * k + 1));
+    }
+
+    std::stringstream ss;
+    ss << kernelHeader(name);
+    // Scale subnormals into the normal range
+    ss << "int tiny = x < 0x1p-1022;\n";
+    ss << "double scaled = tiny ? x * 0x1p54 : x;\n";
+    ss << "uint64_t bits;\n";
+    ss << "memcpy(&bits, &scaled, sizeof(bits));\n";
+    // x = m 2^e, with m in [sqrt(1/2), sqrt(2))
+    ss << "uint64_t top = bits + 0x00095f6200000000ULL;\n";
+    ss << "uint64_t exponentBits = (top >> 52) | 0x4330000000000000ULL;\n";
+    ss << "double e;\n";
+    ss << "memcpy(&e, &exponentBits, sizeof(e));\n";
+    ss << "e = e - 0x1p52 - 1023 - (tiny ? 54 : 0);\n";
+    ss << "uint64_t mantissaBits = ((top & 0x000fffff00000000ULL) + "
+          "0x3fe6a09e00000000ULL) | (bits & 0xffffffffULL);\n";
+    ss << "double m;\n";
+    ss << "memcpy(&m, &mantissaBits, sizeof(m));\n";
+    ss << "double f = m - 1.0;\n";
+    ss << "double s = f / (2.0 + f);\n";
+    ss << "double z = s * s;\n";
+    ss << "double r = e * 6.93147180369123816490e-01 + (e * "
+          "1.90821492927058770002e-10 + 2.0 * s * ("
+       << VectorMathKernels::horner("z", series) << "));\n";
+    // log(+inf) = +inf, log(0) = -inf, and log(x < 0) = log(NaN) = NaN
+    ss << "r = x == HUGE_VAL ? x : r;\n";
+    ss << "out[i] = x > 0 ? r : (x == 0 ? -HUGE_VAL : NAN);\n";
+    ss << "}\n}\n";
+    return ss.str();
+}
+
+std::string VectorMathKernels::expSource(const std::string& name,
+                                         bool accurate) {
+    // exp(r) = Σ r^j / j!, with |r| <= ln(2) / 2
+    std::vector<double> series;
+    double factorial = 1;
+    for (int j = 0; j <= (accurate ? 13 : 7); j++) {
+        factorial *= j > 0 ? j : 1;
+        series.push_back(1.0 / factorial);
+    }
+
+    std::stringstream ss;
+    ss << kernelHeader(name);
+    // Past these exp overflows or underflows, and 2^k stays representable
+    ss << "double c = x > 709.8 ? 709.8 : (x < -745.2 ? -745.2 : x);\n";
+    // exp(x) = 2^k exp(r), with k rounded by adding 1.5 * 2^52
+    ss << "double shifted = c * 0x1.71547652b82fep0 + 0x1.8p52;\n";
+    ss << "uint64_t kBits;\n";
+    ss << "memcpy(&kBits, &shifted, sizeof(kBits));\n";
+    ss << "double k = shifted - 0x1.8p52;\n";
+    ss << "double r = (c - k * 6.93147180369123816490e-01) - k * "
+          "1.90821492927058770002e-10;\n";
+    ss << "double p = " << VectorMathKernels::horner("r", series) << ";\n";
+    // 2^k in two halves, so subnormal and overflowing results are rounded
+    ss << "int64_t kInt = (int64_t)(kBits & 0x000fffffffffffffULL) - "
+          "((int64_t)1 << 51);\n";
+    ss << "int64_t k1 = kInt / 2;\n";
+    ss << "uint64_t scale1Bits = (uint64_t)(k1 + 1023) << 52;\n";
+    ss << "uint64_t scale2Bits = (uint64_t)(kInt - k1 + 1023) << 52;\n";
+    ss << "double scale1;\n";
+    ss << "double scale2;\n";
+    ss << "memcpy(&scale1, &scale1Bits, sizeof(scale1));\n";
+    ss << "memcpy(&scale2, &scale2Bits, sizeof(scale2));\n";
+    ss << "out[i] = x != x ? x : p * scale1 * scale2;\n";
+    ss << "}\n}\n";
+    return ss.str();
+}
+
+std::string VectorMathKernels::sinCosSource(const std::string& name,
+                                            bool accurate, bool cosine) {
+    // sin(r) = r + r Σ (-1)^j r^2j / (2j + 1)! and
+    // cos(r) = 1 + Σ (-1)^j r^2j / (2j)!, with |r| <= pi / 4
+    std::vector<double> sinSeries;
+    std::vector<double> cosSeries;
+    double factorial = 1;
+    for (int j = 1; j <= (accurate ? 18 : 9); j++) {
+        factorial *= j;
+        double sign = (j / 2) % 2 == 0 ? 1 : -1;
+        if (j % 2 == 0) {
+            cosSeries.push_back(sign / factorial);
+        } else if (j > 1) {
+            sinSeries.push_back(sign / factorial);
+        }
+    }
+
+    std::stringstream ss;
+    ss << kernelHeader(name);
+    // x = n pi / 2 + r, with pi / 2 split into three parts so n pi / 2 is
+    // exact for the arguments reduced here
+    ss << "double shifted = x * 0x1.45f306dc9c883p-1 + 0x1.8p52;\n";
+    ss << "uint64_t nBits;\n";
+    ss << "memcpy(&nBits, &shifted, sizeof(nBits));\n";
+    ss << "double multiple = shifted - 0x1.8p52;\n";
+    ss << "double r = ((x - multiple * 1.57079632673412561417e+00) - "
+          "multiple * 6.07710050630396597660e-11) - "
+          "multiple * 2.02226624871116645580e-21;\n";
+    ss << "double z = r * r;\n";
+    ss << "double s = r + r * z * ("
+       << VectorMathKernels::horner("z", sinSeries) << ");\n";
+    ss << "double c = 1.0 + z * (" << VectorMathKernels::horner("z", cosSeries)
+       << ");\n";
+    // cos(x) = sin(x + pi / 2), one quadrant later
+    ss << "uint64_t quadrant = (nBits + " << (cosine ? 1 : 0) << ") & 3;\n";
+    ss << "double v = (quadrant & 1) ? c : s;\n";
+    ss << "out[i] = (quadrant & 2) ? -v : v;\n";
+    ss << "}\n";
+    // Large, infinite, and NaN arguments
+    ss << "for (int i = 0; i < n; i++) {\n";
+    ss << "if (!(fabs(in[i]) <= 0x1p17)) {\n";
+    ss << "out[i] = " << (cosine ? "cos" : "sin") << "(in[i]);\n";
+    ss << "}\n}\n}\n";
+    return ss.str();
+}
+
+std::string VectorMathKernels::powSource(const std::string& name,
+                                         const std::string& logName,
+                                         const std::string& expName) {
+    std::stringstream ss;
+    ss << "static void " << name
+       << "(int n, const double* __restrict in, "
+          "const double* __restrict exponent, double* __restrict out) {\n";
+    // exp(y log|x|), a block at a time through the log and exp kernels
+    ss << "double a[64];\n";
+    ss << "double l[64];\n";
+    ss << "for (int start = 0; start < n; start += 64) {\n";
+    ss << "int count = n - start < 64 ? n - start : 64;\n";
+    ss << "#pragma omp simd\n";
+    ss << "for (int j = 0; j < count; j++) {\n";
+    ss << "a[j] = fabs(in[start + j]);\n";
+    ss << "}\n";
+    ss << logName << "(count, a, l);\n";
+    ss << "#pragma omp simd\n";
+    ss << "for (int j = 0; j < count; j++) {\n";
+    ss << "a[j] = exponent[start + j] * l[j];\n";
+    ss << "}\n";
+    ss << expName << "(count, a, out + start);\n";
+    ss << "}\n";
+    ss << "#pragma omp simd\n";
+    ss << "for (int i = 0; i < n; i++) {\n";
+    ss << "double x = in[i];\n";
+    ss << "double y = exponent[i];\n";
+    // Integers past 2^53 are all even
+    ss << "double half = 0.5 * y;\n";
+    ss << "int integral = y == floor(y);\n";
+    ss << "int odd = integral && fabs(y) < 0x1p53 && half != floor(half);\n";
+    ss << "uint64_t bits;\n";
+    ss << "memcpy(&bits, &x, sizeof(bits));\n";
+    // Negative bases, including -0 and -inf, keep their sign for odd
+    // exponents, and finite ones are NaN for fractional exponents
+    ss << "double r = (bits >> 63) && odd ? -out[i] : out[i];\n";
+    ss << "r = x < 0 && x > -HUGE_VAL && !integral ? NAN : r;\n";
+    // Where y log|x| is 0 times inf or NaN, math.h returns 1
+    ss << "r = fabs(x) == 1 && fabs(y) == HUGE_VAL ? 1.0 : r;\n";
+    ss << "out[i] = x == 1 || y == 0 ? 1.0 : r;\n";
+    ss << "}\n}\n";
+    return ss.str();
+}
+
+std::string VectorMathKernels::prelude(const std::string& source) {
+    return VectorMathKernels::prelude(std::vector<std::string>{source});
+}
+
+std::string VectorMathKernels::prelude(
+        const std::vector<std::string>& sources,
+        const std::set<std::string>& kernels) {
+    std::stringstream ss;
+    for (VectorMath accuracy : {VectorMath::Fast, VectorMath::Accurate}) {
+        auto called = [&](const std::string& function) {
+            std::string name =
+                    VectorMathKernels::kernelName(function, accuracy);
+            bool found = kernels.count(name) > 0;
+            for (const std::string& source : sources) {
+                found = found || source.find(name + "(") != std::string::npos;
+            }
+            return found;
+        };
+        // The pow kernel calls the log and exp kernels
+        bool pow = called("pow");
+        for (const std::string& function : VectorMathKernels::functions()) {
+            if (called(function) ||
+                (pow && (function == "log" || function == "exp"))) {
+                ss << VectorMathKernels::kernelSource(function, accuracy)
+                   << std::endl;
+            }
+        }
+    }
+    if (ss.str().empty()) {
+        return "";
+    }
+    return "#include \"stdint.h\"\n#include \"string.h\"\n\n" + ss.str();
+}
+
+}  // namespace cppmpc
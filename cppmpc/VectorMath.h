@@ -0,0 +1,102 @@
+// Copyright 2021 Ian Ruh
+#ifndef INCLUDE_VECTORMATH_H_
+#define INCLUDE_VECTORMATH_H_
+
+#include <set>
+#include <string>
+#include <vector>
+
+namespace cppmpc {
+
+/**
+ * @brief Whether calls to log, exp, sin, cos, and pow in generated code are
+ * evaluated by the bundled SIMD math kernels, and how accurately.
+ */
+enum class VectorMath {
+    // Call math.h for each value, which is the reference.
+    Off,
+    // Short polynomials, accurate to about 1e-7 relative to the result.
+    // pow loses another factor of |y log(x)|.
+    Fast,
+    // Within a few ulp of math.h, and about 1e-13 for pow.
+    Accurate
+};
+
+/**
+ * @brief The C source of the bundled math kernels.
+ *
+ * Each kernel evaluates one function over an array,
+ * `void kernel(int n, const double* in, double* out)`, in a loop without
+ * branches or calls that the compiler can vectorize with `#pragma omp simd`.
+ * The kernels reduce the argument with integer operations on the bits of
+ * the doubles, and evaluate a polynomial whose length depends on the
+ * accuracy. They agree with math.h on the special values, so log of zero is
+ * -inf and of a negative number is NaN, which the barrier relies on outside
+ * of the feasible region. sin and cos of arguments too large to reduce
+ * accurately fall back to math.h.
+ *
+ * pow takes the exponents as a second array,
+ * `void kernel(int n, const double* in, const double* exponent, double* out)`,
+ * and evaluates exp(y log|x|) with the log and exp kernels of the same
+ * accuracy, so the error grows with the size of y log(x). It then fixes up
+ * the sign for negative bases and odd integer exponents, and the special
+ * values where math.h returns NaN or 1 instead.
+ */
+class VectorMathKernels {
+ private:
+    /**
+     * @brief Print `c[0] + x * (c[1] + x * (...))`.
+     */
+    static std::string horner(const std::string& variable,
+                              const std::vector<double>& coefficients);
+
+    /**
+     * @brief The source of a kernel, without checking the function.
+     */
+    static std::string logSource(const std::string& name, bool accurate);
+    static std::string expSource(const std::string& name, bool accurate);
+    static std::string sinCosSource(const std::string& name, bool accurate,
+                                    bool cosine);
+    static std::string powSource(const std::string& name,
+                                 const std::string& logName,
+                                 const std::string& expName);
+
+ public:
+    /**
+     * @brief The math.h functions that have kernels. A kernel comes after
+     * the kernels it calls.
+     */
+    static const std::vector<std::string>& functions();
+
+    /**
+     * @brief The name of the kernel evaluating a function at the accuracy,
+     * e.g. `cppmpc_vlog_fast`. Throws if the function has no kernel or the
+     * accuracy is Off.
+     */
+    static std::string kernelName(const std::string& function,
+                                  VectorMath accuracy);
+
+    /**
+     * @brief The static C definition of a kernel. The pow kernel calls the
+     * log and exp kernels of the same accuracy, which are defined first.
+     */
+    static std::string kernelSource(const std::string& function,
+                                    VectorMath accuracy);
+
+    /**
+     * @brief The definitions of the kernels called by the given source, and
+     * the headers they need. Empty if it calls none.
+     */
+    static std::string prelude(const std::string& source);
+
+    /**
+     * @brief The definitions of the kernels called by any of the sources or
+     * named in kernels, and the headers they need.
+     */
+    static std::string prelude(const std::vector<std::string>& sources,
+                               const std::set<std::string>& kernels = {});
+};
+
+}  // namespace cppmpc
+
+#endif  // INCLUDE_VECTORMATH_H_
@@ -2,9 +2,12 @@
 #include <gtest/gtest.h>
 
 #include <dlfcn.h>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <optional>
 #include <sstream>
 #include <string>
 #include <tuple>
@@ -13,7 +16,9 @@
 #include <symengine/expression.h>
 
 #include "CodeGenerator.h"
+#include "CodeSink.h"
 #include "OrderedSet.h"
+#include "RuntimeCompiler.h"
 #include "SymEngineUtilities.h"
 #include "SymbolicEquality.h"
 #include "SymbolicInequality.h"
@@ -208,3 +213,308 @@ TEST(CodeGeneratorTests, SymbolicIniequality) {
 
     dlclose(sharedLib);
 }
+
+TEST(CodeGeneratorTests, RollsRepeatedStructure) {
+    const size_t n = 12;
+    std::vector<RCP<const Symbol>> x = variableVector("rolled", n);
+    Expression a = Expression(parameter("rolledOffset"));
+    OrderedSet variableOrdering(x.begin(), x.end());
+    OrderedSet parameterOrdering;
+    parameterOrdering.append(a);
+
+    // Every stage has the same structure, up to the indices
+    Expression objective(0);
+    for (size_t i = 0; i < n; i++) {
+        objective = objective + (Expression(x[i]) - a) * (Expression(x[i]) - a);
+    }
+
+    SparsityPattern gradientPattern;
+    SparsityPattern hessianPattern;
+    DenseMatrix gradientMat =
+            gradient(objective.get_basic(), variableOrdering, gradientPattern);
+    DenseMatrix hessianMat =
+            hessian(objective.get_basic(), variableOrdering, hessianPattern);
+
+    std::string value;
+    std::string grad;
+    std::string hess;
+    std::tie(value, grad, hess) = CodeGenerator::generateObjectiveFunctions(
+            objective.get_basic(), gradientMat, hessianMat, variableOrdering,
+            parameterOrdering, "value", "gradient", "hessian",
+            &gradientPattern, &hessianPattern);
+
+    // The gradient is a single loop rather than n assignments
+    EXPECT_NE(std::string::npos, grad.find("for (int i = 0; i < 12; i++)"));
+    EXPECT_EQ(std::string::npos, grad.find("out[11]"));
+
+    auto module = RuntimeCompiler::compile({value, grad, hess});
+    auto gradientFunction =
+            module->function<InequalityGradientFunction>("gradient");
+    auto hessianFunction =
+            module->function<InequalityHessianFunction>("hessian");
+
+    Eigen::VectorXd param(1);
+    param << 0.5;
+    Eigen::VectorXd state = Eigen::VectorXd::LinSpaced(n, 1.0, 12.0);
+    Eigen::VectorXd gradientOutput(n);
+    Eigen::MatrixXd hessianOutput(n, n);
+    (*gradientFunction)(state.data(), param.data(), gradientOutput.data());
+    (*hessianFunction)(state.data(), param.data(), hessianOutput.data());
+
+    Eigen::VectorXd expectedGradient =
+            2.0 * (state - Eigen::VectorXd::Constant(n, 0.5));
+    EXPECT_TRUE(gradientOutput.isApprox(expectedGradient, 1e-9));
+    EXPECT_TRUE(hessianOutput.isApprox(
+            2.0 * Eigen::MatrixXd::Identity(n, n), 1e-9));
+}
+
+TEST(CodeGeneratorTests, SplitsLargeFunctions) {
+    // A function with five assignments, and a small function
+    GeneratedFunction large;
+    large.name = "large";
+    large.inputs = {"state"};
+    large.zeroed = 5;
+    for (size_t i = 0; i < 5; i++) {
+        large.assignments.emplace_back(
+                i, mul(integer(2), symbol("state[" + std::to_string(i) + "]")));
+    }
+    GeneratedFunction small = CodeGenerator::verbatimFunction(
+            "void small(const double* state, double* out) {\n"
+            "out[0] = state[0];\n}\n");
+
+    // Three chunks of at most two assignments, each in its own file
+    std::vector<std::vector<GeneratedFunction>> units =
+            CodeGenerator::generateTranslationUnits({large, small}, 2);
+    ASSERT_EQ(4, units.size());
+    std::string caller = CodeGenerator::generateSource(units[0]);
+    EXPECT_NE(std::string::npos, caller.find("void small("));
+    EXPECT_NE(std::string::npos, caller.find("large_chunk2(state, out);"));
+    std::string chunk = CodeGenerator::generateSource(units[1]);
+    EXPECT_NE(std::string::npos,
+              chunk.find("void large_chunk0(const double* state, "
+                         "double* out) {"));
+    EXPECT_NE(std::string::npos, chunk.find("out[1] = "));
+    EXPECT_EQ(std::string::npos, chunk.find("out[2]"));
+
+    // Small enough, or not split at all
+    EXPECT_EQ(1, CodeGenerator::generateTranslationUnits({large}, 6).size());
+    EXPECT_EQ(1, CodeGenerator::generateTranslationUnits({large}, 0).size());
+
+    // The text of a function can't be split
+    EXPECT_EQ(1, CodeGenerator::generateTranslationUnits(
+                         {CodeGenerator::verbatimFunction(
+                                 CodeGenerator::generateFunctionCode(large))},
+                         1)
+                         .size());
+
+    // The chunks are compiled separately and linked into one library
+    cppmpc::CompileOptions options;
+    options.maxChunkAssignments = 2;
+    options.compileJobs = 2;
+    auto module = RuntimeCompiler::compile({large, small}, "", options);
+    typedef void (*StateFunction)(const double* state, double* out);
+    double state[] = {1, 2, 3, 4, 5};
+    double out[5] = {};
+    module->function<StateFunction>("large")(state, out);
+    for (size_t i = 0; i < 5; i++) {
+        EXPECT_EQ(2 * state[i], out[i]);
+    }
+}
+
+TEST(CodeGeneratorTests, BatchFunctions) {
+    // out[1 + i] = state[i] * param[0] is rolled into a loop
+    GeneratedFunction function;
+    function.name = "f";
+    function.inputs = {"state", "param"};
+    function.zeroed = 6;
+    RCP<const Basic> scale = symbol("param[0]");
+    for (size_t i = 0; i < 4; i++) {
+        function.assignments.emplace_back(
+                1 + i, mul(symbol("state[" + std::to_string(i) + "]"), scale));
+    }
+    function.assignments.emplace_back(0, sin(symbol("state[5]")));
+
+    GeneratedFunction batch = CodeGenerator::batchFunction(function);
+    std::string code = CodeGenerator::generateFunctionCode(batch);
+    EXPECT_NE(std::string::npos,
+              code.find("void f_batch(int count, "
+                        "const double* __restrict state, "
+                        "const double* __restrict param, "
+                        "double* __restrict out) {"));
+    // The batch loop is inside the rolled loop
+    EXPECT_NE(std::string::npos,
+              code.find("for (int i = 0; i < 4; i++) {\n"
+                        "#pragma omp simd\n"
+                        "for (int batch = 0; batch < count; batch++) {\n"
+                        "out[(1 + 1 * i) * count + batch] = "));
+    EXPECT_NE(std::string::npos,
+              code.find("out[(0) * count + batch] = "
+                        "sin(state[(5) * count + batch]);"));
+
+    // Only functions generated from assignments can be batched
+    EXPECT_THROW(CodeGenerator::batchFunction(
+                         CodeGenerator::verbatimFunction("void g() {}\n")),
+                 std::runtime_error);
+    GeneratedFunction local = function;
+    local.assignments.emplace_back(5, symbol("z"));
+    EXPECT_THROW(CodeGenerator::batchFunction(local), std::runtime_error);
+
+    // Element i of point k is at i * count + k
+    auto module = RuntimeCompiler::compile({function, batch});
+    typedef void (*BatchFunction)(int count, const double* state,
+                                  const double* param, double* out);
+    double state[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+    double param[] = {2, -1};
+    double out[12] = {};
+    module->function<BatchFunction>("f_batch")(2, state, param, out);
+    for (int k = 0; k < 2; k++) {
+        for (int i = 0; i < 4; i++) {
+            EXPECT_EQ(state[i * 2 + k] * param[k], out[(1 + i) * 2 + k]);
+        }
+        EXPECT_DOUBLE_EQ(std::sin(state[5 * 2 + k]), out[k]);
+        EXPECT_EQ(0, out[5 * 2 + k]);
+    }
+}
+
+TEST(CodeGeneratorTests, EqualityUpdateFunctions) {
+    Expression x = Expression(variable("x"));
+    Expression y = Expression(variable("y"));
+    Expression a = Expression(parameter("a"));
+    Expression b = Expression(parameter("b"));
+    OrderedSet variableOrdering = OrderedSet();
+    variableOrdering.append(x);
+    variableOrdering.append(y);
+    OrderedSet parameterOrdering = OrderedSet();
+    parameterOrdering.append(a);
+    parameterOrdering.append(b);
+
+    SymbolicEqualityConstraints constraints = SymbolicEqualityConstraints();
+    constraints.appendConstraint(a * x + a * b * y, b);
+    constraints.appendConstraint(x + 2 * y, 1);
+
+    std::vector<CodeGenerator::UpdateFunction> matrixUpdates;
+    std::vector<CodeGenerator::UpdateFunction> vectorUpdates;
+    std::vector<GeneratedFunction> functions =
+            CodeGenerator::buildSymbolicEqualityFunctions(
+                    constraints, variableOrdering, parameterOrdering,
+                    "equalityMatrix", "equalityVector", &matrixUpdates,
+                    &vectorUpdates);
+
+    // The entries depending on a, and on both a and b, and the constant
+    // depending on b. The second constraint never changes.
+    ASSERT_EQ(2, matrixUpdates.size());
+    EXPECT_EQ(std::vector<int>({0}), matrixUpdates[0].parameters);
+    EXPECT_EQ(std::vector<int>({0, 1}), matrixUpdates[1].parameters);
+    ASSERT_EQ(1, vectorUpdates.size());
+    EXPECT_EQ(std::vector<int>({1}), vectorUpdates[0].parameters);
+
+    for (const CodeGenerator::UpdateFunction& update : matrixUpdates) {
+        functions.push_back(update.function);
+    }
+    functions.push_back(vectorUpdates[0].function);
+    auto module = RuntimeCompiler::compile(functions, "", CompileOptions());
+
+    // Updating the entries depending on b gives the whole matrix for the new
+    // parameters
+    double before[] = {2.0, 3.0};
+    double after[] = {2.0, 5.0};
+    double updated[4];
+    double expected[4];
+    module->function<EqualityMatrixFunction>("equalityMatrix")(before,
+                                                               updated);
+    module->function<EqualityMatrixFunction>("equalityMatrix_update1")(
+            after, updated);
+    module->function<EqualityMatrixFunction>("equalityMatrix")(after,
+                                                               expected);
+    for (size_t i = 0; i < 4; i++) {
+        EXPECT_EQ(expected[i], updated[i]);
+    }
+
+    double updatedVector[2];
+    double expectedVector[2];
+    module->function<EqualityVectorFunction>("equalityVector")(before,
+                                                               updatedVector);
+    module->function<EqualityVectorFunction>("equalityVector_update0")(
+            after, updatedVector);
+    module->function<EqualityVectorFunction>("equalityVector")(after,
+                                                               expectedVector);
+    EXPECT_EQ(expectedVector[0], updatedVector[0]);
+    EXPECT_EQ(expectedVector[1], updatedVector[1]);
+}
+
+typedef void (*ObjectiveFunction)(const double* state, const double* param,
+                                  double* out);
+
+static std::string readFile(const std::string& path) {
+    std::ifstream file(path);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+TEST(CodeGeneratorTests, StreamedObjectiveSource) {
+    Expression x = Expression(variable("x"));
+    Expression y = Expression(variable("y"));
+    Expression a = Expression(parameter("a"));
+    OrderedSet variableOrdering = OrderedSet();
+    variableOrdering.append(x);
+    variableOrdering.append(y);
+    OrderedSet parameterOrdering = OrderedSet();
+    parameterOrdering.append(a);
+
+    // The seventh power is emitted with a helper
+    Expression objective =
+            a * SymEngine::pow(x, Expression(7)) + x * y + SymEngine::sin(y);
+    DenseMatrix gradientMat = cppmpc::gradient(objective, variableOrdering);
+    DenseMatrix hessianMat = cppmpc::hessian(objective, variableOrdering);
+
+    // The streamed functions are the same as the generated ones
+    std::string value;
+    std::string grad;
+    std::string hess;
+    std::tie(value, grad, hess) = CodeGenerator::generateObjectiveFunctions(
+            objective, gradientMat, hessianMat, variableOrdering,
+            parameterOrdering, "value", "gradient", "hessian");
+    StringSink sink;
+    CodeGenerator::writeSource(sink, {value, grad, hess});
+    EXPECT_EQ(CodeGenerator::generateSource({value, grad, hess}), sink.str());
+
+    std::string tempFileBase = std::tmpnam(nullptr);
+    std::string tempFile = tempFileBase + std::string(".cpp");
+    CodeGenerator::writeObjectiveSource(
+            tempFile, objective, gradientMat, hessianMat, variableOrdering,
+            parameterOrdering, "value", "gradient", "hessian");
+    for (const std::string& function : {value, grad, hess}) {
+        EXPECT_NE(std::string::npos, readFile(tempFile).find(function));
+    }
+
+    std::string tempSharedObject = tempFileBase + std::string(".so");
+    std::stringstream cmd;
+    cmd << CPP_COMPILER_PATH << " -shared " << tempFile << " -o "
+        << tempSharedObject;
+    ASSERT_EQ(0, std::system(cmd.str().c_str()));
+    void* sharedLib = dlopen(tempSharedObject.c_str(), RTLD_LAZY);
+    ASSERT_NE(nullptr, sharedLib) << dlerror();
+
+    ObjectiveFunction valueFunction =
+            (ObjectiveFunction)dlsym(sharedLib, "value");
+    ObjectiveFunction hessianFunction =
+            (ObjectiveFunction)dlsym(sharedLib, "hessian");
+    ASSERT_NE(nullptr, valueFunction);
+    ASSERT_NE(nullptr, hessianFunction);
+
+    double state[2] = {0.5, 2.0};
+    double param[1] = {3.0};
+    double out[4];
+    valueFunction(state, param, out);
+    EXPECT_NEAR(3.0 * std::pow(0.5, 7) + 1.0 + std::sin(2.0), out[0], 1e-12);
+    hessianFunction(state, param, out);
+    EXPECT_NEAR(3.0 * 42.0 * std::pow(0.5, 5), out[0], 1e-12);
+    EXPECT_NEAR(1.0, out[1], 1e-12);
+    EXPECT_NEAR(1.0, out[2], 1e-12);
+    EXPECT_NEAR(-std::sin(2.0), out[3], 1e-12);
+
+    dlclose(sharedLib);
+    std::remove(tempFile.c_str());
+    std::remove(tempSharedObject.c_str());
+}
@@ -0,0 +1,51 @@
+// Copyright 2021 Ian Ruh
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "CodeSink.h"
+
+using cppmpc::FileSink;
+using cppmpc::StringSink;
+
+TEST(CodeSinkTests, StringSink) {
+    StringSink sink;
+    sink << "out[" << static_cast<size_t>(3) << "] = "
+         << std::string("x") << ";\n";
+    EXPECT_EQ("out[3] = x;\n", sink.str());
+    EXPECT_EQ("out[3] = x;\n", sink.take());
+    EXPECT_EQ("", sink.str());
+}
+
+TEST(CodeSinkTests, FileSink) {
+    std::string path = std::string(std::tmpnam(nullptr)) + ".cpp";
+    std::string expected;
+    {
+        // Writes both smaller and larger than the buffer
+        FileSink sink(path, 8);
+        for (size_t i = 0; i < 100; i++) {
+            std::string entry = "out[" + std::to_string(i) + "] = x;\n";
+            sink << entry;
+            expected += entry;
+        }
+        std::string large(50, 'y');
+        sink << large;
+        expected += large;
+        EXPECT_EQ(expected.size(), sink.bytesWritten());
+        sink.close();
+        EXPECT_THROW(sink << "z", std::runtime_error);
+    }
+
+    std::ifstream file(path);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    EXPECT_EQ(expected, contents.str());
+    std::remove(path.c_str());
+
+    EXPECT_THROW(FileSink("/nonexistent-directory/source.cpp"),
+                 std::runtime_error);
+}
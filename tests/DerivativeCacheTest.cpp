@@ -0,0 +1,83 @@
+// Copyright 2021 Ian Ruh
+#include <gtest/gtest.h>
+#include <symengine/add.h>
+#include <symengine/basic.h>
+#include <symengine/derivative.h>
+#include <symengine/functions.h>
+#include <symengine/matrix.h>
+#include <symengine/mul.h>
+#include <symengine/symbol.h>
+
+#include "DerivativeCache.h"
+#include "OrderedSet.h"
+#include "SymEngineUtilities.h"
+
+TEST(DerivativeCacheTests, MatchesSymEngine) {
+    SymEngine::RCP<const SymEngine::Symbol> x = cppmpc::variable("x");
+    SymEngine::RCP<const SymEngine::Symbol> y = cppmpc::variable("y");
+    SymEngine::RCP<const SymEngine::Basic> expr = SymEngine::add(
+            SymEngine::mul(x, y),
+            SymEngine::add(SymEngine::sin(x), SymEngine::log(y)));
+
+    cppmpc::DerivativeCache cache;
+    EXPECT_TRUE(SymEngine::eq(*SymEngine::diff(expr, x),
+                              *cache.diff(expr, x)));
+    EXPECT_TRUE(SymEngine::eq(*SymEngine::diff(expr, y),
+                              *cache.diff(expr, y)));
+}
+
+TEST(DerivativeCacheTests, SharedTerms) {
+    SymEngine::RCP<const SymEngine::Symbol> x = cppmpc::variable("x");
+    SymEngine::RCP<const SymEngine::Symbol> y = cppmpc::variable("y");
+    SymEngine::RCP<const SymEngine::Basic> first = SymEngine::sin(x);
+    SymEngine::RCP<const SymEngine::Basic> second =
+            SymEngine::log(SymEngine::mul(x, y));
+
+    cppmpc::DerivativeCache cache;
+    cache.diff(SymEngine::add(first, second), x);
+    size_t cached = cache.size();
+
+    // Only the new sum and its new term are differentiated
+    SymEngine::RCP<const SymEngine::Basic> third = SymEngine::cos(y);
+    cache.diff(SymEngine::add({first, second, third}), x);
+    EXPECT_EQ(cached + 2, cache.size());
+}
+
+TEST(DerivativeCacheTests, Generations) {
+    SymEngine::RCP<const SymEngine::Symbol> x = cppmpc::variable("x");
+    SymEngine::RCP<const SymEngine::Basic> kept = SymEngine::sin(x);
+    SymEngine::RCP<const SymEngine::Basic> dropped = SymEngine::cos(x);
+
+    cppmpc::DerivativeCache cache;
+    cache.diff(kept, x);
+    cache.diff(dropped, x);
+    EXPECT_EQ(2, cache.size());
+
+    // Entries that aren't used for a whole generation are dropped
+    cache.nextGeneration();
+    cache.diff(kept, x);
+    cache.nextGeneration();
+    EXPECT_EQ(1, cache.size());
+}
+
+TEST(DerivativeCacheTests, ActiveScope) {
+    SymEngine::RCP<const SymEngine::Symbol> x = cppmpc::variable("x");
+    SymEngine::RCP<const SymEngine::Symbol> y = cppmpc::variable("y");
+    cppmpc::OrderedSet variableOrdering;
+    variableOrdering.append(x);
+    variableOrdering.append(y);
+    SymEngine::RCP<const SymEngine::Basic> expr =
+            SymEngine::mul(SymEngine::sin(x), y);
+
+    cppmpc::DerivativeCache cache;
+    SymEngine::DenseMatrix uncached = cppmpc::hessian(expr, variableOrdering);
+    {
+        cppmpc::DerivativeCache::Scope scope(cache);
+        EXPECT_EQ(&cache, cppmpc::DerivativeCache::active());
+        SymEngine::DenseMatrix cached =
+                cppmpc::hessian(expr, variableOrdering);
+        EXPECT_TRUE(uncached.eq(cached));
+    }
+    EXPECT_EQ(nullptr, cppmpc::DerivativeCache::active());
+    EXPECT_LT(0, cache.size());
+}
@@ -63,3 +63,61 @@ TEST(SymbolicEqualityTests, BasicLinearization) {
     EXPECT_TRUE(mat == expectedMat);
     EXPECT_TRUE(vector == expectedVector);
 }
+
+TEST(SymbolicEqualityTests, SparseLinearization) {
+    // Variables
+    Expression x = Expression(variable("x"));
+    Expression y = Expression(variable("y"));
+    Expression z = Expression(variable("z"));
+
+    // Parameter
+    Expression a = Expression(parameter("a"));
+
+    OrderedSet ordering = OrderedSet();
+    ordering.append(z);
+    ordering.append(y);
+    ordering.append(x);
+
+    SymbolicEqualityConstraints constraints = SymbolicEqualityConstraints();
+    constraints.appendConstraint(x, 3 * y + 4);
+    constraints.appendConstraint(a * z, 7);
+
+    std::vector<SymbolicTriplet> entries;
+    std::vector<RCP<const Basic>> vector;
+    std::tie(entries, vector) =
+            constraints.convertToSparseLinearSystem(ordering);
+
+    // Only the non-zero entries are returned
+    ASSERT_EQ(3, entries.size());
+    for (const SymbolicTriplet& entry : entries) {
+        if (entry.row == 0 && entry.col == 1) {
+            EXPECT_TRUE(eq(*expand(entry.value), *integer(-3)));
+        } else if (entry.row == 0 && entry.col == 2) {
+            EXPECT_TRUE(eq(*expand(entry.value), *integer(1)));
+        } else {
+            EXPECT_EQ(1, entry.row);
+            EXPECT_EQ(0, entry.col);
+            EXPECT_TRUE(eq(*expand(entry.value), *a.get_basic()));
+        }
+    }
+
+    ASSERT_EQ(2, vector.size());
+    EXPECT_TRUE(eq(*expand(vector[0]), *integer(4)));
+    EXPECT_TRUE(eq(*expand(vector[1]), *integer(7)));
+}
+
+TEST(SymbolicEqualityTests, NonlinearThrows) {
+    Expression x = Expression(variable("x"));
+    Expression y = Expression(variable("y"));
+
+    OrderedSet ordering = OrderedSet();
+    ordering.append(x);
+    ordering.append(y);
+
+    SymbolicEqualityConstraints constraints = SymbolicEqualityConstraints();
+    constraints.appendConstraint(x, 1);
+    constraints.appendConstraint(x * y, 1);
+
+    EXPECT_THROW(constraints.convertToSparseLinearSystem(ordering),
+                 std::runtime_error);
+}
@@ -0,0 +1,131 @@
+// Copyright 2021 Ian Ruh
+#include <gtest/gtest.h>
+
+#include <symengine/basic.h>
+#include <symengine/constants.h>
+#include <symengine/expression.h>
+
+#include <cmath>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <Eigen/Dense>
+#include "ExpressionEmitter.h"
+#include "OrderedSet.h"
+#include "SymEngineUtilities.h"
+#include "SymbolicObjective.h"
+
+using cppmpc::ExpressionEmitter;
+using cppmpc::OperationCount;
+using SymEngine::Expression;
+
+TEST(ExpressionEmitterTests, StrengthReduction) {
+    Expression x(SymEngine::symbol("x"));
+    Expression y(SymEngine::symbol("y"));
+
+    EXPECT_EQ("x*x", ExpressionEmitter::code(x * x));
+    EXPECT_EQ("1.0/(x*x*x)", ExpressionEmitter::code(1 / (x * x * x)));
+    EXPECT_EQ("cppmpc_powi(x, 7)",
+              ExpressionEmitter::code(SymEngine::pow(x, Expression(7))));
+    Expression sinX(SymEngine::sin(x));
+    EXPECT_EQ("cppmpc_powi(sin(x), 2)", ExpressionEmitter::code(sinX * sinX));
+    EXPECT_EQ("sqrt(x)", ExpressionEmitter::code(SymEngine::sqrt(x)));
+    EXPECT_EQ("y/sqrt(x)", ExpressionEmitter::code(y / SymEngine::sqrt(x)));
+    EXPECT_EQ("exp(x)", ExpressionEmitter::code(SymEngine::exp(x)));
+
+    // Only the helpers that are called are defined
+    EXPECT_EQ("", ExpressionEmitter::prelude("out[0] = x*x;"));
+    EXPECT_NE(std::string::npos,
+              ExpressionEmitter::prelude("out[0] = cppmpc_powi(x, 7);")
+                      .find("static inline double cppmpc_powi("));
+}
+
+TEST(ExpressionEmitterTests, ConstantsAndSigns) {
+    Expression x(SymEngine::symbol("x"));
+    Expression y(SymEngine::symbol("y"));
+    Expression pi(SymEngine::pi);
+
+    // Constant factors are folded into one literal
+    EXPECT_EQ("6.2831853071795862*x", ExpressionEmitter::code(2 * pi * x));
+    EXPECT_EQ("0.5", ExpressionEmitter::code(Expression(1) / 2));
+    EXPECT_EQ("1.0", ExpressionEmitter::code(SymEngine::sin(pi / 2)));
+    std::string difference = ExpressionEmitter::code(x - 2 * y);
+    EXPECT_TRUE(difference == "x - 2.0*y" || difference == "-2.0*y + x")
+            << difference;
+    EXPECT_EQ("-x/y", ExpressionEmitter::code(-x / y));
+}
+
+TEST(ExpressionEmitterTests, HornerForm) {
+    Expression x(SymEngine::symbol("x"));
+    Expression y(SymEngine::symbol("y"));
+    Expression z(SymEngine::symbol("z"));
+
+    RCP<const Basic> factored =
+            ExpressionEmitter::hornerForm(x * y + x * z + x);
+    EXPECT_TRUE(SymEngine::eq(*factored, *(x * (1 + y + z)).get_basic()));
+
+    Expression polynomial = 3 * x * x * x + 2 * x * x + x + 5;
+    RCP<const Basic> horner = ExpressionEmitter::hornerForm(polynomial);
+    EXPECT_TRUE(SymEngine::eq(*horner,
+                              *(5 + x * (1 + x * (2 + 3 * x))).get_basic()));
+    EXPECT_LT(ExpressionEmitter::operations(horner).total(),
+              ExpressionEmitter::operations(polynomial).total());
+}
+
+TEST(ExpressionEmitterTests, ChooseExpansion) {
+    Expression x(SymEngine::symbol("x"));
+    Expression y(SymEngine::symbol("y"));
+    Expression z(SymEngine::symbol("z"));
+
+    // Expanding multiplies a product of sums out into eight terms
+    Expression product = (1 + x) * (1 + y) * (1 + z);
+    EXPECT_TRUE(SymEngine::eq(*ExpressionEmitter::optimize(product),
+                              *product.get_basic()));
+
+    // But cancels terms here
+    Expression cancels = x * (x + 1) - x * x;
+    EXPECT_TRUE(SymEngine::eq(*ExpressionEmitter::optimize(cancels),
+                              *x.get_basic()));
+}
+
+TEST(ExpressionEmitterTests, OperationReport) {
+    std::vector<RCP<const SymEngine::Symbol>> x =
+            cppmpc::variableVector("x", 3);
+    Expression a(cppmpc::parameter("a"));
+    cppmpc::OrderedSet variableOrdering(x.begin(), x.end());
+    cppmpc::OrderedSet parameterOrdering;
+    parameterOrdering.append(a);
+
+    // A product of sums, like linearized dynamics
+    Expression x0(x[0]);
+    Expression x1(x[1]);
+    Expression x2(x[2]);
+    cppmpc::FastMPC::SymbolicObjective objective;
+    EXPECT_THROW(objective.operationReport(), std::runtime_error);
+    objective.setObjective((x0 + a) * (x1 + a) * (x2 + a) + x0 * x0 * x1 +
+                           SymEngine::cos(x2) * SymEngine::cos(x2));
+    objective.finalize(variableOrdering, parameterOrdering);
+    Eigen::VectorXd param(1);
+    param << 0.5;
+    objective.setParameters(param);
+
+    Eigen::VectorXd state(3);
+    state << 0.3, -0.2, 0.7;
+    double expected = (0.3 + 0.5) * (-0.2 + 0.5) * (0.7 + 0.5) +
+                      0.3 * 0.3 * -0.2 + std::cos(0.7) * std::cos(0.7);
+    EXPECT_NEAR(expected, objective.value(state), 1e-12);
+    Eigen::Vector3d gradient(
+            (-0.2 + 0.5) * (0.7 + 0.5) + 2 * 0.3 * -0.2,
+            (0.3 + 0.5) * (0.7 + 0.5) + 0.3 * 0.3,
+            (0.3 + 0.5) * (-0.2 + 0.5) - 2 * std::cos(0.7) * std::sin(0.7));
+    EXPECT_TRUE(gradient.isApprox(objective.gradient(state), 1e-12));
+
+    std::map<std::string, OperationCount> report = objective.operationReport();
+    ASSERT_EQ(1, report.count("value"));
+    ASSERT_EQ(1, report.count("hessian"));
+    EXPECT_EQ(0, report["value"].divisions);
+    EXPECT_LT(0, report["value"].multiplications);
+    EXPECT_EQ(0, report["equalityMatrix"].total());
+}
@@ -0,0 +1,121 @@
+// Copyright 2021 Ian Ruh
+#include <gtest/gtest.h>
+
+#include <symengine/basic.h>
+#include <symengine/expression.h>
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include <Eigen/Dense>
+#include "ExpressionTape.h"
+#include "FastMPC.h"
+#include "OrderedSet.h"
+#include "RuntimeCompiler.h"
+#include "SymEngineUtilities.h"
+#include "SymbolicObjective.h"
+
+using cppmpc::ExpressionTape;
+
+TEST(ExpressionTapeTests, Evaluate) {
+    // out = [0, sin(state[0]) * param[0] + weight[0], sqrt(state[1])]
+    ExpressionTape tape;
+    uint32_t x = tape.load(ExpressionTape::Input::State, 0);
+    uint32_t y = tape.load(ExpressionTape::Input::State, 1);
+    uint32_t a = tape.load(ExpressionTape::Input::Parameter, 0);
+    uint32_t w = tape.load(ExpressionTape::Input::Weight, 0);
+    uint32_t sinX = tape.apply(ExpressionTape::Op::Sin, x);
+    uint32_t sum = tape.apply(ExpressionTape::Op::Add,
+                              tape.apply(ExpressionTape::Op::Mul, sinX, a), w);
+    tape.setOutputSize(3);
+    tape.assign(1, sum);
+    tape.assign(2, tape.apply(ExpressionTape::Op::Sqrt, y));
+    EXPECT_THROW(tape.assign(3, sum), std::out_of_range);
+
+    // Evaluating before finishing would read unresolved handles
+    double state[] = {0.5, 4.0};
+    double param[] = {2.0};
+    double weight[] = {-1.0};
+    double out[] = {7.0, 7.0, 7.0};
+    EXPECT_THROW(tape.evaluate(state, param, weight, out), std::runtime_error);
+
+    tape.finish();
+    EXPECT_EQ(4, tape.numInstructions());
+    tape.evaluate(state, param, weight, out);
+    EXPECT_EQ(0.0, out[0]);
+    EXPECT_DOUBLE_EQ(std::sin(0.5) * 2.0 - 1.0, out[1]);
+    EXPECT_DOUBLE_EQ(2.0, out[2]);
+
+    // Operands have to exist when the instruction is added
+    ExpressionTape invalid;
+    EXPECT_THROW(invalid.apply(ExpressionTape::Op::Neg, 0), std::runtime_error);
+}
+
+TEST(ExpressionTapeTests, InterpretedObjectiveMatchesCompiled) {
+    SymEngine::Expression x = SymEngine::Expression(cppmpc::variable("x"));
+    SymEngine::Expression y = SymEngine::Expression(cppmpc::variable("y"));
+    SymEngine::Expression r = SymEngine::Expression(cppmpc::parameter("r"));
+
+    cppmpc::OrderedSet variableOrdering;
+    variableOrdering.append(x);
+    variableOrdering.append(y);
+    cppmpc::OrderedSet parameterOrdering;
+    parameterOrdering.append(r);
+
+    for (cppmpc::FastMPC::BarrierMode mode :
+         {cppmpc::FastMPC::BarrierMode::Symbolic,
+          cppmpc::FastMPC::BarrierMode::Structured}) {
+        cppmpc::FastMPC::SymbolicObjective compiled;
+        cppmpc::FastMPC::SymbolicObjective interpreted;
+        interpreted.compileOptions.backend =
+                cppmpc::CompilerBackend::Interpreter;
+        for (cppmpc::FastMPC::SymbolicObjective* objective :
+             {&compiled, &interpreted}) {
+            objective->barrierMode = mode;
+            // Stay inside a circle, above a line, and below a bound
+            objective->inequalityConstraints.appendLessThan(x * x + y * y,
+                                                            r * r);
+            objective->inequalityConstraints.appendGreaterThan(y, x - 1.0);
+            objective->inequalityConstraints.appendLessThan(y, r);
+            objective->equalityConstraints.appendConstraint(x + y, r / 3.0);
+            SymEngine::Expression shifted = y - 2.0;
+            objective->setObjective(
+                    SymEngine::exp(x) + shifted * shifted * shifted * shifted +
+                    SymEngine::sqrt(1.0 + x * x));
+            objective->finalize(variableOrdering, parameterOrdering);
+
+            Eigen::VectorXd param(1);
+            param << 3.0;
+            objective->setParameters(param);
+        }
+        EXPECT_EQ(cppmpc::CompilationTier::Interpreted,
+                  interpreted.compilationTier());
+        EXPECT_THROW(interpreted.exportObjective("unused"),
+                     std::runtime_error);
+
+        Eigen::VectorXd state(2);
+        state << 0.5, 0.25;
+        EXPECT_NEAR(compiled.value(state), interpreted.value(state), 1e-9);
+        EXPECT_TRUE(compiled.gradient(state).isApprox(
+                interpreted.gradient(state), 1e-9));
+        EXPECT_TRUE(compiled.hessian(state).isApprox(
+                interpreted.hessian(state), 1e-9));
+        EXPECT_NEAR(compiled.inequalityConstraintsValue(state),
+                    interpreted.inequalityConstraintsValue(state), 1e-9);
+        EXPECT_TRUE(compiled.inequalityConstraintsGradient(state).isApprox(
+                interpreted.inequalityConstraintsGradient(state), 1e-9));
+        EXPECT_TRUE(compiled.inequalityConstraintsHessian(state).isApprox(
+                interpreted.inequalityConstraintsHessian(state), 1e-9));
+
+        Eigen::VectorXd startPrimal(2);
+        startPrimal << 0.5, 0.5;
+        cppmpc::FastMPC::Solver compiledSolver(compiled);
+        cppmpc::FastMPC::Solver interpretedSolver(interpreted);
+        auto [compiledMinimum, compiledPrimal, compiledDual] =
+                compiledSolver.minimize(startPrimal);
+        auto [minimum, primal, dual] = interpretedSolver.minimize(startPrimal);
+        EXPECT_NEAR(compiledMinimum, minimum, 1e-6);
+        EXPECT_TRUE(compiledPrimal.isApprox(primal, 1e-6));
+    }
+}
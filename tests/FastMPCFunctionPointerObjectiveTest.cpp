@@ -5,6 +5,7 @@
 #include <cmath>
 #include <iostream>
 #include <optional>
+#include <vector>
 
 #include "FastMPC.h"
 #include "FastMPCFunctionPointerObjective.h"
@@ -108,3 +109,60 @@ TEST(FastMPCTests, FunctionPointerObjective) {
     EXPECT_NEAR(3, primal(0), 1e-2);
     EXPECT_NEAR(2, primal(1), 1e-2);
 }
+
+TEST(FastMPCTests, EqualityUpdateFunctions) {
+    // x[0] * param[0] + x[1] == param[1]
+    FastMPC::FunctionPointerObjective objective =
+            FastMPC::FunctionPointerObjective(2, 0, 1, 2);
+    int fullEvaluations = 0;
+    int matrixUpdates = 0;
+    int vectorUpdates = 0;
+    objective.setEqualityMatrixFunction([&](const double* param, double* out) {
+        fullEvaluations++;
+        out[0] = param[0];
+        out[1] = 1.0;
+    });
+    objective.setEqualityVectorFunction(
+            [](const double* param, double* out) { out[0] = param[1]; });
+    std::vector<FastMPC::DependentUpdate> matrix = {
+            {{0}, [&](const double* param, double* out) {
+                 matrixUpdates++;
+                 out[0] = param[0];
+             }}};
+    std::vector<FastMPC::DependentUpdate> vector = {
+            {{1}, [&](const double* param, double* out) {
+                 vectorUpdates++;
+                 out[0] = param[1];
+             }}};
+    objective.setEqualityUpdateFunctions(matrix, vector);
+
+    Eigen::VectorXd param(2);
+    param << 3.0, 4.0;
+    objective.setParameters(param);
+    Eigen::MatrixXd expectedMatrix(1, 2);
+    expectedMatrix << 3.0, 1.0;
+    EXPECT_EQ(expectedMatrix, *objective.equalityConstraintMatrix());
+    EXPECT_EQ(4.0, (*objective.equalityConstraintVector())(0));
+    EXPECT_EQ(1, fullEvaluations);
+
+    // Unchanged parameters are cached
+    objective.equalityConstraintMatrix();
+    EXPECT_EQ(1, fullEvaluations);
+    EXPECT_EQ(0, matrixUpdates + vectorUpdates);
+
+    // Only the vector depends on the second parameter
+    param << 3.0, 5.0;
+    objective.setParameters(param);
+    EXPECT_EQ(expectedMatrix, *objective.equalityConstraintMatrix());
+    EXPECT_EQ(5.0, (*objective.equalityConstraintVector())(0));
+    EXPECT_EQ(0, matrixUpdates);
+    EXPECT_EQ(1, vectorUpdates);
+
+    param << 6.0, 5.0;
+    objective.setParameters(param);
+    expectedMatrix << 6.0, 1.0;
+    EXPECT_EQ(expectedMatrix, *objective.equalityConstraintMatrix());
+    EXPECT_EQ(1, fullEvaluations);
+    EXPECT_EQ(1, matrixUpdates);
+    EXPECT_EQ(1, vectorUpdates);
+}
@@ -0,0 +1,138 @@
+// Copyright 2021 Ian Ruh
+#include <gtest/gtest.h>
+
+#include <symengine/add.h>
+#include <symengine/basic.h>
+#include <symengine/expression.h>
+#include <symengine/functions.h>
+#include <symengine/mul.h>
+
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "FinalizeProfiler.h"
+#include "OrderedSet.h"
+#include "SymEngineUtilities.h"
+#include "SymbolicObjective.h"
+
+using cppmpc::FinalizeProfiler;
+using cppmpc::FinalizeReport;
+
+TEST(FinalizeProfilerTests, CountNodes) {
+    SymEngine::RCP<const SymEngine::Symbol> x = cppmpc::variable("x");
+    SymEngine::RCP<const SymEngine::Symbol> y = cppmpc::variable("y");
+    SymEngine::RCP<const SymEngine::Basic> sinX = SymEngine::sin(x);
+
+    // x, y, sin(x), and the sum
+    EXPECT_EQ(4, FinalizeProfiler::countNodes({SymEngine::add(sinX, y)}));
+    // Shared subexpressions are only counted once
+    EXPECT_EQ(5, FinalizeProfiler::countNodes(
+                         {SymEngine::add(sinX, y), SymEngine::mul(sinX, y)}));
+}
+
+TEST(FinalizeProfilerTests, NestedPhases) {
+    FinalizeProfiler profiler;
+    {
+        // Nothing is recorded without an active profiler
+        FinalizeProfiler::Phase ignored("ignored");
+    }
+    {
+        FinalizeProfiler::Scope scope(profiler);
+        EXPECT_EQ(&profiler, FinalizeProfiler::active());
+        FinalizeProfiler::Phase outer("outer");
+        for (int i = 0; i < 2; i++) {
+            FinalizeProfiler::Phase inner("inner");
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+    EXPECT_EQ(nullptr, FinalizeProfiler::active());
+
+    FinalizeReport report = profiler.finish();
+    ASSERT_EQ(2, report.phases.size());
+    EXPECT_EQ("inner", report.phases[0].name);
+    EXPECT_EQ(2, report.phases[0].calls);
+    EXPECT_LE(0.04, report.phases[0].seconds);
+    // The time of the nested phases is left out of the outer one
+    EXPECT_EQ("outer", report.phases[1].name);
+    EXPECT_GT(0.02, report.phases[1].seconds);
+    EXPECT_LE(report.phases[0].seconds + report.phases[1].seconds,
+              report.totalSeconds);
+}
+
+TEST(FinalizeProfilerTests, Json) {
+    FinalizeReport report;
+    report.totalSeconds = 1.5;
+    report.phases.push_back({"generate", 0.25, 3});
+    report.transforms.push_back({"optimize", 10, 7, 2});
+    report.sourceBytes["hessian"] = 120;
+    report.objectBytes = 4096;
+
+    std::string json = report.toJson();
+    EXPECT_NE(std::string::npos, json.find("\"totalSeconds\": 1.5"));
+    EXPECT_NE(std::string::npos,
+              json.find("{\"name\": \"generate\", \"seconds\": 0.25, "
+                        "\"calls\": 3}"));
+    EXPECT_NE(std::string::npos,
+              json.find("\"nodesBefore\": 10, \"nodesAfter\": 7"));
+    EXPECT_NE(std::string::npos, json.find("\"hessian\": 120"));
+    EXPECT_NE(std::string::npos, json.find("\"objectBytes\": 4096"));
+    EXPECT_EQ("{", json.substr(0, 1));
+}
+
+TEST(FinalizeProfilerTests, ProfiledFinalize) {
+    SymEngine::Expression x(cppmpc::variable("x"));
+    SymEngine::Expression y(cppmpc::variable("y"));
+    SymEngine::Expression a(cppmpc::parameter("a"));
+    cppmpc::OrderedSet variableOrdering;
+    variableOrdering.append(x);
+    variableOrdering.append(y);
+    cppmpc::OrderedSet parameterOrdering;
+    parameterOrdering.append(a);
+
+    cppmpc::FastMPC::SymbolicObjective objective;
+    objective.setObjective(a * x * x + SymEngine::exp(x * y));
+    objective.equalityConstraints.appendConstraint(x + y, a);
+    objective.inequalityConstraints.appendLessThan(x * x + y * y, 4.0);
+    objective.finalize(variableOrdering, parameterOrdering);
+    EXPECT_THROW(objective.finalizeReport(), std::runtime_error);
+
+    objective.profileFinalize = true;
+    objective.finalize(variableOrdering, parameterOrdering);
+    FinalizeReport report = objective.finalizeReport();
+
+    // The parts were generated by the first finalize, so only compiling and
+    // loading are left
+    bool compiled = false;
+    for (const cppmpc::PhaseTiming& phase : report.phases) {
+        EXPECT_NE("differentiate", phase.name);
+        compiled = compiled || phase.name == "load";
+    }
+    EXPECT_TRUE(compiled);
+    EXPECT_LT(0, report.objectBytes);
+    ASSERT_EQ(1, report.sourceBytes.count("hessian"));
+    EXPECT_LT(0, report.sourceBytes["hessian"]);
+
+    // A new objective is differentiated and generated from scratch
+    cppmpc::FastMPC::SymbolicObjective fresh;
+    fresh.profileFinalize = true;
+    fresh.setObjective(a * x * x * x + SymEngine::exp(x * y));
+    fresh.finalize(variableOrdering, parameterOrdering);
+    report = fresh.finalizeReport();
+    bool differentiated = false;
+    bool generated = false;
+    for (const cppmpc::PhaseTiming& phase : report.phases) {
+        differentiated = differentiated || phase.name == "differentiate";
+        generated = generated || phase.name == "generate";
+    }
+    EXPECT_TRUE(differentiated);
+    EXPECT_TRUE(generated);
+    bool optimized = false;
+    for (const cppmpc::TransformSize& transform : report.transforms) {
+        EXPECT_LT(0, transform.nodesBefore);
+        optimized = optimized || transform.name == "optimize";
+    }
+    EXPECT_TRUE(optimized);
+    EXPECT_NE(std::string::npos, report.toJson().find("\"differentiate\""));
+}
@@ -0,0 +1,155 @@
+// Copyright 2021 Ian Ruh
+#include <gtest/gtest.h>
+
+#include <symengine/basic.h>
+#include <symengine/expression.h>
+
+#include <Eigen/Dense>
+#include <vector>
+#include "FastMPC.h"
+#include "HorizonObjective.h"
+#include "OrderedSet.h"
+#include "SymEngineUtilities.h"
+#include "SymbolicObjective.h"
+
+using SymEngine::Expression;
+
+namespace {
+
+const size_t numStages = 3;
+
+/**
+ * @brief A 1D integrator x_{k+1} = x_k + u_k starting at g, with the control
+ * bounded below by a stage parameter.
+ */
+void buildHorizon(cppmpc::FastMPC::HorizonObjective* horizon) {
+    auto x = cppmpc::variable("horizonX");
+    auto xn = cppmpc::variable("horizonXNext");
+    auto u = cppmpc::variable("horizonU");
+    auto p = cppmpc::parameter("horizonP");
+    auto g = cppmpc::parameter("horizonG");
+
+    horizon->setState({x}, {xn});
+    horizon->setControl({u});
+    horizon->setStageParameters({p});
+    horizon->setGlobalParameters({g});
+
+    horizon->setStageCost(Expression(x) * Expression(x) +
+                          Expression(u) * Expression(u));
+    horizon->appendDynamicsConstraint(Expression(xn),
+                                      Expression(x) + Expression(u));
+    horizon->setInitialState({Expression(g)});
+    horizon->stageInequalityConstraints.appendGreaterThan(Expression(u),
+                                                          -Expression(p));
+    horizon->finalize();
+}
+
+/**
+ * @brief The same problem as buildHorizon, with every stage written out.
+ */
+void buildUnrolled(cppmpc::FastMPC::SymbolicObjective* objective) {
+    auto x = cppmpc::variableVector("unrolledX", numStages);
+    auto u = cppmpc::variableVector("unrolledU", numStages);
+    auto p = cppmpc::parameterVector("unrolledP", numStages);
+    auto g = cppmpc::parameter("unrolledG");
+
+    cppmpc::OrderedSet variableOrdering;
+    cppmpc::OrderedSet parameterOrdering;
+    parameterOrdering.append(g);
+    Expression cost(0);
+    for (size_t k = 0; k < numStages; k++) {
+        variableOrdering.append(x[k]);
+        variableOrdering.append(u[k]);
+        parameterOrdering.append(p[k]);
+
+        cost = cost + Expression(x[k]) * Expression(x[k]) +
+               Expression(u[k]) * Expression(u[k]);
+        if (k + 1 < numStages) {
+            objective->equalityConstraints.appendConstraint(
+                    Expression(x[k + 1]), Expression(x[k]) + Expression(u[k]));
+        }
+        objective->inequalityConstraints.appendGreaterThan(Expression(u[k]),
+                                                           -Expression(p[k]));
+    }
+    objective->equalityConstraints.insertConstraint(0, Expression(x[0]),
+                                                    Expression(g));
+    objective->setObjective(cost);
+    objective->finalize(variableOrdering, parameterOrdering);
+}
+
+}  // namespace
+
+TEST(HorizonObjectiveTests, Layout) {
+    cppmpc::FastMPC::HorizonObjective horizon(numStages);
+    buildHorizon(&horizon);
+
+    EXPECT_EQ(6, horizon.numVariables());
+    EXPECT_EQ(4, horizon.numParameters());
+    EXPECT_EQ(3, horizon.numEqualityConstraints());
+    EXPECT_EQ(3, horizon.numInequalityConstraints());
+
+    EXPECT_EQ(4, horizon.stateIndex(2, 0));
+    EXPECT_EQ(3, horizon.controlIndex(1, 0));
+    EXPECT_EQ(0, horizon.globalParameterIndex(0));
+    EXPECT_EQ(3, horizon.stageParameterIndex(2, 0));
+    EXPECT_THROW(horizon.stateIndex(3, 0), std::out_of_range);
+}
+
+TEST(HorizonObjectiveTests, LoopedFunctions) {
+    cppmpc::FastMPC::HorizonObjective horizon(numStages);
+    buildHorizon(&horizon);
+
+    Eigen::VectorXd param(4);
+    param << 2.0, 0.5, 0.5, 0.5;
+    horizon.setParameters(param);
+
+    Eigen::VectorXd state(6);
+    state << 1.0, 2.0, 3.0, 4.0, 5.0, 6.0;
+    EXPECT_NEAR(91.0, horizon.value(state), 1e-9);
+    EXPECT_TRUE(horizon.gradient(state).isApprox(2.0 * state, 1e-9));
+    EXPECT_TRUE(horizon.hessian(state).isApprox(
+            2.0 * Eigen::MatrixXd::Identity(6, 6), 1e-9));
+
+    Eigen::MatrixXd expectedMatrix(3, 6);
+    expectedMatrix << 1, 0, 0, 0, 0, 0,
+                      -1, -1, 1, 0, 0, 0,
+                      0, 0, -1, -1, 1, 0;
+    EXPECT_TRUE(horizon.equalityConstraintMatrix()->isApprox(expectedMatrix));
+
+    Eigen::VectorXd expectedVector(3);
+    expectedVector << 2.0, 0.0, 0.0;
+    EXPECT_TRUE(horizon.equalityConstraintVector()->isApprox(expectedVector));
+}
+
+TEST(HorizonObjectiveTests, MatchesUnrolled) {
+    cppmpc::FastMPC::HorizonObjective horizon(numStages);
+    buildHorizon(&horizon);
+    cppmpc::FastMPC::SymbolicObjective unrolled;
+    buildUnrolled(&unrolled);
+
+    Eigen::VectorXd param(4);
+    param << 2.0, 0.5, 0.5, 0.5;
+    horizon.setParameters(param);
+    unrolled.setParameters(param);
+
+    Eigen::VectorXd state(6);
+    state << 1.0, 0.2, -0.5, 0.3, 0.4, -0.1;
+    EXPECT_NEAR(unrolled.inequalityConstraintsValue(state),
+                horizon.inequalityConstraintsValue(state), 1e-9);
+    EXPECT_TRUE(unrolled.inequalityConstraintsGradient(state).isApprox(
+            horizon.inequalityConstraintsGradient(state), 1e-9));
+    EXPECT_TRUE(unrolled.inequalityConstraintsHessian(state).isApprox(
+            horizon.inequalityConstraintsHessian(state), 1e-9));
+
+    Eigen::VectorXd startPrimal = Eigen::VectorXd::Zero(6);
+    cppmpc::FastMPC::Solver horizonSolver(horizon);
+    auto [horizonMinimum, horizonPrimal, horizonDual] =
+            horizonSolver.minimize(startPrimal);
+    cppmpc::FastMPC::Solver unrolledSolver(unrolled);
+    auto [unrolledMinimum, unrolledPrimal, unrolledDual] =
+            unrolledSolver.minimize(startPrimal);
+
+    EXPECT_NEAR(unrolledMinimum, horizonMinimum, 1e-2);
+    EXPECT_TRUE(unrolledPrimal.isApprox(horizonPrimal, 1e-2));
+    EXPECT_NEAR(2.0, horizonPrimal(0), 1e-2);
+}
@@ -0,0 +1,58 @@
+// Copyright 2021 Ian Ruh
+#include <gtest/gtest.h>
+
+#include <symengine/add.h>
+#include <symengine/basic.h>
+#include <symengine/expression.h>
+#include <symengine/integer.h>
+#include <symengine/mul.h>
+#include <symengine/symbol.h>
+
+#include "OrderedSet.h"
+#include "SymEngineUtilities.h"
+#include "SymbolicInequality.h"
+
+using namespace SymEngine;
+using namespace cppmpc;
+
+TEST(SymbolicInequalityTests, Classification) {
+    // Variables
+    Expression x = Expression(variable("x"));
+    Expression y = Expression(variable("y"));
+
+    // Parameter
+    Expression a = Expression(parameter("a"));
+
+    OrderedSet ordering = OrderedSet();
+    ordering.append(x);
+    ordering.append(y);
+
+    SymbolicInequalityConstraints constraints;
+    constraints.appendLessThan(x, a);          // Upper bound on x
+    constraints.appendGreaterThan(2 * y, 4);   // Lower bound on y
+    constraints.appendLessThan(x, 5);          // x already has an upper bound
+    constraints.appendLessThan(x + a * y, 1);  // Linear
+    constraints.appendLessThan(x * y, 1);      // Nonlinear
+
+    ClassifiedInequalityConstraints classified = constraints.classify(ordering);
+
+    // Bounds
+    ASSERT_EQ(1, classified.upperBoundIndices.size());
+    EXPECT_EQ(0, classified.upperBoundIndices[0]);
+    EXPECT_TRUE(eq(*classified.upperBounds[0], *a.get_basic()));
+    ASSERT_EQ(1, classified.lowerBoundIndices.size());
+    EXPECT_EQ(1, classified.lowerBoundIndices[0]);
+    EXPECT_TRUE(eq(*classified.lowerBounds[0], *integer(2)));
+
+    // Linear constraints
+    ASSERT_EQ(2, classified.numLinearConstraints());
+    EXPECT_TRUE(eq(*classified.linearVector[0], *integer(5)));
+    EXPECT_TRUE(eq(*classified.linearVector[1], *integer(1)));
+    ASSERT_EQ(3, classified.linearMatrix.size());
+    EXPECT_EQ(1, classified.linearMatrix[2].row);
+    EXPECT_EQ(1, classified.linearMatrix[2].col);
+    EXPECT_TRUE(eq(*classified.linearMatrix[2].value, *a.get_basic()));
+
+    // Nonlinear constraints
+    ASSERT_EQ(1, classified.nonlinear.numConstraints());
+}
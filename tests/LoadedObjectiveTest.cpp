@@ -0,0 +1,171 @@
+// Copyright 2021 Ian Ruh
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <symengine/expression.h>
+
+#include <Eigen/Dense>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "FastMPC.h"
+#include "LoadedObjective.h"
+#include "ObjectiveManifest.h"
+#include "OrderedSet.h"
+#include "SymEngineUtilities.h"
+#include "SymbolicObjective.h"
+
+TEST(LoadedObjectiveTests, ManifestRoundTrip) {
+    cppmpc::FastMPC::ObjectiveManifest manifest;
+    manifest.numVariables = 2;
+    manifest.numParameters = 1;
+    manifest.structuredBarrier = true;
+    manifest.lowerBoundIndices = {1};
+    manifest.variableNames = {"$v_x", "$v_y"};
+    manifest.parameterNames = {"$p_a"};
+    manifest.fixedParameterNames = {"$p_b"};
+    manifest.fixedParameterValues = {0.1};
+    manifest.sparsity.objectiveHessian = cppmpc::SparsityPattern(2, 2);
+    manifest.sparsity.objectiveHessian.insert(1, 1);
+
+    std::filesystem::path path =
+            std::filesystem::temp_directory_path() /
+            ("cppmpc-manifest-" + std::to_string(getpid()) + ".txt");
+    manifest.write(path.string());
+    cppmpc::FastMPC::ObjectiveManifest read =
+            cppmpc::FastMPC::ObjectiveManifest::read(path.string());
+    std::filesystem::remove(path);
+
+    EXPECT_EQ(2, read.numVariables);
+    EXPECT_EQ(1, read.numParameters);
+    EXPECT_TRUE(read.structuredBarrier);
+    EXPECT_EQ(manifest.lowerBoundIndices, read.lowerBoundIndices);
+    EXPECT_TRUE(read.upperBoundIndices.empty());
+    EXPECT_EQ(manifest.variableNames, read.variableNames);
+    EXPECT_EQ(manifest.parameterNames, read.parameterNames);
+    EXPECT_EQ(manifest.fixedParameterNames, read.fixedParameterNames);
+    EXPECT_EQ(manifest.fixedParameterValues, read.fixedParameterValues);
+    EXPECT_EQ(1, read.sparsity.objectiveHessian.nnz());
+    EXPECT_TRUE(read.sparsity.objectiveHessian.contains(1, 1));
+}
+
+TEST(LoadedObjectiveTests, MalformedManifest) {
+    cppmpc::FastMPC::ObjectiveManifest manifest;
+    manifest.numVariables = 2;
+    manifest.numParameters = 1;
+    manifest.variableNames = {"$v_x", "$v_y"};
+    manifest.parameterNames = {"$p_a"};
+    manifest.sparsity.objectiveHessian = cppmpc::SparsityPattern(2, 2);
+    manifest.sparsity.objectiveHessian.insert(1, 1);
+
+    std::filesystem::path path =
+            std::filesystem::temp_directory_path() /
+            ("cppmpc-malformed-" + std::to_string(getpid()) + ".txt");
+    manifest.write(path.string());
+    std::ifstream in(path);
+    std::stringstream written;
+    written << in.rdbuf();
+    in.close();
+
+    // Each field is replaced in turn, and added if it wasn't written
+    std::vector<std::pair<std::string, std::string>> fields = {
+            {"numVariables", "2x"},
+            {"numVariables", "3"},
+            {"parameterNames", "$p_a $p_b"},
+            {"lowerBoundIndices", "1.5"},
+            {"fixedParameterValues", "0.5"},
+            {"objectiveHessian", "2 2 1 2"},
+            {"objectiveHessian", "2 2 -1 0"},
+            {"objectiveHessian", "2 2 1"},
+            {"equalityMatrixUpdates", "2 0"}};
+    for (const auto& [key, values] : fields) {
+        std::stringstream lines(written.str());
+        std::ofstream out(path);
+        bool replaced = false;
+        for (std::string line; std::getline(lines, line);) {
+            if (line.rfind(key + ":", 0) == 0) {
+                line = key + ": " + values;
+                replaced = true;
+            }
+            out << line << std::endl;
+        }
+        if (!replaced) {
+            out << key << ": " << values << std::endl;
+        }
+        out.close();
+        EXPECT_THROW(cppmpc::FastMPC::ObjectiveManifest::read(path.string()),
+                     std::runtime_error)
+                << key << ": " << values;
+    }
+
+    manifest.variableNames = {"$v_x", "$v y"};
+    EXPECT_THROW(manifest.write(path.string()), std::runtime_error);
+    std::filesystem::remove(path);
+}
+
+TEST(LoadedObjectiveTests, ExportAndLoad) {
+    SymEngine::Expression x = SymEngine::Expression(cppmpc::variable("x"));
+    SymEngine::Expression y = SymEngine::Expression(cppmpc::variable("y"));
+    SymEngine::Expression a = SymEngine::Expression(cppmpc::parameter("a"));
+
+    cppmpc::OrderedSet variableOrdering;
+    variableOrdering.append(x);
+    variableOrdering.append(y);
+    cppmpc::OrderedSet parameterOrdering;
+    parameterOrdering.append(a);
+
+    cppmpc::FastMPC::SymbolicObjective objective;
+    objective.equalityConstraints.appendConstraint(x, 3.0);
+    objective.inequalityConstraints.appendGreaterThan(y, a);
+    objective.inequalityConstraints.appendLessThan(x * x + y * y, 25.0);
+    objective.setObjective(x * x + y * y);
+    objective.finalize(variableOrdering, parameterOrdering);
+
+    std::filesystem::path directory =
+            std::filesystem::temp_directory_path() /
+            ("cppmpc-export-" + std::to_string(getpid()));
+    objective.exportObjective(directory.string());
+
+    cppmpc::FastMPC::LoadedObjective loaded(directory.string());
+    EXPECT_EQ(objective.numVariables(), loaded.numVariables());
+    EXPECT_EQ(objective.numParameters(), loaded.numParameters());
+    EXPECT_EQ(objective.numEqualityConstraints(),
+              loaded.numEqualityConstraints());
+    EXPECT_EQ(objective.numInequalityConstraints(),
+              loaded.numInequalityConstraints());
+    EXPECT_EQ(1, loaded.variableIndex("y"));
+    EXPECT_EQ(0, loaded.parameterIndex("a"));
+    EXPECT_EQ(objective.derivativeSparsity().objectiveHessian.nnz(),
+              loaded.manifest().sparsity.objectiveHessian.nnz());
+
+    Eigen::VectorXd param(1);
+    param << 2.0;
+    objective.setParameters(param);
+    loaded.setParameters(param);
+
+    Eigen::VectorXd state(2);
+    state << 1.0, 3.0;
+    EXPECT_NEAR(objective.value(state), loaded.value(state), 1e-9);
+    EXPECT_TRUE(objective.gradient(state).isApprox(loaded.gradient(state)));
+    EXPECT_NEAR(objective.inequalityConstraintsValue(state),
+                loaded.inequalityConstraintsValue(state), 1e-9);
+    EXPECT_TRUE(objective.inequalityConstraintsHessian(state).isApprox(
+            loaded.inequalityConstraintsHessian(state)));
+    EXPECT_TRUE(objective.equalityConstraintMatrix()->isApprox(
+            *loaded.equalityConstraintMatrix()));
+
+    cppmpc::FastMPC::Solver solver = cppmpc::FastMPC::Solver(loaded);
+    Eigen::VectorXd startPrimal(2);
+    startPrimal << 1.0, 3.0;
+    auto [minimum, primal, dual] = solver.minimize(startPrimal);
+
+    EXPECT_NEAR(13, minimum, 1e-2);
+    EXPECT_NEAR(3, primal(0), 1e-2);
+    EXPECT_NEAR(2, primal(1), 1e-2);
+
+    std::filesystem::remove_all(directory);
+}
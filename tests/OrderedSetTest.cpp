@@ -3,6 +3,9 @@
 #include <symengine/basic.h>
 #include <symengine/symbol.h>
 
+#include <string>
+#include <vector>
+
 #include "OrderedSet.h"
 
 using SymEngine::Basic;
@@ -81,3 +84,51 @@ TEST(OrderedSetTests, Subset) {
     EXPECT_FALSE(set3.isSubset(set2));
     EXPECT_FALSE(set1.isSubset(set2));
 }
+
+TEST(OrderedSetTests, BulkInsert) {
+    RCP<const Symbol> w = SymEngine::symbol("w");
+    RCP<const Symbol> x = SymEngine::symbol("x");
+    RCP<const Symbol> y = SymEngine::symbol("y");
+    RCP<const Symbol> z = SymEngine::symbol("z");
+
+    // Duplicates in the range are skipped
+    std::vector<RCP<const Symbol>> symbols = {w, z, w};
+    cppmpc::OrderedSet set(symbols);
+    EXPECT_TRUE(set.isConsistent());
+    EXPECT_EQ(2, set.size());
+
+    // Insert into the middle, skipping symbols already in the set
+    std::vector<RCP<const Symbol>> middle = {x, z, y};
+    set.insert(1, middle.begin(), middle.end());
+    EXPECT_TRUE(set.isConsistent());
+    EXPECT_EQ(4, set.size());
+    EXPECT_EQ(set.at(0), w);
+    EXPECT_EQ(set.at(1), x);
+    EXPECT_EQ(set.at(2), y);
+    EXPECT_EQ(set.at(3), z);
+}
+
+TEST(OrderedSetTests, Frozen) {
+    std::vector<RCP<const Symbol>> symbols;
+    for (size_t i = 0; i < 100; i++) {
+        symbols.push_back(SymEngine::symbol("frozen" + std::to_string(i)));
+    }
+    cppmpc::OrderedSet set(symbols);
+
+    cppmpc::FrozenOrderedSet frozen = set.freeze();
+    cppmpc::FrozenOrderedSet copy = frozen;
+    EXPECT_EQ(100, copy.size());
+    for (size_t i = 0; i < symbols.size(); i++) {
+        EXPECT_EQ(i, copy.indexOf(symbols[i]));
+        // Equal symbols that are different objects are found too
+        EXPECT_EQ(i, copy.indexOf(SymEngine::symbol(symbols[i]->get_name())));
+    }
+    EXPECT_FALSE(copy.contains(SymEngine::symbol("notFrozen")));
+    EXPECT_THROW(copy.indexOf(SymEngine::symbol("notFrozen")),
+                 std::out_of_range);
+
+    // Changing the original doesn't change the frozen set
+    set.remove(0);
+    EXPECT_EQ(100, frozen.size());
+    EXPECT_TRUE(frozen.thaw().isConsistent());
+}
@@ -0,0 +1,241 @@
+// Copyright 2021 Ian Ruh
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <symengine/expression.h>
+
+#include "RuntimeCompiler.h"
+
+using cppmpc::RuntimeCompiler;
+
+typedef void (*AnswerFunction)(double* out);
+
+TEST(RuntimeCompilerTests, CacheKey) {
+    EXPECT_EQ(RuntimeCompiler::cacheKey("void f() {}"),
+              RuntimeCompiler::cacheKey("void f() {}"));
+    EXPECT_NE(RuntimeCompiler::cacheKey("void f() {}"),
+              RuntimeCompiler::cacheKey("void g() {}"));
+    EXPECT_EQ(16, RuntimeCompiler::cacheKey("").size());
+
+    // Code built at another optimization level is a different entry
+    cppmpc::CompileOptions optimized;
+    optimized.optimizationLevel = 2;
+    EXPECT_NE(RuntimeCompiler::cacheKey("void f() {}"),
+              RuntimeCompiler::cacheKey("void f() {}", optimized));
+}
+
+TEST(RuntimeCompilerTests, Backends) {
+    EXPECT_TRUE(
+            RuntimeCompiler::isAvailable(cppmpc::CompilerBackend::External));
+
+    std::vector<std::string> functions = {
+            "void answer(double* out) {\nout[0] = 42;\n}\n"};
+    cppmpc::CompileOptions options;
+    options.backend = cppmpc::CompilerBackend::TinyCC;
+    if (!RuntimeCompiler::isAvailable(cppmpc::CompilerBackend::TinyCC)) {
+        EXPECT_THROW(RuntimeCompiler::compile(functions, "", options),
+                     std::runtime_error);
+        return;
+    }
+
+    // Compiled in memory, so there is no library to export
+    auto module = RuntimeCompiler::compile(functions, "", options);
+    EXPECT_TRUE(module->path().empty());
+    double out = 0;
+    module->function<AnswerFunction>("answer")(&out);
+    EXPECT_EQ(42, out);
+    EXPECT_THROW(module->function<AnswerFunction>("missing"),
+                 std::runtime_error);
+}
+
+TEST(RuntimeCompilerTests, RemovesTemporaryLibrary) {
+    // Without the cache, the library is built in a temporary directory that
+    // its module removes
+    std::string previousDirectory = RuntimeCompiler::cacheDirectory();
+    RuntimeCompiler::setCacheDirectory("");
+    auto module = RuntimeCompiler::compile(std::vector<std::string>{
+            "void answer(double* out) {\nout[0] = 42;\n}\n"});
+    std::filesystem::path directory =
+            std::filesystem::path(module->path()).parent_path();
+    EXPECT_TRUE(std::filesystem::exists(module->path()));
+    double out = 0;
+    module->function<AnswerFunction>("answer")(&out);
+    EXPECT_EQ(42, out);
+
+    module.reset();
+    EXPECT_FALSE(std::filesystem::exists(directory));
+    RuntimeCompiler::setCacheDirectory(previousDirectory);
+}
+
+TEST(RuntimeCompilerTests, ReusesCachedLibrary) {
+    std::string previousDirectory = RuntimeCompiler::cacheDirectory();
+    std::filesystem::path directory =
+            std::filesystem::temp_directory_path() /
+            ("cppmpc-cache-test-" + std::to_string(getpid()));
+    std::filesystem::remove_all(directory);
+    RuntimeCompiler::setCacheDirectory(directory.string());
+
+    std::vector<std::string> functions = {
+            "void answer(double* out) {\nout[0] = 42;\n}\n"};
+
+    auto first = RuntimeCompiler::compile(functions, "answers: 1\n");
+    double out = 0;
+    first->function<AnswerFunction>("answer")(&out);
+    EXPECT_EQ(42, out);
+
+    // The library, its source, and its metadata are the only files left in
+    // the cache
+    size_t numFiles = 0;
+    std::filesystem::path library;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        numFiles += 1;
+        if (entry.path().extension() == ".so") {
+            library = entry.path();
+        }
+    }
+    EXPECT_EQ(3, numFiles);
+    ASSERT_FALSE(library.empty());
+    auto writeTime = std::filesystem::last_write_time(library);
+
+    // The second compile is a cache hit, so the library isn't rebuilt
+    auto second = RuntimeCompiler::compile(functions, "answers: 1\n");
+    out = 0;
+    second->function<AnswerFunction>("answer")(&out);
+    EXPECT_EQ(42, out);
+    EXPECT_EQ(writeTime, std::filesystem::last_write_time(library));
+
+    RuntimeCompiler::setCacheDirectory(previousDirectory);
+    std::filesystem::remove_all(directory);
+}
+
+TEST(RuntimeCompilerTests, KeepsEntriesWithDifferentMetadata) {
+    std::string previousDirectory = RuntimeCompiler::cacheDirectory();
+    std::filesystem::path directory =
+            std::filesystem::temp_directory_path() /
+            ("cppmpc-cache-metadata-test-" + std::to_string(getpid()));
+    std::filesystem::remove_all(directory);
+    RuntimeCompiler::setCacheDirectory(directory.string());
+
+    std::vector<std::string> functions = {
+            "void answer(double* out) {\nout[0] = 42;\n}\n"};
+    auto libraries = [&directory]() {
+        std::vector<std::filesystem::path> paths;
+        for (const auto& entry :
+             std::filesystem::directory_iterator(directory)) {
+            if (entry.path().extension() == ".so") {
+                paths.push_back(entry.path());
+            }
+        }
+        return paths;
+    };
+
+    // The same code for two objectives is kept as two entries
+    RuntimeCompiler::compile(functions, "answers: 1\n");
+    RuntimeCompiler::compile(functions, "answers: 2\n");
+    std::vector<std::filesystem::path> paths = libraries();
+    ASSERT_EQ(2, paths.size());
+    std::vector<std::filesystem::file_time_type> writeTimes;
+    for (const std::filesystem::path& path : paths) {
+        writeTimes.push_back(std::filesystem::last_write_time(path));
+    }
+
+    // Compiling either one again is a hit, instead of replacing the other
+    for (const std::string& metadata : {"answers: 1\n", "answers: 2\n"}) {
+        auto module = RuntimeCompiler::compile(functions, metadata);
+        double out = 0;
+        module->function<AnswerFunction>("answer")(&out);
+        EXPECT_EQ(42, out);
+    }
+    ASSERT_EQ(2, libraries().size());
+    for (size_t i = 0; i < paths.size(); i++) {
+        EXPECT_EQ(writeTimes[i], std::filesystem::last_write_time(paths[i]));
+    }
+
+    RuntimeCompiler::setCacheDirectory(previousDirectory);
+    std::filesystem::remove_all(directory);
+}
+
+TEST(RuntimeCompilerTests, CachesSplitSources) {
+    std::string previousDirectory = RuntimeCompiler::cacheDirectory();
+    std::filesystem::path directory =
+            std::filesystem::temp_directory_path() /
+            ("cppmpc-cache-split-test-" + std::to_string(getpid()));
+    std::filesystem::remove_all(directory);
+    RuntimeCompiler::setCacheDirectory(directory.string());
+
+    // Split into three files of at most two assignments
+    cppmpc::GeneratedFunction large;
+    large.name = "large";
+    large.inputs = {"state"};
+    for (size_t i = 0; i < 5; i++) {
+        large.assignments.emplace_back(
+                i, SymEngine::mul(SymEngine::integer(3),
+                                  SymEngine::symbol("state[" +
+                                                    std::to_string(i) + "]")));
+    }
+    cppmpc::CompileOptions options;
+    options.maxChunkAssignments = 2;
+    auto entries = [&directory]() {
+        std::vector<std::filesystem::path> paths;
+        for (const auto& entry :
+             std::filesystem::directory_iterator(directory)) {
+            paths.push_back(entry.path());
+        }
+        return paths;
+    };
+
+    // The files are written to the cache and removed once they are stored
+    auto first = RuntimeCompiler::compile({large}, "", options);
+    typedef void (*StateFunction)(const double* state, double* out);
+    double state[] = {1, 2, 3, 4, 5};
+    double out[5] = {};
+    first->function<StateFunction>("large")(state, out);
+    for (size_t i = 0; i < 5; i++) {
+        EXPECT_EQ(3 * state[i], out[i]);
+    }
+    ASSERT_EQ(3, entries().size());
+    std::filesystem::path library = first->path();
+    auto writeTime = std::filesystem::last_write_time(library);
+
+    // The same files are a hit, and a changed file is a new entry
+    RuntimeCompiler::compile({large}, "", options);
+    EXPECT_EQ(3, entries().size());
+    EXPECT_EQ(writeTime, std::filesystem::last_write_time(library));
+    large.assignments[4].second = SymEngine::symbol("state[0]");
+    auto changed = RuntimeCompiler::compile({large}, "", options);
+    EXPECT_EQ(6, entries().size());
+    changed->function<StateFunction>("large")(state, out);
+    EXPECT_EQ(state[0], out[4]);
+
+    RuntimeCompiler::setCacheDirectory(previousDirectory);
+    std::filesystem::remove_all(directory);
+}
+
+TEST(RuntimeCompilerTests, Presets) {
+    std::vector<std::string> functions = {
+            "void answer(double* out) {\nout[0] = 6.0 * 7.0;\n}\n"};
+
+    std::vector<std::string> keys;
+    for (cppmpc::CompilePreset preset :
+         {cppmpc::CompilePreset::Debug, cppmpc::CompilePreset::Release,
+          cppmpc::CompilePreset::Native, cppmpc::CompilePreset::FastMath}) {
+        cppmpc::CompileOptions options = RuntimeCompiler::presetOptions(preset);
+        auto module = RuntimeCompiler::compile(functions, "", options);
+        double out = 0;
+        module->function<AnswerFunction>("answer")(&out);
+        EXPECT_EQ(42, out);
+
+        // Each preset is a separate cache entry
+        std::string key = RuntimeCompiler::cacheKey("void f() {}", options);
+        for (const std::string& other : keys) {
+            EXPECT_NE(other, key);
+        }
+        keys.push_back(key);
+    }
+}
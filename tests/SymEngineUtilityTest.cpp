@@ -6,8 +6,10 @@
 #include <symengine/symbol.h>
 #include <symengine/integer.h>
 #include <iostream>
+#include <vector>
 
 #include "OrderedSet.h"
+#include "SparsityPattern.h"
 #include "SymEngineUtilities.h"
 
 using SymEngine::Basic;
@@ -111,3 +113,71 @@ TEST(SymEngineUtilityTests, Hessian) {
     EXPECT_TRUE(Expression(2 * z).get_basic()->compare(*hess.get(2, 1)) == 0);
     EXPECT_TRUE(Expression(2 * y).get_basic()->compare(*hess.get(2, 2)) == 0);
 }
+
+TEST(SymEngineUtilityTests, HessianSparsity) {
+    RCP<const Symbol> xb = SymEngine::symbol("x");
+    RCP<const Symbol> yb = SymEngine::symbol("y");
+    RCP<const Symbol> zb = SymEngine::symbol("z");
+    RCP<const Symbol> wb = SymEngine::symbol("w");
+
+    auto x = Expression(xb);
+    auto y = Expression(yb);
+    auto z = Expression(zb);
+
+    cppmpc::OrderedSet set;
+    set.append(xb);
+    set.append(yb);
+    set.append(zb);
+    set.append(wb);
+
+    Expression exp = x * x * x + 2 * x * y + z * z * y;
+
+    std::vector<size_t> dependencies =
+            cppmpc::variableDependencies(exp.get_basic(), set);
+    EXPECT_EQ(dependencies, std::vector<size_t>({0, 1, 2}));
+
+    cppmpc::SparsityPattern pattern;
+    SymEngine::DenseMatrix hess =
+            cppmpc::hessian(exp.get_basic(), set, pattern);
+
+    EXPECT_EQ(6, pattern.nnz());
+    EXPECT_TRUE(pattern.contains(0, 0));
+    EXPECT_TRUE(pattern.contains(0, 1));
+    EXPECT_FALSE(pattern.contains(0, 2));
+    EXPECT_FALSE(pattern.contains(1, 1));
+    EXPECT_TRUE(pattern.contains(1, 2));
+    EXPECT_TRUE(pattern.contains(2, 2));
+    EXPECT_FALSE(pattern.contains(3, 3));
+
+    // Entries outside of the pattern are still set to zero
+    EXPECT_TRUE(Expression(0).get_basic()->compare(*hess.get(1, 1)) == 0);
+    EXPECT_TRUE(Expression(0).get_basic()->compare(*hess.get(3, 0)) == 0);
+    EXPECT_TRUE((2 * z).get_basic()->compare(*hess.get(1, 2)) == 0);
+}
+
+TEST(SymEngineUtilityTests, JacobianSparsity) {
+    RCP<const Symbol> xb = SymEngine::symbol("x");
+    RCP<const Symbol> yb = SymEngine::symbol("y");
+    RCP<const Symbol> zb = SymEngine::symbol("z");
+
+    auto x = Expression(xb);
+    auto y = Expression(yb);
+    auto z = Expression(zb);
+
+    cppmpc::OrderedSet set;
+    set.append(xb);
+    set.append(yb);
+    set.append(zb);
+
+    SymEngine::DenseMatrix f(2, 1);
+    f.set(0, 0, (3 * y + z).get_basic());
+    f.set(1, 0, (7 * x * x).get_basic());
+
+    cppmpc::SparsityPattern pattern;
+    SymEngine::DenseMatrix jacobian = cppmpc::jacobian(f, set, pattern);
+
+    EXPECT_EQ(3, pattern.nnz());
+    EXPECT_EQ(pattern.row(0), std::vector<size_t>({1, 2}));
+    EXPECT_EQ(pattern.row(1), std::vector<size_t>({0}));
+    EXPECT_TRUE((14 * x).get_basic()->compare(*jacobian.get(1, 0)) == 0);
+}
@@ -0,0 +1,60 @@
+// Copyright 2021 Ian Ruh
+#include <gtest/gtest.h>
+#include <symengine/add.h>
+#include <symengine/basic.h>
+#include <symengine/functions.h>
+#include <symengine/mul.h>
+#include <symengine/symbol.h>
+
+#include "SymEngineUtilities.h"
+#include "SymbolCollector.h"
+
+TEST(SymbolCollectorTests, Classification) {
+    SymEngine::RCP<const SymEngine::Symbol> x = cppmpc::variable("x");
+    SymEngine::RCP<const SymEngine::Symbol> a = cppmpc::parameter("a");
+    SymEngine::RCP<const SymEngine::Symbol> z = SymEngine::symbol("z");
+
+    SymEngine::RCP<const SymEngine::Basic> expr =
+            SymEngine::add(SymEngine::mul(x, a), SymEngine::sin(z));
+
+    cppmpc::SymbolCollector collector;
+    std::shared_ptr<const cppmpc::CollectedSymbols> collected =
+            collector.collect(expr);
+
+    EXPECT_EQ(3, collected->symbols.size());
+    EXPECT_EQ(1, collected->variables.size());
+    EXPECT_EQ(1, collected->variables.count(x));
+    EXPECT_EQ(1, collected->parameters.size());
+    EXPECT_EQ(1, collected->parameters.count(a));
+}
+
+TEST(SymbolCollectorTests, SharedSubexpressions) {
+    SymEngine::RCP<const SymEngine::Symbol> x = cppmpc::variable("x");
+    SymEngine::RCP<const SymEngine::Symbol> y = cppmpc::variable("y");
+    SymEngine::RCP<const SymEngine::Basic> shared =
+            SymEngine::sin(SymEngine::mul(x, y));
+
+    cppmpc::SymbolCollector collector;
+    collector.collect(SymEngine::add(shared, x));
+    size_t visited = collector.size();
+
+    // The shared subexpression has already been visited
+    collector.collect(shared);
+    EXPECT_EQ(visited, collector.size());
+}
+
+TEST(SymbolCollectorTests, ActiveScope) {
+    SymEngine::RCP<const SymEngine::Symbol> x = cppmpc::variable("x");
+    SymEngine::RCP<const SymEngine::Symbol> a = cppmpc::parameter("a");
+    SymEngine::RCP<const SymEngine::Basic> expr = SymEngine::mul(x, a);
+
+    cppmpc::SymbolCollector collector;
+    {
+        cppmpc::SymbolCollector::Scope scope(collector);
+        EXPECT_EQ(&collector, cppmpc::SymbolCollector::active());
+        EXPECT_EQ(1, cppmpc::getVariables(expr).count(x));
+        EXPECT_EQ(1, cppmpc::getParameters(expr).count(a));
+    }
+    EXPECT_EQ(nullptr, cppmpc::SymbolCollector::active());
+    EXPECT_LT(0, collector.size());
+}
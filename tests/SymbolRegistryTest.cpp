@@ -0,0 +1,95 @@
+// Copyright 2021 Ian Ruh
+#include <gtest/gtest.h>
+#include <symengine/basic.h>
+#include <symengine/symbol.h>
+
+#include <vector>
+
+#include "OrderedSet.h"
+#include "SymEngineUtilities.h"
+#include "SymbolRegistry.h"
+
+TEST(SymbolRegistryTests, Kinds) {
+    const cppmpc::SymbolRegistry& registry =
+            cppmpc::SymbolRegistry::instance();
+
+    SymEngine::RCP<const SymEngine::Symbol> x =
+            cppmpc::variable("registryKindX");
+    SymEngine::RCP<const SymEngine::Symbol> a =
+            cppmpc::parameter("registryKindA");
+    SymEngine::RCP<const SymEngine::Symbol> z =
+            SymEngine::symbol("registryKindZ");
+
+    EXPECT_EQ(cppmpc::SymbolKind::Variable, registry.kind(*x));
+    EXPECT_EQ(cppmpc::SymbolKind::Parameter, registry.kind(*a));
+    EXPECT_EQ(cppmpc::SymbolKind::Other, registry.kind(*z));
+    EXPECT_FALSE(registry.id(*z));
+}
+
+TEST(SymbolRegistryTests, Interning) {
+    const cppmpc::SymbolRegistry& registry =
+            cppmpc::SymbolRegistry::instance();
+
+    // Creating the same variable twice gives the same symbol and id
+    SymEngine::RCP<const SymEngine::Symbol> first =
+            cppmpc::variable("registryInternX");
+    SymEngine::RCP<const SymEngine::Symbol> second =
+            cppmpc::variable("registryInternX");
+    EXPECT_EQ(first.get(), second.get());
+    EXPECT_EQ(*registry.id(*first), *registry.id(*second));
+
+    // A symbol with the same name created elsewhere has no id, but is still
+    // classified by its name, and equal to the registered symbol
+    SymEngine::RCP<const SymEngine::Symbol> copy =
+            SymEngine::symbol(first->get_name());
+    EXPECT_FALSE(registry.id(*copy));
+    EXPECT_EQ(cppmpc::SymbolKind::Variable, registry.kind(*copy));
+    EXPECT_EQ(cppmpc::SymbolKind::Parameter,
+              registry.kind(*SymEngine::symbol("$p_registryInternA")));
+    cppmpc::OrderedSet ordering;
+    ordering.append(first);
+    EXPECT_EQ(0, ordering.indexOf(copy));
+    cppmpc::OrderedSet copies;
+    copies.append(copy);
+    EXPECT_EQ(0, copies.indexOf(first));
+    copies.append(first);
+    EXPECT_EQ(1, copies.size());
+    EXPECT_TRUE(copies.isConsistent());
+
+    // The same name can't be reused with a different kind
+    EXPECT_THROW(cppmpc::SymbolRegistry::instance().intern(
+                         first->get_name(), cppmpc::SymbolKind::Parameter),
+                 std::runtime_error);
+}
+
+TEST(SymbolRegistryTests, ContiguousRanges) {
+    const cppmpc::SymbolRegistry& registry =
+            cppmpc::SymbolRegistry::instance();
+
+    std::vector<SymEngine::RCP<const SymEngine::Symbol>> vec =
+            cppmpc::variableVector("registryRange", 5);
+    cppmpc::SymbolId first = *registry.id(*vec[0]);
+    for (size_t i = 0; i < vec.size(); i++) {
+        EXPECT_EQ(first + i, *registry.id(*vec[i]));
+        EXPECT_EQ(vec[i].get(), registry.symbol(first + i).get());
+    }
+
+    // Ordered sets find registered and unregistered symbols
+    cppmpc::OrderedSet ordering;
+    SymEngine::RCP<const SymEngine::Symbol> z =
+            SymEngine::symbol("registryRangeZ");
+    ordering.append(z);
+    for (const SymEngine::RCP<const SymEngine::Symbol>& symbol : vec) {
+        ordering.append(symbol);
+    }
+    ordering.remove(2);
+    EXPECT_TRUE(ordering.isConsistent());
+
+    // Inserting a lower id first still indexes every symbol by id
+    cppmpc::OrderedSet reversed(vec.rbegin(), vec.rend());
+    EXPECT_TRUE(reversed.isConsistent());
+    EXPECT_EQ(4, reversed.indexOf(vec[0]));
+    EXPECT_EQ(0, ordering.indexOf(z));
+    EXPECT_EQ(2, ordering.indexOf(vec[2]));
+    EXPECT_FALSE(ordering.contains(vec[1]));
+}
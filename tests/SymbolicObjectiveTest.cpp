@@ -4,9 +4,23 @@
 #include <symengine/basic.h>
 #include <symengine/expression.h>
 
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include <Eigen/Dense>
 #include "FastMPC.h"
 #include "OrderedSet.h"
+#include "Parallel.h"
+#include "RuntimeCompiler.h"
 #include "SymEngineUtilities.h"
 #include "SymbolicObjective.h"
 
@@ -38,6 +52,12 @@ TEST(SymbolicObjectiveTests, QuadraticSystem) {
     // Finalize
     objective.finalize(variableOrdering, parameterOrdering);
 
+    // Only the diagonal of the hessian is non-zero
+    const cppmpc::SparsityPattern& hessianPattern =
+            objective.derivativeSparsity().objectiveHessian;
+    EXPECT_EQ(2, hessianPattern.nnz());
+    EXPECT_FALSE(hessianPattern.contains(0, 1));
+
     // Set the parameter
     Eigen::VectorXd param(1);
     param << 2.0;
@@ -54,3 +74,480 @@ TEST(SymbolicObjectiveTests, QuadraticSystem) {
     EXPECT_NEAR(3, primal(0), 1e-2);
     EXPECT_NEAR(2, primal(1), 1e-2);
 }
+
+TEST(SymbolicObjectiveTests, StructuredBarrierMatchesSymbolic) {
+    SymEngine::Expression x = SymEngine::Expression(cppmpc::variable("x"));
+    SymEngine::Expression y = SymEngine::Expression(cppmpc::variable("y"));
+    SymEngine::Expression r = SymEngine::Expression(cppmpc::parameter("r"));
+
+    cppmpc::OrderedSet variableOrdering;
+    variableOrdering.append(x);
+    variableOrdering.append(y);
+    cppmpc::OrderedSet parameterOrdering;
+    parameterOrdering.append(r);
+
+    // Stay inside a circle and above a line
+    cppmpc::FastMPC::SymbolicObjective symbolic;
+    cppmpc::FastMPC::SymbolicObjective structured;
+    structured.barrierMode = cppmpc::FastMPC::BarrierMode::Structured;
+    for (cppmpc::FastMPC::SymbolicObjective* objective :
+         {&symbolic, &structured}) {
+        objective->inequalityConstraints.appendLessThan(x * x + y * y, r * r);
+        objective->inequalityConstraints.appendGreaterThan(y, x - 1.0);
+        objective->setObjective(x * x + (y - 2.0) * (y - 2.0));
+        objective->finalize(variableOrdering, parameterOrdering);
+
+        Eigen::VectorXd param(1);
+        param << 3.0;
+        objective->setParameters(param);
+    }
+    EXPECT_TRUE(structured.hasStructuredInequalityConstraints());
+
+    Eigen::VectorXd state(2);
+    state << 0.5, 1.0;
+    EXPECT_NEAR(symbolic.inequalityConstraintsValue(state),
+                structured.inequalityConstraintsValue(state), 1e-9);
+    EXPECT_TRUE(symbolic.inequalityConstraintsGradient(state).isApprox(
+            structured.inequalityConstraintsGradient(state), 1e-9));
+    EXPECT_TRUE(symbolic.inequalityConstraintsHessian(state).isApprox(
+            structured.inequalityConstraintsHessian(state), 1e-9));
+}
+
+TEST(SymbolicObjectiveTests, LinearInequalitiesMatchSymbolic) {
+    SymEngine::Expression x = SymEngine::Expression(cppmpc::variable("x"));
+    SymEngine::Expression y = SymEngine::Expression(cppmpc::variable("y"));
+    SymEngine::Expression a = SymEngine::Expression(cppmpc::parameter("a"));
+
+    cppmpc::OrderedSet variableOrdering;
+    variableOrdering.append(x);
+    variableOrdering.append(y);
+    cppmpc::OrderedSet parameterOrdering;
+    parameterOrdering.append(a);
+
+    // Bounds, a linear constraint, and a nonlinear constraint
+    cppmpc::FastMPC::SymbolicObjective symbolic;
+    symbolic.detectLinearInequalities = false;
+    cppmpc::FastMPC::SymbolicObjective detected;
+    for (cppmpc::FastMPC::SymbolicObjective* objective :
+         {&symbolic, &detected}) {
+        objective->inequalityConstraints.appendLessThan(x, a);
+        objective->inequalityConstraints.appendGreaterThan(y, -1.0);
+        objective->inequalityConstraints.appendLessThan(x + a * y, 4.0);
+        objective->inequalityConstraints.appendLessThan(x * x + y * y, 9.0);
+        objective->setObjective(x * x + y * y);
+        objective->finalize(variableOrdering, parameterOrdering);
+
+        Eigen::VectorXd param(1);
+        param << 2.0;
+        objective->setParameters(param);
+    }
+
+    Eigen::VectorXd state(2);
+    state << 0.5, 1.0;
+    EXPECT_NEAR(symbolic.inequalityConstraintsValue(state),
+                detected.inequalityConstraintsValue(state), 1e-9);
+    EXPECT_TRUE(symbolic.inequalityConstraintsGradient(state).isApprox(
+            detected.inequalityConstraintsGradient(state), 1e-9));
+    EXPECT_TRUE(symbolic.inequalityConstraintsHessian(state).isApprox(
+            detected.inequalityConstraintsHessian(state), 1e-9));
+
+    // Changing the parameters updates the bounds
+    detected.parameter(a) = 1.0;
+    symbolic.parameter(a) = 1.0;
+    EXPECT_NEAR(symbolic.inequalityConstraintsValue(state),
+                detected.inequalityConstraintsValue(state), 1e-9);
+}
+
+TEST(SymbolicObjectiveTests, TieredCompilation) {
+    SymEngine::Expression x = SymEngine::Expression(cppmpc::variable("x"));
+    SymEngine::Expression y = SymEngine::Expression(cppmpc::variable("y"));
+    SymEngine::Expression a = SymEngine::Expression(cppmpc::parameter("a"));
+
+    cppmpc::OrderedSet variableOrdering;
+    variableOrdering.append(x);
+    variableOrdering.append(y);
+    cppmpc::OrderedSet parameterOrdering;
+    parameterOrdering.append(a);
+
+    cppmpc::FastMPC::SymbolicObjective objective;
+    objective.compileOptions.optimizationLevel = 2;
+    objective.compileOptions.tiered = true;
+    objective.equalityConstraints.appendConstraint(x, 3.0);
+    objective.inequalityConstraints.appendGreaterThan(y, a);
+    objective.setObjective(x * x + y * y);
+    objective.finalize(variableOrdering, parameterOrdering);
+
+    // Finalize returns with interpreted or unoptimized code, and an optimized
+    // build pending
+    EXPECT_NE(cppmpc::CompilationTier::Optimized,
+              objective.compilationTier());
+    EXPECT_TRUE(objective.hasPendingOptimizedModule());
+
+    Eigen::VectorXd param(1);
+    param << 2.0;
+    objective.setParameters(param);
+
+    Eigen::VectorXd state(2);
+    state << 1.0, 3.0;
+    double unoptimizedValue = objective.value(state);
+    Eigen::VectorXd unoptimizedGradient = objective.gradient(state);
+
+    cppmpc::FastMPC::Solver solver = cppmpc::FastMPC::Solver(objective);
+    Eigen::VectorXd startPrimal(2);
+    startPrimal << 20.0, 20.0;
+    auto [minimum, primal, dual] = solver.minimize(startPrimal);
+    EXPECT_NEAR(13, minimum, 1e-2);
+
+    // Solving never swaps the code, only an explicit swap does
+    EXPECT_NE(cppmpc::CompilationTier::Optimized,
+              objective.compilationTier());
+    bool swapped = objective.swapOptimizedModule();
+    EXPECT_EQ(swapped, cppmpc::CompilationTier::Optimized ==
+                               objective.compilationTier());
+
+    objective.waitForOptimizedModule();
+    EXPECT_EQ(cppmpc::CompilationTier::Optimized, objective.compilationTier());
+    EXPECT_FALSE(objective.hasPendingOptimizedModule());
+    EXPECT_FALSE(objective.swapOptimizedModule());
+    EXPECT_NEAR(unoptimizedValue, objective.value(state), 1e-9);
+    EXPECT_TRUE(unoptimizedGradient.isApprox(objective.gradient(state)));
+
+    // The optimized code gives the same solution
+    auto [optimizedMinimum, optimizedPrimal, optimizedDual] =
+            solver.minimize(startPrimal);
+    EXPECT_NEAR(minimum, optimizedMinimum, 1e-9);
+    EXPECT_TRUE(primal.isApprox(optimizedPrimal));
+}
+
+TEST(SymbolicObjectiveTests, ProfileGuidedOptimization) {
+    if (std::system("llvm-profdata --version > /dev/null 2>&1") != 0) {
+        GTEST_SKIP() << "llvm-profdata isn't available";
+    }
+
+    SymEngine::Expression x = SymEngine::Expression(cppmpc::variable("x"));
+    SymEngine::Expression y = SymEngine::Expression(cppmpc::variable("y"));
+    SymEngine::Expression a = SymEngine::Expression(cppmpc::parameter("a"));
+
+    cppmpc::OrderedSet variableOrdering;
+    variableOrdering.append(x);
+    variableOrdering.append(y);
+    cppmpc::OrderedSet parameterOrdering;
+    parameterOrdering.append(a);
+
+    cppmpc::FastMPC::SymbolicObjective objective;
+    objective.compileOptions = cppmpc::RuntimeCompiler::presetOptions(
+            cppmpc::CompilePreset::Release);
+    objective.equalityConstraints.appendConstraint(x, 3.0);
+    objective.inequalityConstraints.appendGreaterThan(y, a);
+    objective.setObjective(x * x + y * y);
+    objective.finalize(variableOrdering, parameterOrdering);
+
+    Eigen::VectorXd param(1);
+    param << 2.0;
+    objective.setParameters(param);
+    Eigen::VectorXd state(2);
+    state << 1.0, 3.0;
+    double value = objective.value(state);
+    Eigen::VectorXd gradient = objective.gradient(state);
+
+    // Profile with other parameters, which are reset afterwards
+    std::vector<Eigen::VectorXd> states;
+    std::vector<Eigen::VectorXd> parameters;
+    for (size_t i = 0; i < 10; i++) {
+        states.push_back(Eigen::VectorXd::Constant(2, 3.0 + i));
+        parameters.push_back(Eigen::VectorXd::Constant(1, 1.0 + i));
+    }
+    EXPECT_THROW(objective.optimizeWithProfile(states, {}),
+                 std::runtime_error);
+    objective.optimizeWithProfile(states, parameters);
+    EXPECT_EQ(cppmpc::CompilationTier::Optimized, objective.compilationTier());
+    EXPECT_EQ(value, objective.value(state));
+    EXPECT_TRUE(gradient.isApprox(objective.gradient(state)));
+
+    cppmpc::FastMPC::Solver solver = cppmpc::FastMPC::Solver(objective);
+    Eigen::VectorXd startPrimal(2);
+    startPrimal << 20.0, 20.0;
+    auto [minimum, primal, dual] = solver.minimize(startPrimal);
+    EXPECT_NEAR(13, minimum, 1e-2);
+}
+
+TEST(SymbolicObjectiveTests, BatchEvaluation) {
+    SymEngine::Expression x = SymEngine::Expression(cppmpc::variable("x"));
+    SymEngine::Expression y = SymEngine::Expression(cppmpc::variable("y"));
+    SymEngine::Expression a = SymEngine::Expression(cppmpc::parameter("a"));
+
+    cppmpc::OrderedSet variableOrdering;
+    variableOrdering.append(x);
+    variableOrdering.append(y);
+    cppmpc::OrderedSet parameterOrdering;
+    parameterOrdering.append(a);
+
+    // One point per row
+    Eigen::MatrixXd states = Eigen::MatrixXd::Random(5, 2);
+    Eigen::MatrixXd parameters = Eigen::MatrixXd::Random(5, 1);
+
+    // Batched compiled code, the interpreter, and the scalar fallback
+    for (int variant = 0; variant < 3; variant++) {
+        cppmpc::FastMPC::SymbolicObjective objective;
+        if (variant == 1) {
+            objective.compileOptions.backend =
+                    cppmpc::CompilerBackend::Interpreter;
+        } else if (variant == 2) {
+            objective.generateBatchFunctions = false;
+        }
+        objective.setObjective(SymEngine::exp(a * x) + x * y * y +
+                               SymEngine::sin(y) * a);
+        objective.finalize(variableOrdering, parameterOrdering);
+
+        Eigen::VectorXd values = objective.batchValue(states, parameters);
+        Eigen::MatrixXd gradients =
+                objective.batchGradient(states, parameters);
+        std::vector<Eigen::MatrixXd> hessians =
+                objective.batchHessian(states, parameters);
+        ASSERT_EQ(5, values.rows());
+        ASSERT_EQ(5, gradients.rows());
+        ASSERT_EQ(5, hessians.size());
+
+        for (Eigen::Index k = 0; k < states.rows(); k++) {
+            objective.setParameters(parameters.row(k).transpose());
+            Eigen::VectorXd state = states.row(k).transpose();
+            EXPECT_NEAR(objective.value(state), values(k), 1e-12);
+            EXPECT_TRUE(objective.gradient(state).isApprox(
+                    gradients.row(k).transpose(), 1e-12));
+            EXPECT_TRUE(objective.hessian(state).isApprox(hessians[k],
+                                                          1e-12));
+        }
+
+        EXPECT_THROW(objective.batchValue(states.leftCols(1), parameters),
+                     std::runtime_error);
+        EXPECT_THROW(objective.batchGradient(states, parameters.topRows(4)),
+                     std::runtime_error);
+    }
+}
+
+TEST(SymbolicObjectiveTests, FixedParameters) {
+    SymEngine::Expression x = SymEngine::Expression(cppmpc::variable("x"));
+    SymEngine::Expression y = SymEngine::Expression(cppmpc::variable("y"));
+    SymEngine::Expression a = SymEngine::Expression(cppmpc::parameter("a"));
+    SymEngine::Expression b = SymEngine::Expression(cppmpc::parameter("b"));
+
+    cppmpc::OrderedSet variableOrdering;
+    variableOrdering.append(x);
+    variableOrdering.append(y);
+    cppmpc::OrderedSet parameterOrdering;
+    parameterOrdering.append(a);
+    parameterOrdering.append(b);
+
+    cppmpc::FastMPC::SymbolicObjective full;
+    cppmpc::FastMPC::SymbolicObjective fixed;
+    EXPECT_THROW(fixed.fixParameter(x, 1.0), std::runtime_error);
+    fixed.fixParameter(b, 0.25);
+    for (cppmpc::FastMPC::SymbolicObjective* objective : {&full, &fixed}) {
+        objective->equalityConstraints.appendConstraint(x + b * y, a);
+        objective->inequalityConstraints.appendLessThan(x * x + b * y * y,
+                                                        a * 9.0);
+        objective->setObjective(a * x * x + SymEngine::sin(b * y));
+        objective->finalize(variableOrdering, parameterOrdering);
+    }
+    EXPECT_EQ(2, full.numParameters());
+    EXPECT_EQ(1, fixed.numParameters());
+
+    Eigen::VectorXd fullParam(2);
+    fullParam << 2.0, 0.25;
+    full.setParameters(fullParam);
+    Eigen::VectorXd fixedParam(1);
+    fixedParam << 2.0;
+    fixed.setParameters(fixedParam);
+
+    Eigen::VectorXd state(2);
+    state << 0.5, 1.0;
+    EXPECT_NEAR(full.value(state), fixed.value(state), 1e-12);
+    EXPECT_TRUE(full.gradient(state).isApprox(fixed.gradient(state), 1e-12));
+    EXPECT_TRUE(full.hessian(state).isApprox(fixed.hessian(state), 1e-12));
+    EXPECT_NEAR(full.inequalityConstraintsValue(state),
+                fixed.inequalityConstraintsValue(state), 1e-12);
+    EXPECT_TRUE(full.inequalityConstraintsGradient(state).isApprox(
+            fixed.inequalityConstraintsGradient(state), 1e-12));
+    EXPECT_TRUE(full.equalityConstraintMatrix()->isApprox(
+            *fixed.equalityConstraintMatrix(), 1e-12));
+    EXPECT_TRUE(full.equalityConstraintVector()->isApprox(
+            *fixed.equalityConstraintVector(), 1e-12));
+
+    // Finalizing again doesn't leave out the fixed parameters twice
+    fixed.finalize(variableOrdering, parameterOrdering);
+    EXPECT_EQ(1, fixed.numParameters());
+    fixed.setParameters(fixedParam);
+    EXPECT_NEAR(full.value(state), fixed.value(state), 1e-12);
+    EXPECT_TRUE(full.equalityConstraintVector()->isApprox(
+            *fixed.equalityConstraintVector(), 1e-12));
+}
+
+TEST(SymbolicObjectiveTests, IncrementalFinalize) {
+    std::string previousDirectory = cppmpc::RuntimeCompiler::cacheDirectory();
+    std::filesystem::path directory =
+            std::filesystem::temp_directory_path() /
+            ("cppmpc-incremental-test-" + std::to_string(getpid()));
+    cppmpc::RuntimeCompiler::setCacheDirectory(directory.string());
+    auto numObjects = [&directory]() {
+        size_t count = 0;
+        for (const auto& entry :
+             std::filesystem::directory_iterator(directory)) {
+            count += entry.path().extension() == ".o" ? 1 : 0;
+        }
+        return count;
+    };
+
+    SymEngine::Expression x = SymEngine::Expression(cppmpc::variable("x"));
+    SymEngine::Expression y = SymEngine::Expression(cppmpc::variable("y"));
+    SymEngine::Expression a = SymEngine::Expression(cppmpc::parameter("a"));
+    cppmpc::OrderedSet variableOrdering;
+    variableOrdering.append(x);
+    variableOrdering.append(y);
+    cppmpc::OrderedSet parameterOrdering;
+    parameterOrdering.append(a);
+
+    for (cppmpc::FastMPC::BarrierMode mode :
+         {cppmpc::FastMPC::BarrierMode::Symbolic,
+          cppmpc::FastMPC::BarrierMode::Structured}) {
+        std::filesystem::remove_all(directory);
+
+        cppmpc::FastMPC::SymbolicObjective incremental;
+        cppmpc::FastMPC::SymbolicObjective fresh;
+        for (cppmpc::FastMPC::SymbolicObjective* objective :
+             {&incremental, &fresh}) {
+            objective->barrierMode = mode;
+            objective->compileOptions.incremental = true;
+            objective->setObjective(a * x * x + SymEngine::exp(y));
+            objective->equalityConstraints.appendConstraint(x + y, a);
+            objective->inequalityConstraints.appendLessThan(x * x + y * y,
+                                                            4.0);
+        }
+        incremental.finalize(variableOrdering, parameterOrdering);
+        size_t compiled = numObjects();
+        EXPECT_LT(0, compiled);
+        EXPECT_EQ(1, incremental.numEqualityConstraints());
+        EXPECT_EQ(1, incremental.numInequalityConstraints());
+
+        // Only the functions of the changed inequality constraints are
+        // compiled
+        for (cppmpc::FastMPC::SymbolicObjective* objective :
+             {&incremental, &fresh}) {
+            objective->inequalityConstraints.appendLessThan(x * y, a);
+        }
+        incremental.finalize(variableOrdering, parameterOrdering);
+        size_t added = numObjects() - compiled;
+        EXPECT_LT(0, added);
+        EXPECT_GE(3, added);
+
+        // The sizes are counted again when constraints are added
+        for (cppmpc::FastMPC::SymbolicObjective* objective :
+             {&incremental, &fresh}) {
+            objective->equalityConstraints.appendConstraint(x - y, 2.0 * a);
+            objective->inequalityConstraints.appendLessThan(y * y * y, a);
+        }
+        incremental.finalize(variableOrdering, parameterOrdering);
+        EXPECT_EQ(2, incremental.numVariables());
+        EXPECT_EQ(1, incremental.numParameters());
+        EXPECT_EQ(2, incremental.numEqualityConstraints());
+        EXPECT_EQ(3, incremental.numInequalityConstraints());
+
+        fresh.finalize(variableOrdering, parameterOrdering);
+        Eigen::VectorXd param(1);
+        param << 2.0;
+        incremental.setParameters(param);
+        fresh.setParameters(param);
+        Eigen::VectorXd state(2);
+        state << 0.5, 0.25;
+        EXPECT_NEAR(fresh.value(state), incremental.value(state), 1e-12);
+        EXPECT_TRUE(fresh.hessian(state).isApprox(incremental.hessian(state),
+                                                  1e-12));
+        EXPECT_NEAR(fresh.inequalityConstraintsValue(state),
+                    incremental.inequalityConstraintsValue(state), 1e-12);
+        EXPECT_TRUE(fresh.inequalityConstraintsGradient(state).isApprox(
+                incremental.inequalityConstraintsGradient(state), 1e-12));
+        EXPECT_TRUE(fresh.inequalityConstraintsHessian(state).isApprox(
+                incremental.inequalityConstraintsHessian(state), 1e-12));
+
+        Eigen::MatrixXd matrix = *incremental.equalityConstraintMatrix();
+        Eigen::VectorXd vector = *incremental.equalityConstraintVector();
+        EXPECT_EQ(2, matrix.rows());
+        EXPECT_EQ(2, matrix.cols());
+        EXPECT_EQ(2, vector.rows());
+        EXPECT_TRUE(fresh.equalityConstraintMatrix()->isApprox(matrix, 1e-12));
+        EXPECT_TRUE(fresh.equalityConstraintVector()->isApprox(vector, 1e-12));
+    }
+
+    cppmpc::RuntimeCompiler::setCacheDirectory(previousDirectory);
+    std::filesystem::remove_all(directory);
+}
+
+TEST(SymbolicObjectiveTests, NestedLoopsShareThreads) {
+    // Like the loops of the objectives finalizeAll finalizes at once, each
+    // nested loop gets a share of the cores
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    std::atomic<size_t> active(0);
+    std::atomic<size_t> peak(0);
+    cppmpc::parallelFor(4, 4, [&](size_t) {
+        EXPECT_EQ(4, cppmpc::concurrentThreads());
+        cppmpc::parallelFor(64, 0, [&](size_t) {
+            size_t running = ++active;
+            size_t highest = peak;
+            while (running > highest &&
+                   !peak.compare_exchange_weak(highest, running)) {
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            --active;
+        });
+    });
+    EXPECT_LE(peak.load(), std::max<size_t>(cores, 4));
+    EXPECT_EQ(1, cppmpc::concurrentThreads());
+}
+
+TEST(SymbolicObjectiveTests, ConcurrentFinalize) {
+    // Without the cache, each library is built in its own temporary directory
+    std::string previousDirectory = cppmpc::RuntimeCompiler::cacheDirectory();
+    cppmpc::RuntimeCompiler::setCacheDirectory("");
+
+    SymEngine::Expression x = SymEngine::Expression(cppmpc::variable("x"));
+    SymEngine::Expression y = SymEngine::Expression(cppmpc::variable("y"));
+    SymEngine::Expression a = SymEngine::Expression(cppmpc::parameter("a"));
+    cppmpc::OrderedSet variableOrdering;
+    variableOrdering.append(x);
+    variableOrdering.append(y);
+    cppmpc::OrderedSet parameterOrdering;
+    parameterOrdering.append(a);
+
+    // The libraries all export the same function names
+    std::vector<cppmpc::FastMPC::SymbolicObjective> objectives(4);
+    std::vector<cppmpc::FastMPC::SymbolicObjective*> pointers;
+    for (size_t i = 0; i < objectives.size(); i++) {
+        double scale = static_cast<double>(i + 1);
+        objectives[i].setObjective(scale * a * x * x + y * y);
+        objectives[i].equalityConstraints.appendConstraint(x + y, a);
+        pointers.push_back(&objectives[i]);
+    }
+    cppmpc::FastMPC::SymbolicObjective::finalizeAll(
+            pointers, variableOrdering, parameterOrdering, 4);
+
+    Eigen::VectorXd param(1);
+    param << 2.0;
+    Eigen::VectorXd state(2);
+    state << 0.5, 0.25;
+    for (size_t i = 0; i < objectives.size(); i++) {
+        double scale = static_cast<double>(i + 1);
+        objectives[i].setParameters(param);
+        EXPECT_NEAR(scale * 2.0 * 0.25 + 0.0625, objectives[i].value(state),
+                    1e-12);
+        Eigen::VectorXd gradient = objectives[i].gradient(state);
+        EXPECT_NEAR(scale * 2.0 * 2.0 * 0.5, gradient(0), 1e-12);
+        EXPECT_NEAR(0.5, gradient(1), 1e-12);
+    }
+
+    // An objective can't be finalized twice at once
+    EXPECT_THROW(cppmpc::FastMPC::SymbolicObjective::finalizeAll(
+                         {pointers[0], pointers[0]}, variableOrdering,
+                         parameterOrdering),
+                 std::runtime_error);
+
+    cppmpc::RuntimeCompiler::setCacheDirectory(previousDirectory);
+}
@@ -0,0 +1,363 @@
+// Copyright 2021 Ian Ruh
+#include <gtest/gtest.h>
+
+#include <symengine/add.h>
+#include <symengine/basic.h>
+#include <symengine/expression.h>
+#include <symengine/pow.h>
+#include <symengine/real_double.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Dense>
+#include "CodeGenerator.h"
+#include "FastMPC.h"
+#include "OrderedSet.h"
+#include "RuntimeCompiler.h"
+#include "SymEngineUtilities.h"
+#include "SymbolicObjective.h"
+#include "VectorMath.h"
+
+using cppmpc::CodeGenerator;
+using cppmpc::RuntimeCompiler;
+using cppmpc::VectorMath;
+using cppmpc::VectorMathKernels;
+
+typedef void (*KernelFunction)(const double* in, double* out);
+
+TEST(VectorMathTests, KernelsMatchMathH) {
+    const double infinity = std::numeric_limits<double>::infinity();
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    std::vector<double> inputs = {0.0,     -0.5,      1.0,   2.5e-320, 1e-300,
+                                  0.3,     0.999999,  7.5,   123.25,   -700,
+                                  700,     -1e4,      1e4,   1e300,    -800,
+                                  800,     infinity,  -infinity, nan};
+    const int count = static_cast<int>(inputs.size());
+    // pow takes two arguments, see PowKernelMatchesMathH
+    std::vector<std::string> names = {"log", "exp", "sin", "cos"};
+    std::vector<double (*)(double)> references = {&std::log, &std::exp,
+                                                  &std::sin, &std::cos};
+
+    for (VectorMath accuracy : {VectorMath::Fast, VectorMath::Accurate}) {
+        // Each function evaluates its kernel over the inputs
+        std::vector<std::string> functions;
+        for (const std::string& function : names) {
+            functions.push_back(
+                    "void run_" + function +
+                    "(const double* in, double* out) {\n" +
+                    VectorMathKernels::kernelName(function, accuracy) + "(" +
+                    std::to_string(count) + ", in, out);\n}\n");
+        }
+        auto module = RuntimeCompiler::compile(functions);
+
+        double tolerance = accuracy == VectorMath::Fast ? 1e-7 : 1e-15;
+        for (size_t f = 0; f < functions.size(); f++) {
+            std::vector<double> out(count);
+            module->function<KernelFunction>("run_" + names[f])(inputs.data(),
+                                                                out.data());
+            for (int i = 0; i < count; i++) {
+                double expected = references[f](inputs[i]);
+                if (std::isnan(expected)) {
+                    EXPECT_TRUE(std::isnan(out[i])) << inputs[i];
+                } else if (std::isinf(expected)) {
+                    EXPECT_EQ(expected, out[i]) << inputs[i];
+                } else {
+                    EXPECT_NEAR(expected, out[i],
+                                tolerance * std::max(1.0, std::fabs(expected)))
+                            << names[f] << "("
+                            << inputs[i] << ")";
+                }
+            }
+        }
+    }
+
+    EXPECT_THROW(VectorMathKernels::kernelName("tan", VectorMath::Fast),
+                 std::runtime_error);
+    EXPECT_THROW(VectorMathKernels::kernelName("log", VectorMath::Off),
+                 std::runtime_error);
+}
+
+TEST(VectorMathTests, PowKernelMatchesMathH) {
+    const double infinity = std::numeric_limits<double>::infinity();
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    // Ordinary powers, and the special values of math.h
+    std::vector<std::pair<double, double>> pairs = {
+            {2.5, 0.3},       {0.3, -1.7},        {7.5, 2.25},
+            {123.25, -0.5},   {1e-300, 0.5},      {2.5e-320, 0.25},
+            {2, 1000},        {10, 400},          {0.1, 400},
+            {1e300, 1},       {-2, 3},            {-2, -3},
+            {-2, 4},          {-2, 0.5},          {-8, 1.0 / 3},
+            {0, -1},          {0, 0.5},           {0, 0},
+            {-0.0, 3},        {-0.0, -3},         {-0.0, 2},
+            {infinity, -2},   {infinity, 0.5},    {-infinity, 3},
+            {-infinity, 0.5}, {-infinity, -3},    {nan, 0},
+            {1, nan},         {nan, 2},           {2, nan},
+            {-1, infinity},   {1, infinity},      {0.5, infinity},
+            {0.5, -infinity}, {2, -infinity},     {-0.5, infinity},
+            {-3, 1e300},      {-3, -1e300}};
+    // Repeated past the blocks the kernel evaluates at a time
+    std::vector<double> bases;
+    std::vector<double> exponents;
+    for (int repeat = 0; repeat < 3; repeat++) {
+        for (const auto& pair : pairs) {
+            bases.push_back(pair.first);
+            exponents.push_back(pair.second);
+        }
+    }
+    const int count = static_cast<int>(bases.size());
+
+    typedef void (*PowFunction)(const double* in, const double* exponent,
+                                double* out);
+    for (VectorMath accuracy : {VectorMath::Fast, VectorMath::Accurate}) {
+        auto module = RuntimeCompiler::compile(std::vector<std::string>{
+                "void run_pow(const double* in, const double* exponent, "
+                "double* out) {\n" +
+                VectorMathKernels::kernelName("pow", accuracy) + "(" +
+                std::to_string(count) + ", in, exponent, out);\n}\n"});
+        std::vector<double> out(count);
+        module->function<PowFunction>("run_pow")(bases.data(),
+                                                 exponents.data(), out.data());
+
+        // The error grows with the size of y log(x)
+        double tolerance = accuracy == VectorMath::Fast ? 1e-7 : 1e-15;
+        for (int i = 0; i < count; i++) {
+            double x = bases[i];
+            double y = exponents[i];
+            double expected = std::pow(x, y);
+            if (std::isnan(expected)) {
+                EXPECT_TRUE(std::isnan(out[i])) << x << "^" << y;
+            } else if (std::isinf(expected) || expected == 0) {
+                EXPECT_EQ(expected, out[i]) << x << "^" << y;
+                EXPECT_EQ(std::signbit(expected), std::signbit(out[i]))
+                        << x << "^" << y;
+            } else {
+                double scale =
+                        std::max(1.0, std::fabs(y * std::log(std::fabs(x))));
+                EXPECT_NEAR(expected, out[i],
+                            tolerance * scale * std::fabs(expected))
+                        << x << "^" << y;
+            }
+        }
+    }
+}
+
+TEST(VectorMathTests, VectorizeMathCalls) {
+    SymEngine::Expression x0(SymEngine::symbol("state[0]"));
+    SymEngine::Expression x1(SymEngine::symbol("state[1]"));
+    SymEngine::Expression p0(SymEngine::symbol("param[0]"));
+    auto log = [](const SymEngine::Expression& x) {
+        return SymEngine::Expression(SymEngine::log(x));
+    };
+    auto sin = [](const SymEngine::Expression& x) {
+        return SymEngine::Expression(SymEngine::sin(x));
+    };
+    SymEngine::Expression value =
+            -log(x0) - log(x1) - log(p0 - x0) -
+            log(SymEngine::Expression(SymEngine::exp(x1)) + 1) - log(x0);
+    cppmpc::GeneratedFunction barrier;
+    barrier.name = "barrier";
+    barrier.inputs = {"state", "param"};
+    barrier.assignments.emplace_back(0, value.get_basic());
+    cppmpc::GeneratedFunction vectorized =
+            CodeGenerator::vectorizeMathCalls(barrier, VectorMath::Accurate);
+
+    // exp is only called once, so it stays scalar, and the repeated log is
+    // evaluated once
+    ASSERT_EQ(1, vectorized.gathered.size());
+    EXPECT_EQ("log", vectorized.gathered[0].function);
+    EXPECT_EQ("cppmpc_log0", vectorized.gathered[0].array);
+    EXPECT_EQ(4, vectorized.gathered[0].arguments.size());
+    std::string code = CodeGenerator::generateFunctionCode(vectorized);
+    EXPECT_NE(std::string::npos,
+              code.find("cppmpc_vlog_accurate(4, cppmpc_log0_in, "
+                        "cppmpc_log0);"));
+    EXPECT_NE(std::string::npos, code.find("exp(state[1])"));
+    EXPECT_EQ(std::string::npos,
+              code.substr(code.find("out[0] = ")).find("log("));
+    EXPECT_THROW(CodeGenerator::batchFunction(vectorized), std::runtime_error);
+
+    // Nothing to do
+    EXPECT_TRUE(CodeGenerator::vectorizeMathCalls(barrier, VectorMath::Off)
+                        .gathered.empty());
+    cppmpc::GeneratedFunction few;
+    few.name = "few";
+    few.inputs = {"state"};
+    few.assignments.emplace_back(0, log(x0).get_basic());
+    few.assignments.emplace_back(
+            1, (sin(x0) + sin(x0) + sin(x1)).get_basic());
+    EXPECT_TRUE(CodeGenerator::vectorizeMathCalls(few, VectorMath::Fast)
+                        .gathered.empty());
+
+    // The calls in the arguments of other calls are evaluated first
+    cppmpc::GeneratedFunction nested;
+    nested.name = "nested";
+    nested.inputs = {"state"};
+    for (int i = 0; i < 4; i++) {
+        SymEngine::Expression xi(
+                SymEngine::symbol("state[" + std::to_string(i) + "]"));
+        nested.assignments.emplace_back(i, log(sin(xi) + 2).get_basic());
+    }
+    cppmpc::GeneratedFunction nestedVectorized =
+            CodeGenerator::vectorizeMathCalls(nested, VectorMath::Accurate);
+    ASSERT_EQ(2, nestedVectorized.gathered.size());
+    EXPECT_EQ("cppmpc_sin0", nestedVectorized.gathered[0].array);
+    EXPECT_EQ("cppmpc_log1", nestedVectorized.gathered[1].array);
+
+    // The vectorized functions give the same results as math.h
+    barrier.name = "barrierReference";
+    nested.name = "nestedReference";
+    auto module = RuntimeCompiler::compile(
+            std::vector<cppmpc::GeneratedFunction>{barrier, vectorized, nested,
+                                                   nestedVectorized});
+    typedef void (*BarrierFunction)(const double* state, const double* param,
+                                    double* out);
+    typedef void (*NestedFunction)(const double* state, double* out);
+    double state[] = {0.25, 1.5, -2, 3};
+    double param[] = {2.0};
+    double expected[4];
+    double out[4];
+    module->function<BarrierFunction>("barrierReference")(state, param,
+                                                          expected);
+    module->function<BarrierFunction>("barrier")(state, param, out);
+    EXPECT_NEAR(expected[0], out[0], 1e-14);
+    module->function<NestedFunction>("nestedReference")(state, expected);
+    module->function<NestedFunction>("nested")(state, out);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_NEAR(expected[i], out[i], 1e-15);
+    }
+
+    // Powers printed as calls to pow are gathered with their exponents, and
+    // the others are left to the emitter
+    cppmpc::GeneratedFunction powers;
+    powers.name = "powers";
+    powers.inputs = {"state", "param"};
+    for (int i = 0; i < 4; i++) {
+        RCP<const SymEngine::Basic> xi =
+                SymEngine::symbol("state[" + std::to_string(i) + "]");
+        RCP<const SymEngine::Basic> root =
+                SymEngine::pow(xi, SymEngine::real_double(0.3));
+        RCP<const SymEngine::Basic> power =
+                SymEngine::pow(p0.get_basic(), xi);
+        RCP<const SymEngine::Basic> square =
+                SymEngine::pow(xi, SymEngine::integer(2));
+        powers.assignments.emplace_back(
+                i, SymEngine::add({root, power, square}));
+    }
+    cppmpc::GeneratedFunction powersVectorized =
+            CodeGenerator::vectorizeMathCalls(powers, VectorMath::Accurate);
+    ASSERT_EQ(1, powersVectorized.gathered.size());
+    EXPECT_EQ("pow", powersVectorized.gathered[0].function);
+    EXPECT_EQ(8, powersVectorized.gathered[0].arguments.size());
+    EXPECT_EQ(8, powersVectorized.gathered[0].exponents.size());
+    std::string powersCode =
+            CodeGenerator::generateFunctionCode(powersVectorized);
+    EXPECT_NE(std::string::npos,
+              powersCode.find("cppmpc_vpow_accurate(8, cppmpc_pow0_in, "
+                              "cppmpc_pow0_exponent, cppmpc_pow0);"));
+    EXPECT_EQ(std::string::npos,
+              powersCode.substr(powersCode.find("out[0] = ")).find("pow("));
+
+    powers.name = "powersReference";
+    auto powersModule = RuntimeCompiler::compile(
+            std::vector<cppmpc::GeneratedFunction>{powers, powersVectorized});
+    double positive[] = {0.25, 1.5, 2, 3};
+    powersModule->function<BarrierFunction>("powersReference")(
+            positive, param, expected);
+    powersModule->function<BarrierFunction>("powers")(positive, param, out);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_NEAR(expected[i], out[i], 1e-14);
+    }
+}
+
+TEST(VectorMathTests, VectorizeChunks) {
+    // Each entry has its own form, so the entries aren't rolled into loops
+    cppmpc::GeneratedFunction large;
+    large.name = "large";
+    large.inputs = {"state"};
+    for (int i = 0; i < 8; i++) {
+        large.assignments.emplace_back(
+                i, SymEngine::log(SymEngine::add(
+                           SymEngine::symbol("state[" + std::to_string(i) +
+                                             "]"),
+                           SymEngine::integer(i + 1))));
+    }
+
+    // Each chunk gathers its own calls
+    std::vector<std::vector<cppmpc::GeneratedFunction>> units =
+            CodeGenerator::generateTranslationUnits({large}, 4,
+                                                    VectorMath::Fast);
+    ASSERT_EQ(3, units.size());
+    for (size_t i = 1; i < units.size(); i++) {
+        EXPECT_NE(std::string::npos,
+                  CodeGenerator::generateSource(units[i])
+                          .find("cppmpc_vlog_fast(4, cppmpc_log0_in, "
+                                "cppmpc_log0);"));
+    }
+
+    // The chunked and vectorized function gives the same result as math.h
+    cppmpc::CompileOptions options;
+    options.maxChunkAssignments = 4;
+    options.vectorMath = VectorMath::Accurate;
+    auto module = RuntimeCompiler::compile({large}, "", options);
+    typedef void (*LargeFunction)(const double* state, double* out);
+    double state[] = {0.5, 1, 2, 3, 4, 5, 6, 7};
+    double out[8];
+    module->function<LargeFunction>("large")(state, out);
+    for (int i = 0; i < 8; i++) {
+        EXPECT_NEAR(std::log(state[i] + i + 1), out[i], 1e-15);
+    }
+}
+
+TEST(VectorMathTests, SymbolicObjectiveMatchesMathH) {
+    std::vector<RCP<const SymEngine::Symbol>> x =
+            cppmpc::variableVector("x", 6);
+    SymEngine::Expression r(cppmpc::parameter("r"));
+    cppmpc::OrderedSet variableOrdering(x.begin(), x.end());
+    cppmpc::OrderedSet parameterOrdering;
+    parameterOrdering.append(r);
+
+    cppmpc::FastMPC::SymbolicObjective reference;
+    cppmpc::FastMPC::SymbolicObjective vectorized;
+    vectorized.compileOptions.vectorMath = VectorMath::Accurate;
+    for (cppmpc::FastMPC::SymbolicObjective* objective :
+         {&reference, &vectorized}) {
+        SymEngine::Expression cost(0);
+        for (size_t i = 0; i < x.size(); i++) {
+            SymEngine::Expression xi(x[i]);
+            cost = cost + SymEngine::exp(0.5 * xi) + SymEngine::cos(xi);
+            // Each constraint is a log in the barrier
+            objective->inequalityConstraints.appendLessThan(
+                    xi * xi + SymEngine::sin(xi), r);
+        }
+        objective->setObjective(cost);
+        objective->finalize(variableOrdering, parameterOrdering);
+
+        Eigen::VectorXd param(1);
+        param << 4.0;
+        objective->setParameters(param);
+    }
+
+    Eigen::VectorXd state = Eigen::VectorXd::LinSpaced(6, -1, 1);
+    EXPECT_NEAR(reference.value(state), vectorized.value(state), 1e-12);
+    EXPECT_NEAR(reference.inequalityConstraintsValue(state),
+                vectorized.inequalityConstraintsValue(state), 1e-12);
+    EXPECT_TRUE(reference.inequalityConstraintsGradient(state).isApprox(
+            vectorized.inequalityConstraintsGradient(state), 1e-12));
+    EXPECT_TRUE(reference.inequalityConstraintsHessian(state).isApprox(
+            vectorized.inequalityConstraintsHessian(state), 1e-12));
+
+    cppmpc::FastMPC::Solver referenceSolver(reference);
+    cppmpc::FastMPC::Solver vectorizedSolver(vectorized);
+    Eigen::VectorXd startPrimal = Eigen::VectorXd::Zero(6);
+    auto [referenceMinimum, referencePrimal, referenceDual] =
+            referenceSolver.minimize(startPrimal);
+    auto [minimum, primal, dual] = vectorizedSolver.minimize(startPrimal);
+    EXPECT_NEAR(referenceMinimum, minimum, 1e-9);
+    EXPECT_TRUE(referencePrimal.isApprox(primal, 1e-6));
+}